@@ -2,7 +2,10 @@
 #define FREERTOS_CONFIG_H
 
 #define configUSE_PREEMPTION                    1
-#define configUSE_PORT_OPTIMISED_TASK_SELECTION 0
+/* Generic task selection is used by `make OPTIMISED_TASK_SELECTION=0` */
+#ifndef configUSE_PORT_OPTIMISED_TASK_SELECTION
+#define configUSE_PORT_OPTIMISED_TASK_SELECTION 1
+#endif
 #define configUSE_TICKLESS_IDLE                 0
 #define configCPU_CLOCK_HZ                      16000000
 #define configTICK_RATE_HZ                      250
@@ -12,7 +15,7 @@
 #define configUSE_16_BIT_TICKS                  0
 #define configIDLE_SHOULD_YIELD                 1
 #define configUSE_TASK_NOTIFICATIONS            1
-#define configUSE_MUTEXES                       0
+#define configUSE_MUTEXES                       1
 #define configUSE_RECURSIVE_MUTEXES             0
 #define configUSE_COUNTING_SEMAPHORES           0
 #define configUSE_ALTERNATIVE_API               0 /* Deprecated! */
@@ -26,20 +29,35 @@
 #define configMESSAGE_BUFFER_LENGTH_TYPE        size_t
 
 /* Memory allocation related definitions. */
-#define configTOTAL_HEAP_SIZE                   5*1024
+/* Dynamic allocation is disabled by `make STATIC_ALLOCATION=1` */
+#define configSUPPORT_STATIC_ALLOCATION         1
+#ifndef configSUPPORT_DYNAMIC_ALLOCATION
+#define configSUPPORT_DYNAMIC_ALLOCATION        1
+#endif
+#define configTOTAL_HEAP_SIZE                   8*1024
 
 /* Hook function related definitions. */
-#define configUSE_IDLE_HOOK                     0
+#define configUSE_IDLE_HOOK                     1
 #define configUSE_TICK_HOOK                     0
 #define configCHECK_FOR_STACK_OVERFLOW          2
 #define configUSE_MALLOC_FAILED_HOOK            1
 #define configUSE_DAEMON_TASK_STARTUP_HOOK      0
 
 /* Run time and task stats gathering related definitions. */
-#define configGENERATE_RUN_TIME_STATS           0
+#define configGENERATE_RUN_TIME_STATS           1
 #define configUSE_TRACE_FACILITY                1
 #define configUSE_STATS_FORMATTING_FUNCTIONS    0
 
+/* Run time stats are counted by 64-bit wide timer at CPU clock, the kernel
+uses its lower half. Task switches are counted by the trace hook (see
+FreeRTOSTrace.h). See runtime.cpp for the implementation. */
+void runtime_init(void);
+uint32_t runtime_counter(void);
+void runtime_task_switched_in(uint32_t number);
+
+#define portCONFIGURE_TIMER_FOR_RUN_TIME_STATS() runtime_init()
+#define portGET_RUN_TIME_COUNTER_VALUE()         runtime_counter()
+
 /* Co-routine related definitions. */
 #define configUSE_CO_ROUTINES                   0
 #define configMAX_CO_ROUTINE_PRIORITIES         1
@@ -50,7 +68,11 @@
 #define configTIMER_QUEUE_LENGTH                10
 #define configTIMER_TASK_STACK_DEPTH            configMINIMAL_STACK_SIZE
 
+/* QEMU implements all 8 bits of the priority, benchmarks override it (see
+bench.cpp). */
+#ifndef configPRIO_BITS
 #define configPRIO_BITS       3     /* 8 priority levels */
+#endif
 
 /* The lowest interrupt priority that can be used in a call to a "set priority"
 function. */
@@ -86,7 +108,7 @@ See http://www.FreeRTOS.org/RTOS-Cortex-M3-M4.html. */
 #define INCLUDE_vTaskDelay                      1
 #define INCLUDE_xTaskGetSchedulerState          1
 #define INCLUDE_xTaskGetCurrentTaskHandle       1
-#define INCLUDE_uxTaskGetStackHighWaterMark     0
+#define INCLUDE_uxTaskGetStackHighWaterMark     1
 #define INCLUDE_xTaskGetIdleTaskHandle          0
 #define INCLUDE_eTaskGetState                   0
 #define INCLUDE_xEventGroupSetBitFromISR        1
@@ -96,5 +118,6 @@ See http://www.FreeRTOS.org/RTOS-Cortex-M3-M4.html. */
 #define INCLUDE_xTaskResumeFromISR              1
 
 /* A header file that defines trace macro can be included here. */
+#include "FreeRTOSTrace.h"
 
 #endif /* FREERTOS_CONFIG_H */
\ No newline at end of file
@@ -0,0 +1,89 @@
+#ifndef FREERTOS_TRACE_H
+#define FREERTOS_TRACE_H
+
+/* Kernel trace hooks, recording events into the binary trace (see trace.cpp).
+Task related events use kernel number of the task as object, queue related
+events use number given to the queue at its creation. Ids must be kept in
+sync with tools/trace2json.py */
+
+#define TRACE_TASK_SWITCHED_IN          1   /* arg: 0 */
+#define TRACE_TASK_CREATE               2   /* arg: priority */
+#define TRACE_TASK_DELAY                3   /* arg: 0 */
+#define TRACE_QUEUE_CREATE              4   /* arg: length */
+#define TRACE_QUEUE_SEND                5   /* arg: messages waiting */
+#define TRACE_QUEUE_SEND_FAILED         6   /* arg: messages waiting */
+#define TRACE_QUEUE_SEND_FROM_ISR       7   /* arg: messages waiting */
+#define TRACE_QUEUE_RECEIVE             8   /* arg: messages waiting */
+#define TRACE_QUEUE_RECEIVE_FAILED      9   /* arg: messages waiting */
+#define TRACE_QUEUE_RECEIVE_FROM_ISR    10  /* arg: messages waiting */
+#define TRACE_QUEUE_BLOCK_SEND          11  /* arg: 0 */
+#define TRACE_QUEUE_BLOCK_RECEIVE       12  /* arg: 0 */
+#define TRACE_TASK_NOTIFY               13  /* arg: 0 */
+#define TRACE_TASK_NOTIFY_FROM_ISR      14  /* arg: 0 */
+#define TRACE_TASK_NOTIFY_TAKE          15  /* arg: 0 */
+#define TRACE_TASK_NOTIFY_TAKE_BLOCK    16  /* arg: 0 */
+#define TRACE_MALLOC                    17  /* arg: size */
+#define TRACE_FREE                      18  /* arg: size */
+
+/* Records generated by the recorder itself */
+#define TRACE_TASK_NAME                 0xF0 /* arg: two characters of the name */
+#define TRACE_DROPPED                   0xF1 /* arg: number of lost records */
+
+void trace_record(uint8_t event, uint8_t object, uint16_t arg);
+uint8_t trace_next_queue_number(void);
+
+/* Tasks */
+#define traceTASK_SWITCHED_IN() do { \
+	runtime_task_switched_in(pxCurrentTCB->uxTCBNumber); \
+	trace_record(TRACE_TASK_SWITCHED_IN, pxCurrentTCB->uxTCBNumber, 0); \
+} while(0)
+#define traceTASK_CREATE(pxNewTCB) \
+	trace_record(TRACE_TASK_CREATE, (pxNewTCB)->uxTCBNumber, (pxNewTCB)->uxPriority)
+#define traceTASK_DELAY() \
+	trace_record(TRACE_TASK_DELAY, pxCurrentTCB->uxTCBNumber, 0)
+#define traceTASK_DELAY_UNTIL(xTimeToWake) \
+	trace_record(TRACE_TASK_DELAY, pxCurrentTCB->uxTCBNumber, 0)
+
+/* Queues */
+#define traceQUEUE_CREATE(pxNewQueue) do { \
+	(pxNewQueue)->uxQueueNumber = trace_next_queue_number(); \
+	trace_record(TRACE_QUEUE_CREATE, (pxNewQueue)->uxQueueNumber, (pxNewQueue)->uxLength); \
+} while(0)
+#define traceQUEUE_SEND(pxQueue) \
+	trace_record(TRACE_QUEUE_SEND, (pxQueue)->uxQueueNumber, (pxQueue)->uxMessagesWaiting)
+#define traceQUEUE_SEND_FAILED(pxQueue) \
+	trace_record(TRACE_QUEUE_SEND_FAILED, (pxQueue)->uxQueueNumber, (pxQueue)->uxMessagesWaiting)
+#define traceQUEUE_SEND_FROM_ISR(pxQueue) \
+	trace_record(TRACE_QUEUE_SEND_FROM_ISR, (pxQueue)->uxQueueNumber, (pxQueue)->uxMessagesWaiting)
+#define traceQUEUE_SEND_FROM_ISR_FAILED(pxQueue) \
+	trace_record(TRACE_QUEUE_SEND_FAILED, (pxQueue)->uxQueueNumber, (pxQueue)->uxMessagesWaiting)
+#define traceQUEUE_RECEIVE(pxQueue) \
+	trace_record(TRACE_QUEUE_RECEIVE, (pxQueue)->uxQueueNumber, (pxQueue)->uxMessagesWaiting)
+#define traceQUEUE_RECEIVE_FAILED(pxQueue) \
+	trace_record(TRACE_QUEUE_RECEIVE_FAILED, (pxQueue)->uxQueueNumber, (pxQueue)->uxMessagesWaiting)
+#define traceQUEUE_RECEIVE_FROM_ISR(pxQueue) \
+	trace_record(TRACE_QUEUE_RECEIVE_FROM_ISR, (pxQueue)->uxQueueNumber, (pxQueue)->uxMessagesWaiting)
+#define traceBLOCKING_ON_QUEUE_SEND(pxQueue) \
+	trace_record(TRACE_QUEUE_BLOCK_SEND, (pxQueue)->uxQueueNumber, 0)
+#define traceBLOCKING_ON_QUEUE_RECEIVE(pxQueue) \
+	trace_record(TRACE_QUEUE_BLOCK_RECEIVE, (pxQueue)->uxQueueNumber, 0)
+
+/* Notifications, object is the notified task */
+#define traceTASK_NOTIFY() \
+	trace_record(TRACE_TASK_NOTIFY, pxTCB->uxTCBNumber, 0)
+#define traceTASK_NOTIFY_FROM_ISR() \
+	trace_record(TRACE_TASK_NOTIFY_FROM_ISR, pxTCB->uxTCBNumber, 0)
+#define traceTASK_NOTIFY_GIVE_FROM_ISR() \
+	trace_record(TRACE_TASK_NOTIFY_FROM_ISR, pxTCB->uxTCBNumber, 0)
+#define traceTASK_NOTIFY_TAKE() \
+	trace_record(TRACE_TASK_NOTIFY_TAKE, pxCurrentTCB->uxTCBNumber, 0)
+#define traceTASK_NOTIFY_TAKE_BLOCK() \
+	trace_record(TRACE_TASK_NOTIFY_TAKE_BLOCK, pxCurrentTCB->uxTCBNumber, 0)
+
+/* Heap */
+#define traceMALLOC(pvAddress, uiSize) \
+	trace_record(TRACE_MALLOC, 0, (uiSize))
+#define traceFREE(pvAddress, uiSize) \
+	trace_record(TRACE_FREE, 0, (uiSize))
+
+#endif /* FREERTOS_TRACE_H */
@@ -0,0 +1,105 @@
+///////////////////////////////////////////////////////////////////////////////
+// Lock-free atomic operations
+///////////////////////////////////////////////////////////////////////////////
+
+// Cortex-M4 exclusive access instructions. LDREX marks the address in the
+// exclusive monitor, STREX stores the value only when the monitor is still
+// set. Every exception entry and return clears the monitor, so if anything
+// interrupted the sequence between them, STREX fails and the loop retries.
+// That way words can be updated atomically from tasks and interrupts,
+// without masking any of the interrupts.
+//
+// Host build emulates the monitor by single address and the loaded value.
+// STREX becomes compare-and-swap with that value, and the monitor is
+// cleared by every entry to the interrupt context (see host.cpp). Every
+// thread has its own monitor, like every core, so the tests can run
+// the producers really in parallel (see test.cpp).
+
+#ifndef TARGET_HOST
+
+//! Loads the word and marks it for exclusive access
+inline u32 atomic_load_exclusive(volatile u32* addr)
+{
+	u32 value;
+	__asm volatile("LDREX %0, [%1]" : "=r"(value) : "r"(addr) : "memory");
+	return value;
+}
+
+//! Stores the word, if nothing happened since the exclusive load
+// Returns true, when store succeeded
+inline bool atomic_store_exclusive(volatile u32* addr, u32 value)
+{
+	u32 failed;
+	__asm volatile("STREX %0, %2, [%1]" : "=&r"(failed) : "r"(addr), "r"(value) : "memory");
+	return !failed;
+}
+
+//! Forgets about exclusive load, when store will not be done
+inline void atomic_clear_exclusive()
+{
+	__asm volatile("CLREX" ::: "memory");
+}
+
+//! Data memory barrier, all memory accesses before it are finished before next ones
+inline void atomic_barrier()
+{
+	__asm volatile("DMB" ::: "memory");
+}
+
+#else
+
+static thread_local volatile u32* atomic_monitor;
+static thread_local u32 atomic_monitor_value;
+
+inline u32 atomic_load_exclusive(volatile u32* addr)
+{
+	const auto value = __atomic_load_n(addr, __ATOMIC_SEQ_CST);
+	atomic_monitor_value = value;
+	atomic_monitor = addr;
+	return value;
+}
+
+inline bool atomic_store_exclusive(volatile u32* addr, u32 value)
+{
+	if(atomic_monitor != addr) {
+		return false;
+	}
+
+	atomic_monitor = nullptr;
+	auto expected = atomic_monitor_value;
+	return __atomic_compare_exchange_n(addr, &expected, value, false, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST);
+}
+
+inline void atomic_clear_exclusive()
+{
+	atomic_monitor = nullptr;
+}
+
+inline void atomic_barrier()
+{
+	__atomic_thread_fence(__ATOMIC_SEQ_CST);
+}
+
+#endif
+
+//! Atomically adds value to the word, returns its previous value
+inline u32 atomic_add(volatile u32* addr, u32 value)
+{
+	u32 previous;
+	do {
+		previous = atomic_load_exclusive(addr);
+	} while(!atomic_store_exclusive(addr, previous + value));
+
+	return previous;
+}
+
+//! Atomically exchanges value of the word, returns its previous value
+inline u32 atomic_exchange(volatile u32* addr, u32 value)
+{
+	u32 previous;
+	do {
+		previous = atomic_load_exclusive(addr);
+	} while(!atomic_store_exclusive(addr, value));
+
+	return previous;
+}
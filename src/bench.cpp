@@ -0,0 +1,567 @@
+///////////////////////////////////////////////////////////////////////////////
+// Benchmarks running under QEMU
+///////////////////////////////////////////////////////////////////////////////
+
+// `make bench` builds this file instead of main.cpp and runs every benchmark
+// in qemu-system-arm on MPS2 AN386 board (Cortex-M4 with FPU and the same
+// memory map of code and SRAM), counting executed instructions by QEMU
+// plugin (see tools/bench.py). QEMU models neither pipeline nor flash wait
+// states, so these are not cycles of the board, but they are exactly the same
+// on every machine, so they can be compared against the checked-in baseline.
+//
+// Benchmark and number of its iterations are passed by the semihosting
+// command line, e.g. "bench queue 1000". The program does the setup, runs
+// the iterations and exits QEMU. The script runs every benchmark also with
+// zero iterations and subtracts its count, so only the iterations remain.
+//
+// The board has none of the TM4C123 peripherals, so benchmarks do not touch
+// them: run time stats (WTIMER0) are stubbed and the display transport (I2C)
+// is replaced by a copy to RAM. Trace is compiled in, but not started, like
+// on the board.
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "types.cpp"
+#include "reset.cpp"
+#include "stack.cpp"
+#include "utils.cpp"
+#include "bitband.cpp"
+#include "atomic.cpp"
+
+#include "FreeRTOS.h"
+#include "task.h"
+#include "semphr.h"
+
+#if (configSUPPORT_DYNAMIC_ALLOCATION == 1)
+#include "heap.cpp"
+#endif
+#include "rtos.cpp"
+
+#include "dwt.cpp"
+#include "digits.cpp"
+#include "crc.cpp"
+#include "format.cpp"
+#include "command.cpp"
+#include "trace.cpp"
+
+//
+// Semihosting
+//
+
+//! Operations of ARM semihosting
+constexpr u32 SEMIHOSTING_SYS_WRITE0 = 0x04;
+constexpr u32 SEMIHOSTING_SYS_GET_CMDLINE = 0x15;
+constexpr u32 SEMIHOSTING_SYS_EXIT = 0x18;
+
+//! Reasons of SYS_EXIT, QEMU exits with 0 and 1 respectively
+constexpr u32 SEMIHOSTING_EXIT_SUCCESS = 0x20026; // ADP_Stopped_ApplicationExit
+constexpr u32 SEMIHOSTING_EXIT_FAILURE = 0x20023; // ADP_Stopped_RunTimeErrorUnknown
+
+static u32 semihosting_call(u32 operation, const void* argument)
+{
+	register u32 r0 __asm("r0") = operation;
+	register const void* r1 __asm("r1") = argument;
+	__asm volatile("bkpt 0xAB" : "+r"(r0) : "r"(r1) : "memory");
+	return r0;
+}
+
+static void semihosting_write(const char* string)
+{
+	semihosting_call(SEMIHOSTING_SYS_WRITE0, string);
+}
+
+static void semihosting_write(u32 value)
+{
+	char digits[DIGITS_U32_MAX + 1];
+	*digits_u32(digits, digits + DIGITS_U32_MAX, value) = '\0';
+	semihosting_write(digits);
+}
+
+[[noreturn]] static void semihosting_exit(bool success)
+{
+	const auto reason = (success ? SEMIHOSTING_EXIT_SUCCESS : SEMIHOSTING_EXIT_FAILURE);
+	semihosting_call(SEMIHOSTING_SYS_EXIT, (const void*)(reason));
+	while(true);
+}
+
+//
+// Stubs of the firmware modules, which need the peripherals
+//
+
+//! Reports failed CHECK or assert and stops QEMU
+void log_failure(const char* file, const char* function, int line, const char* expr)
+{
+	static_cast<void>(function);
+	semihosting_write("failed: ");
+	semihosting_write(file);
+	semihosting_write(":");
+	semihosting_write((u32)(line));
+	semihosting_write(": ");
+	semihosting_write(expr);
+	semihosting_write("\n");
+	semihosting_exit(false);
+}
+
+// Personality routines referred by the unwind tables (see unwind.cpp)
+extern "C" void __aeabi_unwind_cpp_pr0() { while(true); }
+extern "C" void __aeabi_unwind_cpp_pr1() { while(true); }
+extern "C" void __aeabi_unwind_cpp_pr2() { while(true); }
+
+void runtime_init() {}
+u32 runtime_counter() { return 0; }
+void runtime_task_switched_in(u32) {}
+
+//! Display data, written instead of I2C transfers
+static u8 bench_display[256];
+
+bool i2c_write(const u8* data, u8 size, u8 ctrl, u8 addr)
+{
+	static_cast<void>(addr);
+	bench_display[0] = ctrl;
+	memcpy(&bench_display[1], data, size);
+	return true;
+}
+
+u32 hib_rtc_seconds() { return 0; }
+u8 buttons_read() { return 0; }
+
+#include "chars.cpp"
+#include "ssd1306.cpp"
+#include "ui.cpp"
+
+//
+// Benchmarks
+//
+
+//! Single benchmark, `run` does the given number of iterations
+struct Benchmark
+{
+	const char* name;
+	void (*run)(u32 iterations);
+	u32 iterations; // Default number of iterations
+	bool kernel; // Whether it runs in a task, otherwise before the scheduler
+};
+
+//! Result of the benchmark, written by compiler barrier, so it is not optimized away
+template<typename T>
+inline void bench_keep(const T& value)
+{
+	__asm volatile("" : : "r"(&value) : "memory");
+}
+
+//! Size of the buffer for the conversions and formatted lines
+constexpr u32 BENCH_LINE_SIZE = 48;
+
+//! Number conversions, each iteration converts one of values of all lengths
+template<char* (*convert)(char* buffer, u32 value)>
+static void bench_conversion(u32 iterations)
+{
+	constexpr u32 count = (sizeof(DIGITS_BENCHMARK_VALUES) / sizeof(DIGITS_BENCHMARK_VALUES[0]));
+	char buffer[BENCH_LINE_SIZE];
+	for(u32 i = 0; i < iterations; ++i) {
+		bench_keep(convert(buffer, DIGITS_BENCHMARK_VALUES[i % count]));
+	}
+}
+
+static char* bench_digits_reference(char* buffer, u32 value)
+{
+	return digits_reference_u32(value, buffer + DIGITS_U32_MAX);
+}
+
+static char* bench_digits_u32(char* buffer, u32 value)
+{
+	return digits_u32(buffer, buffer + DIGITS_U32_MAX, value);
+}
+
+static char* bench_digits_u64(char* buffer, u32 value)
+{
+	return digits_u64(buffer, buffer + DIGITS_U64_MAX, (u64)(value) * DIGITS_POWERS[9]);
+}
+
+static char* bench_digits_hex(char* buffer, u32 value)
+{
+	return digits_hex(buffer, buffer + DIGITS_HEX_MAX, value);
+}
+
+static char* bench_digits_fixed(char* buffer, u32 value)
+{
+	return digits_fixed(buffer, buffer + DIGITS_I32_MAX + 1, (i32)(value), 3);
+}
+
+//! Data of the checksums, instructions per iteration divided by its size
+//! give instructions per byte
+constexpr u32 BENCH_CHECKSUM_SIZE = 256;
+static u32 bench_checksum_data[BENCH_CHECKSUM_SIZE / sizeof(u32)];
+
+//! Checksums, each iteration goes over whole aligned data
+template<u32 (*checksum)(const void* data, u32 size)>
+static void bench_checksum(u32 iterations)
+{
+	for(u32 i = 0; i < iterations; ++i) {
+		bench_keep(checksum(bench_checksum_data, sizeof(bench_checksum_data)));
+	}
+}
+
+static u32 bench_crc8(const void* data, u32 size)
+{
+	return crc8(data, size);
+}
+
+static u32 bench_crc16(const void* data, u32 size)
+{
+	return crc16(data, size);
+}
+
+static u32 bench_crc32_bytes(const void* data, u32 size)
+{
+	return crc32_final(crc32_update_bytes(CRC32_INIT, (const u8*)(data), size));
+}
+
+static u32 bench_crc32(const void* data, u32 size)
+{
+	return crc32(data, size);
+}
+
+// Line of "top" command, formatted by format.cpp and by newlib-nano. Either
+// of them can be left out, so `make bench-size` gets their code size
+
+#ifndef BENCH_WITHOUT_FORMAT
+static char* bench_format(char* buffer, u32 value)
+{
+	const auto permille = (value % 1000);
+	return format_to(buffer, buffer + BENCH_LINE_SIZE, FORMAT("{-16}{6.1}{10}{7}\n"), "bench", permille, value, (u16)(value));
+}
+#endif
+
+#ifndef BENCH_WITHOUT_SNPRINTF
+static char* bench_snprintf(char* buffer, u32 value)
+{
+	const auto permille = (value % 1000);
+	const auto size = snprintf(buffer, BENCH_LINE_SIZE, "%-16s%4lu.%lu%10lu%7u\n", "bench",
+		(unsigned long)(permille / 10), (unsigned long)(permille % 10), (unsigned long)(value), (unsigned)(u16)(value));
+	return (buffer + size);
+}
+
+//! Heap of newlib, linked by snprintf, but never used for fixed buffer
+extern "C" void* _sbrk(ptrdiff_t increment)
+{
+	static_cast<void>(increment);
+	return (void*)(-1);
+}
+#endif
+
+static void bench_command_nothing([[maybe_unused]] const CommandArgs& args)
+{
+}
+
+//! Commands like the ones of cli.cpp, only their lookup is measured
+constexpr Command BENCH_COMMANDS[] = {
+	{ "time", "", bench_command_nothing, "", false },
+	{ "power", "", bench_command_nothing, "", false },
+	{ "top", "U", bench_command_nothing, "", false },
+	{ "trace", "", bench_command_nothing, "", false },
+	{ "heap", "", bench_command_nothing, "", false },
+	{ "bitband", "", bench_command_nothing, "", false },
+	{ "digits", "", bench_command_nothing, "", false },
+	{ "switch", "", bench_command_nothing, "", false },
+	{ "latency", "", bench_command_nothing, "", false },
+	{ "help", "S", bench_command_nothing, "", false },
+};
+
+constexpr auto BENCH_COMMANDS_TABLE = command_table(BENCH_COMMANDS);
+
+//! Received lines, each iteration dispatches one of them
+constexpr const char* BENCH_COMMAND_LINES[] = { "top 500", "latency", "help switch", "unknown" };
+
+static void bench_command_dispatch(u32 iterations)
+{
+	constexpr u32 count = (sizeof(BENCH_COMMAND_LINES) / sizeof(BENCH_COMMAND_LINES[0]));
+	for(u32 i = 0; i < iterations; ++i) {
+		const auto line = BENCH_COMMAND_LINES[i % count];
+		CommandSlice words[COMMAND_MAX_ARGS + 1];
+		const auto words_count = command_split(line, strlen(line), words, COMMAND_MAX_ARGS + 1);
+
+		CommandArgs args;
+		const auto command = command_find(BENCH_COMMANDS, BENCH_COMMANDS_TABLE, words[0]);
+		if(command && command_parse_args(*command, words + 1, words_count - 1, args)) {
+			command->handler(args);
+		}
+		bench_keep(command);
+	}
+}
+
+static void bench_copy_init_data(u32 iterations)
+{
+	// Runs before the scheduler, so the data are still at their initial values
+	for(u32 i = 0; i < iterations; ++i) {
+		copy_init_data();
+	}
+}
+
+static void bench_zero_bss(u32 iterations)
+{
+	// Runs before the scheduler, so nothing is stored there yet
+	for(u32 i = 0; i < iterations; ++i) {
+		zero_bss();
+	}
+}
+
+static void bench_glyph_blit(u32 iterations)
+{
+	// Redraw of the whole clock, like the first one of ui_task
+	for(u32 i = 0; i < iterations; ++i) {
+		const u8 digit = (i % 10);
+		draw_big_digit(digit, 8, 2);
+		draw_big_digit(digit, 28, 2);
+		draw_colon(48, 2);
+		draw_big_digit(digit, 68, 2);
+		draw_big_digit(digit, 88, 2);
+		draw_small_digit(digit, 108, 4);
+		draw_small_digit(digit, 118, 4);
+	}
+}
+
+RTOS_MEMORY static RtosQueue<u32, 8> bench_queue_memory;
+
+static void bench_queue(u32 iterations)
+{
+	// Send and receive without blocking, so no context switch happens
+	const auto queue = bench_queue_memory.create();
+	CHECK(queue);
+
+	for(u32 i = 0; i < iterations; ++i) {
+		CHECK(xQueueSend(queue, &i, 0) == pdTRUE);
+		u32 value;
+		CHECK(xQueueReceive(queue, &value, 0) == pdTRUE);
+	}
+}
+
+RTOS_MEMORY static RtosTask<configMINIMAL_STACK_SIZE> bench_ping_task_memory;
+RTOS_MEMORY static RtosTask<configMINIMAL_STACK_SIZE> bench_pong_task_memory;
+
+static TaskHandle_t bench_caller;
+static TaskHandle_t bench_ping;
+static TaskHandle_t bench_pong;
+static u32 bench_rounds;
+
+static void bench_ping_task(void* params)
+{
+	static_cast<void>(params);
+
+	// Task is running before its creation returns the handle
+	bench_ping = xTaskGetCurrentTaskHandle();
+	for(u32 i = 0; i < bench_rounds; ++i) {
+		xTaskNotifyGive(bench_pong);
+		ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+	}
+
+	xTaskNotifyGive(bench_caller);
+	vTaskSuspend(nullptr);
+}
+
+static void bench_pong_task(void* params)
+{
+	static_cast<void>(params);
+	while(true) {
+		ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+		xTaskNotifyGive(bench_ping);
+	}
+}
+
+static void bench_notify_pingpong(u32 iterations)
+{
+	// Same as `pingpong_benchmark`, but counted by QEMU instead of DWT
+	bench_caller = xTaskGetCurrentTaskHandle();
+	bench_rounds = iterations;
+
+	constexpr auto priority = (configMAX_PRIORITIES - 1);
+	CHECK(bench_pong = bench_pong_task_memory.create(bench_pong_task, "pong", nullptr, priority));
+	CHECK(bench_ping_task_memory.create(bench_ping_task, "ping", nullptr, priority));
+	ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+}
+
+//! All benchmarks, their names are used by the baseline
+static const Benchmark BENCHMARKS[] = {
+	{ "digits_reference", bench_conversion<bench_digits_reference>, 1000, false },
+	{ "digits_u32", bench_conversion<bench_digits_u32>, 1000, false },
+	{ "digits_u64", bench_conversion<bench_digits_u64>, 1000, false },
+	{ "digits_hex", bench_conversion<bench_digits_hex>, 1000, false },
+	{ "digits_fixed", bench_conversion<bench_digits_fixed>, 1000, false },
+#ifndef BENCH_WITHOUT_FORMAT
+	{ "format", bench_conversion<bench_format>, 1000, false },
+#endif
+#ifndef BENCH_WITHOUT_SNPRINTF
+	{ "snprintf", bench_conversion<bench_snprintf>, 1000, false },
+#endif
+	{ "crc8", bench_checksum<bench_crc8>, 100, false },
+	{ "crc16", bench_checksum<bench_crc16>, 100, false },
+	{ "crc32_bytes", bench_checksum<bench_crc32_bytes>, 100, false },
+	{ "crc32", bench_checksum<bench_crc32>, 100, false },
+	{ "command_dispatch", bench_command_dispatch, 1000, false },
+	{ "copy_init_data", bench_copy_init_data, 100, false },
+	{ "zero_bss", bench_zero_bss, 100, false },
+	{ "glyph_blit", bench_glyph_blit, 100, false },
+	{ "queue", bench_queue, 1000, true },
+	{ "notify_pingpong", bench_notify_pingpong, 1000, true },
+};
+
+//
+// Benchmarks runner
+//
+
+RTOS_MEMORY static RtosTask<configMINIMAL_STACK_SIZE * 2> bench_task_memory;
+
+static const Benchmark* bench_selected;
+static u32 bench_iterations;
+
+[[noreturn]] static void bench_finish(const Benchmark& benchmark, u32 iterations)
+{
+	semihosting_write("{\"benchmark\": \"");
+	semihosting_write(benchmark.name);
+	semihosting_write("\", \"iterations\": ");
+	semihosting_write(iterations);
+	semihosting_write("}\n");
+	semihosting_exit(true);
+}
+
+static void bench_task(void* params)
+{
+	static_cast<void>(params);
+	bench_selected->run(bench_iterations);
+	bench_finish(*bench_selected, bench_iterations);
+}
+
+//! Lists benchmarks and their default iterations, as JSON
+[[noreturn]] static void bench_list()
+{
+	semihosting_write("{");
+	for(const auto& benchmark : BENCHMARKS) {
+		semihosting_write((&benchmark == BENCHMARKS) ? "\"" : ", \"");
+		semihosting_write(benchmark.name);
+		semihosting_write("\": ");
+		semihosting_write(benchmark.iterations);
+	}
+	semihosting_write("}\n");
+	semihosting_exit(true);
+}
+
+//! Returns next word of the command line, terminated in place
+static char* bench_next_word(char*& line)
+{
+	while(*line == ' ') {
+		line++;
+	}
+
+	const auto word = line;
+	while(*line && (*line != ' ')) {
+		line++;
+	}
+	if(*line) {
+		*(line++) = '\0';
+	}
+	return word;
+}
+
+static u32 bench_parse_u32(const char* word)
+{
+	u32 value = 0;
+	for(; (*word >= '0') && (*word <= '9'); ++word) {
+		value = (value * 10) + (*word - '0');
+	}
+	return value;
+}
+
+int main()
+{
+	// Command line: program name, benchmark name and iterations
+	char line[80];
+	struct {
+		char* buffer;
+		u32 size;
+	} cmdline = { line, sizeof(line) };
+	CHECK(semihosting_call(SEMIHOSTING_SYS_GET_CMDLINE, &cmdline) == 0);
+
+	char* cursor = line;
+	bench_next_word(cursor);
+	const auto name = bench_next_word(cursor);
+	const auto count = bench_next_word(cursor);
+
+	const Benchmark* benchmark = nullptr;
+	for(const auto& candidate : BENCHMARKS) {
+		if(strcmp(candidate.name, name) == 0) {
+			benchmark = &candidate;
+		}
+	}
+	if(!benchmark) {
+		bench_list();
+	}
+
+	const auto iterations = (*count ? bench_parse_u32(count) : benchmark->iterations);
+	if(!benchmark->kernel) {
+		benchmark->run(iterations);
+		bench_finish(*benchmark, iterations);
+	}
+
+	bench_selected = benchmark;
+	bench_iterations = iterations;
+	CHECK(bench_task_memory.create(bench_task, "bench", nullptr, tskIDLE_PRIORITY + 1));
+	vTaskStartScheduler();
+
+	// We should not reach that line
+	semihosting_exit(false);
+}
+
+//
+// Free RTOS hooks
+//
+
+void vApplicationIdleHook()
+{
+}
+
+void vApplicationStackOverflowHook(TaskHandle_t pxTask, char *pcTaskName)
+{
+	static_cast<void>(pxTask);
+	log_failure(pcTaskName, "", 0, "stack overflow");
+}
+
+void vApplicationMallocFailedHook()
+{
+	log_failure(__FILE__, __func__, __LINE__, "malloc failed");
+}
+
+//
+// Vector table
+//
+
+void xPortPendSVHandler();
+void xPortSysTickHandler();
+void vPortSVCHandler();
+
+//! Any other exception is a failure of the benchmark
+static void bench_fault()
+{
+	log_failure(__FILE__, __func__, __LINE__, "unexpected exception");
+}
+
+using Handler = void(*)();
+
+__attribute__((section(".vectors"), used)) Handler __isr_vectors[] = {
+	RESET_handler,
+	bench_fault, // NMI
+	bench_fault, // HardFault
+	bench_fault, // MemManage
+	bench_fault, // BusFault
+	bench_fault, // UsageFault
+	bench_fault,
+	bench_fault,
+	bench_fault,
+	bench_fault,
+	vPortSVCHandler, // SVCall
+	bench_fault, // DebugMonitor
+	bench_fault,
+	xPortPendSVHandler, // PendSV
+	xPortSysTickHandler, // SysTick
+};
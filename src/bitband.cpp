@@ -0,0 +1,109 @@
+///////////////////////////////////////////////////////////////////////////////
+// Bit-banding helpers
+///////////////////////////////////////////////////////////////////////////////
+
+// Cortex-M4 maps every bit of the first 1MB of SRAM and peripherals regions
+// to a whole word in the bit-band alias regions. Write of 0 or 1 to the alias
+// word clears or sets single bit of the original word, and it is done by the
+// bus matrix as a single, atomic, read-modify-write transaction.
+// That way we can change single bits shared between tasks and interrupts
+// without disabling the interrupts.
+//
+// bit_word_addr = alias_base + (byte_offset * 32) + (bit_number * 4)
+
+constexpr u32 BITBAND_SRAM_BASE = 0x20000000;
+constexpr u32 BITBAND_SRAM_ALIAS = 0x22000000;
+constexpr u32 BITBAND_PERIPH_BASE = 0x40000000;
+constexpr u32 BITBAND_PERIPH_ALIAS = 0x42000000;
+constexpr u32 BITBAND_REGION_SIZE = 0x100000;
+
+//! Helper to be called, when address is outside bit-band regions
+// Since it is not constexpr, compile-time computation of alias will fail
+void bitband_invalid_address();
+
+//! Computes bit-band alias address of single bit of the word
+constexpr u32 bitband_alias(u32 addr, u8 bit)
+{
+	if(addr >= BITBAND_PERIPH_BASE && addr < (BITBAND_PERIPH_BASE + BITBAND_REGION_SIZE)) {
+		return BITBAND_PERIPH_ALIAS + ((addr - BITBAND_PERIPH_BASE) * 32) + (bit * 4);
+	}
+
+	if(addr >= BITBAND_SRAM_BASE && addr < (BITBAND_SRAM_BASE + BITBAND_REGION_SIZE)) {
+		return BITBAND_SRAM_ALIAS + ((addr - BITBAND_SRAM_BASE) * 32) + (bit * 4);
+	}
+
+	bitband_invalid_address();
+	return 0;
+}
+
+static_assert(bitband_alias(0x4005D410, 4) == 0x42BA8210); // GPIOF->IM, PF4
+static_assert(bitband_alias(0x20000300, 5) == 0x22006014);
+
+//! Converts single bit mask (e.g. PF4 or UART_IM_TXIM) into bit number
+constexpr u8 bitband_bit(u32 mask)
+{
+	return __builtin_ctz(mask);
+}
+
+#ifndef TARGET_HOST
+
+//! Alias word, writes of 0 or 1 change the bit
+using BitbandRef = volatile u32&;
+
+//! Returns alias word of single bit of the word at specified address
+// When arguments are constant, whole computation is done at compile-time
+inline BitbandRef bitband_ref(u32 addr, u8 bit)
+{
+	return *((volatile u32*)(bitband_alias(addr, bit)));
+}
+
+#else
+
+//! Host build has no alias regions, the bit of the simulated register
+// (see host.cpp) is changed by atomic instruction of the host instead
+struct BitbandRef
+{
+	volatile u32* word;
+	u32 mask;
+
+	void operator=(u32 value)
+	{
+		if(value & 0x1) {
+			__atomic_fetch_or(word, mask, __ATOMIC_SEQ_CST);
+		} else {
+			__atomic_fetch_and(word, ~mask, __ATOMIC_SEQ_CST);
+		}
+	}
+};
+
+inline BitbandRef bitband_ref(u32 addr, u8 bit)
+{
+	return { (volatile u32*)(host_registers(addr)), (1u << bit) };
+}
+
+#endif
+
+//! Compile-time checked version of `bitband_ref`
+template<u32 Addr, u32 Mask>
+inline BitbandRef bitband()
+{
+	static_assert((Mask != 0) && ((Mask & (Mask - 1)) == 0), "Mask must have single bit set");
+	constexpr auto alias = bitband_alias(Addr, bitband_bit(Mask));
+#ifndef TARGET_HOST
+	return *((volatile u32*)(alias));
+#else
+	static_cast<void>(alias);
+	return bitband_ref(Addr, bitband_bit(Mask));
+#endif
+}
+
+//! Atomically sets or clears all bits of mask in the word, bit after bit
+// Every bit is changed atomically, but not all of them at once
+inline void bitband_write_mask(u32 addr, u32 mask, bool value)
+{
+	while(mask) {
+		const u8 bit = bitband_bit(mask);
+		mask &= (mask - 1);
+		bitband_ref(addr, bit) = value;
+	}
+}
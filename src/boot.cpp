@@ -0,0 +1,88 @@
+///////////////////////////////////////////////////////////////////////////////
+// Bootloader
+///////////////////////////////////////////////////////////////////////////////
+
+// Small program in the first 16K of the flash (boot.ld), built instead of
+// main.cpp. It selects the slot of the application (see update.cpp), points
+// VTOR to its vector table, and jumps to it with its initial stack pointer.
+// Receiving of the updates is left to the application, so the bootloader
+// never changes and it is written only by the programmer (`make flash`).
+//
+// It has no variables and no peripherals are touched, so the application
+// starts like after reset, with SRAM untouched (e.g. its crash dump). When no
+// slot holds valid image, it waits for the programmer.
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "types.cpp"
+#include "stack.cpp"
+#include "utils.cpp"
+#include "scb.cpp"
+#include "dwt.cpp"
+#include "crc.cpp"
+#include "flash.cpp"
+#include "update.cpp"
+
+//
+// Private functions
+//
+
+//! Starts the image, never returns
+[[noreturn]] static void boot_start(u32 image)
+{
+	const auto vectors = (const u32*)(image);
+	SCB->VTOR = image;
+	__asm volatile("DSB" ::: "memory");
+	__asm volatile
+	(
+		" msr msp, %0       \n"
+		" bx %1             \n"
+		:: "r"(vectors[0]), "r"(vectors[1])
+	);
+	__builtin_unreachable();
+}
+
+[[noreturn]] static void BOOT_handler()
+{
+	const auto slot = update_boot_slot();
+	if(slot != UPDATE_SLOT_NONE) {
+		boot_start(update_image_address(slot));
+	}
+
+	while(true);
+}
+
+static void BOOT_fault_handler()
+{
+	while(true);
+}
+
+//
+// Hooks
+//
+
+//! Failures are only visible in debugger, there is no UART
+void log_failure(const char*, const char*, int, const char*)
+{
+}
+
+//! There are no tasks, flash is never written anyway
+void flash_lock()
+{
+}
+
+void flash_unlock()
+{
+}
+
+//! Vector table of the bootloader, exceptions only, no interrupt is enabled
+__attribute__((section(".vectors"), used)) void (* const boot_vectors[])() = {
+	BOOT_handler,
+	BOOT_fault_handler, // NMI
+	BOOT_fault_handler, // HardFault
+	BOOT_fault_handler, // MemManage
+	BOOT_fault_handler, // BusFault
+	BOOT_fault_handler, // UsageFault
+};
@@ -2,104 +2,123 @@
 // Buttons management
 ///////////////////////////////////////////////////////////////////////////////
 
+// Debouncing is done entirely in interrupts. The edge on any button pin
+// disables its GPIO interrupts and starts periodic timer. The timer samples
+// all button pins at once and feeds them into 2-bit vertical counters
+// (one counter per pin, bits of counters stored in separate bytes).
+// Pin changes its debounced state only after DEBOUNCE_SAMPLES consecutive
+// samples different from current debounced state. Every sample also steps
+// gestures recognition. When all pins are stable and no gesture is in
+// progress, timer is stopped and GPIO interrupts are re-enabled. Only
+// recognized gestures are sent to the queue, so no task runs during debouncing.
+
 //
 // Global variables
 //
 
-//! Queue to store buttons presses events
+//! Queue to store buttons gestures events
+RTOS_MEMORY static RtosQueue<GestureEvent, 8> buttons_queue_memory;
 static QueueHandle_t buttons_queue = nullptr;
 
+//! Events lost because the queue was full, reported by the reader
+static volatile u32 buttons_dropped;
+
+//! Debounced state of buttons (set bit = pressed)
+static u8 buttons_state;
+
+//! Vertical counters - lower and higher bits of counter of each pin
+static u8 buttons_cnt0;
+static u8 buttons_cnt1;
+
 //
 // Private functions
 //
 
-//! Implementation of button handling routine
-static void buttons_task([[maybe_unused]] void* params)
+// Parameters of debouncing - suited for this board's buttons
+constexpr u8 DEBOUNCE_INTERVAL_MS = 8;
+constexpr u8 DEBOUNCE_SAMPLES = 4; // Defined by 2-bit vertical counters
+
+//! Returns, which buttons are currently pressed (not debounced)
+static u8 buttons_sample()
 {
-	// We need some structure to represent buttons and their debouncing state
-	struct Button { u8 pin; u8 timer; u8 counter; } buttons[2];
-	buttons[0].pin = BTN_LEFT_PIN;
-	buttons[1].pin = BTN_RIGHT_PIN;
+	// Buttons are pulled up, so pressed button reads as zero
+	return (~GPIOF->DATA[BTNS_PINS] & BTNS_PINS);
+}
 
-	// Parameters of debouncing - suited for this board's buttons
-	constexpr u8 DEBOUNCE_INTERVAL_MS = 4;
-	constexpr u8 DEBOUNCE_REPEATS = 16;
+//! Performs one debouncing step with specified sample for all pins at once
+// Returns pins, which have just changed their debounced state
+static u8 buttons_debounce(u8 sample)
+{
+	// Counters of pins, which are equal to debounced state, are reset.
+	// Other counters are incremented. When a counter overflows,
+	// corresponding pin changes its debounced state.
+	const u8 delta = (sample ^ buttons_state);
+	buttons_cnt1 = (buttons_cnt1 ^ buttons_cnt0) & delta;
+	buttons_cnt0 = ~buttons_cnt0 & delta;
+
+	const u8 toggled = delta & ~(buttons_cnt0 | buttons_cnt1);
+	buttons_state ^= toggled;
+	return toggled;
+}
 
-	// In loop either wait for any pin to be touched or perform debouncing
-	while(true)
-	{
-		// Wait for any pin to be touched
-		gpio_wait(BTNS_PINS);
-
-		// Some pins have been touched. Begin debouncing
-		auto nextwaketime = xTaskGetTickCount();
-		auto debounce_pins = 0x00;
-		while(true)
-		{
-			// Check, if some pins was touched recently
-			const auto next_debounce_pins = gpio_get();
-			if(next_debounce_pins) {
-				// Initialize them for debouncing
-				for(auto& button : buttons) {
-					if(next_debounce_pins & button.pin) {
-						button.timer = DEBOUNCE_REPEATS;
-						button.counter = 0;
-					}
-				}
-
-				debounce_pins |= next_debounce_pins;
-			}
-
-			// Latch state of pins
-			const auto pins_states = GPIOF->DATA[debounce_pins];
-
-			// Handle debouncing
-			auto finished_pins = 0x00;
-			auto pressed_pins = 0x00;
-			for(auto& [pin, timer, counter] : buttons) {
-				if(!(debounce_pins & pin)) {
-					// Pin is not under debouncing, go to next one
-					continue;
-				}
-
-				// Perform voting for "not_pressed"
-				const auto is_not_pressed = (pins_states & pin);
-				if(is_not_pressed) { ++counter; }
-
-				// If debouncing has finished, detect state of the pin
-				if(--timer == 0) {
-					if(counter < DEBOUNCE_REPEATS/4) {
-						// More than 75% of votes was for "is pressed"
-						pressed_pins |= pin;
-					}
-
-					finished_pins |= pin;
-				}
-			}
-
-			// If there were detected pressed pins, send them to the queue
-			if(pressed_pins) {
-				CHECK(xQueueSend(buttons_queue, &pressed_pins, 0));
-			}
-
-			// Do we have some buttons, that have just end debouncing?
-			if(finished_pins) {
-				// Re-enable interrupts for them
-				gpio_enable(finished_pins);
-
-				// Exclude them from debouncing
-				debounce_pins &= ~finished_pins;
-				if(!debounce_pins)
-				{
-					// No more pins to debounce, we have to wait for interrupt! 
-					break;
-				}
-			}
-
-			// Wait for next interval
-			vTaskDelayUntil(&nextwaketime, pdMS_TO_TICKS(DEBOUNCE_INTERVAL_MS));
+//! Starts debouncing of buttons, called when any of buttons pins is touched
+static void buttons_touched(u8 pin, [[maybe_unused]] BaseType_t* highpriotask_woken)
+{
+	assert(pin & BTNS_PINS);
+
+	// Disable edge interrupts from all buttons. The timer will take care of them
+	gpio_disable(GPIO_PORTF, BTNS_PINS);
+
+	// Start sampling after full interval, if it is not already running
+	if(!(TIMER0->CTL & TIMER_CTL_TAEN)) {
+		TIMER0->TAV = TIMER0->TAILR;
+		TIMER0->CTL |= TIMER_CTL_TAEN;
+	}
+}
+
+//! Debouncing timer interrupt handler
+static void TIMER0A_handler()
+{
+	latency_isr_entry(LATENCY_TIMER0A);
+
+	// We would like to know, if sending events will unblock higher priority task
+	auto highpriotask_woken = pdFALSE;
+
+	// Acknowledge interrupt cause
+	TIMER0->ICR = TIMER_INT_TATO;
+
+	// Perform one debouncing step
+	const auto toggled = buttons_debounce(buttons_sample());
+
+	// Feed debounced state into gestures recognition and send what it found
+	GestureEvent events[GESTURE_MAX_EVENTS];
+	const auto timestamp = xTaskGetTickCountFromISR();
+	const auto count = gestures_step(buttons_state, toggled, timestamp, events);
+	for(u8 i = 0; i < count; ++i) {
+		if(xQueueSendFromISR(buttons_queue, &events[i], &highpriotask_woken) != pdTRUE) {
+			// Reader is too slow (e.g. UI is busy redrawing), it will know
+			atomic_add(&buttons_dropped, 1);
+		}
+	}
+
+	// Check, if all buttons are stable and no gesture is being recognized
+	if(!(buttons_cnt0 | buttons_cnt1) && !gestures_busy()) {
+		// Nothing to debounce, wait for the edges again
+		TIMER0->CTL &= ~TIMER_CTL_TAEN;
+		gpio_enable(GPIO_PORTF, BTNS_PINS);
+
+		// Edge might have happened right before enabling of interrupts
+		if(buttons_sample() != buttons_state) {
+			buttons_touched(BTNS_PINS, &highpriotask_woken);
 		}
 	}
+
+	/* portYIELD_FROM_ISR() will request a context switch if executing this
+	interrupt handler caused a task to leave the blocked state, and the task
+	that left the blocked state has a higher priority than the currently running
+	task (the task this interrupt interrupted). */
+	latency_isr_exit(LATENCY_TIMER0A, (count > 0));
+	portYIELD_FROM_ISR(highpriotask_woken);
 }
 
 //
@@ -108,24 +127,80 @@ static void buttons_task([[maybe_unused]] void* params)
 
 void buttons_init()
 {
-	// Create queue for button press events
-	const auto queue_size = 8;
-	CHECK(buttons_queue = xQueueCreate(queue_size, sizeof(u8)));
-
-	// Create task for buttons handling
-	const auto stacksize = configMINIMAL_STACK_SIZE;
-	const auto params = nullptr;
-	const auto priority = (tskIDLE_PRIORITY + 1);
-	CHECK(xTaskCreate(buttons_task, "buttons", stacksize, params, priority, nullptr));
+	//
+	// Software initialization
+	//
+
+	// Create queue for buttons gestures events
+	CHECK(buttons_queue = buttons_queue_memory.create());
+	gestures_init(DEBOUNCE_INTERVAL_MS);
+
+	// Buttons which are pressed during startup will be reported when released
+	buttons_state = buttons_sample();
+	buttons_cnt0 = 0;
+	buttons_cnt1 = 0;
+	buttons_dropped = 0;
+
+	//
+	// Hardware initialization
+	//
+
+	// Configure TIMER0 as periodic 32-bit timer, which is stopped for now
+	constexpr u32 DEBOUNCE_INTERVAL = (configCPU_CLOCK_HZ / 1000) * DEBOUNCE_INTERVAL_MS;
+	TIMER0->CTL = 0;
+	TIMER0->CFG = TIMER_CFG_32_BIT_TIMER;
+	TIMER0->TAMR = TIMER_TnMR_PERIOD;
+	TIMER0->TAILR = (DEBOUNCE_INTERVAL - 1);
+	TIMER0->ICR = TIMER_INT_TATO;
+	TIMER0->IMR = TIMER_INT_TATO;
+
+	// Start waiting for button edges
+	// NOTE: `buttons_touched` is registered as GPIOF pins handler in handlers.cpp
+	gpio_enable(GPIO_PORTF, BTNS_PINS);
 }
 
+//! Reads (in blocking way) next gesture event
+GestureEvent buttons_read_event()
+{
+	GestureEvent event;
+	CHECK(xQueueReceive(buttons_queue, &event, portMAX_DELAY));
+	latency_task_resumed(LATENCY_TIMER0A);
+	CHECK(event.pins != 0x00);
+
+	// Events recognized after the lost ones are still delivered
+	const auto dropped = atomic_exchange(&buttons_dropped, 0);
+	if(dropped) {
+		LOG_WARNING("Dropped %u button events", dropped);
+	}
+
+	return event;
+}
+
+//! Sets timing parameters of gestures
+void buttons_configure(const GestureConfig& config)
+{
+	NVIC_CRITICAL_SECTION_ENTER(INT_TIMER0A);
+	{
+		gestures_configure(config);
+	}
+	NVIC_CRITICAL_SECTION_LEAVE(INT_TIMER0A);
+}
+
+//! Waits for any buttons to be pressed
 u8 buttons_read()
 {
-	u8 pressed_pins;
-	// Read in blocking way press events from the queue
-	CHECK(xQueueReceive(buttons_queue, &pressed_pins, portMAX_DELAY));
-	CHECK(pressed_pins != 0x00);
-
-	// Return what buttons was pressed
-	return pressed_pins;
-}
\ No newline at end of file
+	// Only events related with pressing are interesting here, skip others
+	while(true) {
+		const auto event = buttons_read_event();
+		switch(event.type) {
+			case GestureType::Press:
+			case GestureType::DoubleClick:
+			case GestureType::Chord:
+				// Return what buttons was pressed
+				return event.pins;
+
+			default:
+				break;
+		}
+	}
+}
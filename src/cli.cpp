@@ -2,63 +2,591 @@
 // Command Line Interface module
 ///////////////////////////////////////////////////////////////////////////////
 
+//
+// Global variables
+//
+
+//! Output of the commands, redirected into packets in RPC mode (see rpc.cpp)
+static void (*cli_output)(const char* data, u32 size) = uart_write;
+
+//! Enters binary RPC mode, until the host leaves it, defined in rpc.cpp
+void rpc_serve();
+
+//
+// Private functions
+//
+
+static void cli_write(const char* data, u32 size)
+{
+	cli_output(data, size);
+}
+
+// Overloaded version, handling string literals (without their '\0')
+template<u32 N>
+static void cli_write(char const (&string)[N])
+{
+	cli_output(string, N - 1);
+}
+
+//! Writes formatted text (see format.cpp) to the output of the commands
+template<typename Format, typename... Args>
+static void cli_format(Format format, Args... args)
+{
+	format_write(cli_output, format, args...);
+}
+
+//! Writes line with label and names of peripherals from POWER_* mask
+static void cli_write_power_periphs(const char* label, u8 periphs)
+{
+	char line[48];
+	auto line_end = format_to(line, line + sizeof(line), FORMAT("{}"), label);
+	for(u8 periph = 1; periph & POWER_ALL; periph <<= 1) {
+		if(periphs & periph) {
+			line_end = format_to(line_end, line + sizeof(line), FORMAT(" {}"), power_periph_name(periph));
+		}
+	}
+
+	line_end = format_to(line_end, line + sizeof(line), FORMAT("\n"));
+	cli_write(line, (line_end - line));
+}
+
+//! Writes line with label and decimal value
+static void cli_write_value(const char* label, u32 value)
+{
+	cli_format(FORMAT("{}{}\n"), label, value);
+}
+
+//! Writes line with label and hexadecimal value (8 digits)
+static void cli_write_hex(const char* label, u32 value)
+{
+	cli_format(FORMAT("{}0x{08x}\n"), label, value);
+}
+
+//
+// Tasks statistics ("top" command)
+//
+
+//! Maximal number of tasks displayed by "top" command
+constexpr u8 CLI_TOP_MAX_TASKS = 8;
+
+//! Interval of refreshing statistics by "top" command, in milliseconds
+constexpr u32 CLI_TOP_INTERVAL = 1000;
+constexpr u32 CLI_TOP_MIN_INTERVAL = 100;
+constexpr u32 CLI_TOP_MAX_INTERVAL = 60000;
+
+//! Snapshot of all tasks statistics
+struct CliTopSnapshot
+{
+	TaskStatus_t tasks[CLI_TOP_MAX_TASKS];
+	u32 switches[CLI_TOP_MAX_TASKS]; // How many times each task was switched in
+	UBaseType_t count;
+	u32 total; // Run time of the whole system (lower half)
+};
+
+static void cli_top_snapshot(CliTopSnapshot& snapshot)
+{
+	snapshot.count = uxTaskGetSystemState(snapshot.tasks, CLI_TOP_MAX_TASKS, &snapshot.total);
+	for(UBaseType_t i = 0; i < snapshot.count; ++i) {
+		snapshot.switches[i] = runtime_task_switches(snapshot.tasks[i].xTaskNumber);
+	}
+}
+
+//! Prints, what the tasks were doing between two snapshots
+static void cli_top_print(const CliTopSnapshot& previous, const CliTopSnapshot& current)
+{
+	cli_format(FORMAT("uptime ms: {}\n"), runtime_now() / (configCPU_CLOCK_HZ / 1000));
+	cli_write("task              cpu%  switches  stack\n");
+
+	// Counters are 32-bit, but differences are right even if they wrapped
+	const auto total = (current.total - previous.total);
+	for(UBaseType_t i = 0; i < current.count; ++i) {
+		const auto& task = current.tasks[i];
+
+		// Task might have been created after previous snapshot
+		u32 previous_run_time = 0;
+		u32 previous_switches = 0;
+		for(UBaseType_t j = 0; j < previous.count; ++j) {
+			if(previous.tasks[j].xTaskNumber == task.xTaskNumber) {
+				previous_run_time = previous.tasks[j].ulRunTimeCounter;
+				previous_switches = previous.switches[j];
+				break;
+			}
+		}
+
+		const auto run_time = (task.ulRunTimeCounter - previous_run_time);
+		const u32 permille = (total > 0) ? (((u64)(run_time) * 1000 + total / 2) / total) : 0;
+
+		// Name is padded to configMAX_TASK_NAME_LEN
+		static_assert(configMAX_TASK_NAME_LEN == 16);
+		const auto switches = (current.switches[i] - previous_switches);
+		cli_format(FORMAT("{-16}{6.1}{10}{7}\n"), task.pcTaskName, permille, switches, task.usStackHighWaterMark);
+	}
+}
+
+//! Prints tasks statistics every CLI_TOP_INTERVAL (or given one), until any key is hit
+static void cli_top(const CommandArgs& args)
+{
+	const auto interval = (args.count > 0) ? min(max(args.numbers[0], CLI_TOP_MIN_INTERVAL), CLI_TOP_MAX_INTERVAL) : CLI_TOP_INTERVAL;
+
+	// Snapshots are too big for the stack of the task
+	static CliTopSnapshot snapshots[2];
+
+	// Drop rest of the command line (e.g. LF after CR)
+	char c;
+	while(uart_read_char(c, 0));
+
+	u8 current = 0;
+	cli_top_snapshot(snapshots[current]);
+	while(!uart_read_char(c, pdMS_TO_TICKS(interval))) {
+		current ^= 1;
+		cli_top_snapshot(snapshots[current]);
+		cli_top_print(snapshots[current ^ 1], snapshots[current]);
+	}
+}
+
+//
+// Kernel trace streaming ("trace" command)
+//
+
+//! Number of records with names of the tasks sent to UART at once
+constexpr u8 CLI_TRACE_CHUNK = 16;
+
+//! Streams kernel trace in binary form (see trace.cpp), until any key is hit
+static void cli_trace([[maybe_unused]] const CommandArgs& args)
+{
+	// Buffers are too big for the stack of the task
+	static TraceRecord records[CLI_TRACE_CHUNK];
+	static TaskStatus_t tasks[CLI_TOP_MAX_TASKS];
+
+	// Drop rest of the command line (e.g. LF after CR)
+	char c;
+	while(uart_read_char(c, 0));
+
+	// Stream header, so host knows where it begins and how to convert time
+	const u32 header[] = { TRACE_MAGIC, configCPU_CLOCK_HZ };
+	cli_write((const char*)(header), sizeof(header));
+
+	// Names of the tasks
+	const auto tasks_count = uxTaskGetSystemState(tasks, CLI_TOP_MAX_TASKS, nullptr);
+	for(UBaseType_t i = 0; i < tasks_count; ++i) {
+		const auto count = trace_task_name(tasks[i].xTaskNumber, tasks[i].pcTaskName, records, CLI_TRACE_CHUNK);
+		if(count > 0) {
+			cli_write((const char*)(records), count * sizeof(TraceRecord));
+		}
+	}
+
+	// Records are sent by the trace task, UART stays locked by this command
+	trace_start(cli_output);
+	while(!uart_read_char(c, portMAX_DELAY));
+	trace_stop();
+}
+
+//
+// Interrupt latency ("latency" command)
+//
+
+//! Prints single statistics of interrupt latency (see latency.cpp)
+static void cli_latency_print(const char* source, const char* kind, const LatencyStats& stats)
+{
+	if(stats.count > 0) {
+		const auto mean = (u32)(stats.sum / stats.count);
+		cli_format(FORMAT("{-10}{-8}{8}{8}{8}{8}\n"), source, kind, stats.count, stats.min, mean, stats.max);
+	} else {
+		cli_format(FORMAT("{-10}{-8}{8}\n"), source, kind, stats.count);
+	}
+
+	// Histogram of non-empty buckets, the last one has no upper bound
+	for(u8 bucket = 0; bucket < LATENCY_BUCKETS; ++bucket) {
+		if(!stats.histogram[bucket]) {
+			continue;
+		}
+
+		const auto bound = (bucket < (LATENCY_BUCKETS - 1)) ? "<" : ">=";
+		cli_format(FORMAT("  {} 2^{}: {}\n"), bound, min<u8>(bucket, LATENCY_BUCKETS - 2), stats.histogram[bucket]);
+	}
+}
+
+//! Prints latency of all interrupt sources in cycles and resets them
+static void cli_latency([[maybe_unused]] const CommandArgs& args)
+{
+	// Statistics are too big for the stack of the task
+	static LatencySourceStats stats[LATENCY_SOURCES];
+	latency_take(stats);
+
+	cli_write("source    kind       count     min    mean     max\n");
+	for(u8 source = 0; source < LATENCY_SOURCES; ++source) {
+		const auto name = latency_source_name((LatencySource)(source));
+		cli_latency_print(name, "handler", stats[source].handler);
+		cli_latency_print(name, "wake", stats[source].wake);
+	}
+}
+
+//
+// Crash report
+//
+
+//! Writes dump of the crash, which caused last reset
+static void cli_crash_report(const CrashDump& dump)
+{
+	cli_format(FORMAT("Crashed by {}\n"), crash_exception_name(dump.exception));
+
+	if(dump.task[0]) {
+		cli_write("task: ");
+		cli_write(dump.task, strnlen(dump.task, sizeof(dump.task)));
+		cli_write("\n", 1);
+	}
+
+	constexpr const char* frame_labels[CRASH_FRAME_WORDS] = {
+		"r0: ", "r1: ", "r2: ", "r3: ", "r12: ", "lr: ", "pc: ", "psr: ",
+	};
+	for(u32 i = 0; i < CRASH_FRAME_WORDS; ++i) {
+		cli_write_hex(frame_labels[i], dump.frame[i]);
+	}
+
+	// Backtrace for tools/symbolize.py
+	for(u32 i = 0; i < dump.backtrace_depth; ++i) {
+		cli_write_hex("at ", dump.backtrace[i]);
+	}
+
+	cli_write_hex("exc_return: ", dump.exc_return);
+	cli_write_hex("cfsr: ", dump.cfsr);
+	cli_write_hex("hfsr: ", dump.hfsr);
+	if(dump.cfsr & SCB_CFSR_MMARVALID) {
+		cli_write_hex("mmfar: ", dump.mmfar);
+	}
+	if(dump.cfsr & SCB_CFSR_BFARVALID) {
+		cli_write_hex("bfar: ", dump.bfar);
+	}
+
+	// Raw stack, starting from the exception frame
+	cli_write_hex("sp: ", dump.sp);
+	for(u32 i = 0; i < dump.stack_words; ++i) {
+		cli_write_hex("  ", dump.stack[i]);
+	}
+}
+
+//
+// Other commands
+//
+
+//! Prints RTC seconds
+static void cli_time([[maybe_unused]] const CommandArgs& args)
+{
+	cli_format(FORMAT("{}\n"), hib_rtc_seconds());
+}
+
+//! Prints current power profile
+static void cli_power([[maybe_unused]] const CommandArgs& args)
+{
+	const auto profile = power_get_profile();
+	cli_write_power_periphs("sleep:", profile.sleep);
+	cli_write_power_periphs("deepsleep:", profile.deepsleep);
+	if(profile.use_deepsleep) {
+		cli_write("idle: deepsleep\n");
+	} else {
+		cli_write("idle: sleep\n");
+	}
+}
+
+#if (configSUPPORT_DYNAMIC_ALLOCATION == 1)
+//! Prints usage of the kernel heap
+static void cli_heap([[maybe_unused]] const CommandArgs& args)
+{
+	const auto stats = heap_get_stats();
+	cli_write_value("capacity: ", stats.capacity);
+	cli_write_value("used: ", stats.used);
+	cli_write_value("high water: ", stats.high_water);
+	cli_write_value("largest free: ", stats.largest_free);
+	cli_write_value("free blocks: ", stats.free_blocks);
+	cli_write_value("allocations: ", stats.allocations);
+	cli_write_value("frees: ", stats.frees);
+	cli_write_value("failures: ", stats.failures);
+
+	// Histogram of free blocks, by their first level class
+	for(u8 fl = 0; fl < HEAP_FL_COUNT; ++fl) {
+		if(!stats.free_histogram[fl]) {
+			continue;
+		}
+
+		cli_format(FORMAT("free >= {}: {}\n"), heap_class_size(fl), stats.free_histogram[fl]);
+	}
+}
+#endif
+
+//! Compares pin interrupts enabling methods
+static void cli_bitband([[maybe_unused]] const CommandArgs& args)
+{
+	const auto result = gpio_benchmark();
+	cli_write_value("critical section: ", result.critical_section);
+	cli_write_value("bitband: ", result.bitband);
+}
+
+//! Compares cycles of number conversions
+static void cli_digits([[maybe_unused]] const CommandArgs& args)
+{
+	const auto result = digits_benchmark();
+	cli_write_value("reference: ", result.reference);
+	cli_write_value("u32: ", result.decimal);
+	cli_write_value("u64: ", result.decimal64);
+	cli_write_value("hex: ", result.hex);
+}
+
+//! Compares throughput of CRCs
+static void cli_crc([[maybe_unused]] const CommandArgs& args)
+{
+	const auto result = crc_benchmark();
+	cli_format(FORMAT("bytes per cycle\ncrc8: {.2}\ncrc16: {.2}\n"), result.crc8, result.crc16);
+	cli_format(FORMAT("crc32 bytes: {.2}\ncrc32: {.2}\n"), result.crc32_bytes, result.crc32);
+}
+
+//! Measures context switch between tasks
+static void cli_switch([[maybe_unused]] const CommandArgs& args)
+{
+	const auto result = pingpong_benchmark();
+	if(result.optimised) {
+		cli_write("selection: optimised\n");
+	} else {
+		cli_write("selection: generic\n");
+	}
+	cli_write_value("switches: ", result.switches);
+	cli_write_value("cycles per switch: ", result.cycles_per_switch);
+}
+
+//! Prints slots of the firmware and the one receiving updates
+static void cli_slots([[maybe_unused]] const CommandArgs& args)
+{
+	const auto running = update_running_slot();
+	for(u8 slot = 0; slot < UPDATE_SLOTS; ++slot) {
+		const auto state = (slot == running) ? "running" : "target";
+		cli_format(FORMAT("slot {} at 0x{08x}: {}, sequence {}, {} bytes\n"), update_slot_name(slot),
+			update_image_address(slot), state, update_sequence(slot), update_image_size(slot));
+	}
+}
+
+//! Writes failure of the update step, returns whether it succeeded
+static bool cli_update_status(UpdateStatus status)
+{
+	if(status != UPDATE_OK) {
+		cli_format(FORMAT("error: {}, {} bytes written\n"), update_status_name(status), update_written());
+	}
+	return (status == UPDATE_OK);
+}
+
+//! Starts update of the other slot by the image of given size and CRC-32
+static void cli_update_begin(const CommandArgs& args)
+{
+	if(cli_update_status(update_begin(args.numbers[0], args.numbers[1]))) {
+		const auto slot = update_target_slot();
+		cli_format(FORMAT("slot {} at 0x{08x}\n"), update_slot_name(slot), update_image_address(slot));
+	}
+}
+
+//! Writes chunk of the image at the offset, binary data come by RPC
+static void cli_update_write(const CommandArgs& args)
+{
+	const auto& data = args.words[1];
+	cli_update_status(update_write(args.numbers[0], (const u8*)(data.data), data.size));
+}
+
+//! Verifies the image and makes its slot started after reset
+static void cli_update_commit([[maybe_unused]] const CommandArgs& args)
+{
+	if(cli_update_status(update_commit())) {
+		const auto ms = (u32)((update_flash_cycles() * 1000) / configCPU_CLOCK_HZ);
+		cli_format(FORMAT("slot {} starts after reset, flash busy {} ms\n"), update_slot_name(update_target_slot()), ms);
+	}
+}
+
+//! Prints the settings and usage of their store
+static void cli_config([[maybe_unused]] const CommandArgs& args)
+{
+	for(u8 key = 0; key < CONFIG_KEYS; ++key) {
+		u32 value;
+		if(config_get((ConfigKey)(key), &value, sizeof(value)) == sizeof(value)) {
+			cli_format(FORMAT("{}: {}\n"), CONFIG_KEY_NAMES[key], value);
+		} else {
+			cli_format(FORMAT("{}: not set\n"), CONFIG_KEY_NAMES[key]);
+		}
+	}
+
+	const auto stats = config_stats();
+	cli_format(FORMAT("blocks: {} used, {} free, sequence {}\n"), stats.used, stats.free, stats.sequence);
+	cli_format(FORMAT("erases: {}, compactions: {}\n"), stats.erases, stats.compactions);
+}
+
+//! Finds the key given by its name, writes failure otherwise
+static bool cli_config_key(const CommandSlice& name, ConfigKey& key)
+{
+	if(!config_find_key(name.data, name.size, key)) {
+		cli_write("error: unknown key\n");
+		return false;
+	}
+	return true;
+}
+
+//! Stores value of the setting, it is used after reset
+static void cli_config_set(const CommandArgs& args)
+{
+	ConfigKey key;
+	if(cli_config_key(args.words[0], key)) {
+		if(config_set_u32(key, args.numbers[1])) {
+			cli_format(FORMAT("{}: {}, used after reset\n"), CONFIG_KEY_NAMES[key], args.numbers[1]);
+		} else {
+			cli_write("error: flash operation failed\n");
+		}
+	}
+}
+
+//! Deletes the setting, so its default is used after reset
+static void cli_config_delete(const CommandArgs& args)
+{
+	ConfigKey key;
+	if(cli_config_key(args.words[0], key) && !config_delete(key)) {
+		cli_write("error: flash operation failed\n");
+	}
+}
+
+//! Resets the microcontroller, e.g. to start the updated slot
+static void cli_reset([[maybe_unused]] const CommandArgs& args)
+{
+	scb_reset();
+}
+
+//! Serves binary RPC, until the host leaves it
+static void cli_rpc([[maybe_unused]] const CommandArgs& args)
+{
+	rpc_serve();
+}
+
+//
+// Commands table
+//
+
+static void cli_help(const CommandArgs& args);
+
+//! All commands of the CLI, looked up by perfect hash of their names
+constexpr Command CLI_COMMANDS[] = {
+	{ "time", "", cli_time, "RTC seconds", false },
+	{ "power", "", cli_power, "power profile", false },
+	{ "top", "U", cli_top, "tasks statistics every <number> ms, until any key", true },
+	{ "trace", "", cli_trace, "binary kernel trace, until any key", true },
+#if (configSUPPORT_DYNAMIC_ALLOCATION == 1)
+	{ "heap", "", cli_heap, "usage of the kernel heap", false },
+#endif
+	{ "bitband", "", cli_bitband, "benchmark of pin interrupts enabling", false },
+	{ "digits", "", cli_digits, "benchmark of number conversions", false },
+	{ "crc", "", cli_crc, "benchmark of CRCs", false },
+	{ "switch", "", cli_switch, "benchmark of context switch", false },
+	{ "latency", "", cli_latency, "interrupt latency, resets it", false },
+	{ "slots", "", cli_slots, "slots of the firmware", false },
+	{ "update_begin", "uu", cli_update_begin, "update of <size> bytes and <crc32>", false },
+	{ "update_write", "us", cli_update_write, "chunk of the update at <offset>", false },
+	{ "update_commit", "", cli_update_commit, "verify the update, switch the slot", false },
+	{ "config", "", cli_config, "settings stored in the flash", false },
+	{ "config_set", "su", cli_config_set, "store <key> <value>, used after reset", false },
+	{ "config_delete", "s", cli_config_delete, "delete <key>, default is used after reset", false },
+	{ "reset", "", cli_reset, "reset the microcontroller", false },
+	{ "rpc", "", cli_rpc, "binary RPC mode for test rigs (tools/rpc.py)", true },
+	{ "help", "S", cli_help, "list of commands or usage of one", false },
+};
+
+constexpr auto CLI_COMMANDS_TABLE = command_table(CLI_COMMANDS);
+
+//! Writes usage of the command, with its description optionally
+static void cli_write_usage(const Command& command, bool with_help)
+{
+	// Space for the terminating '\0' is left
+	char line[48];
+	*command_usage(command, line, line + sizeof(line) - 1) = '\0';
+	if(with_help) {
+		cli_format(FORMAT("{-20} {}\n"), line, command.help);
+	} else {
+		cli_format(FORMAT("usage: {}\n"), line);
+	}
+}
+
+//! Prints all commands, or usage of the one given
+static void cli_help(const CommandArgs& args)
+{
+	if(args.count > 0) {
+		if(const auto command = command_find(CLI_COMMANDS, CLI_COMMANDS_TABLE, args.words[0])) {
+			cli_write_usage(*command, true);
+		} else {
+			cli_write("Invalid command\n");
+		}
+		return;
+	}
+
+	for(const auto& command : CLI_COMMANDS) {
+		cli_write_usage(command, true);
+	}
+}
+
 //
 // Command Line Interface task
 //
 
+//! Stack of the task in words. Handlers of the commands run on it, also over
+//! RPC, with formatting of their output and report of a failed assert.
+//! Provisional until `make stack` runs for the device, taken from the depth
+//! of the host build with the context switch and 10% margin
+constexpr configSTACK_DEPTH_TYPE CLI_STACK_SIZE = 520;
+
 static void cli_task([[maybe_unused]] void *params)
 {
 	// Print some welcome string
-	uart_write("En taro Adun, Executor!\n");
+	uart_lock();
+	cli_write("En taro Adun, Executor!\n");
+
+	// Report the crash, which caused last reset (only once)
+	if(const auto dump = crash_get()) {
+		cli_crash_report(*dump);
+		crash_clear();
+	}
+
+	uart_unlock();
 
-	// We need some string buffers to read/write data
-	char rx_string[32];
-	char tx_string[32];
+	// Editor holds the line and the history, too big for the stack of the task
+	static LineEditor editor;
 
 	// In loop read commands from UART, parse them and write responses
 	while(true)
 	{
-		// Read command from UART until CarriageReturn happen
-		// Minicom uses that when ENTER key is hit.
-		auto rx_count = uart_read_until(rx_string, sizeof(rx_string), '\r');
-
-		// Maybe some function, that receives rxbuffer and txbuffer, and returns
-		// some other txbuffer, which may be a subset of txbuffer or another, 
-		// e.g. formed from compile-time string? 
-
-		// Process received data
-		if((rx_count == 4) && (memcmp(rx_string, "time", 4) == 0))
-		{
-			// "time" command received. 
-			// Since there is only one command available, handle it right here
-
-			// Get RTC seconds, parse to string and write back
-			const auto seconds = hib_rtc_seconds();
-
-			// `to_digits_ascii` writes characters "from back" of the buffer
-			// and we would like to insert NewLine character to the end, so '-1'
-			const auto tx_string_end = (tx_string + sizeof(tx_string));
-			const auto tx_string_begin = to_digits_ascii(seconds, tx_string_end - 1);
-			assert(tx_string_begin >= tx_string);
-			*(tx_string_end - 1) = '\n';
-
-			// Write prepared string to UART
-			const auto tx_count = (tx_string_end - tx_string_begin);
-			uart_write(tx_string_begin, tx_count);
+		// Read command from UART until ENTER key is hit, with echo and editing
+		const auto rx_count = line_read(editor, CLI_COMMANDS);
+
+		// Words are slices of the edited line, the first one is the name
+		CommandSlice words[COMMAND_MAX_ARGS + 1];
+		const auto count = command_split(editor.text, rx_count, words, COMMAND_MAX_ARGS + 1);
+		if(!count) {
+			continue;
 		}
-		else {
-			uart_write("Invalid command\n");
+
+		// Whole response must not be interleaved with the logs
+		uart_lock();
+
+		CommandArgs args;
+		const auto command = command_find(CLI_COMMANDS, CLI_COMMANDS_TABLE, words[0]);
+		if(!command) {
+			cli_write("Invalid command\n");
+		} else if((count > (COMMAND_MAX_ARGS + 1)) || !command_parse_args(*command, words + 1, count - 1, args)) {
+			cli_write_usage(*command, false);
+		} else {
+			command->handler(args);
 		}
 
+		uart_unlock();
+
 		// Signal that we've finished handling command
 		leds_flash(GREEN_LED_PIN);
 	} 
 }
 
-static void cli_init()
+RTOS_MEMORY static RtosTask<CLI_STACK_SIZE> cli_task_memory;
+
+void cli_init()
 {
-	const auto stacksize = configMINIMAL_STACK_SIZE;
 	const auto params = nullptr;
 	const auto priority = (tskIDLE_PRIORITY + 1);
-	CHECK(xTaskCreate(cli_task, "cli", stacksize, params, priority, nullptr));
+	CHECK(cli_task_memory.create(cli_task, "cli", params, priority));
 }
\ No newline at end of file
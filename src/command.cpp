@@ -0,0 +1,263 @@
+///////////////////////////////////////////////////////////////////////////////
+// Commands of the CLI: tokens, arguments and lookup by perfect hash
+///////////////////////////////////////////////////////////////////////////////
+
+// Commands are declared in a constexpr table of names, argument schemas and
+// handlers (see cli.cpp). At compile time `command_table` searches for a
+// seed of the hash, which maps every name to its own slot of a power of two
+// table. Lookup is then hash of the first word, single slot and single
+// comparison of the name, no matter how many commands there are.
+//
+// Received line is split into words in place: they are slices (pointer and
+// size) of the RX buffer, nothing is copied.
+//
+// Schema of the arguments has one character per argument:
+// - `u` unsigned decimal number, parsed before the handler is called
+// - `s` any word
+// Upper case letters are optional arguments, they may only follow the
+// required ones.
+
+//
+// Helper constants
+//
+
+//! Maximal number of arguments of the command
+constexpr u8 COMMAND_MAX_ARGS = 4;
+
+//! Seeds tried by `command_table`, before the compilation fails
+constexpr u32 COMMAND_MAX_SEEDS = 1000;
+
+//
+// Public types
+//
+
+//! Part of the line, not terminated by '\0'
+struct CommandSlice
+{
+	const char* data;
+	u8 size;
+};
+
+//! Arguments of the command, checked against its schema
+struct CommandArgs
+{
+	CommandSlice words[COMMAND_MAX_ARGS];
+	u32 numbers[COMMAND_MAX_ARGS]; // Values of `u` arguments
+	u8 count; // Number of given arguments, including optional ones
+};
+
+//! Entry of the commands table
+struct Command
+{
+	const char* name;
+	const char* schema;
+	void (*handler)(const CommandArgs& args);
+	const char* help;
+	bool interactive; // Reads the UART itself (e.g. until any key), so it is not available over RPC
+};
+
+//! Perfect hash of the commands, `slot` holds index of the command + 1
+template<u32 N>
+struct CommandTable
+{
+	// At least twice as many slots as commands, so the seed is found quickly
+	static constexpr u32 SIZE = (N <= 4) ? 8 : (1u << (32 - __builtin_clz(2 * N - 1)));
+
+	u32 seed;
+	u8 slot[SIZE];
+};
+
+//
+// Private functions
+//
+
+//! Never defined, calling it in constant expression stops the compilation
+void command_error(const char* message);
+
+constexpr u32 command_size(const char* string)
+{
+	u32 size = 0;
+	while(string[size]) {
+		size++;
+	}
+	return size;
+}
+
+//! FNV-1a with seed, upper bits are mixed into the lower ones used by the table
+constexpr u32 command_hash(const char* data, u32 size, u32 seed)
+{
+	u32 hash = (2166136261u ^ seed);
+	for(u32 i = 0; i < size; ++i) {
+		hash = ((hash ^ (u8)(data[i])) * 16777619u);
+	}
+	return (hash ^ (hash >> 16));
+}
+
+constexpr bool command_equal(const char* a, const char* b)
+{
+	u32 i = 0;
+	while(a[i] && (a[i] == b[i])) {
+		i++;
+	}
+	return (a[i] == b[i]);
+}
+
+constexpr void command_check_schema(const char* schema)
+{
+	bool optional = false;
+	u32 count = 0;
+	for(; schema[count]; ++count) {
+		const char c = schema[count];
+		if((c == 'U') || (c == 'S')) {
+			optional = true;
+		} else if((c == 'u') || (c == 's')) {
+			if(optional) {
+				command_error("Required argument follows optional one in the schema");
+			}
+		} else {
+			command_error("Schema may contain only 'u', 's', 'U' and 'S'");
+		}
+	}
+
+	if(count > COMMAND_MAX_ARGS) {
+		command_error("Too many arguments in the schema");
+	}
+}
+
+static bool command_is_space(char c)
+{
+	return (c == ' ') || (c == '\t') || (c == '\n');
+}
+
+//! Parses unsigned decimal number, fails on other characters and overflow
+static bool command_parse_u32(CommandSlice word, u32& value)
+{
+	value = 0;
+	for(u8 i = 0; i < word.size; ++i) {
+		const u8 digit = (word.data[i] - '0');
+		if((digit > 9) || (value > ((UINT32_MAX - digit) / 10))) {
+			return false;
+		}
+		value = (value * 10) + digit;
+	}
+	return true;
+}
+
+//
+// Public functions
+//
+
+//! Builds perfect hash of the commands, evaluated at compile time
+// E.g. `constexpr auto table = command_table(commands);`
+template<u32 N>
+constexpr CommandTable<N> command_table(const Command (&commands)[N])
+{
+	static_assert(N < 255, "Too many commands for the table");
+	for(u32 i = 0; i < N; ++i) {
+		command_check_schema(commands[i].schema);
+		for(u32 j = 0; j < i; ++j) {
+			if(command_equal(commands[i].name, commands[j].name)) {
+				command_error("Command name is not unique");
+			}
+		}
+	}
+
+	CommandTable<N> table = {};
+	for(table.seed = 0; table.seed < COMMAND_MAX_SEEDS; ++table.seed) {
+		for(auto& slot : table.slot) {
+			slot = 0;
+		}
+
+		bool collision = false;
+		for(u32 i = 0; (i < N) && !collision; ++i) {
+			const auto name = commands[i].name;
+			auto& slot = table.slot[command_hash(name, command_size(name), table.seed) & (table.SIZE - 1)];
+			collision = (slot != 0);
+			slot = (i + 1);
+		}
+
+		if(!collision) {
+			return table;
+		}
+	}
+
+	command_error("No perfect hash found, increase COMMAND_MAX_SEEDS");
+	return table;
+}
+
+//! Splits the line into words separated by white space
+// Returns number of words, which may be greater than `capacity`
+u8 command_split(const char* line, u32 size, CommandSlice* words, u8 capacity)
+{
+	u8 count = 0;
+	u32 i = 0;
+	while(true) {
+		while((i < size) && command_is_space(line[i])) {
+			i++;
+		}
+		if(i == size) {
+			return count;
+		}
+
+		const auto begin = i;
+		while((i < size) && !command_is_space(line[i])) {
+			i++;
+		}
+		if(count < capacity) {
+			words[count] = { (line + begin), (u8)(i - begin) };
+		}
+		count++;
+	}
+}
+
+//! Finds command by its name, returns nullptr for unknown one
+template<u32 N>
+const Command* command_find(const Command (&commands)[N], const CommandTable<N>& table, CommandSlice name)
+{
+	const auto slot = table.slot[command_hash(name.data, name.size, table.seed) & (table.SIZE - 1)];
+	if(!slot) {
+		return nullptr;
+	}
+
+	// Name of the command is compared up to its end only
+	const auto& command = commands[slot - 1];
+	if((strncmp(command.name, name.data, name.size) != 0) || (command.name[name.size] != '\0')) {
+		return nullptr;
+	}
+	return &command;
+}
+
+//! Checks words following the name against the schema and parses numbers
+bool command_parse_args(const Command& command, const CommandSlice* words, u8 count, CommandArgs& args)
+{
+	const auto schema = command.schema;
+	if((count > strlen(schema)) || (count < strcspn(schema, "US"))) {
+		return false;
+	}
+
+	args.count = count;
+	for(u8 i = 0; i < count; ++i) {
+		args.words[i] = words[i];
+		args.numbers[i] = 0;
+		if(((schema[i] == 'u') || (schema[i] == 'U')) && !command_parse_u32(words[i], args.numbers[i])) {
+			return false;
+		}
+	}
+	return true;
+}
+
+//! Writes usage of the command, e.g. "top [<number>]", returns end of the text
+char* command_usage(const Command& command, char* begin, char* end)
+{
+	begin = format_to(begin, end, FORMAT("{}"), command.name);
+	for(auto kind = command.schema; *kind; ++kind) {
+		const bool optional = ((*kind == 'U') || (*kind == 'S'));
+		const auto name = ((*kind == 'u') || (*kind == 'U')) ? "<number>" : "<word>";
+		if(optional) {
+			begin = format_to(begin, end, FORMAT(" [{}]"), name);
+		} else {
+			begin = format_to(begin, end, FORMAT(" {}"), name);
+		}
+	}
+	return begin;
+}
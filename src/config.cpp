@@ -0,0 +1,516 @@
+///////////////////////////////////////////////////////////////////////////////
+// Configuration store in the flash
+///////////////////////////////////////////////////////////////////////////////
+
+// Settings (RTC trim, contrast of the display, timing of the gestures) are
+// kept in the last blocks of the flash, after the slots (see update.cpp and
+// the linker script), as a log of key/value records. Flash is programmed only
+// once after erase, so changed value is appended as a new record and the
+// latest record of the key wins. Nothing is overwritten in place.
+//
+// Block layout (32-bit words):
+// - header: CONFIG_MAGIC, sequence number of the block in the log and its
+//   complement, written right after erase
+// - records: key (8 bits), size of the value (8 bits), CRC-16 of the key,
+//   size and value, followed by the value padded by ones to whole words.
+//   Record of zero size deletes the key
+// The first erased word after the records ends the block.
+//
+// At start, the blocks are scanned in order of their sequence numbers and
+// address of the latest record of each key is kept in RAM, so the reading is
+// a lookup. The scan visits each word of the store once at most.
+//
+// Blocks are taken in circle, so each one is erased once per round, which
+// levels the wear. When less than CONFIG_COMPACT_FREE blocks stay erased,
+// the low-priority config task compacts the oldest block: its live records
+// are appended to the head of the log and the block is erased. Live values
+// take small part of the block, so each compaction frees more than it takes.
+// Writes compact on their own only when they would take the last erased
+// block, which is kept for the compaction.
+//
+// Power loss:
+// - Record counts only when its CRC matches. Broken record (power lost
+//   while it was programmed) closes its block, records after it are not read
+//   and new ones go to the next block. Write returns after its record is
+//   programmed and read back, so acknowledged values are never lost
+// - Block belongs to the log only with valid header. Header is programmed
+//   after erase, and the magic is cleared before the next erase, so half
+//   erased block is never read
+// - Compaction copies the records before the old block is erased, so power
+//   loss in between leaves both copies, of the same values
+//
+// NOTE: Flash operations stall the core (see flash.cpp), compaction erases
+// single block per step, while characters coming to the UART may be lost.
+
+//
+// Helper constants
+//
+
+//! Region of the store, after the slots of the firmware up to end of the flash
+constexpr u32 CONFIG_ADDRESS = UPDATE_SLOTS_END;
+constexpr u32 CONFIG_BLOCKS = ((FLASH_SIZE - CONFIG_ADDRESS) / FLASH_BLOCK_SIZE);
+static_assert(CONFIG_BLOCKS == 8, "Linker script keeps 8K for the configuration");
+
+//! Marks the header of the block ("CNFG")
+constexpr u32 CONFIG_MAGIC = 0x47464E43;
+
+//! Longest value of single key
+constexpr u32 CONFIG_VALUE_MAX = 16;
+
+//! Stack of the config task in words, compaction runs on it down to the flash
+//! writes. Provisional like the one of the CLI task (see cli.cpp)
+constexpr configSTACK_DEPTH_TYPE CONFIG_STACK_SIZE = 324;
+
+//! Background compaction starts, when less blocks are erased
+constexpr u32 CONFIG_COMPACT_FREE = 3;
+
+//! Blocks left to the compaction, never taken by writes
+constexpr u32 CONFIG_RESERVE_FREE = 1;
+
+//! Returned, when there is no block
+constexpr u8 CONFIG_BLOCK_NONE = 0xFF;
+
+//! Keys of the settings, stored in the flash, so never renumbered
+enum ConfigKey : u8
+{
+	CONFIG_RTC_TRIM,
+	CONFIG_CONTRAST,
+	CONFIG_LONG_PRESS,
+	CONFIG_DOUBLE_CLICK,
+	CONFIG_REPEAT,
+	CONFIG_KEYS
+};
+
+//! Names of the keys for the CLI
+constexpr const char* CONFIG_KEY_NAMES[CONFIG_KEYS] = {
+	"rtc_trim",
+	"contrast",
+	"long_press",
+	"double_click",
+	"repeat",
+};
+
+//
+// Private types
+//
+
+//! Header at the start of the block
+struct ConfigHeader
+{
+	u32 magic;
+	u32 sequence; // Order of the block in the log, starts at one
+	u32 check; // Complement of the sequence
+};
+
+//! Header word of the record, value follows
+struct ConfigRecord
+{
+	u8 key;
+	u8 size; // Size of the value, zero deletes the key
+	u16 crc; // CRC-16 of the key, size and value
+};
+
+static_assert(sizeof(ConfigRecord) == sizeof(u32));
+
+// Live records of all keys fit the block, besides its header
+static_assert((CONFIG_KEYS * (sizeof(ConfigRecord) + CONFIG_VALUE_MAX)) < (FLASH_BLOCK_SIZE / 2));
+
+//! State of the store in RAM
+struct ConfigStore
+{
+	u32 sequence[CONFIG_BLOCKS]; // Sequence of each block, zero when it is not in the log
+	u32 records[CONFIG_KEYS]; // Address of the latest record of each key, zero when it is not set
+	u8 head; // Block receiving the records
+	u32 cursor; // Address of the next record in the head block
+	u32 next_sequence;
+	u32 erases; // Blocks erased since start
+	u32 compactions;
+};
+
+//! Usage of the store
+struct ConfigStats
+{
+	u32 used; // Blocks in the log
+	u32 free; // Blocks out of the log, erased or waiting for it
+	u32 sequence; // Sequence of the head block
+	u32 erases;
+	u32 compactions;
+};
+
+//
+// Global variables
+//
+
+RTOS_MEMORY static RtosTask<CONFIG_STACK_SIZE> config_task_memory;
+static TaskHandle_t config_compactor;
+
+RTOS_MEMORY static RtosMutex config_mutex_memory;
+static SemaphoreHandle_t config_mutex;
+
+static ConfigStore config_store;
+
+//
+// Private functions
+//
+
+inline u32 config_block_address(u8 block)
+{
+	return (CONFIG_ADDRESS + block * FLASH_BLOCK_SIZE);
+}
+
+inline u8 config_block_of(u32 address)
+{
+	return (u8)((address - CONFIG_ADDRESS) / FLASH_BLOCK_SIZE);
+}
+
+inline u32 config_word(u32 address)
+{
+	u32 word;
+	memcpy(&word, flash_memory(address), sizeof(word));
+	return word;
+}
+
+//! Size of the record in the flash, value is padded to whole words
+constexpr u32 config_record_size(u32 size)
+{
+	return (sizeof(ConfigRecord) + ((size + 3) & ~3u));
+}
+
+static u16 config_record_crc(u8 key, u8 size, const void* value)
+{
+	const u8 fields[] = { key, size };
+	return crc16_update(crc16_update(CRC16_INIT, fields, sizeof(fields)), value, size);
+}
+
+//! Returns sequence of the block, zero when it has no valid header
+static u32 config_block_sequence(u8 block)
+{
+	ConfigHeader header;
+	memcpy(&header, flash_memory(config_block_address(block)), sizeof(header));
+	if((header.magic != CONFIG_MAGIC) || !header.sequence || (header.check != ~header.sequence)) {
+		return 0;
+	}
+	return header.sequence;
+}
+
+//! Whether the words from the address up to the end are erased
+static bool config_erased(u32 address, u32 end)
+{
+	for(; address < end; address += sizeof(u32)) {
+		if(config_word(address) != UINT32_MAX) {
+			return false;
+		}
+	}
+	return true;
+}
+
+//! Returns the block in the log with the lowest sequence above the given one
+static u8 config_block_after(u32 sequence)
+{
+	const auto& store = config_store;
+	u8 found = CONFIG_BLOCK_NONE;
+	for(u8 block = 0; block < CONFIG_BLOCKS; ++block) {
+		if((store.sequence[block] > sequence) &&
+			((found == CONFIG_BLOCK_NONE) || (store.sequence[block] < store.sequence[found]))) {
+			found = block;
+		}
+	}
+	return found;
+}
+
+static u32 config_free_blocks()
+{
+	u32 free = 0;
+	for(const auto sequence : config_store.sequence) {
+		free += !sequence;
+	}
+	return free;
+}
+
+//! Reads the records of the block into the index, returns address after
+//! the last one, or end of the block, when it is closed
+static u32 config_scan(u8 block)
+{
+	auto& store = config_store;
+	const auto end = (config_block_address(block) + FLASH_BLOCK_SIZE);
+	auto address = (config_block_address(block) + sizeof(ConfigHeader));
+	while((address < end) && (config_word(address) != UINT32_MAX)) {
+		ConfigRecord record;
+		memcpy(&record, flash_memory(address), sizeof(record));
+		if((record.size > CONFIG_VALUE_MAX) || ((address + config_record_size(record.size)) > end) ||
+			(record.crc != config_record_crc(record.key, record.size, flash_memory(address) + sizeof(record)))) {
+			return end;
+		}
+
+		// Keys unknown to this firmware are dropped by the compaction
+		if(record.key < CONFIG_KEYS) {
+			store.records[record.key] = (record.size ? address : 0);
+		}
+		address += config_record_size(record.size);
+	}
+
+	// Records are appended only where the rest of the block is erased
+	return config_erased(address, end) ? address : end;
+}
+
+static bool config_erase_block(u8 block)
+{
+	++config_store.erases;
+	return flash_erase(config_block_address(block));
+}
+
+//! Starts new head of the log in the next block out of the log
+static bool config_open()
+{
+	auto& store = config_store;
+	// The first head is block zero, as CONFIG_BLOCK_NONE + 1 wraps to it
+	for(u8 i = 0; i < CONFIG_BLOCKS; ++i) {
+		const u8 block = ((store.head + 1 + i) % CONFIG_BLOCKS);
+		if(store.sequence[block]) {
+			continue;
+		}
+
+		const auto address = config_block_address(block);
+		if(!config_erased(address, address + FLASH_BLOCK_SIZE) && !config_erase_block(block)) {
+			continue;
+		}
+		const ConfigHeader header = { CONFIG_MAGIC, store.next_sequence, ~store.next_sequence };
+		if(!flash_write(address, &header, sizeof(header))) {
+			continue;
+		}
+
+		store.sequence[block] = store.next_sequence++;
+		store.head = block;
+		store.cursor = (address + sizeof(header));
+		return true;
+	}
+	return false;
+}
+
+//! Programs the record to the head of the log, opens new block when needed
+static bool config_append(u8 key, const void* value, u8 size)
+{
+	auto& store = config_store;
+	u8 record[sizeof(ConfigRecord) + CONFIG_VALUE_MAX];
+	const ConfigRecord header = { key, size, config_record_crc(key, size, value) };
+	memcpy(record, &header, sizeof(header));
+	memcpy(record + sizeof(header), value, size);
+
+	// Failed record closes its block, the next one is tried once
+	const auto record_size = config_record_size(size);
+	for(u32 attempt = 0; attempt < 2; ++attempt) {
+		const auto end = (config_block_address(store.head) + FLASH_BLOCK_SIZE);
+		if((store.head == CONFIG_BLOCK_NONE) || ((store.cursor + record_size) > end)) {
+			if(!config_open()) {
+				return false;
+			}
+		}
+
+		const auto address = store.cursor;
+		const auto length = (sizeof(header) + size);
+		store.cursor += record_size;
+		if(flash_write(address, record, length) && !memcmp(flash_memory(address), record, length)) {
+			store.records[key] = (size ? address : 0);
+			return true;
+		}
+		store.cursor = (config_block_address(store.head) + FLASH_BLOCK_SIZE);
+	}
+	return false;
+}
+
+//! Whether the latest record of the key holds the value
+static bool config_current(u8 key, const void* value, u8 size)
+{
+	const auto address = config_store.records[key];
+	if(!address) {
+		return !size;
+	}
+
+	ConfigRecord record;
+	memcpy(&record, flash_memory(address), sizeof(record));
+	return (record.size == size) && !memcmp(flash_memory(address + sizeof(record)), value, size);
+}
+
+//! Moves live records of the oldest block to the head of the log and erases
+//! it, returns whether any block was freed
+static bool config_compact()
+{
+	auto& store = config_store;
+	const auto oldest = config_block_after(0);
+	if((oldest == CONFIG_BLOCK_NONE) || (oldest == store.head)) {
+		return false;
+	}
+
+	for(u8 key = 0; key < CONFIG_KEYS; ++key) {
+		const auto address = store.records[key];
+		if(!address || (config_block_of(address) != oldest)) {
+			continue;
+		}
+
+		// Copy is taken to RAM, flash cannot be read while it is programmed
+		ConfigRecord record;
+		u8 value[CONFIG_VALUE_MAX];
+		memcpy(&record, flash_memory(address), sizeof(record));
+		memcpy(value, flash_memory(address + sizeof(record)), record.size);
+		if(!config_append(key, value, record.size)) {
+			return false;
+		}
+	}
+
+	// Block is out of the log before the erase, so it is never read half erased
+	const u32 retired = 0;
+	flash_write(config_block_address(oldest), &retired, sizeof(retired));
+	store.sequence[oldest] = 0;
+	config_erase_block(oldest);
+	++store.compactions;
+	return true;
+}
+
+//! Store is used by the tasks, but also read by the drivers before the start
+//! of the scheduler
+static void config_lock()
+{
+	if(xTaskGetSchedulerState() != taskSCHEDULER_NOT_STARTED) {
+		CHECK(xSemaphoreTake(config_mutex, portMAX_DELAY));
+	}
+}
+
+static void config_unlock()
+{
+	if(xTaskGetSchedulerState() != taskSCHEDULER_NOT_STARTED) {
+		CHECK(xSemaphoreGive(config_mutex));
+	}
+}
+
+//! Compacts the store, when asked by the writes
+static void config_task([[maybe_unused]] void* params)
+{
+	while(true) {
+		ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+
+		config_lock();
+		while((config_free_blocks() < CONFIG_COMPACT_FREE) && config_compact());
+		config_unlock();
+	}
+}
+
+//
+// Public functions
+//
+
+//! Builds the index by the scan of the log, called before any other access
+void config_init()
+{
+	auto& store = config_store;
+	store = {};
+	store.head = CONFIG_BLOCK_NONE;
+	store.next_sequence = 1;
+	for(u8 block = 0; block < CONFIG_BLOCKS; ++block) {
+		store.sequence[block] = config_block_sequence(block);
+		store.next_sequence = max(store.next_sequence, (store.sequence[block] + 1));
+	}
+
+	// Newer records replace the older ones, the last block is the head
+	u32 sequence = 0;
+	for(auto block = config_block_after(0); block != CONFIG_BLOCK_NONE; block = config_block_after(sequence)) {
+		store.head = block;
+		store.cursor = config_scan(block);
+		sequence = store.sequence[block];
+	}
+
+	CHECK(config_mutex = config_mutex_memory.create());
+
+	const auto priority = tskIDLE_PRIORITY + 1;
+	CHECK(config_compactor = config_task_memory.create(config_task, "config", nullptr, priority));
+}
+
+//! Reads value of the key, returns its size, zero when the key is not set.
+//! Value longer than the buffer is truncated
+u8 config_get(ConfigKey key, void* value, u8 size)
+{
+	assert(key < CONFIG_KEYS);
+
+	config_lock();
+	const auto address = config_store.records[key];
+	if(address) {
+		ConfigRecord record;
+		memcpy(&record, flash_memory(address), sizeof(record));
+		size = min(size, record.size);
+		memcpy(value, flash_memory(address + sizeof(record)), size);
+	}
+	config_unlock();
+	return (address ? size : 0);
+}
+
+//! Returns number value of the key, or the fallback, when it is not set
+u32 config_get_u32(ConfigKey key, u32 fallback)
+{
+	u32 value;
+	return (config_get(key, &value, sizeof(value)) == sizeof(value)) ? value : fallback;
+}
+
+//! Appends new value of the key, returns whether it was programmed. Value
+//! equal to the current one is not written again, zero size deletes the key
+bool config_set(ConfigKey key, const void* value, u8 size)
+{
+	assert((key < CONFIG_KEYS) && (size <= CONFIG_VALUE_MAX));
+
+	config_lock();
+	auto& store = config_store;
+	bool done = true;
+	if(!config_current(key, value, size)) {
+		// Last erased block is left to the compaction, unless it cannot free any
+		const auto end = (config_block_address(store.head) + FLASH_BLOCK_SIZE);
+		if((store.head == CONFIG_BLOCK_NONE) || ((store.cursor + config_record_size(size)) > end)) {
+			while((config_free_blocks() <= CONFIG_RESERVE_FREE) && config_compact());
+		}
+		done = config_append(key, value, size);
+	}
+	const bool compact = (config_free_blocks() < CONFIG_COMPACT_FREE);
+	config_unlock();
+
+	if(compact) {
+		xTaskNotifyGive(config_compactor);
+	}
+	return done;
+}
+
+bool config_set_u32(ConfigKey key, u32 value)
+{
+	return config_set(key, &value, sizeof(value));
+}
+
+//! Deletes the key, so its default is used again
+bool config_delete(ConfigKey key)
+{
+	const u8 none = 0;
+	return config_set(key, &none, 0);
+}
+
+//! Finds the key by its name, which is not terminated
+bool config_find_key(const char* name, u32 size, ConfigKey& key)
+{
+	for(u8 i = 0; i < CONFIG_KEYS; ++i) {
+		if((strncmp(CONFIG_KEY_NAMES[i], name, size) == 0) && (CONFIG_KEY_NAMES[i][size] == '\0')) {
+			key = (ConfigKey)(i);
+			return true;
+		}
+	}
+	return false;
+}
+
+ConfigStats config_stats()
+{
+	config_lock();
+	const auto& store = config_store;
+	const auto free = config_free_blocks();
+	const ConfigStats stats = {
+		(CONFIG_BLOCKS - free),
+		free,
+		(store.head != CONFIG_BLOCK_NONE) ? store.sequence[store.head] : 0,
+		store.erases,
+		store.compactions,
+	};
+	config_unlock();
+	return stats;
+}
@@ -0,0 +1,177 @@
+///////////////////////////////////////////////////////////////////////////////
+// Crash dump capture
+///////////////////////////////////////////////////////////////////////////////
+
+// Fault handlers (see handlers.cpp) pass the stacked exception frame to
+// `crash_capture`, which records it together with fault status registers,
+// name of the running task and raw snapshot of the stack in `.noinit` RAM.
+// Then the microcontroller is reset. That section is not touched by startup
+// code, so the dump survives the reset and the CLI reports it on next boot.
+// After power-up the section holds garbage, so the dump is valid only with
+// CRASH_MAGIC and matching checksum.
+//
+// MemManage, Bus and Usage faults are enabled by `crash_init`, so they are
+// reported as they are instead of being escalated to HardFault.
+//
+// Host build (see host.cpp) has no fault handlers, so nothing is captured.
+
+//
+// Helper constants
+//
+
+//! Marks valid dump (ASCII "CRSH")
+constexpr u32 CRASH_MAGIC = 0x48535243;
+
+//! Maximal number of stack words in the dump
+constexpr u32 CRASH_STACK_WORDS = 32;
+
+//! Maximal number of addresses in the backtrace
+constexpr u32 CRASH_BACKTRACE_DEPTH = 8;
+
+//! Words of basic exception frame: r0-r3, r12, lr, pc and psr
+constexpr u32 CRASH_FRAME_WORDS = 8;
+
+//! Words of exception frame with floating point context
+constexpr u32 CRASH_FP_FRAME_WORDS = 26;
+
+//
+// Public types
+//
+
+//! Dump of the crash, kept over the reset
+struct CrashDump
+{
+	u32 magic; // CRASH_MAGIC, when the dump is valid
+	u32 exception; // Number of the fault exception (3 - HardFault ... 6 - UsageFault)
+	u32 exc_return; // EXC_RETURN value (LR) of the fault handler
+	u32 sp; // Stack pointer, where exception frame was stacked
+	u32 frame[CRASH_FRAME_WORDS]; // r0, r1, r2, r3, r12, lr, pc, psr
+	u32 cfsr; // Configurable Fault Status
+	u32 hfsr; // Hard Fault Status
+	u32 mmfar; // Memory Management Fault Address
+	u32 bfar; // Bus Fault Address
+	char task[configMAX_TASK_NAME_LEN]; // Name of the running task, empty in interrupts
+	u32 backtrace_depth; // Number of valid addresses in the backtrace
+	u32 backtrace[CRASH_BACKTRACE_DEPTH]; // Faulting PC followed by return addresses
+	u32 stack_words; // Number of valid words in the stack snapshot
+	u32 stack[CRASH_STACK_WORDS]; // Words from `sp` upwards
+	u32 checksum; // Checksum of all previous fields
+};
+
+//
+// Global variables
+//
+
+//! Dump of the last crash, not initialized at startup
+__attribute__((section(".noinit"))) static CrashDump crash_dump;
+
+//
+// Private functions
+//
+
+//! Computes checksum of the dump, excluding the checksum itself
+static u32 crash_checksum(const CrashDump& dump)
+{
+	const auto words = (const u32*)(&dump);
+	u32 checksum = CRASH_MAGIC;
+	for(u32 i = 0; i < (offsetof(CrashDump, checksum) / sizeof(u32)); ++i) {
+		checksum = ((checksum << 5) | (checksum >> 27)) ^ words[i];
+	}
+
+	return checksum;
+}
+
+//
+// Public functions
+//
+
+//! Enables dedicated fault exceptions
+void crash_init()
+{
+	SCB->SHCSR |= (SCB_SHCSR_MEMFAULTENA | SCB_SHCSR_BUSFAULTENA | SCB_SHCSR_USGFAULTENA);
+}
+
+#ifndef TARGET_HOST
+
+//! Records the crash and resets the microcontroller
+// Called by fault handlers with address of stacked exception frame
+// and values of r4-r11, which are not stacked by the exception entry
+extern "C" __attribute__((used))
+[[noreturn]] void crash_capture(const u32* frame, u32 exc_return, const u32* registers)
+{
+	u32 ipsr;
+	__asm volatile("MRS %0, IPSR" : "=r"(ipsr));
+
+	memset(&crash_dump, 0, sizeof(crash_dump));
+	crash_dump.exception = (ipsr & 0x1FF);
+	crash_dump.exc_return = exc_return;
+	crash_dump.sp = (u32)((uintptr_t)(frame));
+	crash_dump.cfsr = SCB->CFSR;
+	crash_dump.hfsr = SCB->HFSR;
+	crash_dump.mmfar = SCB->MMFAR;
+	crash_dump.bfar = SCB->BFAR;
+
+	// Frame might not be stacked at all (e.g. stack overflow), so do not
+	// read outside of SRAM, which would cause another fault
+	if(unwind_readable(crash_dump.sp, CRASH_FRAME_WORDS)) {
+		memcpy(crash_dump.frame, frame, sizeof(crash_dump.frame));
+
+		auto words = CRASH_STACK_WORDS;
+		while(!unwind_readable(crash_dump.sp, words)) {
+			words--;
+		}
+
+		memcpy(crash_dump.stack, frame, words * sizeof(u32));
+		crash_dump.stack_words = words;
+
+		// Unwind from the faulting instruction, with SP before the exception
+		UnwindState state = {};
+		memcpy(&state.r[4], registers, 8 * sizeof(u32));
+		const auto frame_words = (exc_return & 0x10) ? CRASH_FRAME_WORDS : CRASH_FP_FRAME_WORDS;
+		const auto aligned = (frame[7] & (1 << 9)) ? sizeof(u32) : 0;
+		state.r[UNWIND_SP] = crash_dump.sp + frame_words * sizeof(u32) + aligned;
+		state.r[UNWIND_LR] = frame[5];
+		state.r[UNWIND_PC] = (frame[6] | 1);
+		crash_dump.backtrace_depth = unwind_backtrace(state, crash_dump.backtrace, CRASH_BACKTRACE_DEPTH);
+	}
+
+	// Task was running only when exception was taken from process stack
+	if((exc_return & 0x4) && (xTaskGetSchedulerState() != taskSCHEDULER_NOT_STARTED)) {
+		strncpy(crash_dump.task, pcTaskGetName(nullptr), sizeof(crash_dump.task) - 1);
+	}
+
+	crash_dump.magic = CRASH_MAGIC;
+	crash_dump.checksum = crash_checksum(crash_dump);
+
+	scb_reset();
+}
+
+#endif
+
+//! Returns dump of the crash before last reset, or nullptr if there was none
+const CrashDump* crash_get()
+{
+	if((crash_dump.magic != CRASH_MAGIC) || (crash_dump.checksum != crash_checksum(crash_dump))) {
+		return nullptr;
+	}
+
+	return &crash_dump;
+}
+
+//! Forgets the dump, once it was reported
+void crash_clear()
+{
+	crash_dump.magic = 0;
+}
+
+//! Returns name of the fault exception
+const char* crash_exception_name(u32 exception)
+{
+	switch(exception) {
+		case 3: return "HardFault";
+		case 4: return "MemManage";
+		case 5: return "BusFault";
+		case 6: return "UsageFault";
+		default: return "Unknown";
+	}
+}
@@ -0,0 +1,225 @@
+///////////////////////////////////////////////////////////////////////////////
+// Cyclic redundancy checks
+///////////////////////////////////////////////////////////////////////////////
+
+// TM4C123 has no CRC engine (unlike TM4C129), so all of them are computed by
+// tables, which are generated at compile time and placed in flash:
+// - CRC-8/SMBUS (polynomial 0x07), one table lookup per byte
+// - CRC-16/CCITT-FALSE (polynomial 0x1021, initial 0xFFFF), one lookup per byte
+// - CRC-32 of Ethernet and zlib (reflected polynomial 0xEDB88320), slice-by-4:
+//   aligned words are loaded at once and four tables are looked up in
+//   parallel, so there is no dependency of the byte lookups on each other
+//
+// Each of them has incremental form for data coming in parts:
+//   auto crc = CRC32_INIT;
+//   crc = crc32_update(crc, part, part_size); ...
+//   crc32_final(crc)
+
+//
+// Helper constants
+//
+
+//! Initial values of the incremental forms
+constexpr u8 CRC8_INIT = 0x00;
+constexpr u16 CRC16_INIT = 0xFFFF;
+constexpr u32 CRC32_INIT = 0xFFFFFFFF;
+
+//! Polynomials, CRC-32 is reflected
+constexpr u8 CRC8_POLYNOMIAL = 0x07;
+constexpr u16 CRC16_POLYNOMIAL = 0x1021;
+constexpr u32 CRC32_POLYNOMIAL = 0xEDB88320;
+
+//! Lookup tables for single byte, and for the next three bytes of CRC-32
+template<typename T, u32 N>
+struct CrcTables
+{
+	T table[N][256];
+};
+
+constexpr CrcTables<u8, 1> crc8_tables()
+{
+	CrcTables<u8, 1> tables = {};
+	for(u32 byte = 0; byte < 256; ++byte) {
+		u8 crc = byte;
+		for(u8 bit = 0; bit < 8; ++bit) {
+			crc = (crc & 0x80) ? ((crc << 1) ^ CRC8_POLYNOMIAL) : (crc << 1);
+		}
+		tables.table[0][byte] = crc;
+	}
+	return tables;
+}
+
+constexpr CrcTables<u16, 1> crc16_tables()
+{
+	CrcTables<u16, 1> tables = {};
+	for(u32 byte = 0; byte < 256; ++byte) {
+		u16 crc = (byte << 8);
+		for(u8 bit = 0; bit < 8; ++bit) {
+			crc = (crc & 0x8000) ? ((crc << 1) ^ CRC16_POLYNOMIAL) : (crc << 1);
+		}
+		tables.table[0][byte] = crc;
+	}
+	return tables;
+}
+
+constexpr CrcTables<u32, 4> crc32_tables()
+{
+	CrcTables<u32, 4> tables = {};
+	for(u32 byte = 0; byte < 256; ++byte) {
+		u32 crc = byte;
+		for(u8 bit = 0; bit < 8; ++bit) {
+			crc = (crc & 1) ? ((crc >> 1) ^ CRC32_POLYNOMIAL) : (crc >> 1);
+		}
+		tables.table[0][byte] = crc;
+	}
+
+	// Table k is CRC of the byte followed by k zero bytes
+	for(u32 k = 1; k < 4; ++k) {
+		for(u32 byte = 0; byte < 256; ++byte) {
+			const auto previous = tables.table[k - 1][byte];
+			tables.table[k][byte] = ((previous >> 8) ^ tables.table[0][previous & 0xFF]);
+		}
+	}
+	return tables;
+}
+
+constexpr auto CRC8_TABLES = crc8_tables();
+constexpr auto CRC16_TABLES = crc16_tables();
+constexpr auto CRC32_TABLES = crc32_tables();
+
+// Tables start like the well-known ones
+static_assert(CRC8_TABLES.table[0][0x01] == 0x07);
+static_assert(CRC16_TABLES.table[0][0x01] == 0x1021);
+static_assert(CRC32_TABLES.table[0][0x01] == 0x77073096);
+
+//
+// Public functions
+//
+
+inline u8 crc8_update(u8 crc, const void* data, u32 size)
+{
+	const auto bytes = (const u8*)(data);
+	for(u32 i = 0; i < size; ++i) {
+		crc = CRC8_TABLES.table[0][crc ^ bytes[i]];
+	}
+	return crc;
+}
+
+inline u16 crc16_update(u16 crc, const void* data, u32 size)
+{
+	const auto bytes = (const u8*)(data);
+	for(u32 i = 0; i < size; ++i) {
+		crc = ((crc << 8) ^ CRC16_TABLES.table[0][(crc >> 8) ^ bytes[i]]);
+	}
+	return crc;
+}
+
+//! CRC-32 byte by byte, used for the unaligned ends by the slice-by-4
+inline u32 crc32_update_bytes(u32 crc, const u8* bytes, u32 size)
+{
+	const auto& table = CRC32_TABLES.table[0];
+	for(u32 i = 0; i < size; ++i) {
+		crc = ((crc >> 8) ^ table[(crc ^ bytes[i]) & 0xFF]);
+	}
+	return crc;
+}
+
+u32 crc32_update(u32 crc, const void* data, u32 size)
+{
+	auto bytes = (const u8*)(data);
+
+	// Bytes before the first aligned word
+	const u32 head = min<u32>(((0u - (uintptr_t)(bytes)) & 3), size);
+	crc = crc32_update_bytes(crc, bytes, head);
+	bytes += head;
+	size -= head;
+
+	// Little-endian word is xor'ed with CRC at once, like four single bytes
+	// (memcpy of aligned word is single load)
+	const auto& table = CRC32_TABLES.table;
+	for(; size >= 4; size -= 4, bytes += 4) {
+		u32 word;
+		memcpy(&word, bytes, sizeof(word));
+		word ^= crc;
+		crc = (table[3][word & 0xFF] ^ table[2][(word >> 8) & 0xFF] ^
+			table[1][(word >> 16) & 0xFF] ^ table[0][word >> 24]);
+	}
+
+	return crc32_update_bytes(crc, bytes, size);
+}
+
+inline u32 crc32_final(u32 crc)
+{
+	return ~crc;
+}
+
+//! CRC of the whole data at once
+inline u8 crc8(const void* data, u32 size)
+{
+	return crc8_update(CRC8_INIT, data, size);
+}
+
+inline u16 crc16(const void* data, u32 size)
+{
+	return crc16_update(CRC16_INIT, data, size);
+}
+
+inline u32 crc32(const void* data, u32 size)
+{
+	return crc32_final(crc32_update(CRC32_INIT, data, size));
+}
+
+//
+// Benchmark
+//
+
+//! Size of the data of the benchmark
+constexpr u32 CRC_BENCHMARK_SIZE = 1024;
+
+//! Throughput in bytes per 100 cycles
+struct Crc_Benchmark
+{
+	u32 crc8;
+	u32 crc16;
+	u32 crc32_bytes; // Without slicing, one table lookup per byte
+	u32 crc32; // Slice-by-4
+};
+
+//! Compares throughput of the CRCs over aligned data
+Crc_Benchmark crc_benchmark()
+{
+	constexpr u8 runs = 4;
+
+	// Words keep the data aligned, content does not matter
+	static u32 data[CRC_BENCHMARK_SIZE / sizeof(u32)];
+	for(u32 i = 0; i < (CRC_BENCHMARK_SIZE / sizeof(u32)); ++i) {
+		data[i] = (i * 2654435761u);
+	}
+
+	// We are taking minimum of all runs, so preemption does not disturb us
+	u32 cycles[4] = { UINT32_MAX, UINT32_MAX, UINT32_MAX, UINT32_MAX };
+	volatile u32 result;
+	for(u8 run = 0; run < runs; ++run) {
+		auto begin = dwt_cycles();
+		result = crc8(data, sizeof(data));
+		cycles[0] = min(cycles[0], dwt_cycles() - begin);
+
+		begin = dwt_cycles();
+		result = crc16(data, sizeof(data));
+		cycles[1] = min(cycles[1], dwt_cycles() - begin);
+
+		begin = dwt_cycles();
+		result = crc32_final(crc32_update_bytes(CRC32_INIT, (const u8*)(data), sizeof(data)));
+		cycles[2] = min(cycles[2], dwt_cycles() - begin);
+
+		begin = dwt_cycles();
+		result = crc32(data, sizeof(data));
+		cycles[3] = min(cycles[3], dwt_cycles() - begin);
+	}
+	static_cast<void>(result);
+
+	const auto throughput = [](u32 cycles) {
+		return (u32)(((u64)(CRC_BENCHMARK_SIZE) * 100) / max<u32>(cycles, 1));
+	};
+	return { throughput(cycles[0]), throughput(cycles[1]), throughput(cycles[2]), throughput(cycles[3]) };
+}
@@ -0,0 +1,273 @@
+///////////////////////////////////////////////////////////////////////////////
+// Conversion of numbers to ASCII digits
+///////////////////////////////////////////////////////////////////////////////
+
+// All conversions write forward into the span [begin, end) given by caller,
+// without any '\0', and return end of the written characters. Decimal
+// numbers are counted first, then written from back two digits per step,
+// taken from the table of pairs. Division by 100 is multiplication by its
+// reciprocal, so no `udiv` is needed (it takes up to 12 cycles on Cortex-M4).
+// 64-bit numbers are split into 8-digit chunks, so the library call doing
+// 64-bit division runs at most twice.
+
+//
+// Helper constants
+//
+
+//! Longest results of the conversions
+constexpr u8 DIGITS_U32_MAX = 10;
+constexpr u8 DIGITS_I32_MAX = 11;
+constexpr u8 DIGITS_U64_MAX = 20;
+constexpr u8 DIGITS_HEX_MAX = 8;
+
+//! Powers of ten fitting into u32
+constexpr u32 DIGITS_POWERS[DIGITS_U32_MAX] = {
+	1, 10, 100, 1000, 10000, 100000, 1000000, 10000000, 100000000, 1000000000,
+};
+
+//! All pairs of decimal digits, "00" to "99"
+constexpr char DIGITS_PAIRS[] =
+	"00010203040506070809"
+	"10111213141516171819"
+	"20212223242526272829"
+	"30313233343536373839"
+	"40414243444546474849"
+	"50515253545556575859"
+	"60616263646566676869"
+	"70717273747576777879"
+	"80818283848586878889"
+	"90919293949596979899";
+
+constexpr char DIGITS_HEX[] = "0123456789ABCDEF";
+
+//
+// Private functions
+//
+
+//! Divides by 100, valid for every u32
+// (2^37 / 100) rounded up, the error stays below 1/100 for 32-bit dividend
+inline u32 digits_div100(u32 value)
+{
+	return (u32)(((u64)(value) * 0x51EB851F) >> 37);
+}
+
+//! Writes decimal digits ending at `end`, returns their beginning
+static char* digits_write_back(char* end, u32 value)
+{
+	while(value >= 100) {
+		const auto quotient = digits_div100(value);
+		const auto pair = (value - quotient * 100);
+		value = quotient;
+
+		end -= 2;
+		memcpy(end, &DIGITS_PAIRS[pair * 2], 2);
+	}
+
+	if(value >= 10) {
+		end -= 2;
+		memcpy(end, &DIGITS_PAIRS[value * 2], 2);
+	} else {
+		*(--end) = ('0' + value);
+	}
+
+	return end;
+}
+
+//
+// Public functions
+//
+
+//! Returns number of decimal digits of the value
+inline u8 digits_count_u32(u32 value)
+{
+	// log10(2) ~ 1233/4096, so the guess is exact or one digit too low
+	// Zero has one digit, as well as one
+	value |= 1;
+	const u8 guess = (((32 - __builtin_clz(value)) * 1233) >> 12);
+	return (guess + 1) - (value < DIGITS_POWERS[guess]);
+}
+
+//! Writes decimal value, e.g. "1234"
+char* digits_u32(char* begin, char* end, u32 value)
+{
+	const auto count = digits_count_u32(value);
+	assert((begin + count) <= end);
+
+	digits_write_back(begin + count, value);
+	return (begin + count);
+}
+
+//! Writes decimal value with at least `width` characters, padded from left
+// With default padding it is like "%08u" of printf
+char* digits_u32_width(char* begin, char* end, u32 value, u8 width, char pad = '0')
+{
+	const auto count = max(digits_count_u32(value), width);
+	assert((begin + count) <= end);
+
+	const auto digits_begin = digits_write_back(begin + count, value);
+	memset(begin, pad, (digits_begin - begin));
+	return (begin + count);
+}
+
+//! Writes signed decimal value, e.g. "-1234"
+char* digits_i32(char* begin, char* end, i32 value)
+{
+	if(value < 0) {
+		assert(begin < end);
+		*(begin++) = '-';
+	}
+
+	// Negation in unsigned arithmetic, so INT32_MIN does not overflow
+	const u32 magnitude = (value < 0) ? (0u - (u32)(value)) : (u32)(value);
+	return digits_u32(begin, end, magnitude);
+}
+
+//! Writes 64-bit decimal value
+char* digits_u64(char* begin, char* end, u64 value)
+{
+	constexpr u32 chunk = DIGITS_POWERS[8];
+	if(value <= UINT32_MAX) {
+		return digits_u32(begin, end, (u32)(value));
+	}
+
+	// Up to 20 digits: leading part and one or two full chunks
+	const u64 upper = (value / chunk);
+	const u32 lower = (u32)(value - upper * chunk);
+	if(upper <= UINT32_MAX) {
+		begin = digits_u32(begin, end, (u32)(upper));
+	} else {
+		const u32 leading = (u32)(upper / chunk);
+		begin = digits_u32(begin, end, leading);
+		begin = digits_u32_width(begin, end, (u32)(upper - (u64)(leading) * chunk), 8);
+	}
+
+	return digits_u32_width(begin, end, lower, 8);
+}
+
+//! Writes hexadecimal value in upper case, without prefix, at least `width` digits
+char* digits_hex(char* begin, char* end, u32 value, u8 width = 1)
+{
+	const u8 significant = ((32 - __builtin_clz(value | 1) + 3) / 4);
+	const auto count = max(significant, width);
+	assert((begin + count) <= end);
+
+	for(auto digit = (begin + count); digit > begin; value >>= 4) {
+		*(--digit) = DIGITS_HEX[value & 0xF];
+	}
+
+	return (begin + count);
+}
+
+//! Writes unsigned fixed-point value with given number of decimal places,
+//! e.g. 12345 with 2 decimals is "123.45"
+char* digits_fixed(char* begin, char* end, u32 value, u8 decimals)
+{
+	assert(decimals < DIGITS_U32_MAX);
+	if(!decimals) {
+		return digits_u32(begin, end, value);
+	}
+
+	const auto scale = DIGITS_POWERS[decimals];
+	const auto integer = (value / scale);
+	begin = digits_u32(begin, end, integer);
+
+	assert(begin < end);
+	*(begin++) = '.';
+	return digits_u32_width(begin, end, (value - integer * scale), decimals);
+}
+
+//! Writes signed fixed-point value, e.g. -5 with 2 decimals is "-0.05"
+char* digits_fixed(char* begin, char* end, i32 value, u8 decimals)
+{
+	if(value < 0) {
+		assert(begin < end);
+		*(begin++) = '-';
+	}
+
+	const u32 magnitude = (value < 0) ? (0u - (u32)(value)) : (u32)(value);
+	return digits_fixed(begin, end, magnitude, decimals);
+}
+
+//
+// Benchmark
+//
+
+//! Previous conversion, one digit per `udiv`, written from back of the buffer
+// Kept only as the reference of the benchmark
+char* digits_reference_u32(u32 value, char* buffer_end)
+{
+	auto buffer = buffer_end;
+	do {
+		const auto tmp = (value / 10);
+		const u8 digit = (value - tmp*10);
+		value = tmp;
+
+		*(--buffer) = digit + '0';
+	}
+	while(value);
+
+	return buffer;
+}
+
+//! Values of all lengths, used by the benchmark
+constexpr u32 DIGITS_BENCHMARK_VALUES[] = {
+	7, 42, 613, 9021, 52417, 381904, 7261530, 48105297, 927364510, UINT32_MAX,
+};
+
+//! Average cycles of single conversion
+struct Digits_Benchmark
+{
+	u32 reference; // `digits_reference_u32`
+	u32 decimal; // `digits_u32`
+	u32 decimal64; // `digits_u64`, values multiplied by 10^9
+	u32 hex; // `digits_hex`
+};
+
+//! Keeps the compiler from removing conversion, which result is not used
+inline void digits_keep(const char* result)
+{
+	__asm volatile("" : : "r"(result) : "memory");
+}
+
+//! Compares cycles of conversions over values of all lengths
+Digits_Benchmark digits_benchmark()
+{
+	constexpr u8 runs = 8;
+	constexpr u32 count = (sizeof(DIGITS_BENCHMARK_VALUES) / sizeof(DIGITS_BENCHMARK_VALUES[0]));
+	char buffer[DIGITS_U64_MAX];
+	const auto buffer_end = (buffer + sizeof(buffer));
+
+	// We are taking minimum of all runs, so preemption does not disturb us
+	Digits_Benchmark result = { UINT32_MAX, UINT32_MAX, UINT32_MAX, UINT32_MAX };
+	for(u8 run = 0; run < runs; ++run) {
+		auto begin = dwt_cycles();
+		for(const auto value : DIGITS_BENCHMARK_VALUES) {
+			digits_keep(digits_reference_u32(value, buffer_end));
+		}
+		result.reference = min(result.reference, dwt_cycles() - begin);
+
+		begin = dwt_cycles();
+		for(const auto value : DIGITS_BENCHMARK_VALUES) {
+			digits_keep(digits_u32(buffer, buffer_end, value));
+		}
+		result.decimal = min(result.decimal, dwt_cycles() - begin);
+
+		begin = dwt_cycles();
+		for(const auto value : DIGITS_BENCHMARK_VALUES) {
+			digits_keep(digits_u64(buffer, buffer_end, (u64)(value) * DIGITS_POWERS[9]));
+		}
+		result.decimal64 = min(result.decimal64, dwt_cycles() - begin);
+
+		begin = dwt_cycles();
+		for(const auto value : DIGITS_BENCHMARK_VALUES) {
+			digits_keep(digits_hex(buffer, buffer_end, value));
+		}
+		result.hex = min(result.hex, dwt_cycles() - begin);
+	}
+
+	result.reference /= count;
+	result.decimal /= count;
+	result.decimal64 /= count;
+	result.hex /= count;
+	return result;
+}
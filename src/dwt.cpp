@@ -0,0 +1,60 @@
+///////////////////////////////////////////////////////////////////////////////
+// Data Watchpoint and Trace unit (cycle counter) management
+///////////////////////////////////////////////////////////////////////////////
+
+struct DWT_Block
+{
+	RW u32 CTRL; // Control
+	RW u32 CYCCNT; // Cycle Count
+	RW u32 CPICNT; // CPI Count
+	RW u32 EXCCNT; // Exception Overhead Count
+	RW u32 SLEEPCNT; // Sleep Count
+	RW u32 LSUCNT; // LSU Count
+	RW u32 FOLDCNT; // Folded-instruction Count
+	RO u32 PCSR; // Program Counter Sample
+};
+
+static_assert(offsetof(DWT_Block, CTRL) == 0x000);
+static_assert(offsetof(DWT_Block, CYCCNT) == 0x004);
+static_assert(offsetof(DWT_Block, CPICNT) == 0x008);
+static_assert(offsetof(DWT_Block, EXCCNT) == 0x00C);
+static_assert(offsetof(DWT_Block, SLEEPCNT) == 0x010);
+static_assert(offsetof(DWT_Block, LSUCNT) == 0x014);
+static_assert(offsetof(DWT_Block, FOLDCNT) == 0x018);
+static_assert(offsetof(DWT_Block, PCSR) == 0x01C);
+
+#define DWT HW_BLOCK(DWT_Block, 0xE0001000)
+
+//! Debug Exception and Monitor Control register
+#define DEMCR (*HW_BLOCK(u32, 0xE000EDFC))
+
+constexpr u32 DEMCR_TRCENA = (1 << 24); // Enables DWT and ITM units
+constexpr u32 DWT_CTRL_CYCCNTENA = (1 << 0); // Enables cycle counter
+
+//! Cycles of the simulated core, defined in host.cpp
+u32 host_cycles();
+
+//
+// Public functions
+//
+
+void dwt_init()
+{
+	// DWT unit is powered only if trace is enabled
+	DEMCR |= DEMCR_TRCENA;
+
+	// Start counting of CPU cycles
+	DWT->CYCCNT = 0;
+	DWT->CTRL |= DWT_CTRL_CYCCNTENA;
+}
+
+//! Returns number of CPU cycles since `dwt_init`, wraps around each 2^32
+inline u32 dwt_cycles()
+{
+#ifndef TARGET_HOST
+	return DWT->CYCCNT;
+#else
+	// Simulated register would not count by itself
+	return host_cycles();
+#endif
+}
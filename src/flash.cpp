@@ -0,0 +1,173 @@
+///////////////////////////////////////////////////////////////////////////////
+// Flash memory controller management
+///////////////////////////////////////////////////////////////////////////////
+
+// Flash of TM4C123 is erased by 1K blocks (to all ones) and programmed by
+// words, which can only clear the bits. Programming goes through the 32-word
+// write buffer: words of single 128-byte aligned row are stored in FWBn and
+// programmed by single WRBUF command, which is much faster than single word
+// writes by FMD, each with its own command.
+//
+// Flash cannot be read while it is erased or programmed, so the core stalls
+// on the next fetch from flash until the operation is done. Interrupts are
+// not served meanwhile (up to tens of milliseconds for erase), so callers
+// have to make sure nothing is coming, e.g. no characters to the UART.
+//
+// Host build simulates the controller and the flash (see host.cpp).
+
+struct FLASH_Block
+{
+	RW u32 FMA; // Flash Memory Address
+	RW u32 FMD; // Flash Memory Data
+	RW u32 FMC; // Flash Memory Control
+	RO u32 FCRIS; // Flash Controller Raw Interrupt Status
+	RW u32 FCIM; // Flash Controller Interrupt Mask
+	RW1C u32 FCMISC; // Flash Controller Masked Interrupt Status and Clear
+	RO u32 _reserved1[0x2];
+	RW u32 FMC2; // Flash Memory Control 2
+	RO u32 _reserved2[0x3];
+	RW u32 FWBVAL; // Flash Write Buffer Valid
+	RO u32 _reserved3[0x33];
+	RW u32 FWBn[32]; // Flash Write Buffer
+};
+
+static_assert(offsetof(FLASH_Block, FMA) == 0x000);
+static_assert(offsetof(FLASH_Block, FMD) == 0x004);
+static_assert(offsetof(FLASH_Block, FMC) == 0x008);
+static_assert(offsetof(FLASH_Block, FCRIS) == 0x00C);
+static_assert(offsetof(FLASH_Block, FCIM) == 0x010);
+static_assert(offsetof(FLASH_Block, FCMISC) == 0x014);
+static_assert(offsetof(FLASH_Block, FMC2) == 0x020);
+static_assert(offsetof(FLASH_Block, FWBVAL) == 0x030);
+static_assert(offsetof(FLASH_Block, FWBn) == 0x100);
+
+#define FLASH_CTRL HW_BLOCK(FLASH_Block, 0x400FD000)
+
+//! Boot Configuration register, tells the key of the commands
+#define FLASH_BOOTCFG (*HW_BLOCK(u32, 0x400FE1D0))
+
+//
+// Helper constants
+//
+
+//! Size of the whole flash
+constexpr u32 FLASH_SIZE = (256 * 1024);
+
+//! Erase unit
+constexpr u32 FLASH_BLOCK_SIZE = 1024;
+
+//! Row programmed at once by the write buffer
+constexpr u32 FLASH_WRITE_BUFFER_WORDS = 32;
+constexpr u32 FLASH_WRITE_BUFFER_SIZE = (FLASH_WRITE_BUFFER_WORDS * sizeof(u32));
+
+//! Commands of FMC and FMC2, written together with the key
+constexpr u32 FLASH_FMC_WRITE = (1 << 0); // Write FMD to FMA
+constexpr u32 FLASH_FMC_ERASE = (1 << 1); // Erase block at FMA
+constexpr u32 FLASH_FMC2_WRBUF = (1 << 0); // Write the buffer to the row at FMA
+constexpr u32 FLASH_FMC_WRKEY_S = 16;
+
+//! Key is 0xA442, when KEY bit of BOOTCFG is set (as it is after erase of
+//! the whole device), 0x71D5 otherwise
+constexpr u32 FLASH_BOOTCFG_KEY = (1 << 4);
+constexpr u32 FLASH_KEY_BOOTCFG = 0xA442;
+constexpr u32 FLASH_KEY_DEFAULT = 0x71D5;
+
+//! Failures of the operations in FCRIS, cleared by the same bits of FCMISC
+constexpr u32 FLASH_FCRIS_ARIS = (1 << 0); // Access to protected flash
+constexpr u32 FLASH_FCRIS_VOLTRIS = (1 << 9); // Pump voltage out of range
+constexpr u32 FLASH_FCRIS_INVDRIS = (1 << 10); // Bit programmed from 0 to 1
+constexpr u32 FLASH_FCRIS_ERRIS = (1 << 11); // Erase verify failed
+constexpr u32 FLASH_FCRIS_PROGRIS = (1 << 13); // Program verify failed
+constexpr u32 FLASH_FCRIS_ERRORS = (FLASH_FCRIS_ARIS | FLASH_FCRIS_VOLTRIS |
+	FLASH_FCRIS_INVDRIS | FLASH_FCRIS_ERRIS | FLASH_FCRIS_PROGRIS);
+
+//! Simulated flash, defined in host.cpp
+const u8* host_flash(u32 address);
+
+//! Keep operations of several tasks from interleaving, defined by the program
+//! (main.cpp suspends the scheduler, boot.cpp has nothing to keep out)
+void flash_lock();
+void flash_unlock();
+
+//
+// Private functions
+//
+
+static u32 flash_key()
+{
+	const auto key = (FLASH_BOOTCFG & FLASH_BOOTCFG_KEY) ? FLASH_KEY_BOOTCFG : FLASH_KEY_DEFAULT;
+	return (key << FLASH_FMC_WRKEY_S);
+}
+
+//! Waits until the command bit is cleared, returns whether it succeeded
+static bool flash_wait(volatile u32& control, u32 command)
+{
+	while(control & command);
+
+	const auto errors = (FLASH_CTRL->FCRIS & FLASH_FCRIS_ERRORS);
+	FLASH_CTRL->FCMISC = errors;
+	return !errors;
+}
+
+//
+// Public functions
+//
+
+//! Returns flash content at the address, for reading only
+inline const u8* flash_memory(u32 address)
+{
+#ifndef TARGET_HOST
+	return (const u8*)(address);
+#else
+	return host_flash(address);
+#endif
+}
+
+//! Erases the block containing the address
+bool flash_erase(u32 address)
+{
+	assert(address < FLASH_SIZE);
+
+	flash_lock();
+	FLASH_CTRL->FCMISC = FLASH_FCRIS_ERRORS;
+	FLASH_CTRL->FMA = (address & ~(FLASH_BLOCK_SIZE - 1));
+	FLASH_CTRL->FMC = (flash_key() | FLASH_FMC_ERASE);
+	const bool done = flash_wait(FLASH_CTRL->FMC, FLASH_FMC_ERASE);
+	flash_unlock();
+	return done;
+}
+
+//! Programs erased flash at word aligned address, row by row of the write
+//! buffer. Incomplete last word is padded by ones, so it stays erased
+bool flash_write(u32 address, const void* data, u32 size)
+{
+	assert(!(address & 3) && ((address + size) <= FLASH_SIZE));
+
+	auto bytes = (const u8*)(data);
+	while(size) {
+		const auto row = (address & ~(FLASH_WRITE_BUFFER_SIZE - 1));
+		const auto chunk = min<u32>(size, (row + FLASH_WRITE_BUFFER_SIZE - address));
+
+		// Only words written to FWBn are marked valid and programmed
+		flash_lock();
+		FLASH_CTRL->FCMISC = FLASH_FCRIS_ERRORS;
+		FLASH_CTRL->FMA = row;
+		for(u32 i = 0; i < chunk; i += sizeof(u32)) {
+			u32 word = UINT32_MAX;
+			memcpy(&word, bytes + i, min<u32>(sizeof(u32), (chunk - i)));
+			FLASH_CTRL->FWBn[((address - row) + i) / sizeof(u32)] = word;
+		}
+
+		FLASH_CTRL->FMC2 = (flash_key() | FLASH_FMC2_WRBUF);
+		const bool done = flash_wait(FLASH_CTRL->FMC2, FLASH_FMC2_WRBUF);
+		flash_unlock();
+		if(!done) {
+			return false;
+		}
+
+		address += chunk;
+		bytes += chunk;
+		size -= chunk;
+	}
+	return true;
+}
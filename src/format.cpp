@@ -0,0 +1,468 @@
+///////////////////////////////////////////////////////////////////////////////
+// Formatting of text, checked at compile time
+///////////////////////////////////////////////////////////////////////////////
+
+// Replacement of printf for the CLI, without heap, varargs and parsing of
+// the format at run time. `FORMAT("...")` gives every format string its own
+// type, so templates see the string as constant expression: it is split
+// into literal pieces and placeholders at compile time and arguments are
+// checked against the placeholders by static_assert. What remains at run
+// time are copies of the literals and the digits_* conversions.
+//
+// Placeholder syntax: {[-][0][width][.decimals][x]}
+// - `-` aligns to the left, otherwise values are aligned to the right
+// - `0` pads numbers with zeros instead of spaces
+// - `.N` prints integer as fixed-point value with N decimal places,
+//   e.g. "{.1}" of 123 is "12.3"
+// - `x` prints unsigned integer in upper case hexadecimal
+// Characters `{` and `}` are written as "{{" and "}}".
+//
+// Arguments may be integers, `char` (the character), `bool` and strings.
+// Output goes to bounded buffer (`format_to`), or through small buffer on
+// the stack to the write function, e.g. `format_write(uart_write, ...)`.
+
+//
+// Helper constants
+//
+
+//! Buffer on the stack of `format_write`, flushed when full
+constexpr u32 FORMAT_BUFFER_SIZE = 48;
+
+//! Maximal width of the placeholder, so every field fits the buffer
+constexpr u8 FORMAT_WIDTH_MAX = 24;
+
+//! Longest field of the number (64-bit decimal with sign), besides the width
+constexpr u8 FORMAT_NUMBER_MAX = (DIGITS_U64_MAX + 1);
+static_assert(max(FORMAT_WIDTH_MAX, FORMAT_NUMBER_MAX) <= FORMAT_BUFFER_SIZE);
+
+//
+// Format string parsing
+//
+
+//! Literal text of the format and placeholder following it, if any
+struct FormatPiece
+{
+	u16 begin; // Offset of the literal in the format
+	u16 size; // Size of the literal
+	bool argument; // Whether the placeholder follows the literal
+	bool left; // Aligned to the left
+	char pad; // ' ' or '0'
+	u8 width; // Minimal number of characters
+	bool fixed; // Fixed-point with `decimals` places
+	u8 decimals;
+	bool hex;
+};
+
+//! Never defined, calling it in constant expression stops the compilation
+// The compiler shows the call, so the message tells what is wrong
+void format_error(const char* message);
+
+//! Splits the format into pieces, when `pieces` is given
+// Returns number of pieces, so it is called first without them
+constexpr u32 format_parse(const char* text, FormatPiece* pieces)
+{
+	u32 count = 0;
+	u32 begin = 0;
+	u32 i = 0;
+	while(text[i]) {
+		const char c = text[i];
+		if(((c == '{') || (c == '}')) && (text[i + 1] == c)) {
+			// Escaped brace ends the literal, the second one is skipped
+			if(pieces) {
+				pieces[count] = { (u16)(begin), (u16)(i + 1 - begin), false, false, ' ', 0, false, 0, false };
+			}
+			count++;
+			i += 2;
+			begin = i;
+			continue;
+		}
+
+		if(c == '}') {
+			format_error("Unmatched '}' in the format, write it as \"}}\"");
+		}
+
+		if(c != '{') {
+			i++;
+			continue;
+		}
+
+		FormatPiece piece = { (u16)(begin), (u16)(i - begin), true, false, ' ', 0, false, 0, false };
+		i++;
+
+		if(text[i] == '-') {
+			piece.left = true;
+			i++;
+		}
+
+		if(text[i] == '0') {
+			piece.pad = '0';
+			i++;
+		}
+
+		while((text[i] >= '0') && (text[i] <= '9')) {
+			piece.width = (piece.width * 10) + (text[i++] - '0');
+			if(piece.width > FORMAT_WIDTH_MAX) {
+				format_error("Width of the placeholder is too large");
+			}
+		}
+
+		if(text[i] == '.') {
+			i++;
+			piece.fixed = true;
+			if((text[i] < '1') || (text[i] > '9') || ((text[i + 1] >= '0') && (text[i + 1] <= '9'))) {
+				format_error("Fixed-point placeholder needs 1 to 9 decimal places");
+			}
+			piece.decimals = (text[i++] - '0');
+		}
+
+		if(text[i] == 'x') {
+			piece.hex = true;
+			i++;
+		}
+
+		if(text[i] != '}') {
+			format_error("Invalid placeholder, expected {[-][0][width][.decimals][x]}");
+		}
+		i++;
+
+		if(piece.left && (piece.pad == '0')) {
+			format_error("Values aligned to the left can not be padded with zeros");
+		}
+		if(piece.fixed && piece.hex) {
+			format_error("Fixed-point value can not be hexadecimal");
+		}
+
+		if(pieces) {
+			pieces[count] = piece;
+		}
+		count++;
+		begin = i;
+	}
+
+	// The rest of the text, even if empty
+	if(pieces) {
+		pieces[count] = { (u16)(begin), (u16)(i - begin), false, false, ' ', 0, false, 0, false };
+	}
+	return (count + 1);
+}
+
+template<u32 N>
+struct FormatPieces
+{
+	FormatPiece piece[N];
+};
+
+template<typename Format, u32 N>
+constexpr FormatPieces<N> format_parse_pieces()
+{
+	FormatPieces<N> result = {};
+	format_parse(Format::text(), result.piece);
+	return result;
+}
+
+//! Pieces of the format, computed once for every format string
+template<typename Format>
+struct FormatParsed
+{
+	static constexpr u32 count = format_parse(Format::text(), nullptr);
+	static constexpr FormatPieces<count> pieces = format_parse_pieces<Format, count>();
+};
+
+//! Format string as constant expression, passed to `format_to` and `format_write`
+// Every use defines its own type, returning the string from constexpr function
+#define FORMAT(string) \
+	([] { \
+		struct FormatString \
+		{ \
+			static constexpr const char* text() { return string; } \
+		}; \
+		return FormatString{}; \
+	}())
+
+//
+// Output
+//
+
+//! Buffer being written, either bounded or flushed when full
+struct FormatOutput
+{
+	char* buffer;
+	char* cursor; // End of characters written so far
+	char* end;
+	void (*write)(const char* data, u32 size); // nullptr when bounded
+
+	//! Sends the buffer, if it can be flushed
+	void flush()
+	{
+		if(write && (cursor > buffer)) {
+			write(buffer, (cursor - buffer));
+			cursor = buffer;
+		}
+	}
+
+	//! Makes room for field of given size, when it can be flushed
+	// Bounded buffer is checked by writing of the field itself
+	char* reserve(u32 size)
+	{
+		if((u32)(end - cursor) < size) {
+			flush();
+		}
+		return cursor;
+	}
+
+	//! Appends characters of any size, in chunks fitting the buffer
+	void append(const char* data, u32 size)
+	{
+		while(size) {
+			reserve(1);
+			const auto chunk = min<u32>(size, (end - cursor));
+			assert(chunk > 0);
+			memcpy(cursor, data, chunk);
+			cursor += chunk;
+			data += chunk;
+			size -= chunk;
+		}
+	}
+
+	//! Appends the character repeated
+	void fill(char c, u32 count)
+	{
+		while(count) {
+			reserve(1);
+			const auto chunk = min<u32>(count, (end - cursor));
+			assert(chunk > 0);
+			memset(cursor, c, chunk);
+			cursor += chunk;
+			count -= chunk;
+		}
+	}
+};
+
+//
+// Arguments
+//
+
+//! Kinds of supported arguments
+enum FormatArgKind : u8
+{
+	FORMAT_ARG_UNSIGNED,
+	FORMAT_ARG_SIGNED,
+	FORMAT_ARG_CHAR,
+	FORMAT_ARG_BOOL,
+	FORMAT_ARG_STRING,
+};
+
+//! Describes how argument of given type is formatted
+// Types without specialization are not supported
+template<typename T>
+struct FormatArg
+{
+	static_assert(sizeof(T) == 0, "Type of the argument is not supported by the format");
+};
+
+template<typename T>
+struct FormatIntegerArg
+{
+	static constexpr FormatArgKind kind = ((T)(-1) < (T)(0)) ? FORMAT_ARG_SIGNED : FORMAT_ARG_UNSIGNED;
+	static constexpr bool wide = (sizeof(T) > sizeof(u32));
+};
+
+template<> struct FormatArg<unsigned char> : FormatIntegerArg<unsigned char> {};
+template<> struct FormatArg<unsigned short> : FormatIntegerArg<unsigned short> {};
+template<> struct FormatArg<unsigned int> : FormatIntegerArg<unsigned int> {};
+template<> struct FormatArg<unsigned long> : FormatIntegerArg<unsigned long> {};
+template<> struct FormatArg<unsigned long long> : FormatIntegerArg<unsigned long long> {};
+template<> struct FormatArg<signed char> : FormatIntegerArg<signed char> {};
+template<> struct FormatArg<short> : FormatIntegerArg<short> {};
+template<> struct FormatArg<int> : FormatIntegerArg<int> {};
+template<> struct FormatArg<long> : FormatIntegerArg<long> {};
+template<> struct FormatArg<long long> : FormatIntegerArg<long long> {};
+
+template<>
+struct FormatArg<char>
+{
+	static constexpr FormatArgKind kind = FORMAT_ARG_CHAR;
+	static constexpr bool wide = false;
+};
+
+template<>
+struct FormatArg<bool>
+{
+	static constexpr FormatArgKind kind = FORMAT_ARG_BOOL;
+	static constexpr bool wide = false;
+};
+
+template<>
+struct FormatArg<const char*>
+{
+	static constexpr FormatArgKind kind = FORMAT_ARG_STRING;
+	static constexpr bool wide = false;
+};
+
+template<>
+struct FormatArg<char*> : FormatArg<const char*> {};
+
+//! Aligns the field written at `field` to the width, in place
+template<u8 Width, char Pad, bool Left>
+inline void format_align(FormatOutput& output, char* field)
+{
+	const u32 size = (output.cursor - field);
+	if(size >= Width) {
+		return;
+	}
+
+	const u32 gap = (Width - size);
+	assert((field + Width) <= output.end);
+	if(Left) {
+		memset(output.cursor, ' ', gap);
+	} else if((Pad == '0') && (*field == '-')) {
+		// Zeros go between the sign and the digits
+		memmove(field + 1 + gap, field + 1, size - 1);
+		memset(field + 1, '0', gap);
+	} else {
+		memmove(field + gap, field, size);
+		memset(field, Pad, gap);
+	}
+	output.cursor += gap;
+}
+
+//! Writes number, character or bool argument, not aligned yet
+// Returns whether the field still needs alignment
+template<bool Left, char Pad, u8 Width, bool Fixed, u8 Decimals, bool Hex, typename T>
+bool format_field(FormatOutput& output, T value)
+{
+	using Arg = FormatArg<T>;
+	auto& cursor = output.cursor;
+	if constexpr(Arg::kind == FORMAT_ARG_CHAR) {
+		assert(cursor < output.end);
+		*(cursor++) = value;
+	} else if constexpr(Arg::kind == FORMAT_ARG_BOOL) {
+		const auto string = (value ? "true" : "false");
+		const u32 size = (value ? 4 : 5);
+		assert((cursor + size) <= output.end);
+		memcpy(cursor, string, size);
+		cursor += size;
+	} else if constexpr(Hex) {
+		// Hexadecimal value is padded with zeros, aligned to the left with spaces
+		constexpr u8 width = (Left ? 1 : max<u8>(Width, 1));
+		const auto upper = (u32)((u64)(value) >> 32);
+		if(upper) {
+			cursor = digits_hex(cursor, output.end, upper, (width > 8) ? (width - 8) : 1);
+			cursor = digits_hex(cursor, output.end, (u32)(value), 8);
+		} else {
+			cursor = digits_hex(cursor, output.end, (u32)(value), width);
+		}
+	} else if constexpr(Fixed && (Arg::kind == FORMAT_ARG_SIGNED)) {
+		cursor = digits_fixed(cursor, output.end, (i32)(value), Decimals);
+	} else if constexpr(Fixed) {
+		cursor = digits_fixed(cursor, output.end, (u32)(value), Decimals);
+	} else if constexpr((Arg::kind == FORMAT_ARG_UNSIGNED) && !Arg::wide && !Left) {
+		// The most common case is aligned by the conversion itself
+		cursor = digits_u32_width(cursor, output.end, value, Width, Pad);
+		return false;
+	} else if constexpr(Arg::kind == FORMAT_ARG_UNSIGNED) {
+		cursor = digits_u64(cursor, output.end, value);
+	} else {
+		if(value < 0) {
+			assert(cursor < output.end);
+			*(cursor++) = '-';
+		}
+
+		// Negation in unsigned arithmetic, so the minimum does not overflow
+		const u64 magnitude = (value < 0) ? (0u - (u64)(value)) : (u64)(value);
+		if(Arg::wide) {
+			cursor = digits_u64(cursor, output.end, magnitude);
+		} else {
+			cursor = digits_u32(cursor, output.end, (u32)(magnitude));
+		}
+	}
+
+	return true;
+}
+
+//! Writes single argument, as described by the placeholder
+template<bool Left, char Pad, u8 Width, bool Fixed, u8 Decimals, bool Hex, typename T>
+void format_argument(FormatOutput& output, T value)
+{
+	using Arg = FormatArg<T>;
+	constexpr bool integer = ((Arg::kind == FORMAT_ARG_UNSIGNED) || (Arg::kind == FORMAT_ARG_SIGNED));
+	static_assert(integer || ((Pad == ' ') && !Fixed && !Hex), "Only integers can be padded with zeros, fixed-point or hexadecimal");
+	static_assert(!Hex || (Arg::kind == FORMAT_ARG_UNSIGNED), "Hexadecimal value must be unsigned");
+	static_assert(!Hex || Left || (Width == 0) || (Pad == '0'), "Hexadecimal value can be padded only with zeros");
+	static_assert(!Fixed || !Arg::wide, "Fixed-point value must fit 32 bits");
+
+	if constexpr(Arg::kind == FORMAT_ARG_STRING) {
+		// Strings may be longer than the buffer, so they are not moved
+		const u32 size = strlen(value);
+		if(!Left && (size < Width)) {
+			output.fill(' ', Width - size);
+		}
+		output.append(value, size);
+		if(Left && (size < Width)) {
+			output.fill(' ', Width - size);
+		}
+	} else {
+		const auto field = output.reserve(max(Width, FORMAT_NUMBER_MAX));
+		if(format_field<Left, Pad, Width, Fixed, Decimals, Hex>(output, value)) {
+			format_align<Width, Pad, Left>(output, field);
+		}
+	}
+}
+
+//! Writes the pieces from I-th to the end, when all arguments are used
+template<typename Format, u32 I>
+void format_pieces(FormatOutput& output)
+{
+	using Parsed = FormatParsed<Format>;
+	if constexpr(I < Parsed::count) {
+		constexpr auto piece = Parsed::pieces.piece[I];
+		static_assert(!piece.argument, "Too few arguments for the format");
+		if constexpr(piece.size > 0) {
+			output.append(Format::text() + piece.begin, piece.size);
+		}
+		format_pieces<Format, I + 1>(output);
+	}
+}
+
+//! Writes the pieces from I-th to the end, `arg` belongs to the next placeholder
+template<typename Format, u32 I, typename Arg, typename... Args>
+void format_pieces(FormatOutput& output, Arg arg, Args... args)
+{
+	using Parsed = FormatParsed<Format>;
+	static_assert(I < Parsed::count, "Too many arguments for the format");
+	constexpr auto piece = Parsed::pieces.piece[I];
+	if constexpr(piece.size > 0) {
+		output.append(Format::text() + piece.begin, piece.size);
+	}
+
+	if constexpr(piece.argument) {
+		format_argument<piece.left, piece.pad, piece.width, piece.fixed, piece.decimals, piece.hex>(output, arg);
+		format_pieces<Format, I + 1>(output, args...);
+	} else {
+		format_pieces<Format, I + 1>(output, arg, args...);
+	}
+}
+
+//
+// Public functions
+//
+
+//! Writes formatted text to the buffer, returns end of the text
+// E.g. `format_to(line, line + sizeof(line), FORMAT("{} ms"), time)`
+template<typename Format, typename... Args>
+char* format_to(char* begin, char* end, Format, Args... args)
+{
+	FormatOutput output = { begin, begin, end, nullptr };
+	format_pieces<Format, 0>(output, args...);
+	return output.cursor;
+}
+
+//! Writes formatted text in chunks to the function, e.g. `uart_write`
+template<typename Format, typename... Args>
+void format_write(void (*write)(const char* data, u32 size), Format, Args... args)
+{
+	char buffer[FORMAT_BUFFER_SIZE];
+	FormatOutput output = { buffer, buffer, (buffer + sizeof(buffer)), write };
+	format_pieces<Format, 0>(output, args...);
+	output.flush();
+}
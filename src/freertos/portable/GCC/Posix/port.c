@@ -0,0 +1,475 @@
+/*
+ * FreeRTOS port for POSIX hosts (host build of the firmware, see host.cpp)
+ *
+ * Implementation of functions defined in portable.h for POSIX threads.
+ *
+ * Tasks are threads, which wait on their own event, until the scheduler
+ * selects them. Only the thread of the running task (pxRunningThread) is
+ * allowed to run, so the kernel data are never accessed concurrently.
+ *
+ * The interrupt context is a handler of SIGUSR1, sent to the running thread.
+ * It is the only place, where the context is switched: the thread selects
+ * the next task, wakes its thread and waits on its own event, still inside
+ * the handler. Once it is selected again, it returns from the handler and
+ * continues exactly where it was interrupted. Yield from the task just
+ * pends the switch and sends the signal to itself, like PendSV.
+ *
+ * Masking of the interrupts blocks the signal in the running thread. Other
+ * threads (tick, simulated peripherals) only set pending flags and send the
+ * signal, so it is delivered once the interrupts are enabled again.
+ *
+ * 1 tab == 4 spaces!
+ */
+
+#include <errno.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+/* Scheduler includes. */
+#include "FreeRTOS.h"
+#include "task.h"
+
+/* Signal used as the interrupt. */
+#define portINTERRUPT_SIGNAL				SIGUSR1
+
+/* Initial nesting of the critical sections, which keeps the interrupts
+disabled until the scheduler starts. */
+#define portINITIAL_CRITICAL_NESTING		( ( UBaseType_t ) 0xaaaaaaaa )
+
+/* Nanoseconds of single tick. */
+#define portTICK_PERIOD_NS					( 1000000000L / configTICK_RATE_HZ )
+
+/*-----------------------------------------------------------*/
+
+/* Binary event, which the thread waits for. */
+typedef struct xTHREAD_EVENT
+{
+	pthread_mutex_t xMutex;
+	pthread_cond_t xCond;
+	BaseType_t xSignalled;
+} ThreadEvent_t;
+
+/* Thread of the task, stored at the top of the task stack. */
+typedef struct xTHREAD
+{
+	pthread_t xThread;
+	ThreadEvent_t xEvent;
+	TaskFunction_t pxCode;
+	void *pvParameters;
+	volatile BaseType_t xDying;
+} Thread_t;
+
+/*-----------------------------------------------------------*/
+
+/* Each task maintains its own interrupt status in the critical nesting
+variable, which is common for all the tasks, since the context is never
+switched inside the critical section. */
+static volatile UBaseType_t uxCriticalNesting = portINITIAL_CRITICAL_NESTING;
+
+/* Thread, which is allowed to run. */
+static Thread_t *volatile pxRunningThread = NULL;
+
+/* Pending interrupt request, tick and context switch. */
+static volatile BaseType_t xInterruptPending = pdFALSE;
+static volatile BaseType_t xTickPending = pdFALSE;
+static volatile BaseType_t xSwitchPending = pdFALSE;
+
+/* Whether the thread is in the interrupt context. */
+static __thread BaseType_t xInsideInterrupt = pdFALSE;
+
+/* Set with the interrupt signal only. */
+static sigset_t xInterruptSignal;
+
+/*-----------------------------------------------------------*/
+
+/*
+ * Exception handlers, called from the interrupt context.
+ */
+void xPortPendSVHandler( void );
+void xPortSysTickHandler( void );
+void vPortSVCHandler( void );
+
+/*-----------------------------------------------------------*/
+
+__attribute__(( constructor )) static void prvSetupInterruptSignal( void )
+{
+	sigemptyset( &xInterruptSignal );
+	sigaddset( &xInterruptSignal, portINTERRUPT_SIGNAL );
+}
+/*-----------------------------------------------------------*/
+
+static void prvEventInit( ThreadEvent_t *pxEvent )
+{
+	pthread_mutex_init( &pxEvent->xMutex, NULL );
+	pthread_cond_init( &pxEvent->xCond, NULL );
+	pxEvent->xSignalled = pdFALSE;
+}
+/*-----------------------------------------------------------*/
+
+static void prvEventDestroy( ThreadEvent_t *pxEvent )
+{
+	pthread_cond_destroy( &pxEvent->xCond );
+	pthread_mutex_destroy( &pxEvent->xMutex );
+}
+/*-----------------------------------------------------------*/
+
+static void prvEventSignal( ThreadEvent_t *pxEvent )
+{
+	pthread_mutex_lock( &pxEvent->xMutex );
+	pxEvent->xSignalled = pdTRUE;
+	pthread_cond_signal( &pxEvent->xCond );
+	pthread_mutex_unlock( &pxEvent->xMutex );
+}
+/*-----------------------------------------------------------*/
+
+static void prvEventWait( ThreadEvent_t *pxEvent )
+{
+	pthread_mutex_lock( &pxEvent->xMutex );
+	while( pxEvent->xSignalled == pdFALSE )
+	{
+		pthread_cond_wait( &pxEvent->xCond, &pxEvent->xMutex );
+	}
+	pxEvent->xSignalled = pdFALSE;
+	pthread_mutex_unlock( &pxEvent->xMutex );
+}
+/*-----------------------------------------------------------*/
+
+static Thread_t *prvGetThreadFromTask( TaskHandle_t xTask )
+{
+	/* First member of the TCB is the top of the stack, which points to the
+	thread (see pxPortInitialiseStack). */
+	return ( Thread_t * ) *( StackType_t ** ) xTask;
+}
+/*-----------------------------------------------------------*/
+
+static BaseType_t prvIsPending( void )
+{
+	return ( __atomic_load_n( &xInterruptPending, __ATOMIC_SEQ_CST ) != pdFALSE ) ||
+		( __atomic_load_n( &xTickPending, __ATOMIC_SEQ_CST ) != pdFALSE ) ||
+		( __atomic_load_n( &xSwitchPending, __ATOMIC_SEQ_CST ) != pdFALSE );
+}
+/*-----------------------------------------------------------*/
+
+static void prvSignalRunningThread( void )
+{
+	Thread_t *pxThread = __atomic_load_n( &pxRunningThread, __ATOMIC_SEQ_CST );
+
+	/* When the switch is in progress, the next thread checks the flags
+	itself, once it is woken. */
+	if( pxThread != NULL )
+	{
+		pthread_kill( pxThread->xThread, portINTERRUPT_SIGNAL );
+	}
+}
+/*-----------------------------------------------------------*/
+
+static void prvResumeRunning( void )
+{
+	/* Interrupts requested while this thread was not running could be
+	signalled to the previous thread. */
+	if( prvIsPending() != pdFALSE )
+	{
+		pthread_kill( pthread_self(), portINTERRUPT_SIGNAL );
+	}
+}
+/*-----------------------------------------------------------*/
+
+static void prvInterruptHandler( int iSignal )
+{
+int iSavedErrno = errno;
+
+	( void ) iSignal;
+	xInsideInterrupt = pdTRUE;
+
+	for( ;; )
+	{
+		/* Peripherals and tick first, like the interrupts of the higher
+		priority than PendSV. */
+		do
+		{
+			__atomic_store_n( &xInterruptPending, pdFALSE, __ATOMIC_SEQ_CST );
+			vApplicationInterruptHook();
+
+			if( __atomic_exchange_n( &xTickPending, pdFALSE, __ATOMIC_SEQ_CST ) != pdFALSE )
+			{
+				xPortSysTickHandler();
+			}
+		} while( __atomic_load_n( &xInterruptPending, __ATOMIC_SEQ_CST ) != pdFALSE );
+
+		if( __atomic_exchange_n( &xSwitchPending, pdFALSE, __ATOMIC_SEQ_CST ) == pdFALSE )
+		{
+			break;
+		}
+
+		/* Returns, when this task is selected again. */
+		xPortPendSVHandler();
+	}
+
+	xInsideInterrupt = pdFALSE;
+	errno = iSavedErrno;
+}
+/*-----------------------------------------------------------*/
+
+static void *prvThreadEntry( void *pvParameters )
+{
+Thread_t *pxThread = ( Thread_t * ) pvParameters;
+
+	/* Wait for the first selection of the task. */
+	prvEventWait( &pxThread->xEvent );
+	if( pxThread->xDying != pdFALSE )
+	{
+		return NULL;
+	}
+
+	xInsideInterrupt = pdFALSE;
+	pthread_sigmask( SIG_UNBLOCK, &xInterruptSignal, NULL );
+	prvResumeRunning();
+
+	pxThread->pxCode( pxThread->pvParameters );
+
+	/* Tasks must not return. */
+	configASSERT( pdFALSE );
+	abort();
+}
+/*-----------------------------------------------------------*/
+
+static void *prvTickThread( void *pvParameters )
+{
+struct timespec xNext;
+
+	( void ) pvParameters;
+
+	clock_gettime( CLOCK_MONOTONIC, &xNext );
+	for( ;; )
+	{
+		xNext.tv_nsec += portTICK_PERIOD_NS;
+		if( xNext.tv_nsec >= 1000000000L )
+		{
+			xNext.tv_nsec -= 1000000000L;
+			xNext.tv_sec++;
+		}
+
+		while( clock_nanosleep( CLOCK_MONOTONIC, TIMER_ABSTIME, &xNext, NULL ) == EINTR );
+
+		__atomic_store_n( &xTickPending, pdTRUE, __ATOMIC_SEQ_CST );
+		prvSignalRunningThread();
+	}
+
+	return NULL;
+}
+/*-----------------------------------------------------------*/
+
+/*
+ * See header file for description.
+ */
+StackType_t *pxPortInitialiseStack( StackType_t *pxTopOfStack, TaskFunction_t pxCode, void *pvParameters )
+{
+Thread_t *pxThread;
+sigset_t xOldSignals;
+int iResult;
+
+	/* Thread is placed at the top of the stack, the stack itself is not
+	used, since the thread has its own one. */
+	pxThread = ( Thread_t * ) ( ( ( portPOINTER_SIZE_TYPE ) ( pxTopOfStack + 1 ) - sizeof( Thread_t ) ) & ~( ( portPOINTER_SIZE_TYPE ) 0xF ) );
+	pxThread->pxCode = pxCode;
+	pxThread->pvParameters = pvParameters;
+	pxThread->xDying = pdFALSE;
+	prvEventInit( &pxThread->xEvent );
+
+	/* Thread starts with the interrupt blocked, until it is selected. */
+	pthread_sigmask( SIG_BLOCK, &xInterruptSignal, &xOldSignals );
+	iResult = pthread_create( &pxThread->xThread, NULL, prvThreadEntry, pxThread );
+	configASSERT( iResult == 0 );
+	pthread_sigmask( SIG_SETMASK, &xOldSignals, NULL );
+
+	return ( StackType_t * ) pxThread;
+}
+/*-----------------------------------------------------------*/
+
+BaseType_t xPortStartScheduler( void )
+{
+struct sigaction xAction;
+pthread_t xTickThread;
+sigset_t xSignals;
+int iResult;
+
+	/* Interrupts are handled only by the threads of the tasks. */
+	pthread_sigmask( SIG_BLOCK, &xInterruptSignal, NULL );
+
+	memset( &xAction, 0, sizeof( xAction ) );
+	xAction.sa_handler = prvInterruptHandler;
+	sigemptyset( &xAction.sa_mask );
+	iResult = sigaction( portINTERRUPT_SIGNAL, &xAction, NULL );
+	configASSERT( iResult == 0 );
+
+	/* Start the timer that generates the tick interrupt. */
+	iResult = pthread_create( &xTickThread, NULL, prvTickThread, NULL );
+	configASSERT( iResult == 0 );
+
+	/* Initialise the critical nesting count ready for the first task. */
+	uxCriticalNesting = 0;
+
+	/* Start the first task. */
+	__atomic_store_n( &pxRunningThread, prvGetThreadFromTask( xTaskGetCurrentTaskHandle() ), __ATOMIC_SEQ_CST );
+	prvEventSignal( &pxRunningThread->xEvent );
+
+	/* Main thread only waits, vTaskEndScheduler is not supported. */
+	sigemptyset( &xSignals );
+	for( ;; )
+	{
+		sigsuspend( &xSignals );
+	}
+
+	/* Should not get here! */
+	return 0;
+}
+/*-----------------------------------------------------------*/
+
+void vPortEndScheduler( void )
+{
+	/* Not implemented in ports where there is nothing to return to.
+	Artificially force an assert. */
+	configASSERT( uxCriticalNesting == 1000UL );
+}
+/*-----------------------------------------------------------*/
+
+void vPortDisableInterrupts( void )
+{
+	pthread_sigmask( SIG_BLOCK, &xInterruptSignal, NULL );
+}
+/*-----------------------------------------------------------*/
+
+void vPortEnableInterrupts( void )
+{
+	/* Interrupt context must not be nested. */
+	if( xInsideInterrupt == pdFALSE )
+	{
+		pthread_sigmask( SIG_UNBLOCK, &xInterruptSignal, NULL );
+	}
+}
+/*-----------------------------------------------------------*/
+
+void vPortEnterCritical( void )
+{
+	portDISABLE_INTERRUPTS();
+	uxCriticalNesting++;
+}
+/*-----------------------------------------------------------*/
+
+void vPortExitCritical( void )
+{
+	configASSERT( uxCriticalNesting );
+	uxCriticalNesting--;
+	if( uxCriticalNesting == 0 )
+	{
+		portENABLE_INTERRUPTS();
+	}
+}
+/*-----------------------------------------------------------*/
+
+void vPortYield( void )
+{
+	/* Signal sent to itself is delivered before pthread_kill returns, unless
+	the interrupts are disabled - then once they are enabled. */
+	__atomic_store_n( &xSwitchPending, pdTRUE, __ATOMIC_SEQ_CST );
+	if( xInsideInterrupt == pdFALSE )
+	{
+		pthread_kill( pthread_self(), portINTERRUPT_SIGNAL );
+	}
+}
+/*-----------------------------------------------------------*/
+
+void vPortYieldFromISR( void )
+{
+	__atomic_store_n( &xSwitchPending, pdTRUE, __ATOMIC_SEQ_CST );
+}
+/*-----------------------------------------------------------*/
+
+void xPortPendSVHandler( void )
+{
+Thread_t *pxThread = prvGetThreadFromTask( xTaskGetCurrentTaskHandle() );
+Thread_t *pxNext;
+
+	vTaskSwitchContext();
+
+	pxNext = prvGetThreadFromTask( xTaskGetCurrentTaskHandle() );
+	if( pxNext == pxThread )
+	{
+		return;
+	}
+
+	__atomic_store_n( &pxRunningThread, pxNext, __ATOMIC_SEQ_CST );
+	prvEventSignal( &pxNext->xEvent );
+
+	/* Interrupts requested in the meantime are handled by the caller. */
+	prvEventWait( &pxThread->xEvent );
+	if( pxThread->xDying != pdFALSE )
+	{
+		pthread_exit( NULL );
+	}
+}
+/*-----------------------------------------------------------*/
+
+void xPortSysTickHandler( void )
+{
+	/* Increment the RTOS tick. */
+	if( xTaskIncrementTick() != pdFALSE )
+	{
+		/* A context switch is required. */
+		vPortYieldFromISR();
+	}
+}
+/*-----------------------------------------------------------*/
+
+void vPortSVCHandler( void )
+{
+	/* First task is started by xPortStartScheduler. */
+}
+/*-----------------------------------------------------------*/
+
+void vPortCancelThread( void *pxTaskToDelete )
+{
+Thread_t *pxThread = prvGetThreadFromTask( ( TaskHandle_t ) pxTaskToDelete );
+
+	/* Thread waits on its event (the running task cannot be deleted here),
+	so it is woken only to exit. */
+	pxThread->xDying = pdTRUE;
+	prvEventSignal( &pxThread->xEvent );
+	pthread_join( pxThread->xThread, NULL );
+	prvEventDestroy( &pxThread->xEvent );
+}
+/*-----------------------------------------------------------*/
+
+BaseType_t xPortIsInsideInterrupt( void )
+{
+	return xInsideInterrupt;
+}
+/*-----------------------------------------------------------*/
+
+void vPortRaiseInterrupt( void )
+{
+	/* Flag is set first, so it is seen either by the thread, which is
+	running now, or by the next one. */
+	__atomic_store_n( &xInterruptPending, pdTRUE, __ATOMIC_SEQ_CST );
+	prvSignalRunningThread();
+}
+/*-----------------------------------------------------------*/
+
+void vPortWaitForInterrupt( void )
+{
+sigset_t xOldSignals;
+
+	/* Pending interrupt ends the wait at once, including the one, which was
+	signalled to the previous thread. */
+	pthread_sigmask( SIG_BLOCK, &xInterruptSignal, &xOldSignals );
+	if( prvIsPending() == pdFALSE )
+	{
+		sigsuspend( &xOldSignals );
+	}
+	pthread_sigmask( SIG_SETMASK, &xOldSignals, NULL );
+	prvResumeRunning();
+}
+/*-----------------------------------------------------------*/
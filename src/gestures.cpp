@@ -0,0 +1,247 @@
+///////////////////////////////////////////////////////////////////////////////
+// Buttons gestures recognition
+///////////////////////////////////////////////////////////////////////////////
+
+// Gestures are recognized from debounced buttons state, sampled in constant
+// intervals (ticks). Every button has its own state machine, which in every
+// tick receives at most one input (press, release, timeout of current state
+// or beginning of the chord) and makes a single transition described by the
+// `gesture_transitions` table. Transition may generate typed event.
+// When all buttons become pressed at once, single chord event is generated
+// and the buttons are ignored until they are released.
+
+//
+// Public types
+//
+
+//! Type of recognized gesture
+enum class GestureType : u8
+{
+	None,
+	Press, // Button has been pressed
+	Release, // Button has been released
+	LongPress, // Button is held for long press interval
+	DoubleClick, // Button has been pressed again shortly after release
+	Repeat, // Button is still held after long press, generated periodically
+	Chord, // All buttons have been pressed together
+};
+
+//! Event describing recognized gesture
+struct GestureEvent
+{
+	GestureType type;
+	u8 pins; // Pins of buttons, which made the gesture
+	TickType_t timestamp; // Kernel ticks, when the gesture was recognized
+};
+
+//! Timing parameters of gestures
+struct GestureConfig
+{
+	u16 long_press_ms; // How long button must be held to make long press
+	u16 double_click_ms; // Maximal time between release and next press
+	u16 repeat_ms; // Period of auto-repeat events after long press
+};
+
+//
+// Private types
+//
+
+enum GestureState : u8
+{
+	GS_IDLE,
+	GS_PRESSED,
+	GS_HELD,
+	GS_WAIT_SECOND,
+	GS_SECOND_PRESSED,
+	GS_CHORD,
+	GS_COUNT
+};
+
+enum GestureInput : u8
+{
+	GI_NONE,
+	GI_PRESS,
+	GI_RELEASE,
+	GI_TIMEOUT,
+	GI_CHORD,
+	GI_COUNT
+};
+
+enum GestureTimeout : u8
+{
+	GT_NONE,
+	GT_LONG_PRESS,
+	GT_DOUBLE_CLICK,
+	GT_REPEAT,
+	GT_COUNT
+};
+
+struct GestureTransition
+{
+	GestureState next;
+	GestureType event;
+};
+
+struct GestureButton
+{
+	u8 pin;
+	GestureState state;
+	u16 timer; // Ticks left to timeout of current state
+};
+
+//
+// Transition tables
+//
+
+// Helper shorthands to keep the table readable
+#define TR(state, event) { GS_##state, GestureType::event }
+
+constexpr GestureTransition gesture_transitions[GS_COUNT][GI_COUNT] = {
+	//  NONE                             PRESS                            RELEASE                          TIMEOUT                          CHORD
+	/* IDLE */
+	{ TR(IDLE, None),                  TR(PRESSED, Press),              TR(IDLE, Release),               TR(IDLE, None),                  TR(CHORD, None) },
+	/* PRESSED */
+	{ TR(PRESSED, None),               TR(PRESSED, None),               TR(WAIT_SECOND, Release),        TR(HELD, LongPress),             TR(CHORD, None) },
+	/* HELD */
+	{ TR(HELD, None),                  TR(HELD, None),                  TR(IDLE, Release),               TR(HELD, Repeat),                TR(CHORD, None) },
+	/* WAIT_SECOND */
+	{ TR(WAIT_SECOND, None),           TR(SECOND_PRESSED, DoubleClick), TR(WAIT_SECOND, None),           TR(IDLE, None),                  TR(CHORD, None) },
+	/* SECOND_PRESSED */
+	{ TR(SECOND_PRESSED, None),        TR(SECOND_PRESSED, None),        TR(IDLE, Release),               TR(HELD, LongPress),             TR(CHORD, None) },
+	/* CHORD */
+	{ TR(CHORD, None),                 TR(CHORD, None),                 TR(IDLE, Release),               TR(CHORD, None),                 TR(CHORD, None) },
+};
+
+#undef TR
+
+//! Which timeout is running, when button is in given state
+constexpr GestureTimeout gesture_state_timeouts[GS_COUNT] = {
+	GT_NONE, // IDLE
+	GT_LONG_PRESS, // PRESSED
+	GT_REPEAT, // HELD
+	GT_DOUBLE_CLICK, // WAIT_SECOND
+	GT_LONG_PRESS, // SECOND_PRESSED
+	GT_NONE, // CHORD
+};
+
+//
+// Global variables
+//
+
+//! State machines of particular buttons
+static GestureButton gesture_buttons[] = {
+	{ BTN_LEFT_PIN, GS_IDLE, 0 },
+	{ BTN_RIGHT_PIN, GS_IDLE, 0 },
+};
+
+constexpr u8 GESTURE_BUTTONS_COUNT = (sizeof(gesture_buttons) / sizeof(gesture_buttons[0]));
+
+//! Maximal number of events, which may be generated in one step
+constexpr u8 GESTURE_MAX_EVENTS = (GESTURE_BUTTONS_COUNT + 1);
+
+//! Lengths of particular timeouts, in ticks
+static u16 gesture_timeout_ticks[GT_COUNT];
+
+//! Interval between consecutive steps, in milliseconds
+static u8 gesture_tick_ms;
+
+//
+// Private functions
+//
+
+static u16 gestures_ms_to_ticks(u16 ms)
+{
+	// Round up, so the timeout takes at least one tick
+	const auto ticks = ((ms + gesture_tick_ms - 1) / gesture_tick_ms);
+	return (ticks > 0) ? ticks : 1;
+}
+
+//
+// Public functions
+//
+
+//! Sets timing parameters of gestures
+// Should not be called concurrently with `gestures_step`
+void gestures_configure(const GestureConfig& config)
+{
+	gesture_timeout_ticks[GT_NONE] = 0;
+	gesture_timeout_ticks[GT_LONG_PRESS] = gestures_ms_to_ticks(config.long_press_ms);
+	gesture_timeout_ticks[GT_DOUBLE_CLICK] = gestures_ms_to_ticks(config.double_click_ms);
+	gesture_timeout_ticks[GT_REPEAT] = gestures_ms_to_ticks(config.repeat_ms);
+}
+
+//! Initializes gestures recognition, which will be stepped every `tick_ms`
+void gestures_init(u8 tick_ms)
+{
+	assert(tick_ms > 0);
+	gesture_tick_ms = tick_ms;
+
+	for(auto& button : gesture_buttons) {
+		button.state = GS_IDLE;
+		button.timer = 0;
+	}
+
+	// Default timings are comfortable for most users, unless configured
+	GestureConfig config;
+	config.long_press_ms = min<u32>(config_get_u32(CONFIG_LONG_PRESS, 800), UINT16_MAX);
+	config.double_click_ms = min<u32>(config_get_u32(CONFIG_DOUBLE_CLICK, 300), UINT16_MAX);
+	config.repeat_ms = min<u32>(config_get_u32(CONFIG_REPEAT, 200), UINT16_MAX);
+	gestures_configure(config);
+}
+
+//! Whether any of the buttons is in the middle of a gesture
+// When false, there is no need to call `gestures_step` until next button edge
+bool gestures_busy()
+{
+	for(const auto& button : gesture_buttons) {
+		if(button.state != GS_IDLE) {
+			return true;
+		}
+	}
+
+	return false;
+}
+
+//! Performs single step of recognition and stores generated events
+// Receives debounced pressed pins and pins which changed in this tick.
+// Returns number of stored events (at most GESTURE_MAX_EVENTS)
+u8 gestures_step(u8 pressed, u8 toggled, TickType_t timestamp, GestureEvent* events)
+{
+	assert(events != nullptr);
+	u8 count = 0;
+
+	// Chord starts, when all buttons became pressed in this tick
+	const u8 previous = (pressed ^ toggled);
+	const auto chord = (pressed == BTNS_PINS) && (previous != BTNS_PINS);
+	if(chord) {
+		events[count++] = { GestureType::Chord, BTNS_PINS, timestamp };
+	}
+
+	for(auto& button : gesture_buttons) {
+		// Determine input of the state machine. Only one per tick
+		auto input = GI_NONE;
+		if(chord) {
+			input = GI_CHORD;
+		} else if(toggled & button.pin) {
+			input = (pressed & button.pin) ? GI_PRESS : GI_RELEASE;
+		} else if(button.timer > 0 && --button.timer == 0) {
+			input = GI_TIMEOUT;
+		}
+
+		// Perform transition, ignoring ones which change nothing
+		const auto& transition = gesture_transitions[button.state][input];
+		if(transition.next == button.state && transition.event == GestureType::None) {
+			continue;
+		}
+
+		button.state = transition.next;
+		button.timer = gesture_timeout_ticks[gesture_state_timeouts[button.state]];
+
+		if(transition.event != GestureType::None) {
+			events[count++] = { transition.event, button.pin, timestamp };
+		}
+	}
+
+	assert(count <= GESTURE_MAX_EVENTS);
+	return count;
+}
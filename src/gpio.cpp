@@ -235,12 +235,12 @@ struct GPIO_Block
 };
 
 // Concrete ports definitions
-#define GPIOA ((volatile GPIO_Block*)(0x40058000))
-#define GPIOB ((volatile GPIO_Block*)(0x40059000))
-#define GPIOC ((volatile GPIO_Block*)(0x4005A000))
-#define GPIOD ((volatile GPIO_Block*)(0x4005B000))
-#define GPIOE ((volatile GPIO_Block*)(0x4005C000))
-#define GPIOF ((volatile GPIO_Block*)(0x4005D000))
+#define GPIOA HW_BLOCK(GPIO_Block, 0x40058000)
+#define GPIOB HW_BLOCK(GPIO_Block, 0x40059000)
+#define GPIOC HW_BLOCK(GPIO_Block, 0x4005A000)
+#define GPIOD HW_BLOCK(GPIO_Block, 0x4005B000)
+#define GPIOE HW_BLOCK(GPIO_Block, 0x4005C000)
+#define GPIOF HW_BLOCK(GPIO_Block, 0x4005D000)
 
 // Pin muxes
 constexpr u32 GPIO_PMUX_PA0_U0RX = (0x1 << 4*0);
@@ -270,14 +270,92 @@ constexpr u8 UART0_PINS = (U0RX_PIN | U0TX_PIN);
 constexpr u8 I2C0_PINS = (I2C0SCL_PIN | I2C0SDA_PIN);
 
 //
-// Global variables
+// Interrupts dispatching
 //
 
-//! Queue to store detected touched pins
-static QueueHandle_t gpio_queue = nullptr;
+// Every port has its own interrupt. The handlers of particular pins are
+// registered at compile-time in a table (see `gpio_make_handlers`), so the
+// port interrupt only has to walk through set bits of MIS register and call
+// handlers of touched pins. Pins without handler are masked, when touched.
 
-//! Handle to task, which is performing wait for pins interrupts
-static volatile TaskHandle_t gpio_wait_task = nullptr;
+//! Ports, which interrupts may be dispatched
+enum GPIO_Port : u8
+{
+	GPIO_PORTA,
+	GPIO_PORTB,
+	GPIO_PORTC,
+	GPIO_PORTD,
+	GPIO_PORTE,
+	GPIO_PORTF,
+	GPIO_PORTS_COUNT
+};
+
+constexpr u8 GPIO_PINS_COUNT = 8;
+
+//! Base addresses of ports blocks
+constexpr u32 gpio_port_addrs[GPIO_PORTS_COUNT] = {
+	0x40058000, 0x40059000, 0x4005A000, 0x4005B000, 0x4005C000, 0x4005D000,
+};
+
+//! Interrupts numbers of ports
+constexpr u32 gpio_port_ints[GPIO_PORTS_COUNT] = {
+	INT_GPIOA, INT_GPIOB, INT_GPIOC, INT_GPIOD, INT_GPIOE, INT_GPIOF,
+};
+
+//! Routine, which is called from interrupt when pin was touched
+// It receives touched pin (as a mask) and may request a context switch
+using GPIO_Handler = void(*)(u8 pin, BaseType_t* highpriotask_woken);
+
+//! Single registration of handler for pins of the port
+struct GPIO_Registration
+{
+	GPIO_Port port;
+	u8 pins;
+	GPIO_Handler handler;
+};
+
+//! Handlers of all pins of all ports, indexed by port and pin number
+struct GPIO_Handlers
+{
+	GPIO_Handler handlers[GPIO_PORTS_COUNT][GPIO_PINS_COUNT];
+};
+
+//! Helper to be called, when some pin is registered twice
+// Since it is not constexpr, the compilation of the table will fail
+void gpio_pin_already_registered();
+
+//! Builds (at compile-time) table of handlers from list of registrations
+template<u32 N>
+constexpr GPIO_Handlers gpio_make_handlers(const GPIO_Registration (&registrations)[N])
+{
+	GPIO_Handlers table = {};
+	for(const auto& registration : registrations) {
+		for(u8 pin = 0; pin < GPIO_PINS_COUNT; ++pin) {
+			if(registration.pins & (1 << pin)) {
+				auto& handler = table.handlers[registration.port][pin];
+				if(handler != nullptr) {
+					gpio_pin_already_registered();
+				}
+
+				handler = registration.handler;
+			}
+		}
+	}
+
+	return table;
+}
+
+//! Returns hardware block of specified port
+static volatile GPIO_Block* gpio_port(GPIO_Port port)
+{
+	assert(port < GPIO_PORTS_COUNT);
+	return HW_BLOCK(GPIO_Block, gpio_port_addrs[port]);
+}
+
+//! Bit-band alias of single pin bit in the register of the port
+// E.g. `GPIO_BITBAND(GPIO_PORTF, IM, PF4) = 1` atomically enables interrupt
+#define GPIO_BITBAND(port, reg, pin) \
+	bitband_ref(gpio_port_addrs[(port)] + offsetof(GPIO_Block, reg), bitband_bit(pin))
 
 //
 // Public functions
@@ -286,18 +364,6 @@ static volatile TaskHandle_t gpio_wait_task = nullptr;
 //! Initializes GPIO peripheral and used pins to work
 void gpio_init()
 {
-	//
-	// Software initialization
-	//
-
-	const auto gpio_queue_size = 8;
-	CHECK(gpio_queue = xQueueCreate(gpio_queue_size, sizeof(u8)));
-	gpio_wait_task = nullptr;
-
-	//
-	// Hardware initialization
-	//
-
 	// GPIOA->LOCK = GPIO_LOCK_KEY; Can be ommited since no pin is here locked
 	// GPIOA->CR = 0; Can be ommited since no pin here is locked
 	// GPIOA->LOCK = 0; Can be ommited since no pin here is locked
@@ -356,87 +422,113 @@ void gpio_init()
 	GPIOF->DEN = LEDS_PINS | BTNS_PINS;
 	GPIOF->AMSEL = 0;
 	GPIOF->IS = 0;
-	GPIOF->IBE = 0;
+	GPIOF->IBE = BTNS_PINS;
 	GPIOF->IEV = 0;
 	GPIOF->ICR = BTNS_PINS;
 	GPIOF->IM = 0;
 }
 
-//! Retrieves (in non-blocking way), which pins caused interrupt
-u8 gpio_get()
+//! Enables interrupts for specified pins of the port
+// Edges, which happened while interrupts were disabled, are forgotten
+void gpio_enable(GPIO_Port port, u8 pins)
 {
-	// Poll if there are any touched pins and return them
-	u8 touched_pins;
-	if(!xQueueReceive(gpio_queue, &touched_pins, 0)) {
-		// Empty queue after timeout -> None of the pin was touched
-		return 0x00;
-	}
+	// Clear stale interrupt causes. Write-1-to-clear is atomic itself
+	gpio_port(port)->ICR = pins;
 
-	return touched_pins;
+	// Enable interrupts for specified pins. Bit-banding makes it atomic, so
+	// we don't have to disable port interrupt for that time
+	const auto IM_addr = (gpio_port_addrs[port] + offsetof(GPIO_Block, IM));
+	bitband_write_mask(IM_addr, pins, 1);
 }
 
-//! Enables interrupts for specified pins
-void gpio_enable(u8 pins)
+//! Disables interrupts for specified pins of the port
+void gpio_disable(GPIO_Port port, u8 pins)
 {
-	NVIC_CRITICAL_SECTION_ENTER(INT_GPIOF);
-	{
-		// Enable interrupts for specified pins
-		GPIOF->IM |= pins;
-	}
-	NVIC_CRITICAL_SECTION_LEAVE(INT_GPIOF);
+	const auto IM_addr = (gpio_port_addrs[port] + offsetof(GPIO_Block, IM));
+	bitband_write_mask(IM_addr, pins, 0);
 }
 
-//! Enables interrupts for specified pins and waits for interrupt from any
-void gpio_wait(u8 pins)
+//! Cycles spent on enabling interrupt of single pin, using different methods
+struct GPIO_Benchmark
+{
+	u32 critical_section; // Read-modify-write with port interrupt disabled
+	u32 bitband; // Single store to bit-band alias
+};
+
+//! Compares cycles needed to atomically enable interrupt of single pin
+// Uses interrupt of RED LED pin, which is not used otherwise
+GPIO_Benchmark gpio_benchmark()
 {
-	NVIC_CRITICAL_SECTION_ENTER(INT_GPIOF);
-	{
-		// Remember task which is waiting
-		gpio_wait_task = xTaskGetCurrentTaskHandle();
+	constexpr u8 pin = RED_LED_PIN;
+	constexpr u8 runs = 8;
+
+	// Each measurement contains also reading of cycles counter, remove it
+	u32 overhead = UINT32_MAX;
+	for(u8 i = 0; i < runs; ++i) {
+		const auto begin = dwt_cycles();
+		const auto end = dwt_cycles();
+		overhead = min(overhead, end - begin);
+	}
+
+	// Pin is an output, but do not let stale edge fire in the middle
+	GPIOF->ICR = pin;
+
+	// We are taking minimum of all runs, so preemption does not disturb us
+	GPIO_Benchmark result = { UINT32_MAX, UINT32_MAX };
+	for(u8 i = 0; i < runs; ++i) {
+		const auto begin = dwt_cycles();
+		NVIC_CRITICAL_SECTION_ENTER(INT_GPIOF);
+		{
+			GPIOF->IM |= pin;
+		}
+		NVIC_CRITICAL_SECTION_LEAVE(INT_GPIOF);
+		const auto end = dwt_cycles();
+		result.critical_section = min(result.critical_section, end - begin - overhead);
 
-		// Enable interrupts for specified pins
-		GPIOF->IM |= pins;
+		GPIO_BITBAND(GPIO_PORTF, IM, pin) = 0;
 	}
-	NVIC_CRITICAL_SECTION_LEAVE(INT_GPIOF);
 
-	// Wait for pins to be touched
-	ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+	for(u8 i = 0; i < runs; ++i) {
+		const auto begin = dwt_cycles();
+		bitband<gpio_port_addrs[GPIO_PORTF] + offsetof(GPIO_Block, IM), pin>() = 1;
+		const auto end = dwt_cycles();
+		result.bitband = min(result.bitband, end - begin - overhead);
+
+		GPIO_BITBAND(GPIO_PORTF, IM, pin) = 0;
+	}
+
+	return result;
 }
 
-static void GPIOF_handler()
+//! Common part of all ports interrupt handlers
+// Calls handlers of touched pins, starting from the highest one
+static void gpio_dispatch(GPIO_Port port, const GPIO_Handler (&handlers)[GPIO_PINS_COUNT])
 {
 	auto highpriotask_woken = pdFALSE;
-	
-	// Interrupt should come from touched pins
-	const auto pins = GPIOF->MIS;
-	if(pins != 0x00) {
-		// Acknowledge interrupt cause
-		GPIOF->ICR = pins;
-
-		// Disable further interrupts for that pins
-		GPIOF->IM &= ~pins;
-
-		// If there is any task waiting for notification, wake it up
-		if(gpio_wait_task != nullptr) {
-			vTaskNotifyGiveFromISR(gpio_wait_task, &highpriotask_woken);
-			gpio_wait_task = nullptr;
+	const auto block = gpio_port(port);
+
+	// Interrupt should come from touched pins. Acknowledge them at once
+	u32 pins = block->MIS;
+	block->ICR = pins;
+
+	while(pins != 0x00) {
+		// Find highest touched pin with single CLZ instruction
+		const u32 pin = (31 - __builtin_clz(pins));
+		const u8 mask = (1 << pin);
+		pins &= ~mask;
+
+		const auto handler = handlers[pin];
+		if(handler != nullptr) {
+			handler(mask, &highpriotask_woken);
+		} else {
+			// Nobody is interested in that pin, do not let it fire again
+			GPIO_BITBAND(port, IM, mask) = 0;
 		}
-
-		// Send the touched pins to the queue.
-		// If writing to the queue unblocks a task, and the unblocked task has a
-		// priority above the currently running task (the task that this interrupt
-		// interrupted), then highpriotask_woken will be set to pdTRUE inside the
-		// xQueueSendFromISR() function. highpriotask_woken is then passed to
-		// portYIELD_FROM_ISR() at the end of this interrupt handler to request a
-		// context switch so the interrupt returns directly to the (higher priority)
-		// unblocked task.
-		xQueueSendFromISR(gpio_queue, &pins, &highpriotask_woken);
 	}
 
 	/* portYIELD_FROM_ISR() will request a context switch if executing this
 	interrupt handler caused a task to leave the blocked state, and the task
 	that left the blocked state has a higher priority than the currently running
-	task (the task this interrupt interrupted).  See the comment above the calls
-	to xSemaphoreGiveFromISR() and xQueueSendFromISR() within this function. */
+	task (the task this interrupt interrupted). */
 	portYIELD_FROM_ISR(highpriotask_woken);
 }
@@ -19,64 +19,80 @@ static void NMI_handler()
     while(1);
 }
 
-extern "C" __attribute__((used)) 
-[[noreturn]] void get_registers_from_stack(const u32* fault_stack)
-{
-    const auto r0 = fault_stack[0]; static_cast<void>(r0);
-    const auto r1 = fault_stack[1]; static_cast<void>(r1); 
-    const auto r2 = fault_stack[2]; static_cast<void>(r2);
-    const auto r3 = fault_stack[3]; static_cast<void>(r3);
+//! Defines fault handler, which passes stacked exception frame, EXC_RETURN
+// and r4-r11 to `crash_capture` (see crash.cpp). Frame is on process stack,
+// when fault happened in a task, or on main stack otherwise
+#ifndef TARGET_HOST
+#define FAULT_HANDLER(name) \
+    static void __attribute__((naked)) name() \
+    { \
+        __asm volatile \
+        ( \
+            " tst lr, #4                                                \n" \
+            " ite eq                                                    \n" \
+            " mrseq r0, msp                                             \n" \
+            " mrsne r0, psp                                             \n" \
+            " mov r1, lr                                                \n" \
+            " push {r4-r11}                                             \n" \
+            " mov r2, sp                                                \n" \
+            " b crash_capture                                           \n" \
+        ); \
+    }
+#else
+// Faults of the host build are signals of the process, never dispatched here
+#define FAULT_HANDLER(name) \
+    static void name() \
+    { \
+        while(true); \
+    }
+#endif
 
-    const auto r12 = fault_stack[4]; static_cast<void>(r12);
-    const auto lr = fault_stack[5]; static_cast<void>(lr);
-    const auto pc = fault_stack[6]; static_cast<void>(pc);
-    const auto psr = fault_stack[7]; static_cast<void>(psr);
+FAULT_HANDLER(HARDFAULT_handler)
+FAULT_HANDLER(MEMMANAGEFAULT_handler)
+FAULT_HANDLER(BUSFAULT_handler)
+FAULT_HANDLER(USAGEFAULT_handler)
 
-    /* When the following line is hit, the variables contain the register values. */
-    while(true);
+static void DUMMY_handler() 
+{ 
+    while(true); 
 }
 
-static void __attribute__((naked)) HARDFAULT_handler()
-{
-    __asm volatile
-    (
-        " tst lr, #4                                                \n"
-        " ite eq                                                    \n"
-        " mrseq r0, msp                                             \n"
-        " mrsne r0, psp                                             \n"
-        " ldr r1, [r0, #24]                                         \n"
-        " ldr r2, handler2_address_const                            \n"
-        " bx r2                                                     \n"
-        " handler2_address_const: .word get_registers_from_stack    \n"
-    );
-}
+//
+// GPIO pins handlers
+//
 
-static void MEMMANAGEFAULT_handler()
-{
-    while(1);
-}
+// Handlers of GPIO pins interrupts. Only one handler per pin is allowed
+constexpr GPIO_Registration gpio_registrations[] = {
+    { GPIO_PORTF, BTNS_PINS, buttons_touched },
+};
 
-static void BUSFAULT_handler()
-{
-    while(1);
-}
+constexpr auto gpio_handlers = gpio_make_handlers(gpio_registrations);
 
-static void USAGEFAULT_handler()
-{
-    while(1);
-}
+static void GPIOA_handler() { gpio_dispatch(GPIO_PORTA, gpio_handlers.handlers[GPIO_PORTA]); }
+static void GPIOB_handler() { gpio_dispatch(GPIO_PORTB, gpio_handlers.handlers[GPIO_PORTB]); }
+static void GPIOC_handler() { gpio_dispatch(GPIO_PORTC, gpio_handlers.handlers[GPIO_PORTC]); }
+static void GPIOD_handler() { gpio_dispatch(GPIO_PORTD, gpio_handlers.handlers[GPIO_PORTD]); }
+static void GPIOE_handler() { gpio_dispatch(GPIO_PORTE, gpio_handlers.handlers[GPIO_PORTE]); }
 
-static void DUMMY_handler() 
-{ 
-    while(true); 
+// Buttons edges only start the debouncing timer, no task is woken directly
+static void GPIOF_handler()
+{
+    latency_isr_entry(LATENCY_GPIOF);
+    gpio_dispatch(GPIO_PORTF, gpio_handlers.handlers[GPIO_PORTF]);
+    latency_isr_exit(LATENCY_GPIOF, false);
 }
 
 // Helper typedef for interrupt handlers function
 using Handler = void(*)();
 
 // Vector table for interrupt handlers
+// Host build has no reset, but it dispatches interrupts from it (see host.cpp)
 __attribute__((section(".vectors"), used)) Handler __isr_vectors[] = {
+#ifndef TARGET_HOST
     RESET_handler,
+#else
+    nullptr,
+#endif
     NMI_handler, // NMI
     HARDFAULT_handler,
     MEMMANAGEFAULT_handler, // MEMMANAGE
@@ -91,11 +107,11 @@ __attribute__((section(".vectors"), used)) Handler __isr_vectors[] = {
     DUMMY_handler,
     xPortPendSVHandler, // PENDSV
     xPortSysTickHandler,
-    DUMMY_handler, // GPIO Port A
-    DUMMY_handler, // GPIO Port B
-    DUMMY_handler, // GPIO Port C
-    DUMMY_handler, // GPIO Port D
-    DUMMY_handler, // GPIO Port E
+    GPIOA_handler, // GPIO Port A
+    GPIOB_handler, // GPIO Port B
+    GPIOC_handler, // GPIO Port C
+    GPIOD_handler, // GPIO Port D
+    GPIOE_handler, // GPIO Port E
     UART0_handler, // UART0
     DUMMY_handler, // UART1
     DUMMY_handler, // SSI0
@@ -110,7 +126,7 @@ __attribute__((section(".vectors"), used)) Handler __isr_vectors[] = {
     DUMMY_handler, // ADC0 Sequence 2
     DUMMY_handler, // ADC0 Sequence 3
     DUMMY_handler, // Watchdog Timers 0 and 1
-    DUMMY_handler, // 16/32-Bit Timer 0A
+    TIMER0A_handler, // 16/32-Bit Timer 0A
     DUMMY_handler, // 16/32-Bit Timer 0B
     DUMMY_handler, // 16/32-Bit Timer 1A
     DUMMY_handler, // 16/32-Bit Timer 1B
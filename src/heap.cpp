@@ -0,0 +1,451 @@
+///////////////////////////////////////////////////////////////////////////////
+// Kernel heap (Two-Level Segregated Fit allocator)
+///////////////////////////////////////////////////////////////////////////////
+
+// Implementation of FreeRTOS `pvPortMalloc` and `vPortFree`, replacing heap_1.
+// Free blocks are kept in lists segregated by size into classes of two levels:
+// first level is power of two, second level splits it linearly into
+// HEAP_SL_COUNT ranges. Bitmaps of non-empty lists let us find suitable block
+// with a few bit scans, so both allocation and freeing take constant time.
+// Freed blocks are immediately merged with their free physical neighbours.
+//
+// Every block starts with header containing physically previous block and
+// size of the whole block (with header). Lowest bit of the size marks free
+// block. Free blocks additionally store links of their free list in payload.
+// Heap ends with zero-sized used sentinel, so there is no need to check bounds.
+
+//
+// Helper heap constants
+//
+
+constexpr size_t HEAP_ALIGN = portBYTE_ALIGNMENT;
+constexpr u8 HEAP_ALIGN_LOG2 = __builtin_ctz(HEAP_ALIGN);
+
+//! Second level - number of lists per power of two
+constexpr u8 HEAP_SL_LOG2 = 3;
+constexpr u8 HEAP_SL_COUNT = (1 << HEAP_SL_LOG2);
+
+//! First level - blocks smaller than HEAP_SMALL_BLOCK share first class
+constexpr u8 HEAP_FL_SHIFT = (HEAP_SL_LOG2 + HEAP_ALIGN_LOG2);
+constexpr size_t HEAP_SMALL_BLOCK = (1 << HEAP_FL_SHIFT);
+constexpr u8 HEAP_FL_MAX = 16; // Blocks up to 64 KiB
+constexpr u8 HEAP_FL_COUNT = (HEAP_FL_MAX - HEAP_FL_SHIFT + 1);
+
+// Rounding of requested size up to the next class may reach next power of two
+static_assert(configTOTAL_HEAP_SIZE <= (1 << (HEAP_FL_MAX - 1)), "Heap is too big for first level classes");
+static_assert((HEAP_ALIGN & (HEAP_ALIGN - 1)) == 0);
+
+constexpr size_t HEAP_BLOCK_FREE = (1 << 0);
+constexpr size_t HEAP_BLOCK_FLAGS = (HEAP_BLOCK_FREE);
+
+//
+// Private types
+//
+
+struct HeapBlock
+{
+	HeapBlock* prev_phys; // Physically previous block, nullptr for the first one
+	size_t size; // Size of the whole block (with header) and flags
+
+	// Valid only in free blocks, overlaps with payload of used ones
+	HeapBlock* next_free;
+	HeapBlock* prev_free;
+};
+
+constexpr size_t HEAP_HEADER_SIZE = offsetof(HeapBlock, next_free);
+constexpr size_t HEAP_MIN_BLOCK = sizeof(HeapBlock);
+
+static_assert((HEAP_HEADER_SIZE % HEAP_ALIGN) == 0, "Payload must stay aligned");
+static_assert((HEAP_MIN_BLOCK % HEAP_ALIGN) == 0);
+
+//
+// Public types
+//
+
+//! Snapshot of heap usage
+struct HeapStats
+{
+	size_t capacity; // Bytes available for blocks (with their headers)
+	size_t used; // Bytes in used blocks (with headers)
+	size_t high_water; // Maximal value of `used` since startup
+	size_t largest_free; // Size of the largest free block (with header)
+	size_t smallest_free; // Size of the smallest free block (with header)
+	size_t free_blocks; // Number of free blocks
+	size_t free_histogram[HEAP_FL_COUNT]; // Free blocks in each first level class
+	size_t allocations; // Successful allocations
+	size_t frees; // Successful frees
+	size_t failures; // Allocations, which could not be satisfied
+};
+
+//
+// Global variables
+//
+
+//! Memory given to the allocator
+alignas(HEAP_ALIGN) static u8 heap_memory[configTOTAL_HEAP_SIZE];
+
+//! Heads of free lists of every class
+static HeapBlock* heap_lists[HEAP_FL_COUNT][HEAP_SL_COUNT];
+
+//! Which first level classes have any non-empty list
+static u32 heap_fl_bitmap;
+
+//! Which lists of particular first level class are non-empty
+static u32 heap_sl_bitmaps[HEAP_FL_COUNT];
+
+//! Whether `heap_memory` has been already formatted
+static bool heap_initialized;
+
+//! Usage statistics, sizes of free blocks and their count are computed on demand
+static HeapStats heap_stats;
+
+//
+// Private functions
+//
+
+static size_t heap_block_size(const HeapBlock* block)
+{
+	return (block->size & ~HEAP_BLOCK_FLAGS);
+}
+
+static bool heap_block_is_free(const HeapBlock* block)
+{
+	return (block->size & HEAP_BLOCK_FREE);
+}
+
+static HeapBlock* heap_block_next(HeapBlock* block)
+{
+	return (HeapBlock*)((u8*)(block) + heap_block_size(block));
+}
+
+static u8 heap_fls(size_t value)
+{
+	return (31 - __builtin_clz(value));
+}
+
+//! Computes class of the list, where block of specified size is stored
+static void heap_mapping(size_t size, u8& fl, u8& sl)
+{
+	if(size < HEAP_SMALL_BLOCK) {
+		fl = 0;
+		sl = (size / (HEAP_SMALL_BLOCK / HEAP_SL_COUNT));
+	} else {
+		const auto bit = heap_fls(size);
+		sl = ((size >> (bit - HEAP_SL_LOG2)) ^ HEAP_SL_COUNT);
+		fl = (bit - (HEAP_FL_SHIFT - 1));
+	}
+
+	assert(fl < HEAP_FL_COUNT);
+	assert(sl < HEAP_SL_COUNT);
+}
+
+//! Computes class, from which any block is big enough for specified size
+static void heap_mapping_search(size_t size, u8& fl, u8& sl)
+{
+	// Round the size up to the next class, unless it is at its beginning
+	if(size >= HEAP_SMALL_BLOCK) {
+		size += ((1 << (heap_fls(size) - HEAP_SL_LOG2)) - 1);
+	}
+
+	heap_mapping(size, fl, sl);
+}
+
+static void heap_list_insert(HeapBlock* block)
+{
+	u8 fl, sl;
+	heap_mapping(heap_block_size(block), fl, sl);
+
+	auto& head = heap_lists[fl][sl];
+	block->prev_free = nullptr;
+	block->next_free = head;
+	if(head) {
+		head->prev_free = block;
+	}
+	head = block;
+
+	heap_fl_bitmap |= (1 << fl);
+	heap_sl_bitmaps[fl] |= (1 << sl);
+	heap_stats.free_histogram[fl]++;
+}
+
+static void heap_list_remove(HeapBlock* block)
+{
+	u8 fl, sl;
+	heap_mapping(heap_block_size(block), fl, sl);
+
+	if(block->next_free) {
+		block->next_free->prev_free = block->prev_free;
+	}
+
+	auto& head = heap_lists[fl][sl];
+	if(block->prev_free) {
+		block->prev_free->next_free = block->next_free;
+	} else {
+		assert(head == block);
+		head = block->next_free;
+	}
+
+	// Keep bitmaps in sync with the lists
+	if(!head) {
+		heap_sl_bitmaps[fl] &= ~(1 << sl);
+		if(!heap_sl_bitmaps[fl]) {
+			heap_fl_bitmap &= ~(1 << fl);
+		}
+	}
+
+	assert(heap_stats.free_histogram[fl] > 0);
+	heap_stats.free_histogram[fl]--;
+}
+
+//! Finds head of the first non-empty list starting from specified class
+static HeapBlock* heap_find_suitable(u8 fl, u8 sl)
+{
+	auto sl_map = (heap_sl_bitmaps[fl] & (~0u << sl));
+	if(!sl_map) {
+		// Nothing in this class, take any from the bigger ones
+		const auto fl_map = (heap_fl_bitmap & (~0u << (fl + 1)));
+		if(!fl_map) {
+			return nullptr;
+		}
+
+		fl = __builtin_ctz(fl_map);
+		sl_map = heap_sl_bitmaps[fl];
+	}
+
+	assert(sl_map);
+	sl = __builtin_ctz(sl_map);
+	return heap_lists[fl][sl];
+}
+
+//! Formats heap memory into single free block and the sentinel
+static void heap_init()
+{
+	const auto capacity = ((sizeof(heap_memory) - HEAP_HEADER_SIZE) & ~(HEAP_ALIGN - 1));
+
+	auto block = (HeapBlock*)(heap_memory);
+	block->prev_phys = nullptr;
+	block->size = (capacity | HEAP_BLOCK_FREE);
+
+	auto sentinel = heap_block_next(block);
+	sentinel->prev_phys = block;
+	sentinel->size = 0;
+
+	heap_stats = {};
+	heap_stats.capacity = capacity;
+	heap_list_insert(block);
+
+	heap_initialized = true;
+}
+
+static void* heap_alloc(size_t wanted)
+{
+	if(!heap_initialized) {
+		heap_init();
+	}
+
+	// Avoid overflows, such block would not fit anyway
+	if(wanted == 0 || wanted > heap_stats.capacity) {
+		return nullptr;
+	}
+
+	const auto size = max(((wanted + HEAP_HEADER_SIZE + HEAP_ALIGN - 1) & ~(HEAP_ALIGN - 1)), HEAP_MIN_BLOCK);
+	if(size > heap_stats.capacity) {
+		return nullptr;
+	}
+
+	u8 fl, sl;
+	heap_mapping_search(size, fl, sl);
+	auto block = heap_find_suitable(fl, sl);
+	if(!block) {
+		return nullptr;
+	}
+
+	assert(heap_block_is_free(block));
+	assert(heap_block_size(block) >= size);
+	heap_list_remove(block);
+
+	// Give back the rest of the block, if it can make another one
+	const auto rest = (heap_block_size(block) - size);
+	if(rest >= HEAP_MIN_BLOCK) {
+		block->size = size;
+
+		auto remainder = heap_block_next(block);
+		remainder->prev_phys = block;
+		remainder->size = (rest | HEAP_BLOCK_FREE);
+		heap_block_next(remainder)->prev_phys = remainder;
+		heap_list_insert(remainder);
+	} else {
+		block->size = heap_block_size(block);
+	}
+
+	heap_stats.used += heap_block_size(block);
+	heap_stats.high_water = max(heap_stats.high_water, heap_stats.used);
+	heap_stats.allocations++;
+
+	return ((u8*)(block) + HEAP_HEADER_SIZE);
+}
+
+static void heap_free(void* ptr)
+{
+	auto block = (HeapBlock*)((u8*)(ptr) - HEAP_HEADER_SIZE);
+	assert(heap_initialized);
+	assert(!heap_block_is_free(block));
+	assert(heap_block_size(block) >= HEAP_MIN_BLOCK);
+
+	heap_stats.used -= heap_block_size(block);
+	heap_stats.frees++;
+
+	// Merge with next block. Sentinel is never free, so it stops us
+	auto next = heap_block_next(block);
+	if(heap_block_is_free(next)) {
+		heap_list_remove(next);
+		block->size += heap_block_size(next);
+		heap_block_next(block)->prev_phys = block;
+	}
+
+	// Merge with previous block
+	auto prev = block->prev_phys;
+	if(prev && heap_block_is_free(prev)) {
+		heap_list_remove(prev);
+		prev->size = (heap_block_size(prev) + heap_block_size(block));
+		heap_block_next(prev)->prev_phys = prev;
+		block = prev;
+	}
+
+	block->size |= HEAP_BLOCK_FREE;
+	heap_list_insert(block);
+}
+
+//! Returns size of the largest free block
+static size_t heap_largest_free()
+{
+	if(!heap_fl_bitmap) {
+		return 0;
+	}
+
+	// Blocks in one list may differ in size, so check the whole top list
+	const u8 fl = heap_fls(heap_fl_bitmap);
+	const u8 sl = heap_fls(heap_sl_bitmaps[fl]);
+
+	size_t largest = 0;
+	for(auto block = heap_lists[fl][sl]; block; block = block->next_free) {
+		largest = max(largest, heap_block_size(block));
+	}
+
+	return largest;
+}
+
+//! Returns size of the smallest free block
+static size_t heap_smallest_free()
+{
+	if(!heap_fl_bitmap) {
+		return 0;
+	}
+
+	const u8 fl = __builtin_ctz(heap_fl_bitmap);
+	const u8 sl = __builtin_ctz(heap_sl_bitmaps[fl]);
+
+	size_t smallest = SIZE_MAX;
+	for(auto block = heap_lists[fl][sl]; block; block = block->next_free) {
+		smallest = min(smallest, heap_block_size(block));
+	}
+
+	return smallest;
+}
+
+//
+// Public functions
+//
+
+//! Returns smallest block size of specified first level class
+constexpr size_t heap_class_size(u8 fl)
+{
+	return (fl == 0) ? 0 : (1 << (fl + HEAP_FL_SHIFT - 1));
+}
+
+//! Returns current heap usage
+HeapStats heap_get_stats()
+{
+	vTaskSuspendAll();
+	if(!heap_initialized) {
+		heap_init();
+	}
+
+	auto stats = heap_stats;
+	stats.largest_free = heap_largest_free();
+	stats.smallest_free = heap_smallest_free();
+	xTaskResumeAll();
+
+	stats.free_blocks = 0;
+	for(const auto count : stats.free_histogram) {
+		stats.free_blocks += count;
+	}
+
+	return stats;
+}
+
+//
+// FreeRTOS memory management interface
+//
+
+void vApplicationMallocFailedHook();
+
+void* pvPortMalloc(size_t size)
+{
+	vTaskSuspendAll();
+	const auto ptr = heap_alloc(size);
+	if(!ptr) {
+		heap_stats.failures++;
+	}
+	traceMALLOC(ptr, size);
+	xTaskResumeAll();
+
+#if (configUSE_MALLOC_FAILED_HOOK == 1)
+	if(!ptr) {
+		vApplicationMallocFailedHook();
+	}
+#endif
+
+	return ptr;
+}
+
+void vPortFree(void* ptr)
+{
+	if(!ptr) {
+		return;
+	}
+
+	vTaskSuspendAll();
+	traceFREE(ptr, heap_block_size((HeapBlock*)((u8*)(ptr) - HEAP_HEADER_SIZE)));
+	heap_free(ptr);
+	xTaskResumeAll();
+}
+
+void vPortInitialiseBlocks()
+{
+	// Heap is formatted on first use
+}
+
+size_t xPortGetFreeHeapSize()
+{
+	const auto stats = heap_get_stats();
+	return (stats.capacity - stats.used);
+}
+
+size_t xPortGetMinimumEverFreeHeapSize()
+{
+	const auto stats = heap_get_stats();
+	return (stats.capacity - stats.high_water);
+}
+
+void vPortGetHeapStats(HeapStats_t* output)
+{
+	const auto stats = heap_get_stats();
+	output->xAvailableHeapSpaceInBytes = (stats.capacity - stats.used);
+	output->xSizeOfLargestFreeBlockInBytes = stats.largest_free;
+	output->xSizeOfSmallestFreeBlockInBytes = stats.smallest_free;
+	output->xNumberOfFreeBlocks = stats.free_blocks;
+	output->xMinimumEverFreeBytesRemaining = (stats.capacity - stats.high_water);
+	output->xNumberOfSuccessfulAllocations = stats.allocations;
+	output->xNumberOfSuccessfulFrees = stats.frees;
+}
@@ -75,7 +75,10 @@ static_assert(offsetof(HIB_Block, RTCT) == 0x024);
 static_assert(offsetof(HIB_Block, RTCSS) == 0x028);
 static_assert(offsetof(HIB_Block, DATA) == 0x030);
 
-#define HIB ((volatile HIB_Block*)(0x400FC000))
+#define HIB HW_BLOCK(HIB_Block, 0x400FC000)
+
+//! Reset value of RTCT, no trim of the 32.768kHz crystal
+constexpr u32 HIB_RTCT_DEFAULT = 0x7FFF;
 
 void hib_init()
 {
@@ -92,6 +95,10 @@ void hib_init()
 	// Busy wait for write complete / capable
 	while(!(HIB->CTL & HIB_CTL_WRC));
 
+	// Trim of the crystal, measured on the board (see config.cpp)
+	HIB->RTCT = (config_get_u32(CONFIG_RTC_TRIM, HIB_RTCT_DEFAULT) & HIB_RTCT_TRIM_M);
+	while(!(HIB->CTL & HIB_CTL_WRC));
+
 	// Enable RTC timer
 	HIB->CTL = (HIB_CTL_CLK32EN | HIB_CTL_RTCEN);
 }
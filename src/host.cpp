@@ -0,0 +1,1147 @@
+///////////////////////////////////////////////////////////////////////////////
+// Host build support
+///////////////////////////////////////////////////////////////////////////////
+
+// `make TARGET=host` builds the firmware as a native Linux program, running
+// on the POSIX port of the kernel (see portable/GCC/Posix). Drivers are left
+// untouched: their register blocks (HW_BLOCK, bitband_ref) are redirected to
+// the plain memory below, where simple models of the peripherals play the
+// hardware. Models are stepped in the interrupt context, right before they
+// raise their interrupts, so they never run concurrently with the handlers:
+// - NVIC: priorities of the interrupts, enabling is reported by nvic.cpp
+// - UART0: connected to a pseudo-terminal, its path is printed at start
+// - I2C0 with SSD1306 display, dumped as PBM image on every change
+// - GPIOF: LEDs printed on change, buttons pressed by keys on stdin
+// - TIMER0 (debouncing) and WTIMER0 (run time stats), counting cycles
+//   of simulated 16MHz core
+// - HIB: RTC counting seconds of the local time
+// - Flash controller: erase and programming of the flash, which is mapped
+//   from a file, so it persists like on the board. The host plays
+//   the bootloader: VTOR is set to the slot it would start (see update.cpp).
+//   HOST_FLASH_POWER_LOSS=n in the environment cuts the power in the middle
+//   of the n-th erase or programming: random part of the words is done and
+//   the program ends, like the board losing its supply (see config.cpp)
+// Everything else (SYSCTL, GPIO pin configuration, SCB...) is only memory.
+//
+// The hardware thread watches the pseudo-terminal and stdin, and raises the
+// interrupt, whenever a model has something to do. Writes of the firmware
+// (UART data, I2C commands) are noticed within HOST_POLL_INTERVAL_NS, unless
+// some other interrupt comes first.
+//
+// NOTE: Models are polled, so the registers are updated only on entry to
+// the interrupt context. E.g. run time counter has the resolution of
+// the kernel tick, unless there is a context switch.
+
+//
+// Helper constants
+//
+
+//! Simulated regions: peripherals and private peripheral bus
+constexpr u32 HOST_PERIPHERALS_BASE = 0x40000000;
+constexpr u32 HOST_PRIVATE_BASE = 0xE0000000;
+constexpr u32 HOST_REGION_SIZE = 0x100000;
+
+//! Interval of polling of the models by the hardware thread
+constexpr u64 HOST_POLL_INTERVAL_NS = 200000;
+
+//! Maximal number of handlers run by single entry to the interrupt context,
+//! so interrupt, which is never cleared, does not stall the program
+constexpr u32 HOST_MAX_DISPATCHES = 64;
+
+//! UART0 DR value, when nothing was written and nothing was received.
+//! Written characters have upper half either zero or all ones (sign extended)
+constexpr u32 HOST_UART_DR_EMPTY = 0x00010000;
+
+//! Upper half of UART0 DR holding the received character
+constexpr u32 HOST_UART_DR_RECEIVED = 0x00020000;
+
+//! Cycles of single character at 115200 baud (start, 8 data and stop bit)
+constexpr u64 HOST_UART_CHAR_CYCLES = (configCPU_CLOCK_HZ * 10ull / 115200);
+
+//! Size of the ring of received characters, must be power of two
+constexpr u32 HOST_UART_RX_SIZE = 256;
+static_assert((HOST_UART_RX_SIZE & (HOST_UART_RX_SIZE - 1)) == 0);
+
+//! Time of the button press by single key
+constexpr u64 HOST_CLICK_NS = 150000000;
+
+//! I2C master status after the command
+constexpr u32 HOST_I2C_MCS_IDLE = 0x20;
+constexpr u32 HOST_I2C_MCS_BUSBSY = 0x40;
+constexpr u32 HOST_I2C_MCS_ERROR = 0x02;
+constexpr u32 HOST_I2C_MCS_ADRACK = 0x04;
+
+//! I2C master commands
+constexpr u32 HOST_I2C_MCS_RUN = 0x01;
+constexpr u32 HOST_I2C_MCS_START = 0x02;
+constexpr u32 HOST_I2C_MCS_STOP = 0x04;
+
+//! Address and size of the simulated display
+constexpr u8 HOST_SSD1306_ADDR = 0x3C;
+constexpr u32 HOST_SSD1306_WIDTH = 128;
+constexpr u32 HOST_SSD1306_PAGES = 8;
+
+//! File with the image of the display
+constexpr const char* HOST_SSD1306_IMAGE = "ssd1306.pbm";
+
+//! File with the content of the flash
+constexpr const char* HOST_FLASH_IMAGE = "flash.bin";
+
+//! Flash controller status of finished erase or programming
+constexpr u32 HOST_FLASH_FCRIS_PRIS = (1 << 1);
+
+//! Environment variable with number of the flash operation losing the power
+constexpr const char* HOST_FLASH_POWER_LOSS = "HOST_FLASH_POWER_LOSS";
+
+//
+// Private types
+//
+
+//! State of the simulated timer
+struct HostTimer
+{
+	u32 base; // Address of the register block
+	bool wide; // Whether 64-bit counter is formed by TAV and TBV
+	bool running; // Whether TAEN was seen set
+	u64 start; // Cycles at the start
+	u64 value; // Counter value at the start
+	u64 timeouts; // Number of time-outs reported since the start
+	u32 last; // TAV written by the model, other value is written by the firmware
+};
+
+//! State of the simulated SSD1306 display
+struct HostSsd1306
+{
+	u8 ram[HOST_SSD1306_PAGES][HOST_SSD1306_WIDTH];
+	u8 page;
+	u8 column;
+	bool on;
+	bool inverted;
+	bool remapped; // Column 127 is SEG0 (A1)
+	bool reversed; // COM scan from COM63 (C8)
+	bool control; // Next byte is control byte
+	bool data; // Following bytes are data, not commands
+	bool single; // Only one byte follows the control byte (Co bit)
+	u8 command; // Command waiting for its arguments
+	u8 arguments; // Number of the arguments still expected
+	bool changed; // Whether image has to be written
+};
+
+//
+// Global variables
+//
+
+static u32 host_peripherals[HOST_REGION_SIZE / 4];
+static u32 host_private[HOST_REGION_SIZE / 4];
+
+//! Monotonic time of the start, so cycles count from zero
+static u64 host_start_ns;
+
+//! Interrupts enabled in NVIC, changed atomically by the tasks and handlers
+static u64 host_nvic_enabled;
+
+//! Pseudo-terminal of UART0 (master side) and its slave side, which is kept
+//! open, so the master does not hang up, when nobody is connected
+static int host_uart_fd = -1;
+static int host_uart_slave_fd = -1;
+
+//! Received characters, written by the hardware thread
+static u8 host_uart_rx[HOST_UART_RX_SIZE];
+static u32 host_uart_rx_head;
+static u32 host_uart_rx_tail;
+
+//! Cycles, when next character can be received
+static u64 host_uart_rx_next;
+
+//! Whether the received character was given to the handler
+static bool host_uart_rx_delivered;
+
+static HostTimer host_timer0 = { 0x40030000, false, false, 0, 0, 0, 0 };
+static HostTimer host_wtimer0 = { 0x40036000, true, false, 0, 0, 0, 0 };
+
+//! Cycles of the next time-out of TIMER0, UINT64_MAX if none
+static u64 host_timer0_deadline = UINT64_MAX;
+
+//! Pins driven by the firmware and levels seen by it
+static u8 host_gpiof_out;
+static u8 host_gpiof_levels;
+
+//! Pressed buttons (pins), changed by the hardware thread
+static u8 host_buttons;
+
+//! Whether I2C transaction has started
+static bool host_i2c_active;
+
+//! Whether I2C transaction is addressed to the display
+static bool host_i2c_display;
+
+static HostSsd1306 host_ssd1306;
+
+//! RTC counter at `host_rtc_start` and the last seen load value
+static u32 host_rtc_base;
+static u64 host_rtc_start;
+static u32 host_rtc_load;
+
+//! Simulated flash, mapped from HOST_FLASH_IMAGE
+static u8* host_flash_memory;
+
+//! Flash operations done so far and the one losing the power, zero for none
+static u32 host_flash_operations;
+static u32 host_flash_power_loss;
+
+//! Terminal settings of stdin, restored at exit
+static termios host_stdin_termios;
+static bool host_stdin_raw;
+
+//
+// Private functions
+//
+
+//! Prints message of the host to stdout
+static void host_print(const char* format, ...) __attribute__((format(printf, 1, 2)));
+static void host_print(const char* format, ...)
+{
+	char buffer[160];
+	va_list args;
+	va_start(args, format);
+	const int size = vsnprintf(buffer, sizeof(buffer), format, args);
+	va_end(args);
+
+	if(size > 0) {
+		const auto written = write(STDOUT_FILENO, buffer, min<size_t>(size, sizeof(buffer) - 1));
+		static_cast<void>(written);
+	}
+}
+
+[[noreturn]] static void host_fatal(const char* message)
+{
+	host_print("host: %s\n", message);
+	abort();
+}
+
+static void host_stdin_restore()
+{
+	if(host_stdin_raw) {
+		tcsetattr(STDIN_FILENO, TCSANOW, &host_stdin_termios);
+	}
+}
+
+static u64 host_now_ns()
+{
+	timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return ((u64)(now.tv_sec) * 1000000000ull + (u64)(now.tv_nsec));
+}
+
+//! Cycles of the simulated core since the start
+static u64 host_cycles_wide()
+{
+	return ((host_now_ns() - host_start_ns) * (configCPU_CLOCK_HZ / 1000000) / 1000);
+}
+
+//! Register as seen by the models, including the read-only ones
+static volatile u32& host_reg(u32 address)
+{
+	return *(volatile u32*)(host_registers(address));
+}
+
+//! Register read by the hardware thread, while the firmware may write it
+static u32 host_peek(u32 address)
+{
+	return __atomic_load_n((u32*)(host_registers(address)), __ATOMIC_RELAXED);
+}
+
+#define HOST_REG(base, type, reg) host_reg((base) + offsetof(type, reg))
+#define HOST_PEEK(base, type, reg) host_peek((base) + offsetof(type, reg))
+
+//
+// NVIC
+//
+
+//! Returns priority of the interrupt, lower value is more urgent
+static u8 host_nvic_priority(u32 irq)
+{
+	return ((volatile u8*)(&HOST_REG(0xE000E000, NVIC_Block, PRI[0])))[irq];
+}
+
+//
+// UART0
+//
+
+void host_uart_write(const char* data, u32 size)
+{
+	// Nobody might be reading the terminal, so data are rather dropped
+	// than blocking the program
+	if(host_uart_fd >= 0) {
+		const auto written = write(host_uart_fd, data, size);
+		static_cast<void>(written);
+	}
+}
+
+//! Whether DR holds character written by the firmware
+static bool host_uart_dr_written(u32 dr)
+{
+	return ((dr != HOST_UART_DR_EMPTY) && ((dr & 0xFFFF0000) != HOST_UART_DR_RECEIVED));
+}
+
+static bool host_uart_rx_ready(u64 now)
+{
+	const auto head = __atomic_load_n(&host_uart_rx_head, __ATOMIC_ACQUIRE);
+	return ((head != host_uart_rx_tail) && (now >= __atomic_load_n(&host_uart_rx_next, __ATOMIC_RELAXED)));
+}
+
+static bool host_uart_step(u64 now)
+{
+	auto& dr = HOST_REG(UART0_BASE, UART_Block, DR);
+	auto& ris = HOST_REG(UART0_BASE, UART_Block, RIS);
+	auto& icr = HOST_REG(UART0_BASE, UART_Block, ICR);
+
+	ris &= ~icr;
+	icr = 0;
+
+	// Handler has read the character, so it is gone
+	if(host_uart_rx_delivered) {
+		host_uart_rx_delivered = false;
+		ris &= ~UART_RIS_RXRIS;
+		if((dr & 0xFFFF0000) == HOST_UART_DR_RECEIVED) {
+			dr = HOST_UART_DR_EMPTY;
+		}
+	}
+
+	// Character written by the firmware is sent at once
+	if(host_uart_dr_written(dr)) {
+		const char c = (char)(dr);
+		host_uart_write(&c, 1);
+		dr = HOST_UART_DR_EMPTY;
+		ris |= UART_RIS_TXRIS;
+	}
+
+	// Receive next character, when the handler is ready to take it. DR is
+	// shared by both directions, so it must not be in the middle of sending
+	const u32 rx_enabled = (UART_CTL_UARTEN | UART_CTL_RXE);
+	const auto ctl = HOST_REG(UART0_BASE, UART_Block, CTL);
+	if(((ctl & rx_enabled) == rx_enabled) && (HOST_REG(UART0_BASE, UART_Block, IM) & UART_IM_RXIM) &&
+		(__atomic_load_n(&host_nvic_enabled, __ATOMIC_RELAXED) & (1ull << INT_UART0)) && !(ris & (UART_RIS_TXRIS | UART_RIS_RXRIS)) &&
+		(dr == HOST_UART_DR_EMPTY) && host_uart_rx_ready(now))
+	{
+		dr = (host_uart_rx[host_uart_rx_tail & (HOST_UART_RX_SIZE - 1)] | HOST_UART_DR_RECEIVED);
+		__atomic_store_n(&host_uart_rx_tail, host_uart_rx_tail + 1, __ATOMIC_RELEASE);
+		__atomic_store_n(&host_uart_rx_next, now + HOST_UART_CHAR_CYCLES, __ATOMIC_RELAXED);
+		host_uart_rx_delivered = true;
+		ris |= UART_RIS_RXRIS;
+	}
+
+	HOST_REG(UART0_BASE, UART_Block, FR) = (UART_FR_TXFE | UART_FR_RXFE);
+	const auto mis = (ris & HOST_REG(UART0_BASE, UART_Block, IM));
+	HOST_REG(UART0_BASE, UART_Block, MIS) = mis;
+	return (mis != 0);
+}
+
+static bool host_uart_written()
+{
+	return host_uart_dr_written(HOST_PEEK(UART0_BASE, UART_Block, DR));
+}
+
+//! Stores characters received by the pseudo-terminal, called by the hardware thread
+static void host_uart_receive()
+{
+	const auto tail = __atomic_load_n(&host_uart_rx_tail, __ATOMIC_ACQUIRE);
+	const auto free = (HOST_UART_RX_SIZE - (host_uart_rx_head - tail));
+	if(free == 0) {
+		// Let the firmware take some first
+		return;
+	}
+
+	u8 buffer[HOST_UART_RX_SIZE];
+	const auto size = read(host_uart_fd, buffer, free);
+	for(ssize_t i = 0; i < size; ++i) {
+		host_uart_rx[(host_uart_rx_head + i) & (HOST_UART_RX_SIZE - 1)] = buffer[i];
+	}
+	if(size > 0) {
+		__atomic_store_n(&host_uart_rx_head, host_uart_rx_head + size, __ATOMIC_RELEASE);
+	}
+}
+
+static void host_uart_init()
+{
+	host_reg(UART0_BASE + offsetof(UART_Block, DR)) = HOST_UART_DR_EMPTY;
+
+	host_uart_fd = posix_openpt(O_RDWR | O_NOCTTY | O_NONBLOCK);
+	if((host_uart_fd < 0) || (grantpt(host_uart_fd) != 0) || (unlockpt(host_uart_fd) != 0)) {
+		host_fatal("cannot create pseudo-terminal for UART0");
+	}
+
+	const char* path = ptsname(host_uart_fd);
+	host_uart_slave_fd = open(path, O_RDWR | O_NOCTTY);
+	if(host_uart_slave_fd < 0) {
+		host_fatal("cannot open pseudo-terminal for UART0");
+	}
+
+	// Terminal passes the bytes as they are, like the serial line
+	termios settings;
+	tcgetattr(host_uart_slave_fd, &settings);
+	cfmakeraw(&settings);
+	tcsetattr(host_uart_slave_fd, TCSANOW, &settings);
+
+	host_print("host: UART0 is %s\n", path);
+}
+
+//
+// Timers
+//
+
+//! Steps the timer, returns whether time-out happened and its next deadline
+static bool host_timer_step(HostTimer& timer, u64 now, u64& deadline)
+{
+	auto& ris = host_reg(timer.base + offsetof(TIMER_Block, RIS));
+	auto& icr = host_reg(timer.base + offsetof(TIMER_Block, ICR));
+	auto& ctl = host_reg(timer.base + offsetof(TIMER_Block, CTL));
+	auto& tav = host_reg(timer.base + offsetof(TIMER_Block, TAV));
+	auto& tbv = host_reg(timer.base + offsetof(TIMER_Block, TBV));
+	const auto tamr = host_reg(timer.base + offsetof(TIMER_Block, TAMR));
+	const bool wide = (timer.wide && (host_reg(timer.base + offsetof(TIMER_Block, CFG)) == TIMER_CFG_32_BIT_TIMER));
+
+	ris &= ~icr;
+	icr = 0;
+	deadline = UINT64_MAX;
+
+	// Counter starts from the value written by the firmware, also when it
+	// is written while running
+	const bool enabled = (ctl & TIMER_CTL_TAEN);
+	if(enabled && (!timer.running || (tav != timer.last))) {
+		timer.running = true;
+		timer.start = now;
+		timer.value = (wide ? (((u64)(tbv) << 32) | tav) : tav);
+		timer.timeouts = 0;
+	}
+	else if(!enabled) {
+		timer.running = false;
+	}
+
+	if(timer.running) {
+		const auto elapsed = (now - timer.start);
+		u64 value;
+		if(tamr & TIMER_TnMR_CDIR) {
+			value = (timer.value + elapsed);
+		}
+		else {
+			// Time-out at zero, then the counter is reloaded
+			const u64 period = ((u64)(host_reg(timer.base + offsetof(TIMER_Block, TAILR))) + 1);
+			u64 timeouts = 0;
+			if(elapsed <= timer.value) {
+				value = (timer.value - elapsed);
+			}
+			else {
+				const auto overrun = (elapsed - timer.value - 1);
+				timeouts = (1 + (overrun / period));
+				value = (period - 1 - (overrun % period));
+			}
+
+			if(timeouts > timer.timeouts) {
+				timer.timeouts = timeouts;
+				ris |= TIMER_INT_TATO;
+				if((tamr & 0x3) == TIMER_TnMR_ONE_SHOT) {
+					ctl &= ~TIMER_CTL_TAEN;
+					timer.running = false;
+					value = 0;
+				}
+			}
+
+			if(timer.running) {
+				deadline = (timer.start + timer.value + 1 + (timer.timeouts * period));
+			}
+		}
+
+		tav = (u32)(value);
+		timer.last = (u32)(value);
+		host_reg(timer.base + offsetof(TIMER_Block, TAR)) = (u32)(value);
+		if(wide) {
+			tbv = (u32)(value >> 32);
+			host_reg(timer.base + offsetof(TIMER_Block, TBR)) = (u32)(value >> 32);
+		}
+	}
+
+	const auto mis = (ris & host_reg(timer.base + offsetof(TIMER_Block, IMR)));
+	host_reg(timer.base + offsetof(TIMER_Block, MIS)) = mis;
+	return (mis & TIMER_INT_TATO);
+}
+
+//
+// GPIOF (LEDs and buttons)
+//
+
+static bool host_gpiof_step()
+{
+	constexpr u32 base = 0x4005D000;
+	auto data = (volatile u32*)(&host_reg(base));
+	auto& ris = HOST_REG(base, GPIO_Block, RIS);
+	auto& icr = HOST_REG(base, GPIO_Block, ICR);
+	const u8 dir = HOST_REG(base, GPIO_Block, DIR);
+
+	// Writes of the firmware differ from the levels set by previous step.
+	// Address bits mask the pins
+	for(u32 mask = 1; mask < 0x100; ++mask) {
+		if(data[mask] != (host_gpiof_levels & mask)) {
+			const u8 pins = (mask & dir);
+			host_gpiof_out = ((host_gpiof_out & ~pins) | (data[mask] & pins));
+		}
+	}
+
+	// Buttons are pulled up, pressed one reads zero
+	const auto previous = host_gpiof_levels;
+	const u8 buttons = (BTNS_PINS & ~__atomic_load_n(&host_buttons, __ATOMIC_RELAXED));
+	host_gpiof_levels = ((host_gpiof_out & dir) | (buttons & ~dir));
+	for(u32 mask = 0; mask < 0x100; ++mask) {
+		data[mask] = (host_gpiof_levels & mask);
+	}
+
+	const u8 leds = ((previous ^ host_gpiof_levels) & LEDS_PINS & dir);
+	if(leds) {
+		const auto on = [](u8 pin) { return (host_gpiof_levels & pin) ? "on" : "off"; };
+		host_print("host: LEDs red %s, green %s, blue %s\n", on(RED_LED_PIN), on(GREEN_LED_PIN), on(BLUE_LED_PIN));
+	}
+
+	// Edge interrupts, rising one is selected by IEV, unless both are
+	const u8 changed = (previous ^ host_gpiof_levels);
+	const u8 rising = (changed & host_gpiof_levels);
+	const u8 ibe = HOST_REG(base, GPIO_Block, IBE);
+	const u8 iev = HOST_REG(base, GPIO_Block, IEV);
+	const u8 edges = ((changed & ibe) | (rising & iev & ~ibe) | (changed & ~rising & ~iev & ~ibe));
+
+	ris &= ~icr;
+	icr = 0;
+	ris |= (edges & ~HOST_REG(base, GPIO_Block, IS));
+
+	const auto mis = (ris & HOST_REG(base, GPIO_Block, IM));
+	HOST_REG(base, GPIO_Block, MIS) = mis;
+	return (mis != 0);
+}
+
+static void host_gpiof_init()
+{
+	// Buttons read as released already during initialization
+	auto data = (volatile u32*)(&host_reg(0x4005D000));
+	host_gpiof_levels = BTNS_PINS;
+	for(u32 mask = 0; mask < 0x100; ++mask) {
+		data[mask] = (host_gpiof_levels & mask);
+	}
+}
+
+//
+// I2C0 with SSD1306
+//
+
+//! Writes image of the display as PBM file, lit pixels are black
+static void host_ssd1306_dump()
+{
+	auto& display = host_ssd1306;
+	constexpr u32 height = (HOST_SSD1306_PAGES * 8);
+	constexpr u32 row_bytes = (HOST_SSD1306_WIDTH / 8);
+
+	char header[32];
+	const int header_size = snprintf(header, sizeof(header), "P4\n%u %u\n", HOST_SSD1306_WIDTH, height);
+
+	// Usual modules are mounted upside down, so firmware remaps both
+	// columns and rows (A1, C8) to see the image upright
+	u8 image[height][row_bytes] = {};
+	for(u32 row = 0; row < height; ++row) {
+		for(u32 column = 0; column < HOST_SSD1306_WIDTH; ++column) {
+			const bool lit = display.on &&
+				(((display.ram[row / 8][column] >> (row % 8)) & 1) != display.inverted);
+			const u32 x = (display.remapped ? column : (HOST_SSD1306_WIDTH - 1 - column));
+			const u32 y = (display.reversed ? row : (height - 1 - row));
+			if(lit) {
+				image[y][x / 8] |= (0x80 >> (x % 8));
+			}
+		}
+	}
+
+	// File is replaced at once, so viewers never see it half written
+	char path[64];
+	snprintf(path, sizeof(path), "%s.tmp", HOST_SSD1306_IMAGE);
+	const int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if(fd < 0) {
+		return;
+	}
+	const bool written = (write(fd, header, header_size) == header_size) &&
+		(write(fd, image, sizeof(image)) == (ssize_t)(sizeof(image)));
+	close(fd);
+	if(written) {
+		rename(path, HOST_SSD1306_IMAGE);
+	}
+}
+
+static void host_ssd1306_command(u8 byte)
+{
+	auto& display = host_ssd1306;
+
+	if(display.arguments) {
+		display.arguments--;
+		return;
+	}
+
+	display.command = byte;
+	if(byte < 0x10) {
+		display.column = ((display.column & 0xF0) | byte);
+	}
+	else if(byte < 0x20) {
+		display.column = ((display.column & 0x0F) | ((byte & 0x0F) << 4));
+	}
+	else if((byte & 0xF8) == 0xB0) {
+		display.page = (byte & 0x07);
+	}
+	else if((byte & 0xFE) == 0xA0) {
+		display.remapped = (byte & 1);
+	}
+	else if((byte == 0xC0) || (byte == 0xC8)) {
+		display.reversed = (byte == 0xC8);
+	}
+	else if((byte & 0xFE) == 0xAE) {
+		display.on = (byte & 1);
+	}
+	else if((byte & 0xFE) == 0xA6) {
+		display.inverted = (byte & 1);
+	}
+	else {
+		// Skip arguments of the other commands
+		switch(byte) {
+			case 0x20: case 0x81: case 0x8D: case 0xA8: case 0xAD: case 0xD3:
+			case 0xD5: case 0xD9: case 0xDA: case 0xDB:
+				display.arguments = 1;
+				break;
+			case 0x21: case 0x22: case 0xA3:
+				display.arguments = 2;
+				break;
+			case 0x29: case 0x2A:
+				display.arguments = 5;
+				break;
+			case 0x26: case 0x27:
+				display.arguments = 6;
+				break;
+			default:
+				break;
+		}
+		return;
+	}
+
+	display.changed = true;
+}
+
+static void host_ssd1306_write(u8 byte)
+{
+	auto& display = host_ssd1306;
+
+	if(display.control) {
+		display.control = false;
+		display.single = (byte & 0x80);
+		display.data = (byte & 0x40);
+		return;
+	}
+
+	if(display.data) {
+		// Page addressing, column wraps within the page
+		display.ram[display.page][display.column % HOST_SSD1306_WIDTH] = byte;
+		display.column = ((display.column + 1) % HOST_SSD1306_WIDTH);
+		display.changed = true;
+	}
+	else {
+		host_ssd1306_command(byte);
+	}
+
+	display.control = display.single;
+}
+
+static bool host_i2c_step()
+{
+	constexpr u32 base = 0x40020000;
+	auto& mcs = HOST_REG(base, I2C_Block, MCS);
+	auto& mris = HOST_REG(base, I2C_Block, MRIS);
+	auto& micr = HOST_REG(base, I2C_Block, MICR);
+
+	mris &= ~micr;
+	micr = 0;
+
+	// Written command has RUN bit, status never has it
+	const auto command = mcs;
+	if(command & HOST_I2C_MCS_RUN) {
+		u32 status = 0;
+		if(command & HOST_I2C_MCS_START) {
+			const auto address = HOST_REG(base, I2C_Block, MSA);
+			host_i2c_active = true;
+			host_i2c_display = (((address >> I2C_MSA_SA_S) == HOST_SSD1306_ADDR) && !(address & I2C_MSA_RS));
+			host_ssd1306.control = true;
+		}
+
+		if(!host_i2c_active || !host_i2c_display) {
+			status = (HOST_I2C_MCS_ERROR | HOST_I2C_MCS_ADRACK);
+		}
+		else {
+			host_ssd1306_write(HOST_REG(base, I2C_Block, MDR));
+		}
+
+		if(command & HOST_I2C_MCS_STOP) {
+			host_i2c_active = false;
+			if(host_ssd1306.changed) {
+				host_ssd1306.changed = false;
+				host_ssd1306_dump();
+			}
+		}
+
+		mcs = (status | (host_i2c_active ? HOST_I2C_MCS_BUSBSY : HOST_I2C_MCS_IDLE));
+		mris |= I2C_MRIS_RIS;
+	}
+
+	const auto mmis = (mris & HOST_REG(base, I2C_Block, MIMR));
+	HOST_REG(base, I2C_Block, MMIS) = mmis;
+	return (mmis != 0);
+}
+
+static bool host_i2c_written()
+{
+	return (HOST_PEEK(0x40020000, I2C_Block, MCS) & HOST_I2C_MCS_RUN);
+}
+
+//
+// Hibernation module (RTC)
+//
+
+static void host_hib_step(u64 now)
+{
+	constexpr u32 base = 0x400FC000;
+	auto& ctl = HOST_REG(base, HIB_Block, CTL);
+	const auto load = HOST_REG(base, HIB_Block, RTCLD);
+
+	// Module is always ready for writes
+	ctl |= HIB_CTL_WRC;
+
+	if(load != host_rtc_load) {
+		host_rtc_load = load;
+		host_rtc_base = load;
+		host_rtc_start = now;
+	}
+
+	if(ctl & HIB_CTL_RTCEN) {
+		const auto elapsed = (now - host_rtc_start);
+		const auto seconds = (elapsed / configCPU_CLOCK_HZ);
+		const auto subseconds = ((elapsed % configCPU_CLOCK_HZ) * 32768 / configCPU_CLOCK_HZ);
+		HOST_REG(base, HIB_Block, RTCC) = (host_rtc_base + (u32)(seconds));
+		HOST_REG(base, HIB_Block, RTCSS) = ((u32)(subseconds) & HIB_RTCSS_RTCSSC_M);
+	}
+	else {
+		host_rtc_base = HOST_REG(base, HIB_Block, RTCC);
+		host_rtc_start = now;
+	}
+}
+
+static void host_hib_init()
+{
+	constexpr u32 base = 0x400FC000;
+
+	// RTC keeps running while the board is off, so it starts at the local time
+	const auto now = time(nullptr);
+	tm local;
+	localtime_r(&now, &local);
+	host_rtc_base = (u32)(now + local.tm_gmtoff);
+	host_rtc_load = 0;
+	HOST_REG(base, HIB_Block, RTCC) = host_rtc_base;
+	HOST_REG(base, HIB_Block, CTL) = (HIB_CTL_CLK32EN | HIB_CTL_RTCEN | HIB_CTL_WRC);
+}
+
+//
+// Flash controller
+//
+
+//! Programs the word, bits can be only cleared, like in NOR flash
+static bool host_flash_program(u32 address, u32 word)
+{
+	u32 previous;
+	memcpy(&previous, host_flash_memory + address, sizeof(previous));
+	const u32 programmed = (previous & word);
+	memcpy(host_flash_memory + address, &programmed, sizeof(programmed));
+	return (programmed == word);
+}
+
+//! Counts the operation, returns whether the power is lost in its middle
+static bool host_flash_interrupted()
+{
+	return (++host_flash_operations == host_flash_power_loss);
+}
+
+//! Random bits of the interrupted operation, the same for the same operation
+static u32 host_flash_random()
+{
+	static u32 seed = host_flash_power_loss;
+	return ((u32)(rand_r(&seed)) ^ ((u32)(rand_r(&seed)) << 16));
+}
+
+//! Ends the program like the board without supply, the flash keeps what
+//! was done so far
+[[noreturn]] static void host_flash_lost()
+{
+	host_print("host: power lost in flash operation %u\n", host_flash_operations);
+	host_stdin_restore();
+	_exit(1);
+}
+
+//! Erases random part of the block, the last word only partly
+[[noreturn]] static void host_flash_erase_lost(u32 block)
+{
+	const auto words = (host_flash_random() % (FLASH_BLOCK_SIZE / sizeof(u32)));
+	memset(host_flash_memory + block, 0xFF, words * sizeof(u32));
+
+	u32 word;
+	memcpy(&word, host_flash_memory + block + words * sizeof(u32), sizeof(word));
+	word |= host_flash_random();
+	memcpy(host_flash_memory + block + words * sizeof(u32), &word, sizeof(word));
+	host_flash_lost();
+}
+
+//! Programs random part of the words, the last one only partly
+[[noreturn]] static void host_flash_program_lost(u32 address, const u32* words, u32 count)
+{
+	const auto done = (host_flash_random() % count);
+	for(u32 i = 0; i < done; ++i) {
+		host_flash_program(address + i * sizeof(u32), words[i]);
+	}
+	host_flash_program(address + done * sizeof(u32), (words[done] | host_flash_random()));
+	host_flash_lost();
+}
+
+//! Erase and programming finish at once, so the firmware sees them done
+//! when it polls the control registers after the interrupt context
+static void host_flash_step()
+{
+	constexpr u32 base = 0x400FD000;
+	auto& fmc = HOST_REG(base, FLASH_Block, FMC);
+	auto& fmc2 = HOST_REG(base, FLASH_Block, FMC2);
+	auto& fcris = HOST_REG(base, FLASH_Block, FCRIS);
+	auto& fcmisc = HOST_REG(base, FLASH_Block, FCMISC);
+
+	fcris &= ~fcmisc;
+	fcmisc = 0;
+
+	// Commands with wrong key are ignored by the hardware
+	const auto key = (flash_key() >> FLASH_FMC_WRKEY_S);
+	const auto address = HOST_REG(base, FLASH_Block, FMA);
+	u32 status = 0;
+	if((fmc & (FLASH_FMC_ERASE | FLASH_FMC_WRITE)) && ((fmc >> FLASH_FMC_WRKEY_S) == key)) {
+		if(address >= FLASH_SIZE) {
+			status = FLASH_FCRIS_ARIS;
+		}
+		else if(fmc & FLASH_FMC_ERASE) {
+			const auto block = (address & ~(FLASH_BLOCK_SIZE - 1));
+			if(host_flash_interrupted()) {
+				host_flash_erase_lost(block);
+			}
+			memset(host_flash_memory + block, 0xFF, FLASH_BLOCK_SIZE);
+			status = HOST_FLASH_FCRIS_PRIS;
+		}
+		else {
+			const u32 word = HOST_REG(base, FLASH_Block, FMD);
+			if(host_flash_interrupted()) {
+				host_flash_program_lost(address & ~3u, &word, 1);
+			}
+			const bool valid = host_flash_program(address & ~3u, word);
+			status = (HOST_FLASH_FCRIS_PRIS | (valid ? 0 : FLASH_FCRIS_INVDRIS));
+		}
+	}
+	fmc = 0;
+
+	// Model cannot see which words of the buffer were written, so they are
+	// left erased afterwards and words of all ones are skipped: they were not
+	// written, while other words of the row may be programmed already
+	if((fmc2 & FLASH_FMC2_WRBUF) && ((fmc2 >> FLASH_FMC_WRKEY_S) == key)) {
+		const auto row = (address & ~(FLASH_WRITE_BUFFER_SIZE - 1));
+		if(row >= FLASH_SIZE) {
+			status = FLASH_FCRIS_ARIS;
+		}
+		else {
+			u32 words[FLASH_WRITE_BUFFER_WORDS];
+			for(u32 i = 0; i < FLASH_WRITE_BUFFER_WORDS; ++i) {
+				auto& word = host_reg(base + offsetof(FLASH_Block, FWBn) + i * sizeof(u32));
+				words[i] = word;
+				word = UINT32_MAX;
+			}
+			if(host_flash_interrupted()) {
+				host_flash_program_lost(row, words, FLASH_WRITE_BUFFER_WORDS);
+			}
+
+			bool valid = true;
+			for(u32 i = 0; i < FLASH_WRITE_BUFFER_WORDS; ++i) {
+				if(words[i] != UINT32_MAX) {
+					valid &= host_flash_program(row + i * sizeof(u32), words[i]);
+				}
+			}
+			status = (HOST_FLASH_FCRIS_PRIS | (valid ? 0 : FLASH_FCRIS_INVDRIS));
+		}
+		HOST_REG(base, FLASH_Block, FWBVAL) = 0;
+	}
+	fmc2 = 0;
+
+	fcris |= status;
+}
+
+static bool host_flash_written()
+{
+	constexpr u32 base = 0x400FD000;
+	return (HOST_PEEK(base, FLASH_Block, FMC) & (FLASH_FMC_ERASE | FLASH_FMC_WRITE)) ||
+		(HOST_PEEK(base, FLASH_Block, FMC2) & FLASH_FMC2_WRBUF);
+}
+
+static void host_flash_init()
+{
+	const int fd = open(HOST_FLASH_IMAGE, O_RDWR | O_CREAT, 0644);
+	struct stat info;
+	if((fd < 0) || (fstat(fd, &info) != 0)) {
+		host_fatal("cannot open flash image");
+	}
+
+	// New flash is erased
+	const bool created = (info.st_size == 0);
+	if((info.st_size != FLASH_SIZE) && (ftruncate(fd, FLASH_SIZE) != 0)) {
+		host_fatal("cannot resize flash image");
+	}
+	void* memory = mmap(nullptr, FLASH_SIZE, (PROT_READ | PROT_WRITE), MAP_SHARED, fd, 0);
+	close(fd);
+	if(memory == MAP_FAILED) {
+		host_fatal("cannot map flash image");
+	}
+	host_flash_memory = (u8*)(memory);
+	if(created) {
+		memset(host_flash_memory, 0xFF, FLASH_SIZE);
+	}
+
+	const auto power_loss = getenv(HOST_FLASH_POWER_LOSS);
+	host_flash_power_loss = (power_loss ? (u32)(strtoul(power_loss, nullptr, 10)) : 0);
+
+	// BOOTCFG of the board, which was never configured
+	constexpr u32 base = 0x400FD000;
+	host_reg(0x400FE1D0) = 0xFFFFFFFE;
+	for(u32 i = 0; i < FLASH_WRITE_BUFFER_WORDS; ++i) {
+		host_reg(base + offsetof(FLASH_Block, FWBn) + i * sizeof(u32)) = UINT32_MAX;
+	}
+
+	// This program plays image of slot A, when no slot is valid
+	auto slot = update_boot_slot();
+	if(slot == UPDATE_SLOT_NONE) {
+		slot = 0;
+	}
+	HOST_REG(0xE000ED00, SCB_Block, VTOR) = update_image_address(slot);
+	host_print("host: flash is kept in %s, started slot %s\n", HOST_FLASH_IMAGE, update_slot_name(slot));
+}
+
+//
+// Hardware thread
+//
+
+static void host_exit(int signal)
+{
+	host_stdin_restore();
+	_exit(128 + signal);
+}
+
+//! Keys pressing the buttons: lower case clicks the button, upper case holds
+//! or releases it
+static void host_buttons_key(char key, u64 (&release)[2], u64 now)
+{
+	static constexpr u8 pins[2] = { BTN_LEFT_PIN, BTN_RIGHT_PIN };
+	static constexpr char keys[2] = { 'l', 'r' };
+
+	for(u32 i = 0; i < 2; ++i) {
+		if(key == keys[i]) {
+			__atomic_or_fetch(&host_buttons, pins[i], __ATOMIC_RELAXED);
+			release[i] = (now + HOST_CLICK_NS);
+		}
+		else if(key == (keys[i] - 'a' + 'A')) {
+			__atomic_xor_fetch(&host_buttons, pins[i], __ATOMIC_RELAXED);
+			release[i] = UINT64_MAX;
+		}
+	}
+}
+
+static void* host_hardware_thread(void*)
+{
+	static constexpr u8 pins[2] = { BTN_LEFT_PIN, BTN_RIGHT_PIN };
+	u64 release[2] = { UINT64_MAX, UINT64_MAX };
+	bool stdin_open = true;
+	u8 buttons = 0;
+
+	while(true) {
+		pollfd fds[2] = {
+			{ host_uart_fd, POLLIN, 0 },
+			{ (stdin_open ? STDIN_FILENO : -1), POLLIN, 0 },
+		};
+		const timespec timeout = { 0, HOST_POLL_INTERVAL_NS };
+		ppoll(fds, 2, &timeout, nullptr);
+
+		bool raise = false;
+		if(fds[0].revents & POLLIN) {
+			host_uart_receive();
+		}
+
+		const auto now = host_now_ns();
+		if(fds[1].revents & (POLLIN | POLLHUP)) {
+			char keys[16];
+			const auto size = read(STDIN_FILENO, keys, sizeof(keys));
+			if(size <= 0) {
+				stdin_open = false;
+			}
+			for(ssize_t i = 0; i < size; ++i) {
+				host_buttons_key(keys[i], release, now);
+			}
+		}
+
+		for(u32 i = 0; i < 2; ++i) {
+			if(now >= release[i]) {
+				__atomic_and_fetch(&host_buttons, (u8)(~pins[i]), __ATOMIC_RELAXED);
+				release[i] = UINT64_MAX;
+			}
+		}
+
+		// Buttons are seen by the firmware only after the step
+		const auto pressed = __atomic_load_n(&host_buttons, __ATOMIC_RELAXED);
+		raise |= (pressed != buttons);
+		buttons = pressed;
+
+		const auto cycles = host_cycles_wide();
+		raise |= host_uart_rx_ready(cycles);
+		raise |= (cycles >= __atomic_load_n(&host_timer0_deadline, __ATOMIC_RELAXED));
+		raise |= (host_uart_written() || host_i2c_written() || host_flash_written());
+
+		if(raise) {
+			vPortRaiseInterrupt();
+		}
+	}
+
+	return nullptr;
+}
+
+//
+// Public functions
+//
+
+//! Translates address of the register to the simulated memory
+volatile void* host_registers(u32 address)
+{
+	if((address - HOST_PERIPHERALS_BASE) < HOST_REGION_SIZE) {
+		return ((u8*)(host_peripherals) + (address - HOST_PERIPHERALS_BASE));
+	}
+	if((address - HOST_PRIVATE_BASE) < HOST_REGION_SIZE) {
+		return ((u8*)(host_private) + (address - HOST_PRIVATE_BASE));
+	}
+
+	host_print("host: access to unmapped address 0x%08X\n", address);
+	abort();
+}
+
+void host_nvic_enable(u32 num, bool enable)
+{
+	assert(num < 64);
+	if(enable) {
+		__atomic_or_fetch(&host_nvic_enabled, (1ull << num), __ATOMIC_RELAXED);
+	}
+	else {
+		__atomic_and_fetch(&host_nvic_enabled, ~(1ull << num), __ATOMIC_RELAXED);
+	}
+}
+
+//! Flash content at the address, for reading by the firmware
+const u8* host_flash(u32 address)
+{
+	assert(address < FLASH_SIZE);
+	return (host_flash_memory + address);
+}
+
+//! Reset ends the process, it is started again by the user or tools/update.py
+void host_reset()
+{
+	host_print("host: reset\n");
+	host_stdin_restore();
+	_exit(0);
+}
+
+u32 host_cycles()
+{
+	return (u32)(host_cycles_wide());
+}
+
+//! Sets up the simulated hardware, called first in `main`
+void host_init()
+{
+	host_start_ns = host_now_ns();
+
+	// Reset values of the simulated registers
+	host_uart_init();
+	host_reg(0x40020000 + offsetof(I2C_Block, MCS)) = HOST_I2C_MCS_IDLE;
+	host_gpiof_init();
+	host_hib_init();
+	host_flash_init();
+
+	// Keys go to the program at once, without echo
+	if(isatty(STDIN_FILENO) && (tcgetattr(STDIN_FILENO, &host_stdin_termios) == 0)) {
+		termios settings = host_stdin_termios;
+		settings.c_lflag &= ~(ICANON | ECHO);
+		settings.c_cc[VMIN] = 1;
+		settings.c_cc[VTIME] = 0;
+		tcsetattr(STDIN_FILENO, TCSANOW, &settings);
+		host_stdin_raw = true;
+		atexit(host_stdin_restore);
+		signal(SIGINT, host_exit);
+		signal(SIGTERM, host_exit);
+	}
+
+	host_print("host: display is written to %s\n", HOST_SSD1306_IMAGE);
+	host_print("host: keys l/r click left/right button, L/R hold or release it\n");
+
+	// Hardware thread never takes the interrupt signal
+	sigset_t signals;
+	sigset_t old_signals;
+	sigfillset(&signals);
+	pthread_sigmask(SIG_BLOCK, &signals, &old_signals);
+	pthread_t thread;
+	if(pthread_create(&thread, nullptr, host_hardware_thread, nullptr) != 0) {
+		host_fatal("cannot create hardware thread");
+	}
+	pthread_sigmask(SIG_SETMASK, &old_signals, nullptr);
+}
+
+//! Entry of the interrupt context (see portmacro.h), dispatches interrupts
+//! of the peripherals by their priority, until none is pending
+void vApplicationInterruptHook()
+{
+	// Exception entry clears the exclusive monitor
+	atomic_clear_exclusive();
+
+	for(u32 i = 0; i < HOST_MAX_DISPATCHES; ++i) {
+		const auto now = host_cycles_wide();
+		host_hib_step(now);
+		host_flash_step();
+
+		u64 deadline;
+		u64 unused;
+		u64 pending = 0;
+		pending |= ((u64)(host_uart_step(now)) << INT_UART0);
+		pending |= ((u64)(host_i2c_step()) << INT_I2C0);
+		pending |= ((u64)(host_gpiof_step()) << INT_GPIOF);
+		pending |= ((u64)(host_timer_step(host_timer0, now, deadline)) << INT_TIMER0A);
+		host_timer_step(host_wtimer0, now, unused);
+		__atomic_store_n(&host_timer0_deadline, deadline, __ATOMIC_RELAXED);
+
+		pending &= __atomic_load_n(&host_nvic_enabled, __ATOMIC_RELAXED);
+		if(!pending) {
+			return;
+		}
+
+		// The most urgent one, lower number wins at the same priority
+		u32 irq = __builtin_ctzll(pending);
+		for(u32 other = irq + 1; other < 64; ++other) {
+			if((pending & (1ull << other)) && (host_nvic_priority(other) < host_nvic_priority(irq))) {
+				irq = other;
+			}
+		}
+
+		// Vector table starts with reset, which is exception 1
+		__isr_vectors[(irq + 16) - 1]();
+		atomic_clear_exclusive();
+	}
+}
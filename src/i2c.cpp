@@ -71,10 +71,20 @@ static_assert(offsetof(I2C_Block, SACKCTL) == 0x820);
 static_assert(offsetof(I2C_Block, PP) == 0xFC0);
 static_assert(offsetof(I2C_Block, PC) == 0xFC4);
 
-#define I2C0 ((volatile I2C_Block*)(0x40020000))
-#define I2C1 ((volatile I2C_Block*)(0x40021000))
-#define I2C2 ((volatile I2C_Block*)(0x40022000))
-#define I2C3 ((volatile I2C_Block*)(0x40023000))
+constexpr u32 I2C0_BASE = 0x40020000;
+constexpr u32 I2C1_BASE = 0x40021000;
+constexpr u32 I2C2_BASE = 0x40022000;
+constexpr u32 I2C3_BASE = 0x40023000;
+
+#define I2C0 HW_BLOCK(I2C_Block, I2C0_BASE)
+#define I2C1 HW_BLOCK(I2C_Block, I2C1_BASE)
+#define I2C2 HW_BLOCK(I2C_Block, I2C2_BASE)
+#define I2C3 HW_BLOCK(I2C_Block, I2C3_BASE)
+
+//! Bit-band alias of single bit in the register of the I2C
+// E.g. `I2C_BITBAND(I2C0_BASE, MIMR, I2C_MIMR_IM) = 1` atomically unmasks interrupt
+#define I2C_BITBAND(base, reg, mask) \
+	bitband<(base) + offsetof(I2C_Block, reg), (mask)>()
 
 #define I2C_WRITE_TO(x) ((x) << 1)
 #define I2C_READ_FROM(x) (((x) << 1) | I2C_MSA_RS)
@@ -122,7 +132,7 @@ void i2c_init()
 	I2C0->MICR = 0xFFFFFFFF;
 
 	// Enable master interrupts
-	I2C0->MIMR = I2C_MIMR_IM;
+	I2C_BITBAND(I2C0_BASE, MIMR, I2C_MIMR_IM) = 1;
 }
 
 bool i2c_write_one(u8 data, u8 addr)
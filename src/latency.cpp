@@ -0,0 +1,152 @@
+///////////////////////////////////////////////////////////////////////////////
+// Interrupt latency measurement
+///////////////////////////////////////////////////////////////////////////////
+
+// Interrupt handlers call `latency_isr_entry` first and `latency_isr_exit`
+// right before `portYIELD_FROM_ISR`, telling whether they passed data to
+// a task. The task calls `latency_task_resumed`, when it got the data. For every source there
+// are two statistics, both counted in DWT cycles from the handler entry:
+// - handler: until the yield, so time spent in the handler
+// - wake: until the task runs, so it contains also the context switch or
+//   waiting for other tasks of higher priority
+// If more interrupts happen before the task gets the data, wake latency is
+// measured from the oldest one.
+//
+// Besides min/max/mean there is histogram of log2 of the cycles, so rare
+// outliers (jitter) are visible. The CLI "latency" command prints and resets
+// them, e.g. before and after change of a driver or of the kernel.
+
+//
+// Public types
+//
+
+//! Measured interrupt sources
+enum LatencySource : u8
+{
+	LATENCY_UART0_RX, // Character received, read by `uart_read_*`
+	LATENCY_GPIOF, // Button edge, handled by `buttons_touched` (no task is woken)
+	LATENCY_TIMER0A, // Gesture events, read by `buttons_read_event`
+	LATENCY_SOURCES,
+};
+
+//! Number of histogram buckets, the last one counts also larger values
+constexpr u8 LATENCY_BUCKETS = 24;
+
+//! Statistics of measured cycles
+struct LatencyStats
+{
+	u32 count;
+	u32 min;
+	u32 max;
+	u64 sum;
+	u32 histogram[LATENCY_BUCKETS]; // Bucket N counts values below 2^N
+};
+
+//! Statistics of single source
+struct LatencySourceStats
+{
+	LatencyStats handler; // From entry to yield of the handler
+	LatencyStats wake; // From entry of the handler to the task
+};
+
+//
+// Global variables
+//
+
+static LatencySourceStats latency_stats[LATENCY_SOURCES];
+
+//! Timestamp of entry to the handler, which is running now
+static u32 latency_entry[LATENCY_SOURCES];
+
+//! Timestamp of the oldest handler, which data was not taken yet by the task
+static u32 latency_pending[LATENCY_SOURCES];
+
+//! Whether `latency_pending` holds the timestamp
+static bool latency_is_pending[LATENCY_SOURCES];
+
+//
+// Private functions
+//
+
+static void latency_record(LatencyStats& stats, u32 cycles)
+{
+	stats.count++;
+	stats.min = min(stats.min, cycles);
+	stats.max = max(stats.max, cycles);
+	stats.sum += cycles;
+
+	const u8 bucket = cycles ? (32 - __builtin_clz(cycles)) : 0;
+	stats.histogram[min<u8>(bucket, LATENCY_BUCKETS - 1)]++;
+}
+
+static void latency_clear(LatencyStats& stats)
+{
+	memset(&stats, 0, sizeof(stats));
+	stats.min = UINT32_MAX;
+}
+
+//
+// Public functions
+//
+
+void latency_init()
+{
+	for(auto& stats : latency_stats) {
+		latency_clear(stats.handler);
+		latency_clear(stats.wake);
+	}
+}
+
+//! Called at the very beginning of the interrupt handler
+inline void latency_isr_entry(LatencySource source)
+{
+	latency_entry[source] = dwt_cycles();
+}
+
+//! Called before `portYIELD_FROM_ISR`, `passed` tells whether the handler
+//! passed data to a task, which will call `latency_task_resumed`
+inline void latency_isr_exit(LatencySource source, bool passed)
+{
+	const auto entry = latency_entry[source];
+	latency_record(latency_stats[source].handler, dwt_cycles() - entry);
+
+	if(passed && !latency_is_pending[source]) {
+		latency_pending[source] = entry;
+		latency_is_pending[source] = true;
+	}
+}
+
+//! Called by the task, when it got data from the handler
+void latency_task_resumed(LatencySource source)
+{
+	taskENTER_CRITICAL();
+	{
+		if(latency_is_pending[source]) {
+			latency_record(latency_stats[source].wake, dwt_cycles() - latency_pending[source]);
+			latency_is_pending[source] = false;
+		}
+	}
+	taskEXIT_CRITICAL();
+}
+
+//! Copies statistics of all sources and resets them
+void latency_take(LatencySourceStats (&stats)[LATENCY_SOURCES])
+{
+	taskENTER_CRITICAL();
+	{
+		memcpy(stats, latency_stats, sizeof(stats));
+		latency_init();
+	}
+	taskEXIT_CRITICAL();
+}
+
+//! Returns name of the source
+const char* latency_source_name(LatencySource source)
+{
+	switch(source) {
+		case LATENCY_UART0_RX: return "uart0 rx";
+		case LATENCY_GPIOF: return "gpiof";
+		case LATENCY_TIMER0A: return "timer0a";
+		default: return "unknown";
+	}
+}
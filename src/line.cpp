@@ -0,0 +1,477 @@
+///////////////////////////////////////////////////////////////////////////////
+// Line editor of the CLI
+///////////////////////////////////////////////////////////////////////////////
+
+// Reads line from the UART, like readline of the shells, for VT100
+// compatible terminal (minicom, screen, picocom):
+// - printable characters are echoed and inserted at the cursor
+// - left/right arrows (Ctrl-B/F), Home/End (Ctrl-A/E) move the cursor
+// - Backspace, Delete, Ctrl-K (to the end) and Ctrl-C (whole line) erase
+// - up/down arrows (Ctrl-P/N) go through the history
+// - Tab completes the name of the command
+//
+// Terminal is updated incrementally: only the characters after the change
+// are written, followed by moving the cursor back. Each key is answered by
+// single UART write, under `uart_lock`.
+//
+// History is a ring of bytes in fixed arena. Each line is stored between two
+// bytes with its length, so the ring can be walked in both directions, and
+// the oldest lines are dropped to make room for the new ones.
+
+//
+// Helper constants
+//
+
+//! Maximal length of the line
+constexpr u8 LINE_SIZE = 64;
+
+//! Size of the history arena, must be power of two
+constexpr u32 LINE_HISTORY_SIZE = 256;
+static_assert((LINE_HISTORY_SIZE & (LINE_HISTORY_SIZE - 1)) == 0);
+static_assert(LINE_HISTORY_SIZE >= (LINE_SIZE + 2));
+
+//! Printed before each line
+constexpr char LINE_PROMPT[] = "> ";
+
+//! Output of single key, longer one is written in more parts
+constexpr u32 LINE_OUTPUT_SIZE = 32;
+
+//! Characters of the keys
+constexpr char LINE_CTRL_A = 0x01;
+constexpr char LINE_CTRL_B = 0x02;
+constexpr char LINE_CTRL_C = 0x03;
+constexpr char LINE_CTRL_E = 0x05;
+constexpr char LINE_CTRL_F = 0x06;
+constexpr char LINE_BACKSPACE = 0x08;
+constexpr char LINE_TAB = 0x09;
+constexpr char LINE_LF = 0x0A;
+constexpr char LINE_CTRL_K = 0x0B;
+constexpr char LINE_CR = 0x0D;
+constexpr char LINE_CTRL_N = 0x0E;
+constexpr char LINE_CTRL_P = 0x10;
+constexpr char LINE_ESCAPE = 0x1B;
+constexpr char LINE_DELETE = 0x7F;
+
+//! State of escape sequences decoding
+enum LineEscape : u8
+{
+	LINE_ESCAPE_NONE,
+	LINE_ESCAPE_START, // After ESC
+	LINE_ESCAPE_CSI, // After ESC [, parameter follows
+	LINE_ESCAPE_SS3, // After ESC O
+};
+
+//
+// Public types
+//
+
+//! History of entered lines
+struct LineHistory
+{
+	char arena[LINE_HISTORY_SIZE];
+	u32 head; // End of the newest line (not wrapped)
+	u32 tail; // Beginning of the oldest line (not wrapped)
+};
+
+//! State of the editor, kept between lines because of the history
+struct LineEditor
+{
+	char text[LINE_SIZE];
+	u8 size;
+	u8 cursor; // Position in the text, 0 to size
+	LineEscape escape;
+	u8 parameter; // Number of CSI sequence, e.g. 3 of ESC [ 3 ~
+	bool carriage_return; // Last key was CR, so following LF is dropped
+	u32 browse; // Beginning of the line shown from history, `head` when none
+	LineHistory history;
+	char scratch[LINE_SIZE]; // Line copied out of the history, it may wrap in the ring
+};
+
+//
+// Private functions
+//
+
+static char line_history_at(const LineHistory& history, u32 position)
+{
+	return history.arena[position & (LINE_HISTORY_SIZE - 1)];
+}
+
+//! Stores the line as the newest one, unless it is empty or repeated
+static void line_history_push(LineHistory& history, const char* text, u8 size)
+{
+	if(!size) {
+		return;
+	}
+
+	// Repeated line is stored once, like with HISTCONTROL=ignoredups
+	if(history.head != history.tail) {
+		const u8 newest = line_history_at(history, history.head - 1);
+		const auto begin = (history.head - newest - 1);
+		bool same = (newest == size);
+		for(u8 i = 0; same && (i < size); ++i) {
+			same = (line_history_at(history, begin + i) == text[i]);
+		}
+		if(same) {
+			return;
+		}
+	}
+
+	// Drop the oldest lines, until there is room
+	while((history.head + size + 2 - history.tail) > LINE_HISTORY_SIZE) {
+		history.tail += (u8)(line_history_at(history, history.tail)) + 2;
+	}
+
+	history.arena[history.head++ & (LINE_HISTORY_SIZE - 1)] = size;
+	for(u8 i = 0; i < size; ++i) {
+		history.arena[history.head++ & (LINE_HISTORY_SIZE - 1)] = text[i];
+	}
+	history.arena[history.head++ & (LINE_HISTORY_SIZE - 1)] = size;
+}
+
+//! Moves the cursor of the terminal back
+static void line_back(FormatOutput& output, u8 count)
+{
+	// Backspaces are shorter than the escape sequence for few columns
+	if(count < 4) {
+		output.fill('\b', count);
+		return;
+	}
+
+	output.append("\x1b[", 2);
+	output.cursor = digits_u32(output.reserve(3), output.end, count);
+	output.append("D", 1);
+}
+
+//! Writes text from the cursor to the end, followed by `erase` spaces,
+//! and returns the cursor of the terminal back
+static void line_write_tail(const LineEditor& editor, FormatOutput& output, u8 erase)
+{
+	const u8 count = (editor.size - editor.cursor);
+	output.append(editor.text + editor.cursor, count);
+	output.fill(' ', erase);
+	line_back(output, count + erase);
+}
+
+static void line_bell(FormatOutput& output)
+{
+	output.append("\a", 1);
+}
+
+//! Inserts characters at the cursor
+static void line_insert(LineEditor& editor, FormatOutput& output, const char* chars, u8 count)
+{
+	if((editor.size + count) > LINE_SIZE) {
+		line_bell(output);
+		return;
+	}
+
+	const auto position = (editor.text + editor.cursor);
+	memmove(position + count, position, (editor.size - editor.cursor));
+	memcpy(position, chars, count);
+	editor.size += count;
+
+	output.append(position, count);
+	editor.cursor += count;
+	line_write_tail(editor, output, 0);
+}
+
+//! Erases characters from the cursor
+static void line_erase(LineEditor& editor, FormatOutput& output, u8 count)
+{
+	const auto position = (editor.text + editor.cursor);
+	memmove(position, position + count, (editor.size - editor.cursor - count));
+	editor.size -= count;
+	line_write_tail(editor, output, count);
+}
+
+//! Replaces the whole text, only its changed part is written
+static void line_replace(LineEditor& editor, FormatOutput& output, const char* text, u8 size)
+{
+	u8 common = 0;
+	while((common < editor.cursor) && (common < size) && (editor.text[common] == text[common])) {
+		common++;
+	}
+
+	line_back(output, editor.cursor - common);
+	memcpy(editor.text + common, text + common, (size - common));
+	output.append(editor.text + common, (size - common));
+	if(editor.size > size) {
+		// Erase to the end of the line
+		output.append("\x1b[K", 3);
+	}
+
+	editor.size = size;
+	editor.cursor = size;
+}
+
+static void line_move_left(LineEditor& editor, FormatOutput& output)
+{
+	if(editor.cursor > 0) {
+		editor.cursor--;
+		line_back(output, 1);
+	}
+}
+
+static void line_move_right(LineEditor& editor, FormatOutput& output)
+{
+	if(editor.cursor < editor.size) {
+		output.append(editor.text + editor.cursor, 1);
+		editor.cursor++;
+	}
+}
+
+static void line_move_home(LineEditor& editor, FormatOutput& output)
+{
+	line_back(output, editor.cursor);
+	editor.cursor = 0;
+}
+
+static void line_move_end(LineEditor& editor, FormatOutput& output)
+{
+	output.append(editor.text + editor.cursor, (editor.size - editor.cursor));
+	editor.cursor = editor.size;
+}
+
+static void line_backspace(LineEditor& editor, FormatOutput& output)
+{
+	if(editor.cursor > 0) {
+		editor.cursor--;
+		line_back(output, 1);
+		line_erase(editor, output, 1);
+	}
+}
+
+static void line_delete(LineEditor& editor, FormatOutput& output)
+{
+	if(editor.cursor < editor.size) {
+		line_erase(editor, output, 1);
+	}
+}
+
+//! Shows the line of the history at `browse`
+static void line_history_show(LineEditor& editor, FormatOutput& output)
+{
+	const u8 size = line_history_at(editor.history, editor.browse);
+	for(u8 i = 0; i < size; ++i) {
+		editor.scratch[i] = line_history_at(editor.history, editor.browse + 1 + i);
+	}
+	line_replace(editor, output, editor.scratch, size);
+}
+
+//! Shows older line from the history
+static void line_history_older(LineEditor& editor, FormatOutput& output)
+{
+	const auto& history = editor.history;
+	if(editor.browse == history.tail) {
+		line_bell(output);
+		return;
+	}
+
+	editor.browse -= (u8)(line_history_at(history, editor.browse - 1)) + 2;
+	line_history_show(editor, output);
+}
+
+//! Shows newer line from the history, or empty line after the newest one
+static void line_history_newer(LineEditor& editor, FormatOutput& output)
+{
+	const auto& history = editor.history;
+	if(editor.browse == history.head) {
+		line_bell(output);
+		return;
+	}
+
+	editor.browse += (u8)(line_history_at(history, editor.browse)) + 2;
+	if(editor.browse == history.head) {
+		line_replace(editor, output, "", 0);
+		return;
+	}
+
+	line_history_show(editor, output);
+}
+
+//! Completes name of the command before the cursor
+// Single match is completed with the space, more of them are completed to
+// their common prefix, or listed when there is nothing to complete
+static void line_complete(LineEditor& editor, FormatOutput& output, const Command* commands, u32 count)
+{
+	// Only the first word is completed
+	const auto prefix = editor.text;
+	const auto prefix_size = editor.cursor;
+	for(u8 i = 0; i < prefix_size; ++i) {
+		if(prefix[i] == ' ') {
+			line_bell(output);
+			return;
+		}
+	}
+
+	const Command* first = nullptr;
+	u32 matches = 0;
+	u8 common = 0;
+	for(u32 i = 0; i < count; ++i) {
+		const auto name = commands[i].name;
+		if(strncmp(name, prefix, prefix_size) != 0) {
+			continue;
+		}
+
+		if(!first) {
+			first = &commands[i];
+			common = strlen(name);
+		} else {
+			u8 same = 0;
+			while((same < common) && (name[same] == first->name[same])) {
+				same++;
+			}
+			common = same;
+		}
+		matches++;
+	}
+
+	if(!matches) {
+		line_bell(output);
+		return;
+	}
+
+	if(matches == 1) {
+		line_insert(editor, output, first->name + prefix_size, (common - prefix_size));
+		line_insert(editor, output, " ", 1);
+		return;
+	}
+
+	if(common > prefix_size) {
+		line_insert(editor, output, first->name + prefix_size, (common - prefix_size));
+		return;
+	}
+
+	// Candidates on their own line, then the whole line again
+	output.append("\r\n", 2);
+	for(u32 i = 0; i < count; ++i) {
+		const auto name = commands[i].name;
+		if(strncmp(name, prefix, prefix_size) == 0) {
+			output.append(name, strlen(name));
+			output.append("  ", 2);
+		}
+	}
+	output.append("\r\n", 2);
+	output.append(LINE_PROMPT, sizeof(LINE_PROMPT) - 1);
+	output.append(editor.text, editor.size);
+	line_back(output, editor.size - editor.cursor);
+}
+
+//! Handles the final character of the escape sequence
+static void line_escape(LineEditor& editor, FormatOutput& output, char c)
+{
+	switch(c) {
+		case 'A': line_history_older(editor, output); break;
+		case 'B': line_history_newer(editor, output); break;
+		case 'C': line_move_right(editor, output); break;
+		case 'D': line_move_left(editor, output); break;
+		case 'H': line_move_home(editor, output); break;
+		case 'F': line_move_end(editor, output); break;
+		case '~':
+			// VT220 keys, both numbers of Home and End are in use
+			switch(editor.parameter) {
+				case 1: case 7: line_move_home(editor, output); break;
+				case 3: line_delete(editor, output); break;
+				case 4: case 8: line_move_end(editor, output); break;
+				default: break;
+			}
+			break;
+		default:
+			break;
+	}
+}
+
+//! Handles single received character, returns whether the line is finished
+static bool line_key(LineEditor& editor, FormatOutput& output, char c, const Command* commands, u32 count)
+{
+	const bool carriage_return = editor.carriage_return;
+	editor.carriage_return = (c == LINE_CR);
+
+	switch(editor.escape) {
+		case LINE_ESCAPE_START:
+			editor.escape = (c == '[') ? LINE_ESCAPE_CSI : (c == 'O') ? LINE_ESCAPE_SS3 : LINE_ESCAPE_NONE;
+			editor.parameter = 0;
+			return false;
+		case LINE_ESCAPE_CSI:
+			if((c >= '0') && (c <= '9')) {
+				editor.parameter = (editor.parameter * 10) + (c - '0');
+				return false;
+			}
+			[[fallthrough]];
+		case LINE_ESCAPE_SS3:
+			editor.escape = LINE_ESCAPE_NONE;
+			line_escape(editor, output, c);
+			return false;
+		case LINE_ESCAPE_NONE:
+			break;
+	}
+
+	switch(c) {
+		case LINE_CR:
+		case LINE_LF:
+			// LF of CR LF terminal is already handled
+			if((c == LINE_LF) && carriage_return) {
+				return false;
+			}
+			output.append("\r\n", 2);
+			line_history_push(editor.history, editor.text, editor.size);
+			return true;
+		case LINE_CTRL_C:
+			output.append("^C\r\n", 4);
+			editor.size = 0;
+			return true;
+		case LINE_ESCAPE: editor.escape = LINE_ESCAPE_START; break;
+		case LINE_BACKSPACE:
+		case LINE_DELETE: line_backspace(editor, output); break;
+		case LINE_TAB: line_complete(editor, output, commands, count); break;
+		case LINE_CTRL_A: line_move_home(editor, output); break;
+		case LINE_CTRL_E: line_move_end(editor, output); break;
+		case LINE_CTRL_B: line_move_left(editor, output); break;
+		case LINE_CTRL_F: line_move_right(editor, output); break;
+		case LINE_CTRL_P: line_history_older(editor, output); break;
+		case LINE_CTRL_N: line_history_newer(editor, output); break;
+		case LINE_CTRL_K: line_erase(editor, output, (editor.size - editor.cursor)); break;
+		default:
+			if((c >= ' ') && (c < LINE_DELETE)) {
+				line_insert(editor, output, &c, 1);
+			}
+			break;
+	}
+	return false;
+}
+
+//
+// Public functions
+//
+
+//! Reads line from the UART with editing, returns its size
+// Text of the line stays in `editor.text` until the next call. Names of the
+// commands are used for the completion.
+template<u32 N>
+u8 line_read(LineEditor& editor, const Command (&commands)[N])
+{
+	editor.size = 0;
+	editor.cursor = 0;
+	editor.escape = LINE_ESCAPE_NONE;
+	editor.browse = editor.history.head;
+
+	uart_lock();
+	uart_write(LINE_PROMPT, sizeof(LINE_PROMPT) - 1);
+	uart_unlock();
+
+	char buffer[LINE_OUTPUT_SIZE];
+	while(true) {
+		char c;
+		CHECK(uart_read_char(c, portMAX_DELAY));
+
+		FormatOutput output = { buffer, buffer, (buffer + sizeof(buffer)), uart_write };
+		uart_lock();
+		const bool finished = line_key(editor, output, c, commands, N);
+		output.flush();
+		uart_unlock();
+
+		if(finished) {
+			return editor.size;
+		}
+	}
+}
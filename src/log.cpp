@@ -0,0 +1,295 @@
+///////////////////////////////////////////////////////////////////////////////
+// Deferred binary logging
+///////////////////////////////////////////////////////////////////////////////
+
+// Format strings of the LOG_* macros are placed in `.log_strings` section,
+// which is not loaded into the microcontroller (see linker script). It starts
+// at address zero, so address of the string is its unique id. Call site
+// only stores the id, timestamp and raw arguments in the RAM ring, which is
+// a matter of a few stores. Low-priority log task ships the records over UART
+// and tools/logdecode.py formats the messages on the host, using ELF file.
+//
+// Records can be produced by tasks and interrupts at once, so words of the
+// ring are reserved lock-free, the same way as in trace.cpp. Record is
+// committed by the last write of its header. When the ring is full, records
+// are dropped and the log task reports how many of them were lost.
+//
+// Record layout (32-bit words):
+// - header: id (16 bits), number of words (8 bits), LOG_COMMITTED (8 bits)
+// - timestamp: lower and upper half of `runtime_now`
+// - arguments: one word each, 64-bit integers take two words, floating point
+//   values are stored as float
+// On UART each record is preceded by LOG_FRAME_START byte, which never occurs
+// in the text written by the CLI, so the host can tell them apart.
+//
+// NOTE: `%s` arguments must point to strings in flash, which never change,
+// since only their address is stored
+
+//
+// Helper constants
+//
+
+//! Number of words in the ring, must be power of two
+constexpr u32 LOG_RING_SIZE = 256;
+static_assert((LOG_RING_SIZE & (LOG_RING_SIZE - 1)) == 0);
+
+//! Words of the record before its arguments
+constexpr u32 LOG_HEADER_WORDS = 3;
+
+//! Maximal size of the record, in words
+constexpr u32 LOG_MAX_WORDS = 16;
+
+//! Marks committed header of the record (ASCII "L")
+constexpr u32 LOG_COMMITTED = 0x4C;
+
+//! Precedes every record sent over UART
+constexpr u8 LOG_FRAME_START = 0xFE;
+
+//! Id of the record reporting number of dropped records
+constexpr u16 LOG_DROPPED_ID = 0xFFFF;
+
+//! Maximal number of addresses in the backtrace of the failure
+constexpr u32 LOG_BACKTRACE_DEPTH = 8;
+
+//! Interval between flushes of the ring
+constexpr TickType_t LOG_INTERVAL = pdMS_TO_TICKS(20);
+
+//
+// Global variables
+//
+
+RTOS_MEMORY static RtosTask<configMINIMAL_STACK_SIZE> log_task_memory;
+
+//! Ring of records
+static volatile u32 log_ring[LOG_RING_SIZE];
+
+//! Index of next word to be reserved by producers (not wrapped)
+static volatile u32 log_head;
+
+//! Index of next word to be read by the consumer (not wrapped)
+static volatile u32 log_tail;
+
+//! Records lost because the ring was full
+static volatile u32 log_dropped;
+
+//
+// Private functions
+//
+
+//! Stores next word of the record
+inline void log_store(u32& index, u32 word)
+{
+	log_ring[(index++) & (LOG_RING_SIZE - 1)] = word;
+}
+
+//! Describes how argument of given type is stored in the record
+// Integers, enums and pointers take one word, 64-bit integers take two
+template<typename T>
+struct LogArg
+{
+	static constexpr u32 words = (sizeof(T) > sizeof(u32)) ? 2 : 1;
+
+	static void store(u32& index, T value)
+	{
+		const auto bits = (u64)(value);
+		log_store(index, (u32)(bits));
+		if(words > 1) {
+			log_store(index, (u32)(bits >> 32));
+		}
+	}
+};
+
+//! Floating point values are stored as raw bits of float
+template<>
+struct LogArg<float>
+{
+	static constexpr u32 words = 1;
+
+	static void store(u32& index, float value)
+	{
+		u32 bits;
+		memcpy(&bits, &value, sizeof(bits));
+		log_store(index, bits);
+	}
+};
+
+//! Doubles (e.g. floats promoted by the expressions) are stored as float
+template<>
+struct LogArg<double>
+{
+	static constexpr u32 words = 1;
+
+	static void store(u32& index, double value)
+	{
+		LogArg<float>::store(index, (float)(value));
+	}
+};
+
+//! Does nothing, but lets the compiler check arguments against the format
+inline void log_check_format(const char* format, ...) __attribute__((format(printf, 1, 2)));
+inline void log_check_format(const char*, ...) {}
+
+//! Writes data to the simulated UART0, defined in host.cpp
+void host_uart_write(const char* data, u32 size);
+
+//! Writes data directly to UART0, without interrupts and kernel
+static void log_write_polling(const char* data, u32 size)
+{
+#ifndef TARGET_HOST
+	for(u32 i = 0; i < size; ++i) {
+		while(UART0->FR & UART_FR_TXFF);
+		UART0->DR = data[i];
+	}
+#else
+	// Simulated registers are updated only in the interrupt context
+	host_uart_write(data, size);
+#endif
+}
+
+//! Sends all committed records from the ring using specified function
+static void log_flush(void (*write)(const char* data, u32 size))
+{
+	// Frame start followed by words of the record
+	char frame[1 + LOG_MAX_WORDS * sizeof(u32)];
+	frame[0] = LOG_FRAME_START;
+
+	// Report lost records before the ones recorded after them
+	const auto dropped = atomic_exchange(&log_dropped, 0);
+	if(dropped) {
+		const auto now = runtime_now();
+		const u32 words[] = {
+			((u32)(LOG_DROPPED_ID) << 16) | (4 << 8) | LOG_COMMITTED,
+			(u32)(now),
+			(u32)(now >> 32),
+			dropped,
+		};
+		memcpy(&frame[1], words, sizeof(words));
+		write(frame, 1 + sizeof(words));
+	}
+
+	while(true) {
+		const u32 header = log_ring[log_tail & (LOG_RING_SIZE - 1)];
+		if((header & 0xFF) != LOG_COMMITTED) {
+			// Not committed yet (or nothing more)
+			break;
+		}
+
+		atomic_barrier();
+		const u32 words = ((header >> 8) & 0xFF);
+		for(u32 i = 0; i < words; ++i) {
+			const auto index = ((log_tail + i) & (LOG_RING_SIZE - 1));
+			const u32 word = log_ring[index];
+			memcpy(&frame[1 + i * sizeof(u32)], &word, sizeof(word));
+
+			// Every word is cleared, not only the header. Any of them becomes
+			// header of some later record, which must not look committed,
+			// before its producer writes it (arguments may end with 0x4C)
+			log_ring[index] = 0;
+		}
+
+		// Free the words for producers
+		atomic_barrier();
+		log_tail = (log_tail + words);
+
+		write(frame, 1 + words * sizeof(u32));
+	}
+}
+
+static void log_task(void* params)
+{
+	static_cast<void>(params);
+
+	while(true) {
+		vTaskDelay(LOG_INTERVAL);
+
+		uart_lock();
+		log_flush(uart_write);
+		uart_unlock();
+	}
+}
+
+//
+// Public functions
+//
+
+//! Stores the record in the ring. Safe to be called from tasks and interrupts
+// Use LOG_* macros instead of calling it directly
+template<typename... Args>
+void log_write(u16 id, Args... args)
+{
+	constexpr u32 words = (LOG_HEADER_WORDS + ... + LogArg<Args>::words);
+	static_assert(words <= LOG_MAX_WORDS, "Too many arguments of the log");
+
+	// Reserve the words and take timestamp atomically
+	u32 head;
+	u64 time;
+	do {
+		head = atomic_load_exclusive(&log_head);
+		time = runtime_now();
+
+		if((head + words - log_tail) > LOG_RING_SIZE) {
+			// Ring is full, log task will report that later
+			atomic_clear_exclusive();
+			atomic_add(&log_dropped, 1);
+			return;
+		}
+	} while(!atomic_store_exclusive(&log_head, head + words));
+
+	u32 index = (head + 1);
+	log_store(index, (u32)(time));
+	log_store(index, (u32)(time >> 32));
+	(LogArg<Args>::store(index, args), ...);
+
+	// Commit the record, once all other words are visible
+	atomic_barrier();
+	log_ring[head & (LOG_RING_SIZE - 1)] = ((u32)(id) << 16) | (words << 8) | LOG_COMMITTED;
+}
+
+//! Helper macro, stores the record with format string interned in ELF file
+#define LOG(level, format, ...) \
+	do { \
+		__attribute__((section(".log_strings"))) \
+		static const char log_format[] = level " " __FILE__ ":" LOG_LINE(__LINE__) ": " format; \
+		if(false) { \
+			log_check_format(format, ##__VA_ARGS__); \
+		} \
+		log_write((u16)((uintptr_t)(log_format)), ##__VA_ARGS__); \
+	} while(0)
+
+#define LOG_LINE(line) LOG_STRINGIFY(line)
+#define LOG_STRINGIFY(x) #x
+
+//! Logs the message with printf-like format, e.g. LOG_INFO("Got %u bytes", size)
+#define LOG_ERROR(format, ...) LOG("E", format, ##__VA_ARGS__)
+#define LOG_WARNING(format, ...) LOG("W", format, ##__VA_ARGS__)
+#define LOG_INFO(format, ...) LOG("I", format, ##__VA_ARGS__)
+#define LOG_DEBUG(format, ...) LOG("D", format, ##__VA_ARGS__)
+
+void log_init()
+{
+	CHECK(log_task_memory.create(log_task, "log", nullptr, tskIDLE_PRIORITY + 1));
+}
+
+//! Logs the failure and sends all pending records, even when kernel is broken
+// Called by CHECK and assert macros (see utils.cpp), before the program hangs
+void log_failure(const char* file, const char* function, int line, const char* expr)
+{
+	// Nothing can be sent before UART is initialized
+	if(!(UART0->CTL & UART_CTL_UARTEN)) {
+		return;
+	}
+
+	LOG_ERROR("%s:%d: %s: failed %s", file, line, function, expr);
+
+	// Backtrace for tools/symbolize.py, starting from this function
+	u32 backtrace[LOG_BACKTRACE_DEPTH];
+	const auto depth = unwind_backtrace_here(backtrace, LOG_BACKTRACE_DEPTH);
+	for(u32 i = 0; i < depth; ++i) {
+		LOG_ERROR("  at 0x%08x", backtrace[i]);
+	}
+
+	// Other tasks and interrupts will not run anymore, so send pending
+	// records by polling
+	taskDISABLE_INTERRUPTS();
+	log_flush(log_write_polling);
+}
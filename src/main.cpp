@@ -5,15 +5,41 @@
 #include <stdint.h>
 #include <string.h>
 
+// Host build runs as native program (see host.cpp)
+#ifdef TARGET_HOST
+#include <execinfo.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+#endif
+
 #include "types.cpp"
+#ifndef TARGET_HOST
 #include "reset.cpp"
 #include "stack.cpp"
+#endif
 #include "utils.cpp"
+#include "bitband.cpp"
+#include "atomic.cpp"
 
 #include "FreeRTOS.h"
 #include "task.h"
 #include "semphr.h"
 
+#if (configSUPPORT_DYNAMIC_ALLOCATION == 1)
+#include "heap.cpp"
+#endif
+#include "rtos.cpp"
+
 #include "hw_sysctl.h"
 #include "hw_gpio.h"
 #include "hw_uart.h"
@@ -21,21 +47,46 @@
 #include "hw_hibernate.h"
 
 #include "nvic.cpp"
+#include "scb.cpp"
+#include "unwind.cpp"
+#include "crash.cpp"
+#include "dwt.cpp"
+#include "digits.cpp"
+#include "crc.cpp"
+#include "flash.cpp"
+#include "update.cpp"
+#include "config.cpp"
+#include "format.cpp"
+#include "command.cpp"
 #include "sysctl.cpp"
+#include "power.cpp"
 #include "gpio.cpp"
+#include "timer.cpp"
+#include "runtime.cpp"
+#include "trace.cpp"
+#include "latency.cpp"
 #include "uart.cpp"
+#include "log.cpp"
+#include "line.cpp"
 #include "i2c.cpp"
 #include "hibernate.cpp"
 #include "leds.cpp"
+#include "gestures.cpp"
 #include "buttons.cpp"
 #include "chars.cpp"
+#include "pingpong.cpp"
 
 #include "cli.cpp"
+#include "rpc.cpp"
 #include "ssd1306.cpp"
 #include "ui.cpp"
 
 #include "handlers.cpp"
 
+#ifdef TARGET_HOST
+#include "host.cpp"
+#endif
+
 //
 // Main application routine
 //
@@ -47,17 +98,27 @@ int main()
 	// *(volatile u32*)(0xE000E008) |= 0x7;
 
 	// Hardware initialization
+	#ifdef TARGET_HOST
+		host_init();
+	#endif
+	crash_init();
 	sys_init();
+	dwt_init();
+	latency_init();
+	power_init();
 	gpio_init();
 	uart_init();
 	i2c_init();
+	config_init();
 	hib_init();
 	buttons_init();
 	nvic_init();
 
 	// Software initialization
+	log_init();
+	trace_init();
 	cli_init();
-	ssd1306_init();
+	ssd1306_init(min<u32>(config_get_u32(CONFIG_CONTRAST, SSD1306_CONTRAST), UINT8_MAX));
 	ui_init();
 
 	// Run kernel
@@ -71,6 +132,12 @@ int main()
 // Free RTOS hooks
 //
 
+void vApplicationIdleHook()
+{
+	// Nothing to do, let the core sleep until next interrupt
+	power_idle();
+}
+
 void vApplicationStackOverflowHook(TaskHandle_t pxTask, char *pcTaskName)
 {
 	/* Check pcTaskName for the name of the offending task, or pxCurrentTCB
@@ -89,3 +156,19 @@ void vApplicationMallocFailedHook( void )
 	configTOTAL_HEAP_SIZE configuration constant in FreeRTOSConfig.h. */
 	for( ;; );
 }
+
+//
+// Flash hooks
+//
+
+//! Update (CLI task) and the configuration store (its own task) program
+//! the flash, so the scheduler is suspended for each of the operations
+void flash_lock()
+{
+	vTaskSuspendAll();
+}
+
+void flash_unlock()
+{
+	xTaskResumeAll();
+}
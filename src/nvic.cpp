@@ -126,7 +126,7 @@ struct NVIC_Block
 	WO u32 SWTRIG;
 }; 
 
-#define NVIC ((volatile NVIC_Block*)(0xE000E000))
+#define NVIC HW_BLOCK(NVIC_Block, 0xE000E000)
 
 static_assert(offsetof(NVIC_Block, EN) == 0x100);
 static_assert(offsetof(NVIC_Block, DIS) == 0x180);
@@ -136,26 +136,30 @@ static_assert(offsetof(NVIC_Block, ACTIVE) == 0x300);
 static_assert(offsetof(NVIC_Block, PRI) == 0x400);
 static_assert(offsetof(NVIC_Block, SWTRIG) == 0xF00);
 
-void nvic_init()
+void nvic_set_priority(u32 num, u8 priority)
 {
-	//
-	// Enable particular interrupts and set their priorities
-	//
-	
-	// TODO: What about INT_GPIOF?
-	NVIC->EN[INT_UART0 / 32] = (1 << (INT_UART0 % 32));
-	NVIC->EN[INT_I2C0 / 32] = (1 << (INT_I2C0 % 32));
-	NVIC->PRI[INT_UART0 / 4] = (0x5 << ((INT_UART0 % 4)*8 + 5));
-	NVIC->PRI[INT_GPIOF / 4] = (0x5 << ((INT_GPIOF % 4)*8 + 5));
-	NVIC->PRI[INT_I2C0 / 4] = (0x5 << ((INT_I2C0 % 4)*8 + 5));
+	// Each PRI register holds priorities of four interrupts, 
+	// only 3 upper bits of each byte are implemented
+	const auto shift = ((num % 4)*8);
+	const auto pri = (NVIC->PRI[num / 4] & ~(0xFF << shift));
+	NVIC->PRI[num / 4] = (pri | (priority << (shift + 5)));
 }
 
+#ifdef TARGET_HOST
+//! Enables or disables interrupt of the simulated NVIC, defined in host.cpp
+// Writes of EN/DIS registers in a row would be lost for the polled model
+void host_nvic_enable(u32 num, bool enable);
+#endif
+
 void nvic_enable_int(u32 num)
 {
 	// EN* registers are write-1 sensitive. It means that we can
 	// without care set other bits to zero, because it does nothing with
 	// 0-written bits
 	NVIC->EN[num / 32] = (1 << (num % 32));
+	#ifdef TARGET_HOST
+		host_nvic_enable(num, true);
+	#endif
 }
 
 void nvic_disable_int(u32 num)
@@ -164,6 +168,32 @@ void nvic_disable_int(u32 num)
 	// without care set other bits to zero, because it does nothing with
 	// 0-written bits
 	NVIC->DIS[num / 32] = (1 << (num % 32));
+	#ifdef TARGET_HOST
+		host_nvic_enable(num, false);
+	#endif
+}
+
+void nvic_init()
+{
+	//
+	// Enable particular interrupts and set their priorities
+	//
+	
+	nvic_enable_int(INT_UART0);
+	nvic_enable_int(INT_I2C0);
+	nvic_enable_int(INT_TIMER0A);
+	nvic_set_priority(INT_UART0, 0x5);
+	nvic_set_priority(INT_I2C0, 0x5);
+	nvic_set_priority(INT_TIMER0A, 0x5);
+
+	// All GPIO ports may have pins interrupts. Unused are masked in ports
+	constexpr u32 GPIO_INTS[] = { 
+		INT_GPIOA, INT_GPIOB, INT_GPIOC, INT_GPIOD, INT_GPIOE, INT_GPIOF 
+	};
+	for(const auto num : GPIO_INTS) {
+		nvic_enable_int(num);
+		nvic_set_priority(num, 0x5);
+	}
 }
 
 #define NVIC_CRITICAL_SECTION_ENTER(num) nvic_disable_int((num))
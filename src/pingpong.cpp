@@ -0,0 +1,108 @@
+///////////////////////////////////////////////////////////////////////////////
+// Context switch benchmark
+///////////////////////////////////////////////////////////////////////////////
+
+// Two tasks of the same priority, higher than any other task, pass direct
+// to task notification back and forth. Giving the notification only makes
+// the other task ready (it has the same priority), and taking it blocks,
+// so every half of the round is exactly one context switch. Cycles are
+// counted by DWT over many rounds, so the result contains the notification
+// calls, kernel hooks and selection of the highest priority ready task.
+// The latter depends on configUSE_PORT_OPTIMISED_TASK_SELECTION, which can
+// be switched by `make OPTIMISED_TASK_SELECTION=0`.
+//
+// Tasks exist only for the time of the benchmark.
+
+//
+// Helper constants
+//
+
+//! Number of rounds, each one contains two context switches
+constexpr u32 PINGPONG_ROUNDS = 1000;
+
+//! Priority of both tasks, so nothing but interrupts disturbs them
+constexpr UBaseType_t PINGPONG_PRIORITY = (configMAX_PRIORITIES - 1);
+
+//
+// Public types
+//
+
+//! Result of the benchmark
+struct PingPong_Benchmark
+{
+	u32 switches; // Number of context switches done
+	u32 cycles_per_switch; // Average cycles of single switch
+	bool optimised; // Whether port optimised task selection was used
+};
+
+//
+// Global variables
+//
+
+RTOS_MEMORY static RtosTask<configMINIMAL_STACK_SIZE> ping_task_memory;
+RTOS_MEMORY static RtosTask<configMINIMAL_STACK_SIZE> pong_task_memory;
+
+static TaskHandle_t pingpong_caller;
+static TaskHandle_t pingpong_ping;
+static TaskHandle_t pingpong_pong;
+
+//! Cycles spent on all rounds
+static u32 pingpong_cycles;
+
+//
+// Private functions
+//
+
+static void pingpong_ping_task(void* params)
+{
+	static_cast<void>(params);
+
+	// Task is running before its creation returns the handle
+	pingpong_ping = xTaskGetCurrentTaskHandle();
+
+	const auto begin = dwt_cycles();
+	for(u32 i = 0; i < PINGPONG_ROUNDS; ++i) {
+		xTaskNotifyGive(pingpong_pong);
+		ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+	}
+	pingpong_cycles = (dwt_cycles() - begin);
+
+	// Report the result and wait for deletion
+	xTaskNotifyGive(pingpong_caller);
+	vTaskSuspend(nullptr);
+}
+
+static void pingpong_pong_task(void* params)
+{
+	static_cast<void>(params);
+
+	while(true) {
+		ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+		xTaskNotifyGive(pingpong_ping);
+	}
+}
+
+//
+// Public functions
+//
+
+//! Measures cycles of single context switch between two tasks
+// Blocks the calling task until both tasks are done
+PingPong_Benchmark pingpong_benchmark()
+{
+	pingpong_caller = xTaskGetCurrentTaskHandle();
+	ulTaskNotifyTake(pdTRUE, 0);
+
+	// Pong waits for the first notification, ping starts rounds at once
+	pingpong_pong = pong_task_memory.create(pingpong_pong_task, "pong", nullptr, PINGPONG_PRIORITY);
+	CHECK(pingpong_pong);
+	const auto ping = ping_task_memory.create(pingpong_ping_task, "ping", nullptr, PINGPONG_PRIORITY);
+	CHECK(ping);
+
+	ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+	vTaskDelete(ping);
+	vTaskDelete(pingpong_pong);
+
+	constexpr u32 switches = (PINGPONG_ROUNDS * 2);
+	return { switches, (pingpong_cycles / switches), (configUSE_PORT_OPTIMISED_TASK_SELECTION == 1) };
+}
@@ -0,0 +1,184 @@
+///////////////////////////////////////////////////////////////////////////////
+// Power management (Sleep and Deep-Sleep clock gating)
+///////////////////////////////////////////////////////////////////////////////
+
+// When the ACG bit in RCC register is set, the clocks of peripherals during
+// Sleep and Deep-Sleep modes are taken from SCGCx and DCGCx registers
+// respectively, instead of RCGCx ones. Peripherals, which are not listed in
+// these registers are simply gated, as soon as the core executes WFI.
+// In Deep-Sleep the system clock is additionally switched to the source
+// selected in DSLPCLKCFG register.
+
+//
+// Helper power constants
+//
+
+//! Peripherals, which clocking in low-power modes is managed by the profile
+constexpr u8 POWER_UART0 = (1 << 0);
+constexpr u8 POWER_I2C0  = (1 << 1);
+constexpr u8 POWER_GPIOF = (1 << 2);
+constexpr u8 POWER_HIB   = (1 << 3);
+
+constexpr u8 POWER_ALL = (POWER_UART0 | POWER_I2C0 | POWER_GPIOF | POWER_HIB);
+
+//! Describes, which peripherals stay clocked in low-power modes
+struct PowerProfile
+{
+	u8 sleep; // Peripherals clocked in Sleep mode
+	u8 deepsleep; // Peripherals clocked in Deep-Sleep mode
+	bool use_deepsleep; // Whether idle should go to Deep-Sleep instead of Sleep
+};
+
+//! Clock gating bits belonging to particular peripheral
+struct PowerGate
+{
+	u8 periph;
+	const char* name;
+	u32 gpio; // Ports needed by the peripheral (its pins)
+	u32 hib;
+	u32 uart;
+	u32 i2c;
+	u32 timer;
+};
+
+// NOTE: SCGCx/DCGCx registers have the same layout as RCGCx ones, so
+// we are using only RCGC bit definitions for all of them.
+// UART0 and I2C0 keep also clock of their pins ports (PORTA and PORTB)
+// GPIOF keeps also clock of buttons debouncing timer (TIMER0)
+// Time base of run-time statistics (WTIMER0) is never gated
+constexpr PowerGate power_gates[] = {
+	{ POWER_UART0, "UART0", SYSCTL_RCGCGPIO_R0, 0, SYSCTL_RCGCUART_R0, 0, 0 },
+	{ POWER_I2C0, "I2C0", SYSCTL_RCGCGPIO_R1, 0, 0, SYSCTL_RCGCI2C_R0, 0 },
+	{ POWER_GPIOF, "GPIOF", SYSCTL_RCGCGPIO_R5, 0, 0, 0, SYSCTL_RCGCTIMER_R0 },
+	{ POWER_HIB, "HIB", 0, SYSCTL_RCGCHIB_R0, 0, 0, 0 },
+};
+
+//
+// Global variables
+//
+
+//! Currently requested power profile
+static PowerProfile power_profile;
+
+//! Whether profile has changed since last write to the hardware
+static bool power_profile_dirty;
+
+//
+// Private functions
+//
+
+//! Computes GPIO/HIB/UART/I2C/TIMER clock gating bits for specified peripherals
+static PowerGate power_gates_merge(u8 periphs)
+{
+	PowerGate merged = { periphs, nullptr, 0, 0, 0, 0, 0 };
+	for(const auto& gate : power_gates) {
+		if(periphs & gate.periph) {
+			merged.gpio |= gate.gpio;
+			merged.hib |= gate.hib;
+			merged.uart |= gate.uart;
+			merged.i2c |= gate.i2c;
+			merged.timer |= gate.timer;
+		}
+	}
+
+	return merged;
+}
+
+//! Writes specified profile into clock gating registers
+static void power_apply(const PowerProfile& profile)
+{
+	const auto sleep = power_gates_merge(profile.sleep);
+	SYSCTL->SCGCGPIO = sleep.gpio;
+	SYSCTL->SCGCHIB = sleep.hib;
+	SYSCTL->SCGCUART = sleep.uart;
+	SYSCTL->SCGCI2C = sleep.i2c;
+	SYSCTL->SCGCTIMER = sleep.timer;
+	SYSCTL->SCGCWTIMER = SYSCTL_RCGCWTIMER_R0;
+
+	const auto deepsleep = power_gates_merge(profile.deepsleep);
+	SYSCTL->DCGCGPIO = deepsleep.gpio;
+	SYSCTL->DCGCHIB = deepsleep.hib;
+	SYSCTL->DCGCUART = deepsleep.uart;
+	SYSCTL->DCGCI2C = deepsleep.i2c;
+	SYSCTL->DCGCTIMER = deepsleep.timer;
+	SYSCTL->DCGCWTIMER = SYSCTL_RCGCWTIMER_R0;
+
+	// Choose, which of low-power modes will be entered by WFI
+	if(profile.use_deepsleep) {
+		SCB->SCR |= SCB_SCR_SLEEPDEEP;
+	} else {
+		SCB->SCR &= ~SCB_SCR_SLEEPDEEP;
+	}
+}
+
+//
+// Public functions
+//
+
+void power_init()
+{
+	// By default everything stays clocked in Sleep, so the drivers are working
+	// as usual. In Deep-Sleep only wake-up sources (buttons and RTC) are left.
+	power_profile.sleep = POWER_ALL;
+	power_profile.deepsleep = (POWER_GPIOF | POWER_HIB);
+	power_profile.use_deepsleep = false;
+	power_profile_dirty = true;
+
+	// Keep PIOSC undivided as a Deep-Sleep clock, so SysTick does not drift
+	SYSCTL->DSLPCLKCFG = SYSCTL_DSLPCLKCFG_O_IO;
+
+	// Let the SCGCx and DCGCx registers take effect in low-power modes
+	SYSCTL->RCC |= SYSCTL_RCC_ACG;
+}
+
+//! Returns currently requested power profile
+PowerProfile power_get_profile()
+{
+	taskENTER_CRITICAL();
+	const auto profile = power_profile;
+	taskEXIT_CRITICAL();
+
+	return profile;
+}
+
+//! Requests new power profile. It will be applied when system goes idle
+void power_set_profile(const PowerProfile& profile)
+{
+	taskENTER_CRITICAL();
+	power_profile = profile;
+	power_profile_dirty = true;
+	taskEXIT_CRITICAL();
+}
+
+//! Returns name of specified peripheral (single bit of POWER_* mask)
+const char* power_periph_name(u8 periph)
+{
+	for(const auto& gate : power_gates) {
+		if(gate.periph == periph) {
+			return gate.name;
+		}
+	}
+
+	return nullptr;
+}
+
+//! Applies pending power profile and puts the core into low-power mode
+// Should be called only from the idle task
+void power_idle()
+{
+	taskENTER_CRITICAL();
+	if(power_profile_dirty) {
+		power_apply(power_profile);
+		power_profile_dirty = false;
+	}
+	taskEXIT_CRITICAL();
+
+	// Wait for any interrupt. Clocks will be gated according to the profile
+#ifndef TARGET_HOST
+	__asm volatile("DSB");
+	__asm volatile("WFI");
+	__asm volatile("ISB");
+#else
+	vPortWaitForInterrupt();
+#endif
+}
@@ -0,0 +1,299 @@
+///////////////////////////////////////////////////////////////////////////////
+// Binary RPC of the CLI
+///////////////////////////////////////////////////////////////////////////////
+
+// Test rigs call the commands of the CLI in binary form, which is cheaper
+// to produce and to parse than the text with echo. Text command "rpc"
+// switches the serial link into this mode, until the host sends RPC_EXIT.
+// Host side is tools/rpc.py.
+//
+// Every packet is COBS encoded (no 0x00 inside) and ended by 0x00:
+//   [payload][CRC-16/CCITT-FALSE of the payload (see crc.cpp), little-endian]
+//
+// Request payload is [id][command][arguments]:
+// - command is index into CLI_COMMANDS, or one of RPC_DESCRIBE, RPC_EXIT
+// - arguments follow the schema of the command: u32 little-endian for 'u',
+//   length and characters for 's', optional ones may be left out
+//
+// Response payload is [id][status][output]. Output of the handler is sent
+// as soon as it fills the packet, with RPC_STATUS_MORE, and the last packet
+// carries the final status.
+//
+// Requests are handled in order, but the host does not have to wait for the
+// response before it sends the next one; id pairs them. Requests in flight
+// are bounded by RX queue of the UART. Packet with bad CRC is answered with
+// RPC_STATUS_BAD_FRAME, so the host can repeat the request. Commands
+// programming the flash stall the core (see flash.cpp), so nothing may come
+// before their response, e.g. tools/update.py keeps single request in flight.
+//
+// UART is locked for the whole RPC mode, so log records are held back and
+// never get between the packets.
+
+//
+// Helper constants
+//
+
+//! Payload of the response besides the output
+constexpr u32 RPC_HEADER_SIZE = 2;
+constexpr u32 RPC_CRC_SIZE = 2;
+
+//! Output of the command carried by single packet
+constexpr u32 RPC_OUTPUT_SIZE = 60;
+
+//! Longest response packet before encoding
+constexpr u32 RPC_PACKET_SIZE = (RPC_HEADER_SIZE + RPC_OUTPUT_SIZE + RPC_CRC_SIZE);
+
+//! Longest request, chunk of the firmware update with its offset (see update.cpp)
+constexpr u32 RPC_REQUEST_SIZE = (RPC_HEADER_SIZE + sizeof(u32) + 1 + UPDATE_CHUNK_SIZE + RPC_CRC_SIZE);
+
+//! COBS adds one byte per 254 bytes, plus the terminating 0x00
+constexpr u32 rpc_frame_size(u32 packet_size)
+{
+	return (packet_size + (packet_size / 254) + 2);
+}
+
+//! Commands besides the ones of CLI_COMMANDS
+constexpr u8 RPC_DESCRIBE = 0xFF; // Output is name and schema of each command, all ended by '\0'
+constexpr u8 RPC_EXIT = 0xFE; // Back to text mode
+
+static_assert((sizeof(CLI_COMMANDS) / sizeof(CLI_COMMANDS[0])) < RPC_EXIT);
+
+//! Status of the response
+enum RpcStatus : u8
+{
+	RPC_STATUS_OK,
+	RPC_STATUS_MORE, // Output continues in the next packet
+	RPC_STATUS_UNKNOWN_COMMAND,
+	RPC_STATUS_BAD_ARGUMENTS,
+	RPC_STATUS_INTERACTIVE, // Command reads the UART itself
+	RPC_STATUS_BAD_FRAME,
+};
+
+//
+// Global variables
+//
+
+//! Received frame, decoded in place
+static u8 rpc_rx[rpc_frame_size(RPC_REQUEST_SIZE)];
+
+//! Packet of the response being filled, header is followed by the output
+static u8 rpc_response[RPC_PACKET_SIZE];
+static u32 rpc_response_size;
+
+//! Encoded response
+static u8 rpc_tx[rpc_frame_size(RPC_PACKET_SIZE)];
+
+//
+// Private functions
+//
+
+//! Encodes data with COBS and appends 0x00, returns size of the frame
+static u32 rpc_cobs_encode(const u8* data, u32 size, u8* frame)
+{
+	// Each block starts with the distance to the next zero (or its end)
+	u32 code_index = 0;
+	u32 frame_size = 1;
+	u8 code = 1;
+	for(u32 i = 0; i < size; ++i) {
+		if(data[i]) {
+			frame[frame_size++] = data[i];
+			code++;
+		}
+
+		if(!data[i] || (code == 0xFF)) {
+			frame[code_index] = code;
+			code_index = frame_size++;
+			code = 1;
+		}
+	}
+
+	frame[code_index] = code;
+	frame[frame_size++] = 0;
+	return frame_size;
+}
+
+//! Decodes COBS frame (without the terminating 0x00) in place
+// Returns size of the data, or zero when the frame is broken
+static u32 rpc_cobs_decode(u8* frame, u32 size)
+{
+	u32 data_size = 0;
+	u32 i = 0;
+	while(i < size) {
+		const u8 code = frame[i++];
+		if(!code || ((i + code - 1) > size)) {
+			return 0;
+		}
+
+		for(u8 j = 1; j < code; ++j) {
+			frame[data_size++] = frame[i++];
+		}
+
+		// Block shorter than 254 bytes ends by zero, unless it is the last one
+		if((code < 0xFF) && (i < size)) {
+			frame[data_size++] = 0;
+		}
+	}
+	return data_size;
+}
+
+//! Sends the response packet with its output so far
+static void rpc_send(RpcStatus status)
+{
+	rpc_response[1] = status;
+	const auto crc = crc16(rpc_response, rpc_response_size);
+	rpc_response[rpc_response_size++] = (crc & 0xFF);
+	rpc_response[rpc_response_size++] = (crc >> 8);
+
+	const auto size = rpc_cobs_encode(rpc_response, rpc_response_size, rpc_tx);
+	uart_write((const char*)(rpc_tx), size);
+	rpc_response_size = RPC_HEADER_SIZE;
+}
+
+//! Output of the commands in RPC mode, full packets are sent at once
+static void rpc_output_write(const char* data, u32 size)
+{
+	while(size) {
+		if(rpc_response_size == (RPC_HEADER_SIZE + RPC_OUTPUT_SIZE)) {
+			rpc_send(RPC_STATUS_MORE);
+		}
+
+		const auto chunk = min<u32>(size, (RPC_HEADER_SIZE + RPC_OUTPUT_SIZE - rpc_response_size));
+		memcpy(rpc_response + rpc_response_size, data, chunk);
+		rpc_response_size += chunk;
+		data += chunk;
+		size -= chunk;
+	}
+}
+
+//! Writes name and schema of all commands
+static void rpc_describe()
+{
+	for(const auto& command : CLI_COMMANDS) {
+		rpc_output_write(command.name, strlen(command.name) + 1);
+		rpc_output_write(command.schema, strlen(command.schema) + 1);
+	}
+}
+
+//! Reads binary arguments of the command by its schema
+// Words point into the received packet, nothing is copied
+static bool rpc_parse_args(const Command& command, const u8* data, u32 size, CommandArgs& args)
+{
+	const auto schema = command.schema;
+	args.count = 0;
+	while(size) {
+		const auto kind = schema[args.count];
+		if(!kind) {
+			return false;
+		}
+
+		auto& word = args.words[args.count];
+		auto& number = args.numbers[args.count];
+		if((kind == 'u') || (kind == 'U')) {
+			if(size < sizeof(u32)) {
+				return false;
+			}
+			word = { (const char*)(data), sizeof(u32) };
+			number = (data[0] | (data[1] << 8) | (data[2] << 16) | ((u32)(data[3]) << 24));
+		} else {
+			if((size < 1u) || (size < (1u + data[0]))) {
+				return false;
+			}
+			word = { (const char*)(data + 1), data[0] };
+			number = 0;
+		}
+
+		const u32 used = ((kind == 'u') || (kind == 'U')) ? sizeof(u32) : (1u + data[0]);
+		data += used;
+		size -= used;
+		args.count++;
+	}
+
+	// Only optional ones may be left out
+	return (args.count >= strcspn(schema, "US"));
+}
+
+//! Handles single packet, returns whether RPC mode ends
+static bool rpc_handle(u8* frame, u32 size)
+{
+	// Too short packets are only noise, e.g. rest of the text line
+	size = rpc_cobs_decode(frame, size);
+	if(size < (RPC_HEADER_SIZE + RPC_CRC_SIZE)) {
+		return false;
+	}
+
+	size -= RPC_CRC_SIZE;
+	const u16 crc = (frame[size] | (frame[size + 1] << 8));
+	rpc_response[0] = frame[0];
+	rpc_response_size = RPC_HEADER_SIZE;
+	if(crc != crc16(frame, size)) {
+		rpc_send(RPC_STATUS_BAD_FRAME);
+		return false;
+	}
+
+	const auto index = frame[1];
+	if(index == RPC_EXIT) {
+		rpc_send(RPC_STATUS_OK);
+		return true;
+	}
+
+	if(index == RPC_DESCRIBE) {
+		rpc_describe();
+		rpc_send(RPC_STATUS_OK);
+		return false;
+	}
+
+	if(index >= (sizeof(CLI_COMMANDS) / sizeof(CLI_COMMANDS[0]))) {
+		rpc_send(RPC_STATUS_UNKNOWN_COMMAND);
+		return false;
+	}
+
+	const auto& command = CLI_COMMANDS[index];
+	CommandArgs args;
+	if(command.interactive) {
+		rpc_send(RPC_STATUS_INTERACTIVE);
+	} else if(!rpc_parse_args(command, frame + RPC_HEADER_SIZE, size - RPC_HEADER_SIZE, args)) {
+		rpc_send(RPC_STATUS_BAD_ARGUMENTS);
+	} else {
+		command.handler(args);
+		rpc_send(RPC_STATUS_OK);
+	}
+	return false;
+}
+
+//
+// Public functions
+//
+
+//! Serves RPC requests until RPC_EXIT, UART has to be locked by the caller
+void rpc_serve()
+{
+	// Drop rest of the command line (e.g. LF after CR)
+	char c;
+	while(uart_read_char(c, 0));
+
+	cli_output = rpc_output_write;
+
+	// Frames longer than the buffer are dropped whole
+	u32 size = 0;
+	bool overflow = false;
+	while(true) {
+		CHECK(uart_read_char(c, portMAX_DELAY));
+		if(c) {
+			if(size < sizeof(rpc_rx)) {
+				rpc_rx[size++] = c;
+			} else {
+				overflow = true;
+			}
+			continue;
+		}
+
+		const bool exit = (!overflow && rpc_handle(rpc_rx, size));
+		size = 0;
+		overflow = false;
+		if(exit) {
+			break;
+		}
+	}
+
+	cli_output = uart_write;
+}
@@ -0,0 +1,147 @@
+///////////////////////////////////////////////////////////////////////////////
+// Kernel objects allocation
+///////////////////////////////////////////////////////////////////////////////
+
+// Tasks, queues and mutexes are created through `RtosTask`, `RtosQueue`
+// and `RtosMutex` wrappers.
+// In static allocation mode (`make STATIC_ALLOCATION=1`) the wrappers hold
+// memory of the object, sized at compile time, and there is no heap at all.
+// When the objects do not fit into SRAM, linking fails instead of hanging in
+// `vApplicationMallocFailedHook` at runtime. In dynamic allocation mode the
+// wrappers are empty and objects are allocated from the kernel heap.
+//
+// All wrappers should be defined with RTOS_MEMORY and named `*_task_memory`,
+// `*_queue_memory` or `*_mutex_memory`, so `make budget` can report them.
+
+//! Places kernel object memory in its own section of SRAM
+#define RTOS_MEMORY __attribute__((section(".bss.rtos")))
+
+//
+// Statically allocated objects
+//
+
+//! Task with statically allocated control block and stack
+template<configSTACK_DEPTH_TYPE StackDepth>
+struct RtosStaticTask
+{
+	StaticTask_t tcb;
+	StackType_t stack[StackDepth];
+
+	TaskHandle_t create(TaskFunction_t function, const char* name, void* params, UBaseType_t priority)
+	{
+		return xTaskCreateStatic(function, name, StackDepth, params, priority, stack, &tcb);
+	}
+};
+
+//! Queue with statically allocated control block and storage
+template<typename T, UBaseType_t Length>
+struct RtosStaticQueue
+{
+	StaticQueue_t queue;
+	u8 storage[Length * sizeof(T)];
+
+	QueueHandle_t create()
+	{
+		return xQueueCreateStatic(Length, sizeof(T), storage, &queue);
+	}
+};
+
+//! Mutex with statically allocated control block
+struct RtosStaticMutex
+{
+	StaticSemaphore_t semaphore;
+
+	SemaphoreHandle_t create()
+	{
+		return xSemaphoreCreateMutexStatic(&semaphore);
+	}
+};
+
+//
+// Dynamically allocated objects
+//
+
+#if (configSUPPORT_DYNAMIC_ALLOCATION == 1)
+
+//! Task allocated from the kernel heap
+template<configSTACK_DEPTH_TYPE StackDepth>
+struct RtosDynamicTask
+{
+	TaskHandle_t create(TaskFunction_t function, const char* name, void* params, UBaseType_t priority)
+	{
+		TaskHandle_t handle = nullptr;
+		xTaskCreate(function, name, StackDepth, params, priority, &handle);
+		return handle;
+	}
+};
+
+//! Queue allocated from the kernel heap
+template<typename T, UBaseType_t Length>
+struct RtosDynamicQueue
+{
+	QueueHandle_t create()
+	{
+		return xQueueCreate(Length, sizeof(T));
+	}
+};
+
+//! Mutex allocated from the kernel heap
+struct RtosDynamicMutex
+{
+	SemaphoreHandle_t create()
+	{
+		return xSemaphoreCreateMutex();
+	}
+};
+
+#endif
+
+//
+// Objects used by the application
+//
+
+#if (configSUPPORT_DYNAMIC_ALLOCATION == 0)
+
+template<configSTACK_DEPTH_TYPE StackDepth>
+using RtosTask = RtosStaticTask<StackDepth>;
+
+template<typename T, UBaseType_t Length>
+using RtosQueue = RtosStaticQueue<T, Length>;
+
+using RtosMutex = RtosStaticMutex;
+
+#else
+
+template<configSTACK_DEPTH_TYPE StackDepth>
+using RtosTask = RtosDynamicTask<StackDepth>;
+
+template<typename T, UBaseType_t Length>
+using RtosQueue = RtosDynamicQueue<T, Length>;
+
+using RtosMutex = RtosDynamicMutex;
+
+#endif
+
+//
+// Kernel tasks memory
+//
+
+// Idle task and timers daemon task are always allocated statically
+RTOS_MEMORY static RtosStaticTask<configMINIMAL_STACK_SIZE> idle_task_memory;
+RTOS_MEMORY static RtosStaticTask<configTIMER_TASK_STACK_DEPTH> timer_task_memory;
+
+//! Provides memory of the idle task to the kernel
+void vApplicationGetIdleTaskMemory(StaticTask_t** tcb, StackType_t** stack, uint32_t* stack_depth)
+{
+	*tcb = &idle_task_memory.tcb;
+	*stack = idle_task_memory.stack;
+	*stack_depth = configMINIMAL_STACK_SIZE;
+}
+
+//! Provides memory of the timers daemon task to the kernel
+void vApplicationGetTimerTaskMemory(StaticTask_t** tcb, StackType_t** stack, uint32_t* stack_depth)
+{
+	*tcb = &timer_task_memory.tcb;
+	*stack = timer_task_memory.stack;
+	*stack_depth = configTIMER_TASK_STACK_DEPTH;
+}
@@ -0,0 +1,80 @@
+///////////////////////////////////////////////////////////////////////////////
+// Run-time statistics of tasks
+///////////////////////////////////////////////////////////////////////////////
+
+// Time base of the statistics is WTIMER0, concatenated into single 64-bit
+// timer counting up at CPU clock, so it never wraps in practice.
+// The kernel accumulates run time of tasks in 32-bit counters, so it gets
+// only lower half of the timer. It wraps every ~268 s at 16 MHz, which is
+// fine for differences taken in shorter intervals. Additionally we count
+// how many times each task was switched in, using kernel trace hook.
+//
+// NOTE: Hooks used by the kernel are declared in FreeRTOSConfig.h
+
+//
+// Helper constants
+//
+
+//! Maximal number of tasks tracked (by their kernel numbers, starting from 1)
+constexpr u8 RUNTIME_MAX_TASKS = 16;
+
+//
+// Global variables
+//
+
+//! How many times particular task was switched in
+static u32 runtime_switches[RUNTIME_MAX_TASKS];
+
+//
+// Public functions
+//
+
+//! Starts the time base. Called by the kernel, when scheduler starts
+void runtime_init()
+{
+	// NOTE: WTIMER0 is clocked by `sys_init`, also in low-power modes
+	// (see `power_apply`), otherwise time spent in idle would not be counted
+
+	// Configure WTIMER0 as 64-bit periodic timer, counting up from zero
+	WTIMER0->CTL = 0;
+	WTIMER0->CFG = TIMER_CFG_32_BIT_TIMER;
+	WTIMER0->TAMR = (TIMER_TnMR_PERIOD | TIMER_TnMR_CDIR);
+	WTIMER0->TAILR = UINT32_MAX;
+	WTIMER0->TBILR = UINT32_MAX;
+	WTIMER0->TAV = 0;
+	WTIMER0->TBV = 0;
+	WTIMER0->CTL = (TIMER_CTL_TAEN | TIMER_CTL_TASTALL);
+}
+
+//! Returns number of CPU cycles since start of the scheduler
+u64 runtime_now()
+{
+	// Upper half might change between reads, so repeat until it is stable
+	u32 high, low;
+	do {
+		high = WTIMER0->TBV;
+		low = WTIMER0->TAV;
+	} while(high != WTIMER0->TBV);
+
+	return ((u64)(high) << 32) | low;
+}
+
+//! Returns lower half of the time base, used by the kernel at every switch
+u32 runtime_counter()
+{
+	return WTIMER0->TAV;
+}
+
+//! Called by the kernel, when task with specified number is switched in
+void runtime_task_switched_in(u32 number)
+{
+	if(number < RUNTIME_MAX_TASKS) {
+		runtime_switches[number]++;
+	}
+}
+
+//! Returns how many times task with specified number was switched in
+u32 runtime_task_switches(u32 number)
+{
+	return (number < RUNTIME_MAX_TASKS) ? runtime_switches[number] : 0;
+}
@@ -0,0 +1,93 @@
+///////////////////////////////////////////////////////////////////////////////
+// System Control Block (Cortex-M4 core peripheral) management
+///////////////////////////////////////////////////////////////////////////////
+
+struct SCB_Block
+{
+	RO u32 CPUID; // CPU ID Base
+	RW u32 ICSR; // Interrupt Control and State
+	RW u32 VTOR; // Vector Table Offset
+	RW u32 AIRCR; // Application Interrupt and Reset Control
+	RW u32 SCR; // System Control
+	RW u32 CCR; // Configuration and Control
+	RW u32 SHPR1; // System Handler Priority 1
+	RW u32 SHPR2; // System Handler Priority 2
+	RW u32 SHPR3; // System Handler Priority 3
+	RW u32 SHCSR; // System Handler Control and State
+	RW1C u32 CFSR; // Configurable Fault Status
+	RW1C u32 HFSR; // Hard Fault Status
+	RO u32 _reserved1[0x1];
+	RW u32 MMFAR; // Memory Management Fault Address
+	RW u32 BFAR; // Bus Fault Address
+	RW u32 AFSR; // Auxiliary Fault Status
+};
+
+static_assert(offsetof(SCB_Block, CPUID) == 0x000);
+static_assert(offsetof(SCB_Block, ICSR) == 0x004);
+static_assert(offsetof(SCB_Block, VTOR) == 0x008);
+static_assert(offsetof(SCB_Block, AIRCR) == 0x00C);
+static_assert(offsetof(SCB_Block, SCR) == 0x010);
+static_assert(offsetof(SCB_Block, CCR) == 0x014);
+static_assert(offsetof(SCB_Block, SHPR1) == 0x018);
+static_assert(offsetof(SCB_Block, SHPR2) == 0x01C);
+static_assert(offsetof(SCB_Block, SHPR3) == 0x020);
+static_assert(offsetof(SCB_Block, SHCSR) == 0x024);
+static_assert(offsetof(SCB_Block, CFSR) == 0x028);
+static_assert(offsetof(SCB_Block, HFSR) == 0x02C);
+static_assert(offsetof(SCB_Block, MMFAR) == 0x034);
+static_assert(offsetof(SCB_Block, BFAR) == 0x038);
+static_assert(offsetof(SCB_Block, AFSR) == 0x03C);
+
+#define SCB HW_BLOCK(SCB_Block, 0xE000ED00)
+
+//
+// Bit fields of System Control register
+//
+
+constexpr u32 SCB_SCR_SLEEPONEXIT = (1 << 1); // Sleep on return to Thread mode
+constexpr u32 SCB_SCR_SLEEPDEEP = (1 << 2); // Use Deep-Sleep instead of Sleep
+constexpr u32 SCB_SCR_SEVONPEND = (1 << 4); // Wake up on pending interrupt
+
+//
+// Bit fields of Application Interrupt and Reset Control register
+//
+
+constexpr u32 SCB_AIRCR_VECTKEY = (0x05FA << 16); // Must be written together with other bits
+constexpr u32 SCB_AIRCR_SYSRESETREQ = (1 << 2); // Request system reset
+
+//
+// Bit fields of System Handler Control and State register
+//
+
+constexpr u32 SCB_SHCSR_MEMFAULTENA = (1 << 16); // Enable Memory Management Fault
+constexpr u32 SCB_SHCSR_BUSFAULTENA = (1 << 17); // Enable Bus Fault
+constexpr u32 SCB_SHCSR_USGFAULTENA = (1 << 18); // Enable Usage Fault
+
+//
+// Bit fields of Configurable Fault Status register
+//
+
+constexpr u32 SCB_CFSR_MMARVALID = (1 << 7); // MMFAR holds valid address
+constexpr u32 SCB_CFSR_BFARVALID = (1 << 15); // BFAR holds valid address
+
+//! Resets the process instead of the microcontroller, defined in host.cpp
+#ifdef TARGET_HOST
+[[noreturn]] void host_reset();
+#endif
+
+//
+// Public functions
+//
+
+//! Resets the microcontroller, after all pending writes
+[[noreturn]] inline void scb_reset()
+{
+#ifndef TARGET_HOST
+	__asm volatile("DSB" ::: "memory");
+	SCB->AIRCR = (SCB_AIRCR_VECTKEY | SCB_AIRCR_SYSRESETREQ);
+	__asm volatile("DSB" ::: "memory");
+	while(true);
+#else
+	host_reset();
+#endif
+}
@@ -141,12 +141,23 @@ constexpr u8 SSD1306_COLS = 128;
 constexpr u8 SSD1306_ROWS = 64;
 constexpr u8 SSD1306_PAGES = (SSD1306_ROWS/8);
 
+//! Contrast, unless configured (see config.cpp)
+constexpr u8 SSD1306_CONTRAST = 0x50;
+
+//
+// Global variables
+//
+
+static u8 ssd1306_contrast = SSD1306_CONTRAST;
+
 //
 // Public functions
 //
 
-void ssd1306_init()
+//! Sets contrast used by `ssd1306_startup`
+void ssd1306_init(u8 contrast)
 {
+	ssd1306_contrast = contrast;
 }
 
 void ssd1306_write_cmds(const u8* cmds, u8 size)
@@ -216,11 +227,11 @@ void ssd1306_clear()
 void ssd1306_startup()
 {
 	// Display initialization commands
-	constexpr u8 SSD1306_INITDATA[] = {
+	const u8 SSD1306_INITDATA[] = {
 		SSD1306_SET_DISPLAY_OFF,
 		SSD1306_SET_COLUMN_LOW(0),
 		SSD1306_SET_START_LINE(0),
-		SSD1306_SET_CONTRAST(0x50),
+		SSD1306_SET_CONTRAST(ssd1306_contrast),
 		SSD1306_SET_PUMP_VOLTAGE_7_4V,
 		SSD1306_SET_REMAP_REVERSE,
 		SSD1306_SET_ENTIREDISPLAY_OFF,
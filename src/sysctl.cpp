@@ -29,17 +29,142 @@ struct SYSCTL_Block
     RO u32 PLLFREQ0; // PLL Frequency 0
     RO u32 PLLFREQ1; // PLL Frequency 1
     RO u32 PLLSTAT; // PLL Status
-
-    // TODO: add missing registers here
-
-    u32 _reserved8[0x127];
-    RW u32 RCGCGPIO;
-    RW u32 RCGCDMA;
-    u32 _reserved9[0x1];
-    RW u32 RCGCHIB;
-    RW u32 RCGCUART;
-    RW u32 RCGCSSI;
-    RW u32 RCGCI2C;
+    RO u32 _reserved8[0x7];
+    RW u32 SLPPWRCFG; // Sleep Power Configuration
+    RW u32 DSLPPWRCFG; // Deep-Sleep Power Configuration
+    RO u32 _reserved9[0x9];
+    RW u32 LDOSPCTL; // LDO Sleep Power Control
+    RO u32 LDOSPCAL; // LDO Sleep Power Calibration
+    RW u32 LDODPCTL; // LDO Deep-Sleep Power Control
+    RO u32 LDODPCAL; // LDO Deep-Sleep Power Calibration
+    RO u32 _reserved10[0x2];
+    RO u32 SDPMST; // Sleep / Deep-Sleep Power Mode Status
+    RO u32 _reserved11[0x4C];
+    RO u32 PPWD; // Watchdog Timer Peripheral Present
+    RO u32 PPTIMER; // 16/32-Bit General-Purpose Timer Peripheral Present
+    RO u32 PPGPIO; // General-Purpose Input/Output Peripheral Present
+    RO u32 PPDMA; // Micro Direct Memory Access Peripheral Present
+    RO u32 _reserved12[0x1];
+    RO u32 PPHIB; // Hibernation Peripheral Present
+    RO u32 PPUART; // Universal Asynchronous Receiver/Transmitter Peripheral Present
+    RO u32 PPSSI; // Synchronous Serial Interface Peripheral Present
+    RO u32 PPI2C; // Inter-Integrated Circuit Peripheral Present
+    RO u32 _reserved13[0x1];
+    RO u32 PPUSB; // Universal Serial Bus Peripheral Present
+    RO u32 _reserved14[0x2];
+    RO u32 PPCAN; // Controller Area Network Peripheral Present
+    RO u32 PPADC; // Analog-to-Digital Converter Peripheral Present
+    RO u32 PPACMP; // Analog Comparator Peripheral Present
+    RO u32 PPPWM; // Pulse Width Modulator Peripheral Present
+    RO u32 PPQEI; // Quadrature Encoder Interface Peripheral Present
+    RO u32 _reserved15[0x4];
+    RO u32 PPEEPROM; // EEPROM Peripheral Present
+    RO u32 PPWTIMER; // 32/64-Bit Wide General-Purpose Timer Peripheral Present
+    RO u32 _reserved16[0x68];
+    RW u32 SRWD; // Watchdog Timer Software Reset
+    RW u32 SRTIMER; // 16/32-Bit General-Purpose Timer Software Reset
+    RW u32 SRGPIO; // General-Purpose Input/Output Software Reset
+    RW u32 SRDMA; // Micro Direct Memory Access Software Reset
+    RO u32 _reserved17[0x1];
+    RW u32 SRHIB; // Hibernation Software Reset
+    RW u32 SRUART; // Universal Asynchronous Receiver/Transmitter Software Reset
+    RW u32 SRSSI; // Synchronous Serial Interface Software Reset
+    RW u32 SRI2C; // Inter-Integrated Circuit Software Reset
+    RO u32 _reserved18[0x1];
+    RW u32 SRUSB; // Universal Serial Bus Software Reset
+    RO u32 _reserved19[0x2];
+    RW u32 SRCAN; // Controller Area Network Software Reset
+    RW u32 SRADC; // Analog-to-Digital Converter Software Reset
+    RW u32 SRACMP; // Analog Comparator Software Reset
+    RW u32 SRPWM; // Pulse Width Modulator Software Reset
+    RW u32 SRQEI; // Quadrature Encoder Interface Software Reset
+    RO u32 _reserved20[0x4];
+    RW u32 SREEPROM; // EEPROM Software Reset
+    RW u32 SRWTIMER; // 32/64-Bit Wide General-Purpose Timer Software Reset
+    RO u32 _reserved21[0x28];
+    RW u32 RCGCWD; // Watchdog Timer Run Mode Clock Gating Control
+    RW u32 RCGCTIMER; // 16/32-Bit General-Purpose Timer Run Mode Clock Gating Control
+    RW u32 RCGCGPIO; // General-Purpose Input/Output Run Mode Clock Gating Control
+    RW u32 RCGCDMA; // Micro Direct Memory Access Run Mode Clock Gating Control
+    RO u32 _reserved22[0x1];
+    RW u32 RCGCHIB; // Hibernation Run Mode Clock Gating Control
+    RW u32 RCGCUART; // Universal Asynchronous Receiver/Transmitter Run Mode Clock Gating Control
+    RW u32 RCGCSSI; // Synchronous Serial Interface Run Mode Clock Gating Control
+    RW u32 RCGCI2C; // Inter-Integrated Circuit Run Mode Clock Gating Control
+    RO u32 _reserved23[0x1];
+    RW u32 RCGCUSB; // Universal Serial Bus Run Mode Clock Gating Control
+    RO u32 _reserved24[0x2];
+    RW u32 RCGCCAN; // Controller Area Network Run Mode Clock Gating Control
+    RW u32 RCGCADC; // Analog-to-Digital Converter Run Mode Clock Gating Control
+    RW u32 RCGCACMP; // Analog Comparator Run Mode Clock Gating Control
+    RW u32 RCGCPWM; // Pulse Width Modulator Run Mode Clock Gating Control
+    RW u32 RCGCQEI; // Quadrature Encoder Interface Run Mode Clock Gating Control
+    RO u32 _reserved25[0x4];
+    RW u32 RCGCEEPROM; // EEPROM Run Mode Clock Gating Control
+    RW u32 RCGCWTIMER; // 32/64-Bit Wide General-Purpose Timer Run Mode Clock Gating Control
+    RO u32 _reserved26[0x28];
+    RW u32 SCGCWD; // Watchdog Timer Sleep Mode Clock Gating Control
+    RW u32 SCGCTIMER; // 16/32-Bit General-Purpose Timer Sleep Mode Clock Gating Control
+    RW u32 SCGCGPIO; // General-Purpose Input/Output Sleep Mode Clock Gating Control
+    RW u32 SCGCDMA; // Micro Direct Memory Access Sleep Mode Clock Gating Control
+    RO u32 _reserved27[0x1];
+    RW u32 SCGCHIB; // Hibernation Sleep Mode Clock Gating Control
+    RW u32 SCGCUART; // Universal Asynchronous Receiver/Transmitter Sleep Mode Clock Gating Control
+    RW u32 SCGCSSI; // Synchronous Serial Interface Sleep Mode Clock Gating Control
+    RW u32 SCGCI2C; // Inter-Integrated Circuit Sleep Mode Clock Gating Control
+    RO u32 _reserved28[0x1];
+    RW u32 SCGCUSB; // Universal Serial Bus Sleep Mode Clock Gating Control
+    RO u32 _reserved29[0x2];
+    RW u32 SCGCCAN; // Controller Area Network Sleep Mode Clock Gating Control
+    RW u32 SCGCADC; // Analog-to-Digital Converter Sleep Mode Clock Gating Control
+    RW u32 SCGCACMP; // Analog Comparator Sleep Mode Clock Gating Control
+    RW u32 SCGCPWM; // Pulse Width Modulator Sleep Mode Clock Gating Control
+    RW u32 SCGCQEI; // Quadrature Encoder Interface Sleep Mode Clock Gating Control
+    RO u32 _reserved30[0x4];
+    RW u32 SCGCEEPROM; // EEPROM Sleep Mode Clock Gating Control
+    RW u32 SCGCWTIMER; // 32/64-Bit Wide General-Purpose Timer Sleep Mode Clock Gating Control
+    RO u32 _reserved31[0x28];
+    RW u32 DCGCWD; // Watchdog Timer Deep-Sleep Mode Clock Gating Control
+    RW u32 DCGCTIMER; // 16/32-Bit General-Purpose Timer Deep-Sleep Mode Clock Gating Control
+    RW u32 DCGCGPIO; // General-Purpose Input/Output Deep-Sleep Mode Clock Gating Control
+    RW u32 DCGCDMA; // Micro Direct Memory Access Deep-Sleep Mode Clock Gating Control
+    RO u32 _reserved32[0x1];
+    RW u32 DCGCHIB; // Hibernation Deep-Sleep Mode Clock Gating Control
+    RW u32 DCGCUART; // Universal Asynchronous Receiver/Transmitter Deep-Sleep Mode Clock Gating Control
+    RW u32 DCGCSSI; // Synchronous Serial Interface Deep-Sleep Mode Clock Gating Control
+    RW u32 DCGCI2C; // Inter-Integrated Circuit Deep-Sleep Mode Clock Gating Control
+    RO u32 _reserved33[0x1];
+    RW u32 DCGCUSB; // Universal Serial Bus Deep-Sleep Mode Clock Gating Control
+    RO u32 _reserved34[0x2];
+    RW u32 DCGCCAN; // Controller Area Network Deep-Sleep Mode Clock Gating Control
+    RW u32 DCGCADC; // Analog-to-Digital Converter Deep-Sleep Mode Clock Gating Control
+    RW u32 DCGCACMP; // Analog Comparator Deep-Sleep Mode Clock Gating Control
+    RW u32 DCGCPWM; // Pulse Width Modulator Deep-Sleep Mode Clock Gating Control
+    RW u32 DCGCQEI; // Quadrature Encoder Interface Deep-Sleep Mode Clock Gating Control
+    RO u32 _reserved35[0x4];
+    RW u32 DCGCEEPROM; // EEPROM Deep-Sleep Mode Clock Gating Control
+    RW u32 DCGCWTIMER; // 32/64-Bit Wide General-Purpose Timer Deep-Sleep Mode Clock Gating Control
+    RO u32 _reserved36[0x68];
+    RO u32 PRWD; // Watchdog Timer Peripheral Ready
+    RO u32 PRTIMER; // 16/32-Bit General-Purpose Timer Peripheral Ready
+    RO u32 PRGPIO; // General-Purpose Input/Output Peripheral Ready
+    RO u32 PRDMA; // Micro Direct Memory Access Peripheral Ready
+    RO u32 _reserved37[0x1];
+    RO u32 PRHIB; // Hibernation Peripheral Ready
+    RO u32 PRUART; // Universal Asynchronous Receiver/Transmitter Peripheral Ready
+    RO u32 PRSSI; // Synchronous Serial Interface Peripheral Ready
+    RO u32 PRI2C; // Inter-Integrated Circuit Peripheral Ready
+    RO u32 _reserved38[0x1];
+    RO u32 PRUSB; // Universal Serial Bus Peripheral Ready
+    RO u32 _reserved39[0x2];
+    RO u32 PRCAN; // Controller Area Network Peripheral Ready
+    RO u32 PRADC; // Analog-to-Digital Converter Peripheral Ready
+    RO u32 PRACMP; // Analog Comparator Peripheral Ready
+    RO u32 PRPWM; // Pulse Width Modulator Peripheral Ready
+    RO u32 PRQEI; // Quadrature Encoder Interface Peripheral Ready
+    RO u32 _reserved40[0x4];
+    RO u32 PREEPROM; // EEPROM Peripheral Ready
+    RO u32 PRWTIMER; // 32/64-Bit Wide General-Purpose Timer Peripheral Ready
 };
 
 static_assert(offsetof(SYSCTL_Block, PBORCTL) == 0x030);
@@ -58,15 +183,111 @@ static_assert(offsetof(SYSCTL_Block, PIOSCSTAT) == 0x154);
 static_assert(offsetof(SYSCTL_Block, PLLFREQ0) == 0x160);
 static_assert(offsetof(SYSCTL_Block, PLLFREQ1) == 0x164);
 static_assert(offsetof(SYSCTL_Block, PLLSTAT) == 0x168);
-// TODO: add missing registers here
+static_assert(offsetof(SYSCTL_Block, SLPPWRCFG) == 0x188);
+static_assert(offsetof(SYSCTL_Block, DSLPPWRCFG) == 0x18C);
+static_assert(offsetof(SYSCTL_Block, LDOSPCTL) == 0x1B4);
+static_assert(offsetof(SYSCTL_Block, LDOSPCAL) == 0x1B8);
+static_assert(offsetof(SYSCTL_Block, LDODPCTL) == 0x1BC);
+static_assert(offsetof(SYSCTL_Block, LDODPCAL) == 0x1C0);
+static_assert(offsetof(SYSCTL_Block, SDPMST) == 0x1CC);
+static_assert(offsetof(SYSCTL_Block, PPWD) == 0x300);
+static_assert(offsetof(SYSCTL_Block, PPTIMER) == 0x304);
+static_assert(offsetof(SYSCTL_Block, PPGPIO) == 0x308);
+static_assert(offsetof(SYSCTL_Block, PPDMA) == 0x30C);
+static_assert(offsetof(SYSCTL_Block, PPHIB) == 0x314);
+static_assert(offsetof(SYSCTL_Block, PPUART) == 0x318);
+static_assert(offsetof(SYSCTL_Block, PPSSI) == 0x31C);
+static_assert(offsetof(SYSCTL_Block, PPI2C) == 0x320);
+static_assert(offsetof(SYSCTL_Block, PPUSB) == 0x328);
+static_assert(offsetof(SYSCTL_Block, PPCAN) == 0x334);
+static_assert(offsetof(SYSCTL_Block, PPADC) == 0x338);
+static_assert(offsetof(SYSCTL_Block, PPACMP) == 0x33C);
+static_assert(offsetof(SYSCTL_Block, PPPWM) == 0x340);
+static_assert(offsetof(SYSCTL_Block, PPQEI) == 0x344);
+static_assert(offsetof(SYSCTL_Block, PPEEPROM) == 0x358);
+static_assert(offsetof(SYSCTL_Block, PPWTIMER) == 0x35C);
+static_assert(offsetof(SYSCTL_Block, SRWD) == 0x500);
+static_assert(offsetof(SYSCTL_Block, SRTIMER) == 0x504);
+static_assert(offsetof(SYSCTL_Block, SRGPIO) == 0x508);
+static_assert(offsetof(SYSCTL_Block, SRDMA) == 0x50C);
+static_assert(offsetof(SYSCTL_Block, SRHIB) == 0x514);
+static_assert(offsetof(SYSCTL_Block, SRUART) == 0x518);
+static_assert(offsetof(SYSCTL_Block, SRSSI) == 0x51C);
+static_assert(offsetof(SYSCTL_Block, SRI2C) == 0x520);
+static_assert(offsetof(SYSCTL_Block, SRUSB) == 0x528);
+static_assert(offsetof(SYSCTL_Block, SRCAN) == 0x534);
+static_assert(offsetof(SYSCTL_Block, SRADC) == 0x538);
+static_assert(offsetof(SYSCTL_Block, SRACMP) == 0x53C);
+static_assert(offsetof(SYSCTL_Block, SRPWM) == 0x540);
+static_assert(offsetof(SYSCTL_Block, SRQEI) == 0x544);
+static_assert(offsetof(SYSCTL_Block, SREEPROM) == 0x558);
+static_assert(offsetof(SYSCTL_Block, SRWTIMER) == 0x55C);
+static_assert(offsetof(SYSCTL_Block, RCGCWD) == 0x600);
+static_assert(offsetof(SYSCTL_Block, RCGCTIMER) == 0x604);
 static_assert(offsetof(SYSCTL_Block, RCGCGPIO) == 0x608);
 static_assert(offsetof(SYSCTL_Block, RCGCDMA) == 0x60C);
 static_assert(offsetof(SYSCTL_Block, RCGCHIB) == 0x614);
 static_assert(offsetof(SYSCTL_Block, RCGCUART) == 0x618);
 static_assert(offsetof(SYSCTL_Block, RCGCSSI) == 0x61C);
 static_assert(offsetof(SYSCTL_Block, RCGCI2C) == 0x620);
+static_assert(offsetof(SYSCTL_Block, RCGCUSB) == 0x628);
+static_assert(offsetof(SYSCTL_Block, RCGCCAN) == 0x634);
+static_assert(offsetof(SYSCTL_Block, RCGCADC) == 0x638);
+static_assert(offsetof(SYSCTL_Block, RCGCACMP) == 0x63C);
+static_assert(offsetof(SYSCTL_Block, RCGCPWM) == 0x640);
+static_assert(offsetof(SYSCTL_Block, RCGCQEI) == 0x644);
+static_assert(offsetof(SYSCTL_Block, RCGCEEPROM) == 0x658);
+static_assert(offsetof(SYSCTL_Block, RCGCWTIMER) == 0x65C);
+static_assert(offsetof(SYSCTL_Block, SCGCWD) == 0x700);
+static_assert(offsetof(SYSCTL_Block, SCGCTIMER) == 0x704);
+static_assert(offsetof(SYSCTL_Block, SCGCGPIO) == 0x708);
+static_assert(offsetof(SYSCTL_Block, SCGCDMA) == 0x70C);
+static_assert(offsetof(SYSCTL_Block, SCGCHIB) == 0x714);
+static_assert(offsetof(SYSCTL_Block, SCGCUART) == 0x718);
+static_assert(offsetof(SYSCTL_Block, SCGCSSI) == 0x71C);
+static_assert(offsetof(SYSCTL_Block, SCGCI2C) == 0x720);
+static_assert(offsetof(SYSCTL_Block, SCGCUSB) == 0x728);
+static_assert(offsetof(SYSCTL_Block, SCGCCAN) == 0x734);
+static_assert(offsetof(SYSCTL_Block, SCGCADC) == 0x738);
+static_assert(offsetof(SYSCTL_Block, SCGCACMP) == 0x73C);
+static_assert(offsetof(SYSCTL_Block, SCGCPWM) == 0x740);
+static_assert(offsetof(SYSCTL_Block, SCGCQEI) == 0x744);
+static_assert(offsetof(SYSCTL_Block, SCGCEEPROM) == 0x758);
+static_assert(offsetof(SYSCTL_Block, SCGCWTIMER) == 0x75C);
+static_assert(offsetof(SYSCTL_Block, DCGCWD) == 0x800);
+static_assert(offsetof(SYSCTL_Block, DCGCTIMER) == 0x804);
+static_assert(offsetof(SYSCTL_Block, DCGCGPIO) == 0x808);
+static_assert(offsetof(SYSCTL_Block, DCGCDMA) == 0x80C);
+static_assert(offsetof(SYSCTL_Block, DCGCHIB) == 0x814);
+static_assert(offsetof(SYSCTL_Block, DCGCUART) == 0x818);
+static_assert(offsetof(SYSCTL_Block, DCGCSSI) == 0x81C);
+static_assert(offsetof(SYSCTL_Block, DCGCI2C) == 0x820);
+static_assert(offsetof(SYSCTL_Block, DCGCUSB) == 0x828);
+static_assert(offsetof(SYSCTL_Block, DCGCCAN) == 0x834);
+static_assert(offsetof(SYSCTL_Block, DCGCADC) == 0x838);
+static_assert(offsetof(SYSCTL_Block, DCGCACMP) == 0x83C);
+static_assert(offsetof(SYSCTL_Block, DCGCPWM) == 0x840);
+static_assert(offsetof(SYSCTL_Block, DCGCQEI) == 0x844);
+static_assert(offsetof(SYSCTL_Block, DCGCEEPROM) == 0x858);
+static_assert(offsetof(SYSCTL_Block, DCGCWTIMER) == 0x85C);
+static_assert(offsetof(SYSCTL_Block, PRWD) == 0xA00);
+static_assert(offsetof(SYSCTL_Block, PRTIMER) == 0xA04);
+static_assert(offsetof(SYSCTL_Block, PRGPIO) == 0xA08);
+static_assert(offsetof(SYSCTL_Block, PRDMA) == 0xA0C);
+static_assert(offsetof(SYSCTL_Block, PRHIB) == 0xA14);
+static_assert(offsetof(SYSCTL_Block, PRUART) == 0xA18);
+static_assert(offsetof(SYSCTL_Block, PRSSI) == 0xA1C);
+static_assert(offsetof(SYSCTL_Block, PRI2C) == 0xA20);
+static_assert(offsetof(SYSCTL_Block, PRUSB) == 0xA28);
+static_assert(offsetof(SYSCTL_Block, PRCAN) == 0xA34);
+static_assert(offsetof(SYSCTL_Block, PRADC) == 0xA38);
+static_assert(offsetof(SYSCTL_Block, PRACMP) == 0xA3C);
+static_assert(offsetof(SYSCTL_Block, PRPWM) == 0xA40);
+static_assert(offsetof(SYSCTL_Block, PRQEI) == 0xA44);
+static_assert(offsetof(SYSCTL_Block, PREEPROM) == 0xA58);
+static_assert(offsetof(SYSCTL_Block, PRWTIMER) == 0xA5C);
 
-#define SYSCTL ((volatile SYSCTL_Block*)(0x400FE000))
+#define SYSCTL HW_BLOCK(SYSCTL_Block, 0x400FE000)
 
 void sys_init()
 {
@@ -94,6 +315,16 @@ void sys_init()
     UART_PERIPHS |= SYSCTL_RCGCUART_R0; // UART0
     SYSCTL->RCGCUART = UART_PERIPHS;
 
+    // Enable clocks for timers
+    u8 TIMER_PERIPHS = 0;
+    TIMER_PERIPHS |= SYSCTL_RCGCTIMER_R0; // TIMER0 (buttons debouncing)
+    SYSCTL->RCGCTIMER = TIMER_PERIPHS;
+
+    // Enable clocks for wide timers
+    u8 WTIMER_PERIPHS = 0;
+    WTIMER_PERIPHS |= SYSCTL_RCGCWTIMER_R0; // WTIMER0 (run-time statistics)
+    SYSCTL->RCGCWTIMER = WTIMER_PERIPHS;
+
     // This delay is needed in order to properly initialize clock for peripherals
     __asm("NOP");
     __asm("NOP");
@@ -0,0 +1,821 @@
+///////////////////////////////////////////////////////////////////////////////
+// Tests of the modules on the host
+///////////////////////////////////////////////////////////////////////////////
+
+// `make TARGET=host test` builds this file instead of main.cpp, with all
+// modules of the firmware and the models of host.cpp, but the kernel is never
+// started and the hardware thread is not created: registers are only plain
+// memory, which the tests write and read themselves. Tests call the private
+// functions of the modules directly (it is a single translation unit), so
+// they are written the way the interrupts and tasks would call them.
+//
+// Test is selected by its name on the command line, without any, all of them
+// are run. Every test prints its name and OK or FAIL, the program exits with
+// failure, when any of them failed. Failed CHECK or assert inside a module
+// aborts the program, which fails the make target as well.
+
+#ifndef TARGET_HOST
+#error "Tests are built only for the host, by `make TARGET=host test`"
+#endif
+
+#include <stdint.h>
+#include <string.h>
+
+#include <execinfo.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <sched.h>
+#include <signal.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "types.cpp"
+#include "utils.cpp"
+#include "bitband.cpp"
+#include "atomic.cpp"
+
+#include "FreeRTOS.h"
+#include "task.h"
+#include "semphr.h"
+
+#if (configSUPPORT_DYNAMIC_ALLOCATION == 1)
+#include "heap.cpp"
+#endif
+#include "rtos.cpp"
+
+#include "hw_sysctl.h"
+#include "hw_gpio.h"
+#include "hw_uart.h"
+#include "hw_i2c.h"
+#include "hw_hibernate.h"
+
+#include "nvic.cpp"
+#include "scb.cpp"
+#include "unwind.cpp"
+#include "crash.cpp"
+#include "dwt.cpp"
+#include "digits.cpp"
+#include "crc.cpp"
+#include "flash.cpp"
+#include "update.cpp"
+#include "config.cpp"
+#include "format.cpp"
+#include "command.cpp"
+#include "sysctl.cpp"
+#include "power.cpp"
+#include "gpio.cpp"
+#include "timer.cpp"
+#include "runtime.cpp"
+#include "trace.cpp"
+#include "latency.cpp"
+#include "uart.cpp"
+#include "log.cpp"
+#include "line.cpp"
+#include "i2c.cpp"
+#include "hibernate.cpp"
+#include "leds.cpp"
+#include "gestures.cpp"
+#include "buttons.cpp"
+#include "chars.cpp"
+#include "pingpong.cpp"
+
+#include "cli.cpp"
+#include "rpc.cpp"
+#include "ssd1306.cpp"
+#include "ui.cpp"
+
+#include "handlers.cpp"
+
+#include "host.cpp"
+
+//
+// Helpers
+//
+
+//! Single test, returns whether it passed
+struct Test
+{
+	const char* name;
+	bool (*run)();
+};
+
+//! Reports failed expectation and returns from the test
+#define TEST_EXPECT(x) \
+	do { \
+		if(!(x)) { \
+			printf("%s:%d: failed %s\n", __FILE__, __LINE__, #x); \
+			return false; \
+		} \
+	} while(0)
+
+//
+// Deferred logging (log.cpp)
+//
+
+//! Producers writing at once, each of them is a thread, not a task, so
+//! they run really in parallel, which is harder than interrupts preempting
+//! the tasks on the board
+constexpr u32 TEST_LOG_WRITERS = 4;
+
+//! Records written by each producer
+constexpr u32 TEST_LOG_RECORDS = 50000;
+
+//! Record id, which is not a real format string
+constexpr u16 TEST_LOG_ID = 0x1234;
+
+//! Low byte of every argument is LOG_COMMITTED, so any stale word of old
+//! records looks like committed header, if the consumer leaves it in the ring
+static u32 test_log_argument(u32 writer, u32 sequence, u32 index)
+{
+	return (((writer * 0x9E3779B9u) ^ (sequence * 0x85EBCA6Bu) ^ (index << 28)) & ~0xFFu) | LOG_COMMITTED;
+}
+
+//! Received records of each producer and the ones reported as dropped
+static u32 test_log_received[TEST_LOG_WRITERS];
+static u32 test_log_next[TEST_LOG_WRITERS];
+static u32 test_log_dropped;
+static bool test_log_corrupted;
+
+//! Written records, set when all producers finished
+static volatile bool test_log_done;
+
+static void* test_log_writer(void* params)
+{
+	const auto writer = (u32)(uintptr_t)(params);
+
+	// Lengths of the records differ, so stale words land at all offsets
+	for(u32 sequence = 0; sequence < TEST_LOG_RECORDS; ++sequence) {
+		const auto argument = [&](u32 index) { return test_log_argument(writer, sequence, index); };
+		switch((sequence + writer) % 3) {
+			case 0:
+				log_write(TEST_LOG_ID, writer, sequence);
+				break;
+			case 1:
+				log_write(TEST_LOG_ID, writer, sequence, argument(0));
+				break;
+			default:
+				log_write(TEST_LOG_ID, writer, sequence, argument(0), argument(1), argument(2), argument(3));
+				break;
+		}
+
+		// Let the consumer run now and then, even on single core, otherwise
+		// the ring is full almost all the time and most records are dropped
+		if((sequence % 8) == 0) {
+			sched_yield();
+		}
+	}
+	return nullptr;
+}
+
+//! Checks the frame written by `log_flush`
+static void test_log_record(const char* data, u32 size)
+{
+	u32 words[LOG_MAX_WORDS];
+	const auto count = ((size - 1) / sizeof(u32));
+	if((data[0] != (char)(LOG_FRAME_START)) || (((size - 1) % sizeof(u32)) != 0) || (count < LOG_HEADER_WORDS)) {
+		test_log_corrupted = true;
+		return;
+	}
+	memcpy(words, &data[1], count * sizeof(u32));
+
+	const auto id = (words[0] >> 16);
+	if((((words[0] >> 8) & 0xFF) != count) || ((words[0] & 0xFF) != LOG_COMMITTED)) {
+		test_log_corrupted = true;
+		return;
+	}
+	if(id == LOG_DROPPED_ID) {
+		test_log_dropped += words[3];
+		return;
+	}
+
+	// Producer, its sequence and the arguments must be the ones it wrote
+	const auto writer = words[3];
+	const auto sequence = words[4];
+	const auto arguments = (count - LOG_HEADER_WORDS - 2);
+	const u32 expected = (((sequence + writer) % 3) == 0) ? 0 : (((sequence + writer) % 3) == 1) ? 1 : 4;
+	if((id != TEST_LOG_ID) || (writer >= TEST_LOG_WRITERS) || (sequence < test_log_next[writer]) || (arguments != expected)) {
+		test_log_corrupted = true;
+		return;
+	}
+	for(u32 i = 0; i < arguments; ++i) {
+		if(words[5 + i] != test_log_argument(writer, sequence, i)) {
+			test_log_corrupted = true;
+			return;
+		}
+	}
+
+	test_log_next[writer] = (sequence + 1);
+	test_log_received[writer]++;
+}
+
+static void* test_log_consumer(void* params)
+{
+	static_cast<void>(params);
+
+	// Flushes as fast as it can, so the ring wraps around all the time,
+	// and once more after the producers, to get the last records
+	while(!test_log_done && !test_log_corrupted) {
+		log_flush(test_log_record);
+	}
+	if(!test_log_corrupted) {
+		log_flush(test_log_record);
+	}
+	return nullptr;
+}
+
+//! Records from concurrent producers are either received intact or counted
+//! as dropped, none is received twice or made of words of older records
+static bool test_log_concurrent_writers()
+{
+	pthread_t consumer;
+	pthread_t writers[TEST_LOG_WRITERS];
+	TEST_EXPECT(pthread_create(&consumer, nullptr, test_log_consumer, nullptr) == 0);
+	for(u32 i = 0; i < TEST_LOG_WRITERS; ++i) {
+		TEST_EXPECT(pthread_create(&writers[i], nullptr, test_log_writer, (void*)(uintptr_t)(i)) == 0);
+	}
+	for(auto& writer : writers) {
+		pthread_join(writer, nullptr);
+	}
+	test_log_done = true;
+	pthread_join(consumer, nullptr);
+
+	u32 received = 0;
+	for(const auto count : test_log_received) {
+		received += count;
+	}
+	printf("log: %u records received, %u dropped\n", received, test_log_dropped);
+
+	TEST_EXPECT(!test_log_corrupted);
+	TEST_EXPECT((received + test_log_dropped) == (TEST_LOG_WRITERS * TEST_LOG_RECORDS));
+	TEST_EXPECT(log_head == log_tail);
+	for(const auto word : log_ring) {
+		TEST_EXPECT(word == 0);
+	}
+	return true;
+}
+
+//
+// Buttons debouncing and gestures (buttons.cpp, gestures.cpp)
+//
+
+//! Event expected from the trace
+struct TestButtonsEvent
+{
+	GestureType type;
+	u8 pins;
+};
+
+//! Levels of the buttons in consecutive samples (DEBOUNCE_INTERVAL_MS), with
+//! bounces as they come from the contacts, and the events they must produce
+struct TestButtonsTrace
+{
+	const char* name;
+	const char* levels; // '.' none, 'L' left, 'R' right, 'B' both pressed, count repeats the previous one
+	TestButtonsEvent events[8];
+	u8 count;
+};
+
+constexpr u8 TEST_L = BTN_LEFT_PIN;
+constexpr u8 TEST_R = BTN_RIGHT_PIN;
+constexpr u8 TEST_B = BTNS_PINS;
+
+// Default timings: long press 100 samples, double click 38, repeat 25
+static const TestButtonsTrace TEST_BUTTONS_TRACES[] = {
+	{ "bounces only", ".2L.LL.LLL..10", {}, 0 },
+	{ "click", ".2L..L.LL10.L.L.60", {
+		{ GestureType::Press, TEST_L },
+		{ GestureType::Release, TEST_L },
+	}, 2 },
+	{ "long press", ".2R.RR129.R.60", {
+		{ GestureType::Press, TEST_R },
+		{ GestureType::LongPress, TEST_R },
+		{ GestureType::Repeat, TEST_R },
+		{ GestureType::Release, TEST_R },
+	}, 4 },
+	{ "double click", ".2L.L8.L.5L.L8.60", {
+		{ GestureType::Press, TEST_L },
+		{ GestureType::Release, TEST_L },
+		{ GestureType::DoubleClick, TEST_L },
+		{ GestureType::Release, TEST_L },
+	}, 4 },
+	{ "chord", ".2B.BB.B10.B.60", {
+		{ GestureType::Chord, TEST_B },
+		{ GestureType::Release, TEST_L },
+		{ GestureType::Release, TEST_R },
+	}, 3 },
+	{ "staggered chord", ".2L.L6BRB10.60", {
+		{ GestureType::Press, TEST_L },
+		{ GestureType::Chord, TEST_B },
+		{ GestureType::Release, TEST_L },
+		{ GestureType::Release, TEST_R },
+	}, 4 },
+};
+
+//! Pressed pins of the level in the trace
+static u8 test_buttons_pins(char level)
+{
+	switch(level) {
+		case 'L': return TEST_L;
+		case 'R': return TEST_R;
+		case 'B': return TEST_B;
+		default: return 0;
+	}
+}
+
+//! Plays the trace on the pins: edge interrupt of GPIOF, while it is enabled,
+//! otherwise TIMER0 interrupt every sample. Stores received events
+static u32 test_buttons_play(const char* levels, GestureEvent* events, u32 size)
+{
+	// Nothing is pressed at the start, so nothing is reported when released
+	GPIOF->DATA[BTNS_PINS] = BTNS_PINS;
+	buttons_init();
+
+	u8 previous = 0;
+	u32 count = 0;
+	for(const char* cursor = levels; *cursor;) {
+		const auto pins = test_buttons_pins(*(cursor++));
+		u32 repeat = 0;
+		while((*cursor >= '0') && (*cursor <= '9')) {
+			repeat = (repeat * 10) + (*(cursor++) - '0');
+		}
+
+		for(u32 i = 0; i < max<u32>(repeat, 1); ++i) {
+			// Buttons are pulled up, pressed one reads as zero
+			GPIOF->DATA[BTNS_PINS] = (~pins & BTNS_PINS);
+
+			auto highpriotask_woken = pdFALSE;
+			if(TIMER0->CTL & TIMER_CTL_TAEN) {
+				TIMER0A_handler();
+			}
+			else if((pins ^ previous) & GPIOF->IM) {
+				buttons_touched((pins ^ previous) & GPIOF->IM, &highpriotask_woken);
+			}
+			previous = pins;
+
+			GestureEvent event;
+			while((count < size) && (xQueueReceive(buttons_queue, &event, 0) == pdTRUE)) {
+				events[count++] = event;
+			}
+		}
+	}
+	return count;
+}
+
+//! Bounces shorter than DEBOUNCE_SAMPLES make no events, the rest make
+//! the gestures, and debouncing ends with the timer stopped and the edges
+//! enabled again
+static bool test_buttons_traces()
+{
+	for(const auto& trace : TEST_BUTTONS_TRACES) {
+		GestureEvent events[16];
+		const auto count = test_buttons_play(trace.levels, events, 16);
+		printf("buttons: %s:", trace.name);
+		for(u32 i = 0; i < count; ++i) {
+			printf(" %u/0x%02X", (u32)(events[i].type), events[i].pins);
+		}
+		printf("\n");
+
+		TEST_EXPECT(count == trace.count);
+		for(u32 i = 0; i < count; ++i) {
+			TEST_EXPECT(events[i].type == trace.events[i].type);
+			TEST_EXPECT(events[i].pins == trace.events[i].pins);
+		}
+		TEST_EXPECT(!(TIMER0->CTL & TIMER_CTL_TAEN));
+		TEST_EXPECT((GPIOF->IM & BTNS_PINS) == BTNS_PINS);
+		TEST_EXPECT(!gestures_busy());
+	}
+	return true;
+}
+
+//! Events, which do not fit the queue, are counted and reported by the reader
+static bool test_buttons_dropped()
+{
+	// Six clicks, no double ones, while nobody reads the queue
+	GestureEvent events[1];
+	TEST_EXPECT(test_buttons_play(".2L6.60L6.60L6.60L6.60L6.60L6.60", events, 0) == 0);
+	TEST_EXPECT(uxQueueMessagesWaiting(buttons_queue) == 8);
+	TEST_EXPECT(buttons_dropped == 4);
+
+	const auto event = buttons_read_event();
+	TEST_EXPECT((event.type == GestureType::Press) && (event.pins == TEST_L));
+	TEST_EXPECT(buttons_dropped == 0);
+	return true;
+}
+
+//
+// Kernel heap (heap.cpp)
+//
+
+// Random allocations and frees of kernel-like objects, done by the TLSF
+// allocator and two reference ones of the same capacity: heap_1 of FreeRTOS
+// (bump pointer, never frees) and first-fit over the address-ordered free
+// list with merging of the neighbours (like heap_4). The same sequence is
+// replayed TEST_HEAP_RUNS times and every operation keeps its fastest time,
+// so preemption of the process does not hide in the worst case.
+
+//! Live objects at most, operations and replays of the sequence
+constexpr u32 TEST_HEAP_SLOTS = 32;
+constexpr u32 TEST_HEAP_STEPS = 100000;
+constexpr u32 TEST_HEAP_RUNS = 5;
+
+//! Allocator under the test
+struct TestAllocator
+{
+	const char* name;
+	void (*init)();
+	void* (*alloc)(size_t size);
+	void (*free)(void* ptr);
+	void (*usage)(size_t& free, size_t& largest); // Bytes in free blocks, with headers
+};
+
+static void test_tlsf_init()
+{
+	// Formatting alone expects empty lists, like at the startup
+	memset(heap_lists, 0, sizeof(heap_lists));
+	memset(heap_sl_bitmaps, 0, sizeof(heap_sl_bitmaps));
+	heap_fl_bitmap = 0;
+	heap_init();
+}
+
+static void test_tlsf_free(void* ptr)
+{
+	heap_free(ptr);
+}
+
+static void test_tlsf_usage(size_t& free, size_t& largest)
+{
+	free = (heap_stats.capacity - heap_stats.used);
+	largest = heap_largest_free();
+}
+
+//! heap_1: blocks are cut from the start of the rest, freeing does nothing
+alignas(HEAP_ALIGN) static u8 test_heap1_memory[configTOTAL_HEAP_SIZE];
+static size_t test_heap1_used;
+
+static void test_heap1_init()
+{
+	test_heap1_used = 0;
+}
+
+static void* test_heap1_alloc(size_t size)
+{
+	size = ((size + HEAP_ALIGN - 1) & ~(HEAP_ALIGN - 1));
+	if(size > (sizeof(test_heap1_memory) - test_heap1_used)) {
+		return nullptr;
+	}
+
+	const auto ptr = &test_heap1_memory[test_heap1_used];
+	test_heap1_used += size;
+	return ptr;
+}
+
+static void test_heap1_free(void* ptr)
+{
+	static_cast<void>(ptr);
+}
+
+static void test_heap1_usage(size_t& free, size_t& largest)
+{
+	free = largest = (sizeof(test_heap1_memory) - test_heap1_used);
+}
+
+//! First-fit: free blocks are linked by address, allocation takes the first
+//! one big enough and splits it, freeing merges it with adjacent free blocks
+struct TestFitBlock
+{
+	TestFitBlock* next; // Next free block, by address
+	size_t size; // Size of the whole block (with header)
+};
+
+constexpr size_t TEST_FIT_HEADER = ((sizeof(TestFitBlock) + HEAP_ALIGN - 1) & ~(HEAP_ALIGN - 1));
+
+alignas(HEAP_ALIGN) static u8 test_fit_memory[configTOTAL_HEAP_SIZE];
+static TestFitBlock* test_fit_free_list;
+
+//! The longest walk over the free list by single operation
+static u32 test_fit_longest_walk;
+
+static void test_fit_init()
+{
+	test_fit_free_list = (TestFitBlock*)(test_fit_memory);
+	test_fit_free_list->next = nullptr;
+	test_fit_free_list->size = sizeof(test_fit_memory);
+	test_fit_longest_walk = 0;
+}
+
+static void* test_fit_alloc(size_t wanted)
+{
+	const auto size = max((wanted + TEST_FIT_HEADER + HEAP_ALIGN - 1) & ~(HEAP_ALIGN - 1), 2 * TEST_FIT_HEADER);
+
+	u32 walk = 0;
+	auto link = &test_fit_free_list;
+	for(; *link && ((*link)->size < size); link = &(*link)->next) {
+		walk++;
+	}
+	test_fit_longest_walk = max(test_fit_longest_walk, walk);
+
+	const auto block = *link;
+	if(!block) {
+		return nullptr;
+	}
+
+	// Rest of the block stays in its place of the list, if it makes a block
+	if((block->size - size) >= (2 * TEST_FIT_HEADER)) {
+		const auto rest = (TestFitBlock*)((u8*)(block) + size);
+		rest->next = block->next;
+		rest->size = (block->size - size);
+		block->size = size;
+		*link = rest;
+	} else {
+		*link = block->next;
+	}
+	return ((u8*)(block) + TEST_FIT_HEADER);
+}
+
+static void test_fit_free(void* ptr)
+{
+	auto block = (TestFitBlock*)((u8*)(ptr) - TEST_FIT_HEADER);
+
+	u32 walk = 0;
+	TestFitBlock* prev = nullptr;
+	auto next = test_fit_free_list;
+	for(; next && (next < block); prev = next, next = next->next) {
+		walk++;
+	}
+	test_fit_longest_walk = max(test_fit_longest_walk, walk);
+
+	block->next = next;
+	if(next && (((u8*)(block) + block->size) == (u8*)(next))) {
+		block->size += next->size;
+		block->next = next->next;
+	}
+
+	if(prev && (((u8*)(prev) + prev->size) == (u8*)(block))) {
+		prev->size += block->size;
+		prev->next = block->next;
+	} else if(prev) {
+		prev->next = block;
+	} else {
+		test_fit_free_list = block;
+	}
+}
+
+static void test_fit_usage(size_t& free, size_t& largest)
+{
+	free = largest = 0;
+	for(auto block = test_fit_free_list; block; block = block->next) {
+		free += block->size;
+		largest = max(largest, block->size);
+	}
+}
+
+static const TestAllocator TEST_ALLOCATORS[] = {
+	{ "tlsf", test_tlsf_init, heap_alloc, test_tlsf_free, test_tlsf_usage },
+	{ "heap_1", test_heap1_init, test_heap1_alloc, test_heap1_free, test_heap1_usage },
+	{ "first-fit", test_fit_init, test_fit_alloc, test_fit_free, test_fit_usage },
+};
+
+//! Pseudo-random numbers (xorshift32), the same sequence for the same seed
+static u32 test_random(u32& state)
+{
+	state ^= (state << 13);
+	state ^= (state >> 17);
+	state ^= (state << 5);
+	return state;
+}
+
+//! Sizes like kernel objects: mostly small ones, some queues and stacks
+static size_t test_heap_size(u32& state)
+{
+	const auto kind = (test_random(state) % 100);
+	const auto range = (kind < 70) ? 64 : (kind < 95) ? 256 : 1024;
+	return (8 + (test_random(state) % range));
+}
+
+static u64 test_now_ns()
+{
+	timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return ((u64)(now.tv_sec) * 1000000000ull + (u64)(now.tv_nsec));
+}
+
+//! Results of the allocator
+struct TestHeapResult
+{
+	u32 failures; // Allocations, which returned nothing
+	u32 fragmented; // Failures, while free bytes would be enough
+	u32 worst_fragmentation; // Percent of free bytes outside the largest block
+	u64 alloc_ns; // The slowest allocation and free
+	u64 free_ns;
+};
+
+//! Fastest time of every operation over the replays
+static u32 test_heap_times[TEST_HEAP_STEPS];
+
+//! Replays the sequence with the allocator, checks that the objects never
+//! overlap (every one is filled by its own pattern and checked, when freed)
+static bool test_heap_run(const TestAllocator& allocator, TestHeapResult& result)
+{
+	result = {};
+	memset(test_heap_times, 0xFF, sizeof(test_heap_times));
+	u32 alloc_steps[TEST_HEAP_STEPS / 32 + 1] = {};
+
+	for(u32 run = 0; run < TEST_HEAP_RUNS; ++run) {
+		u8* slots[TEST_HEAP_SLOTS] = {};
+		size_t sizes[TEST_HEAP_SLOTS] = {};
+		u32 state = 0x2545F491;
+		allocator.init();
+
+		for(u32 step = 0; step < TEST_HEAP_STEPS; ++step) {
+			const auto slot = (test_random(state) % TEST_HEAP_SLOTS);
+			const auto pattern = (u8)(slot + 1);
+			u64 start;
+			if(!slots[slot]) {
+				const auto size = test_heap_size(state);
+				start = test_now_ns();
+				slots[slot] = (u8*)(allocator.alloc(size));
+				test_heap_times[step] = min<u32>(test_heap_times[step], test_now_ns() - start);
+				alloc_steps[step / 32] |= (1u << (step % 32));
+
+				if(!slots[slot]) {
+					if(run == 0) {
+						size_t free, largest;
+						allocator.usage(free, largest);
+						result.failures++;
+						result.fragmented += (free >= (size + (2 * HEAP_HEADER_SIZE)));
+					}
+					continue;
+				}
+
+				TEST_EXPECT(((uintptr_t)(slots[slot]) % HEAP_ALIGN) == 0);
+				sizes[slot] = size;
+				memset(slots[slot], pattern, size);
+			} else {
+				for(size_t i = 0; i < sizes[slot]; ++i) {
+					TEST_EXPECT(slots[slot][i] == pattern);
+				}
+				start = test_now_ns();
+				allocator.free(slots[slot]);
+				test_heap_times[step] = min<u32>(test_heap_times[step], test_now_ns() - start);
+				slots[slot] = nullptr;
+			}
+
+			if(run == 0) {
+				size_t free, largest;
+				allocator.usage(free, largest);
+				if(free > 0) {
+					result.worst_fragmentation = max<u32>(result.worst_fragmentation, 100 - (100 * largest / free));
+				}
+			}
+		}
+
+		// Everything freed at the end is merged back into single block
+		for(u32 slot = 0; slot < TEST_HEAP_SLOTS; ++slot) {
+			if(slots[slot]) {
+				allocator.free(slots[slot]);
+			}
+		}
+		size_t free, largest;
+		allocator.usage(free, largest);
+		TEST_EXPECT(largest == free);
+	}
+
+	for(u32 step = 0; step < TEST_HEAP_STEPS; ++step) {
+		auto& worst = (alloc_steps[step / 32] & (1u << (step % 32))) ? result.alloc_ns : result.free_ns;
+		worst = max<u64>(worst, test_heap_times[step]);
+	}
+	return true;
+}
+
+//! TLSF keeps working with random frees and has bounded time of operations
+static bool test_heap_stress()
+{
+	printf("heap: %-10s %9s %11s %14s %9s %9s\n", "allocator", "failures", "fragmented", "fragmentation", "alloc ns", "free ns");
+	TestHeapResult results[sizeof(TEST_ALLOCATORS) / sizeof(TEST_ALLOCATORS[0])];
+	for(u32 i = 0; i < (sizeof(TEST_ALLOCATORS) / sizeof(TEST_ALLOCATORS[0])); ++i) {
+		const auto& allocator = TEST_ALLOCATORS[i];
+		auto& result = results[i];
+		TEST_EXPECT(test_heap_run(allocator, result));
+		printf("heap: %-10s %9u %11u %13u%% %9llu %9llu\n", allocator.name, result.failures, result.fragmented,
+			result.worst_fragmentation, (unsigned long long)(result.alloc_ns), (unsigned long long)(result.free_ns));
+	}
+	printf("heap: first-fit walked %u free blocks at most\n", test_fit_longest_walk);
+	return true;
+}
+
+//
+// Backtraces (unwind.cpp), symbolized by tools/symbolize.py
+//
+
+//! Depth of the printed backtrace
+constexpr u32 TEST_BACKTRACE_DEPTH = 8;
+
+//! Calls of known functions, `make symbolize-check` expects them in this
+//! order, under `unwind_backtrace_here`
+__attribute__((noinline)) static u32 test_backtrace_leaf(u32* addresses)
+{
+	const auto depth = unwind_backtrace_here(addresses, TEST_BACKTRACE_DEPTH);
+	__asm volatile("" ::: "memory"); // Not a tail call
+	return depth;
+}
+
+__attribute__((noinline)) static u32 test_backtrace_middle(u32* addresses)
+{
+	const auto depth = test_backtrace_leaf(addresses);
+	__asm volatile("" ::: "memory");
+	return depth;
+}
+
+__attribute__((noinline)) static u32 test_backtrace_root(u32* addresses)
+{
+	const auto depth = test_backtrace_middle(addresses);
+	__asm volatile("" ::: "memory");
+	return depth;
+}
+
+//! Prints backtrace the way the failure log does
+static bool test_unwind_backtrace()
+{
+	u32 addresses[TEST_BACKTRACE_DEPTH];
+	const auto depth = test_backtrace_root(addresses);
+	TEST_EXPECT(depth >= 4);
+
+	for(u32 i = 0; i < depth; ++i) {
+		printf("  at 0x%08x\n", addresses[i]);
+	}
+	return true;
+}
+
+//
+// Tests runner
+//
+
+static const Test TESTS[] = {
+	{ "log_concurrent_writers", test_log_concurrent_writers },
+	{ "buttons_traces", test_buttons_traces },
+	{ "buttons_dropped", test_buttons_dropped },
+	{ "heap_stress", test_heap_stress },
+	{ "unwind_backtrace", test_unwind_backtrace },
+};
+
+int main(int argc, char** argv)
+{
+	bool passed = true;
+	for(const auto& test : TESTS) {
+		bool selected = (argc < 2);
+		for(int i = 1; i < argc; ++i) {
+			selected |= (strcmp(argv[i], test.name) == 0);
+		}
+		if(!selected) {
+			continue;
+		}
+
+		fflush(stdout);
+		const auto result = test.run();
+		printf("%s: %s\n", test.name, result ? "OK" : "FAIL");
+		passed &= result;
+	}
+
+	printf("%s\n", passed ? "OK" : "FAIL");
+	return (passed ? EXIT_SUCCESS : EXIT_FAILURE);
+}
+
+//
+// Free RTOS hooks
+//
+
+void vApplicationIdleHook()
+{
+}
+
+void vApplicationStackOverflowHook(TaskHandle_t pxTask, char *pcTaskName)
+{
+	static_cast<void>(pxTask);
+	log_failure(pcTaskName, "", 0, "stack overflow");
+	halt();
+}
+
+void vApplicationMallocFailedHook()
+{
+	log_failure(__FILE__, __func__, __LINE__, "malloc failed");
+	halt();
+}
+
+//
+// Flash hooks
+//
+
+void flash_lock()
+{
+}
+
+void flash_unlock()
+{
+}
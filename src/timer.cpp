@@ -0,0 +1,124 @@
+///////////////////////////////////////////////////////////////////////////////
+// General-Purpose Timers management
+///////////////////////////////////////////////////////////////////////////////
+
+// To use a GPTM, the appropriate TIMERn bit must be set in the RCGCTIMER
+// or RCGCWTIMER register. The GPTM is configured for Periodic mode by
+// following sequence:
+// 1. Ensure the timer is disabled (the TnEN bit in the CTL register is cleared)
+// before making any changes.
+// 2. Write the GPTM Configuration Register (CFG) with a value of 0x0000.0000.
+// 3. Configure the TnMR field in the GPTM Timer n Mode Register (TnMR):
+// write a value of 0x2 for Periodic mode.
+// 4. Optionally configure the TnSNAPS, TnWOT, TnMTE, and TnCDIR bits in the
+// TnMR register to select whether to capture the value of the free-running
+// timer at time-out, use an external trigger to start counting, configure
+// an additional trigger or interrupt, and count up or down.
+// 5. Load the start value into the GPTM Timer n Interval Load Register (TnILR).
+// 6. If interrupts are required, set the appropriate bits in the GPTM
+// Interrupt Mask Register (IMR).
+// 7. Set the TnEN bit in the CTL register to enable the timer and start counting.
+// 8. Poll the GPTMRIS register or wait for the interrupt to be generated
+// (if enabled). In both cases, the status flags are cleared by writing a 1
+// to the appropriate bit of the GPTM Interrupt Clear Register (ICR).
+
+struct TIMER_Block
+{
+	RW u32 CFG; // Configuration
+	RW u32 TAMR; // Timer A Mode
+	RW u32 TBMR; // Timer B Mode
+	RW u32 CTL; // Control
+	RW u32 SYNC; // Synchronize
+	RO u32 _reserved1[0x1];
+	RW u32 IMR; // Interrupt Mask
+	RO u32 RIS; // Raw Interrupt Status
+	RO u32 MIS; // Masked Interrupt Status
+	W1C u32 ICR; // Interrupt Clear
+	RW u32 TAILR; // Timer A Interval Load
+	RW u32 TBILR; // Timer B Interval Load
+	RW u32 TAMATCHR; // Timer A Match
+	RW u32 TBMATCHR; // Timer B Match
+	RW u32 TAPR; // Timer A Prescale
+	RW u32 TBPR; // Timer B Prescale
+	RW u32 TAPMR; // Timer A Prescale Match
+	RW u32 TBPMR; // Timer B Prescale Match
+	RO u32 TAR; // Timer A
+	RO u32 TBR; // Timer B
+	RW u32 TAV; // Timer A Value
+	RW u32 TBV; // Timer B Value
+	RO u32 RTCPD; // RTC Predivide
+	RO u32 TAPS; // Timer A Prescale Snapshot
+	RO u32 TBPS; // Timer B Prescale Snapshot
+	RO u32 TAPV; // Timer A Prescale Value
+	RO u32 TBPV; // Timer B Prescale Value
+	RO u32 _reserved2[0x3D5];
+	RO u32 PP; // Peripheral Properties
+};
+
+static_assert(offsetof(TIMER_Block, CFG) == 0x000);
+static_assert(offsetof(TIMER_Block, TAMR) == 0x004);
+static_assert(offsetof(TIMER_Block, TBMR) == 0x008);
+static_assert(offsetof(TIMER_Block, CTL) == 0x00C);
+static_assert(offsetof(TIMER_Block, SYNC) == 0x010);
+static_assert(offsetof(TIMER_Block, IMR) == 0x018);
+static_assert(offsetof(TIMER_Block, RIS) == 0x01C);
+static_assert(offsetof(TIMER_Block, MIS) == 0x020);
+static_assert(offsetof(TIMER_Block, ICR) == 0x024);
+static_assert(offsetof(TIMER_Block, TAILR) == 0x028);
+static_assert(offsetof(TIMER_Block, TBILR) == 0x02C);
+static_assert(offsetof(TIMER_Block, TAMATCHR) == 0x030);
+static_assert(offsetof(TIMER_Block, TBMATCHR) == 0x034);
+static_assert(offsetof(TIMER_Block, TAPR) == 0x038);
+static_assert(offsetof(TIMER_Block, TBPR) == 0x03C);
+static_assert(offsetof(TIMER_Block, TAPMR) == 0x040);
+static_assert(offsetof(TIMER_Block, TBPMR) == 0x044);
+static_assert(offsetof(TIMER_Block, TAR) == 0x048);
+static_assert(offsetof(TIMER_Block, TBR) == 0x04C);
+static_assert(offsetof(TIMER_Block, TAV) == 0x050);
+static_assert(offsetof(TIMER_Block, TBV) == 0x054);
+static_assert(offsetof(TIMER_Block, RTCPD) == 0x058);
+static_assert(offsetof(TIMER_Block, TAPS) == 0x05C);
+static_assert(offsetof(TIMER_Block, TBPS) == 0x060);
+static_assert(offsetof(TIMER_Block, TAPV) == 0x064);
+static_assert(offsetof(TIMER_Block, TBPV) == 0x068);
+static_assert(offsetof(TIMER_Block, PP) == 0xFC0);
+
+// 16/32-bit timers
+#define TIMER0 HW_BLOCK(TIMER_Block, 0x40030000)
+#define TIMER1 HW_BLOCK(TIMER_Block, 0x40031000)
+#define TIMER2 HW_BLOCK(TIMER_Block, 0x40032000)
+#define TIMER3 HW_BLOCK(TIMER_Block, 0x40033000)
+#define TIMER4 HW_BLOCK(TIMER_Block, 0x40034000)
+#define TIMER5 HW_BLOCK(TIMER_Block, 0x40035000)
+
+// 32/64-bit wide timers
+#define WTIMER0 HW_BLOCK(TIMER_Block, 0x40036000)
+#define WTIMER1 HW_BLOCK(TIMER_Block, 0x40037000)
+#define WTIMER2 HW_BLOCK(TIMER_Block, 0x4004C000)
+#define WTIMER3 HW_BLOCK(TIMER_Block, 0x4004D000)
+#define WTIMER4 HW_BLOCK(TIMER_Block, 0x4004E000)
+#define WTIMER5 HW_BLOCK(TIMER_Block, 0x4004F000)
+
+//
+// Bit fields of timer registers
+//
+
+// CFG register
+constexpr u32 TIMER_CFG_32_BIT_TIMER = 0x0; // 32-bit (or 64-bit for wide) timer
+constexpr u32 TIMER_CFG_16_BIT = 0x4; // 16-bit (or 32-bit for wide) timers
+
+// TAMR/TBMR registers
+constexpr u32 TIMER_TnMR_ONE_SHOT = 0x1; // One-Shot Timer mode
+constexpr u32 TIMER_TnMR_PERIOD = 0x2; // Periodic Timer mode
+constexpr u32 TIMER_TnMR_CAP = 0x3; // Capture mode
+constexpr u32 TIMER_TnMR_CDIR = (1 << 4); // Count Direction (up)
+
+// CTL register
+constexpr u32 TIMER_CTL_TAEN = (1 << 0); // Timer A Enable
+constexpr u32 TIMER_CTL_TASTALL = (1 << 1); // Timer A Stall Enable (when debugging)
+constexpr u32 TIMER_CTL_TBEN = (1 << 8); // Timer B Enable
+constexpr u32 TIMER_CTL_TBSTALL = (1 << 9); // Timer B Stall Enable (when debugging)
+
+// IMR, RIS, MIS and ICR registers
+constexpr u32 TIMER_INT_TATO = (1 << 0); // Timer A Time-Out
+constexpr u32 TIMER_INT_TBTO = (1 << 8); // Timer B Time-Out
@@ -0,0 +1,256 @@
+///////////////////////////////////////////////////////////////////////////////
+// Kernel trace recorder
+///////////////////////////////////////////////////////////////////////////////
+
+// Kernel trace hooks (see FreeRTOSTrace.h) call `trace_record`, which stores
+// fixed-size binary record in the RAM ring. Records can be produced by tasks
+// and interrupts at once, so slots are reserved lock-free, by incrementing
+// the head index with exclusive access (see atomic.cpp). Timestamp is taken
+// inside the reservation loop, so records in the ring are always ordered by
+// time. Record is committed by the last write of event id, so the single
+// consumer can tell reserved slots from the finished ones.
+//
+// Consumer (see `trace_drain`) converts timestamps into deltas from previous
+// record, so host gets compact stream, which is independent of the counter
+// wraps. When the ring is full, records are dropped and the consumer reports
+// how many of them were lost. The consumer is the low-priority trace task,
+// like the one of log.cpp, which sends the records by the output given to
+// `trace_start`, so the caller only waits for the end of the stream.
+//
+// NOTE: The stream is binary, so the caller must own the UART for the whole
+// time (the "trace" command holds `uart_lock`). Records of the trace task
+// itself are in the stream too, but it runs only every TRACE_INTERVAL,
+// unless the ring is being filled faster than it is sent
+//
+// Stream starts with TRACE_MAGIC and CPU clock frequency, followed by records
+// describing names of tasks and then by the recorded events.
+// Use tools/trace2json.py to convert it into Chrome/Perfetto JSON timeline.
+
+//
+// Public types
+//
+
+//! Single record of the trace, the same in the ring and in the stream
+struct TraceRecord
+{
+	u32 time; // Timestamp (in ring) or delta from previous record (in stream), in CPU cycles
+	u8 event; // One of TRACE_* ids, zero marks not yet committed slot
+	u8 object; // Number of task or queue, which the event is related to
+	u16 arg; // Additional data specific for the event
+};
+
+static_assert(sizeof(TraceRecord) == 8);
+
+//
+// Helper constants
+//
+
+//! Number of records in the ring, must be power of two
+constexpr u32 TRACE_RING_SIZE = 128;
+static_assert((TRACE_RING_SIZE & (TRACE_RING_SIZE - 1)) == 0);
+
+//! Beginning of the stream (ASCII "TRC1")
+constexpr u32 TRACE_MAGIC = 0x31435254;
+
+//! Number of records sent at once
+constexpr u32 TRACE_CHUNK = 16;
+
+//! How often the ring is checked for new records, when it was empty
+constexpr TickType_t TRACE_INTERVAL = pdMS_TO_TICKS(10);
+
+//
+// Global variables
+//
+
+//! Ring of trace records
+static TraceRecord trace_ring[TRACE_RING_SIZE];
+
+//! Index of next slot to be reserved by producers (not wrapped)
+static volatile u32 trace_head;
+
+//! Index of next slot to be read by the consumer (not wrapped)
+static volatile u32 trace_tail;
+
+//! Records lost because the ring was full
+static volatile u32 trace_dropped;
+
+//! Whether events are recorded
+static volatile bool trace_enabled;
+
+//! Timestamp of last record read by consumer
+static u32 trace_last_time;
+
+//! Last number given to the queue
+static volatile u8 trace_queue_number;
+
+RTOS_MEMORY static RtosTask<configMINIMAL_STACK_SIZE> trace_task_memory;
+static TaskHandle_t trace_sender;
+
+//! Output of the stream, given to `trace_start`
+static void (*trace_output)(const char* data, u32 size);
+
+//! Task waiting in `trace_stop` for the last records to be sent
+static TaskHandle_t trace_stopper;
+
+//
+// Public functions
+//
+
+//! Records single event. Safe to be called from tasks and interrupts
+void trace_record(u8 event, u8 object, u16 arg)
+{
+	if(!trace_enabled) {
+		return;
+	}
+
+	// Reserve the slot and take its timestamp atomically
+	u32 head;
+	u32 time;
+	do {
+		head = atomic_load_exclusive(&trace_head);
+		time = dwt_cycles();
+
+		if((head - trace_tail) >= TRACE_RING_SIZE) {
+			// Ring is full, consumer will report that later
+			atomic_clear_exclusive();
+			atomic_add(&trace_dropped, 1);
+			return;
+		}
+	} while(!atomic_store_exclusive(&trace_head, head + 1));
+
+	auto& slot = trace_ring[head & (TRACE_RING_SIZE - 1)];
+	slot.time = time;
+	slot.object = object;
+	slot.arg = arg;
+
+	// Commit the record, once all other fields are visible
+	atomic_barrier();
+	slot.event = event;
+}
+
+//! Gives unique number to the new queue, used by its trace records
+u8 trace_next_queue_number()
+{
+	return ++trace_queue_number;
+}
+
+//! Starts recording of events, forgetting all previous ones. The trace task
+//! sends them by specified output, until `trace_stop`
+void trace_start(void (*output)(const char* data, u32 size))
+{
+	assert(output != nullptr);
+	trace_output = output;
+
+	trace_enabled = false;
+
+	// Begin with empty ring
+	for(auto& slot : trace_ring) {
+		slot.event = 0;
+	}
+
+	trace_tail = trace_head;
+	trace_dropped = 0;
+	trace_last_time = dwt_cycles();
+
+	atomic_barrier();
+	trace_enabled = true;
+	xTaskNotifyGive(trace_sender);
+}
+
+//! Stops recording of events, returns when all recorded ones were sent
+void trace_stop()
+{
+	trace_stopper = xTaskGetCurrentTaskHandle();
+	trace_enabled = false;
+	ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+}
+
+//! Moves committed records from the ring into specified buffer
+// Converts timestamps into deltas and reports dropped records.
+// Returns number of records stored in the buffer
+u32 trace_drain(TraceRecord* records, u32 count)
+{
+	assert(records != nullptr);
+	assert(count > 0);
+
+	u32 i = 0;
+
+	// Report lost records before the ones recorded after them
+	const auto dropped = atomic_exchange(&trace_dropped, 0);
+	if(dropped) {
+		const auto now = dwt_cycles();
+		records[i++] = { now - trace_last_time, TRACE_DROPPED, 0, (u16)(min<u32>(dropped, UINT16_MAX)) };
+		trace_last_time = now;
+	}
+
+	for(; i < count; ++i) {
+		auto& slot = trace_ring[trace_tail & (TRACE_RING_SIZE - 1)];
+		if(!slot.event) {
+			// Not committed yet (or nothing more)
+			break;
+		}
+
+		atomic_barrier();
+		records[i] = slot;
+		records[i].time = (slot.time - trace_last_time);
+		trace_last_time = slot.time;
+
+		// Free the slot for producers
+		slot.event = 0;
+		atomic_barrier();
+		trace_tail = (trace_tail + 1);
+	}
+
+	return i;
+}
+
+//! Builds records with name of the task, two characters per record
+// Returns number of records stored in the buffer
+u32 trace_task_name(u8 task, const char* name, TraceRecord* records, u32 count)
+{
+	u32 i = 0;
+	for(; i < count && name[0]; ++i) {
+		const u16 chars = (name[0] | (name[1] << 8));
+		records[i] = { 0, TRACE_TASK_NAME, task, chars };
+		name += (name[1] ? 2 : 1);
+	}
+
+	return i;
+}
+
+//
+// Trace task
+//
+
+static void trace_task(void* params)
+{
+	static_cast<void>(params);
+
+	// Too big for the stack of the task
+	static TraceRecord records[TRACE_CHUNK];
+
+	while(true) {
+		// Sleep until the stream is started
+		ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+
+		// Send what is in the ring, wait for more only when it was empty.
+		// Stopped trace is checked after the drain, so its records are sent
+		u32 count;
+		do {
+			const bool enabled = trace_enabled;
+			count = trace_drain(records, TRACE_CHUNK);
+			if(count > 0) {
+				trace_output((const char*)(records), count * sizeof(TraceRecord));
+			} else if(enabled) {
+				vTaskDelay(TRACE_INTERVAL);
+			}
+		} while(trace_enabled || (count > 0));
+
+		xTaskNotifyGive(trace_stopper);
+	}
+}
+
+void trace_init()
+{
+	CHECK(trace_sender = trace_task_memory.create(trace_task, "trace", nullptr, tskIDLE_PRIORITY + 1));
+}
@@ -19,6 +19,15 @@ using i64 = int64_t;
 #define W1C
 #define RW1C
 
+//! Hardware block of specified type at the address, e.g. `HW_BLOCK(UART_Block, 0x4000C000)`
+// Host build (see host.cpp) redirects the address to the simulated registers
+#ifdef TARGET_HOST
+volatile void* host_registers(u32 address);
+#define HW_BLOCK(type, address) ((volatile type*)(host_registers(address)))
+#else
+#define HW_BLOCK(type, address) ((volatile type*)(address))
+#endif
+
 //! Generic buffer to store byte data
 struct Buffer
 {
@@ -92,21 +92,43 @@ static_assert(offsetof(UART_Block, BIT9AMASK) == 0x0A8);
 static_assert(offsetof(UART_Block, PP) == 0xFC0);
 static_assert(offsetof(UART_Block, CC) == 0xFC8);
 
-#define UART0 ((volatile UART_Block*)(0x4000C000))
-#define UART1 ((volatile UART_Block*)(0x4000D000))
-#define UART2 ((volatile UART_Block*)(0x4000E000))
-#define UART3 ((volatile UART_Block*)(0x4000F000))
-#define UART4 ((volatile UART_Block*)(0x40010000))
-#define UART5 ((volatile UART_Block*)(0x40011000))
-#define UART6 ((volatile UART_Block*)(0x40012000))
-#define UART7 ((volatile UART_Block*)(0x40013000))
+constexpr u32 UART0_BASE = 0x4000C000;
+constexpr u32 UART1_BASE = 0x4000D000;
+constexpr u32 UART2_BASE = 0x4000E000;
+constexpr u32 UART3_BASE = 0x4000F000;
+constexpr u32 UART4_BASE = 0x40010000;
+constexpr u32 UART5_BASE = 0x40011000;
+constexpr u32 UART6_BASE = 0x40012000;
+constexpr u32 UART7_BASE = 0x40013000;
+
+#define UART0 HW_BLOCK(UART_Block, UART0_BASE)
+#define UART1 HW_BLOCK(UART_Block, UART1_BASE)
+#define UART2 HW_BLOCK(UART_Block, UART2_BASE)
+#define UART3 HW_BLOCK(UART_Block, UART3_BASE)
+#define UART4 HW_BLOCK(UART_Block, UART4_BASE)
+#define UART5 HW_BLOCK(UART_Block, UART5_BASE)
+#define UART6 HW_BLOCK(UART_Block, UART6_BASE)
+#define UART7 HW_BLOCK(UART_Block, UART7_BASE)
+
+//! Bit-band alias of single bit in the register of the UART
+// E.g. `UART_BITBAND(UART0_BASE, IM, UART_IM_TXIM) = 0` atomically masks interrupt
+#define UART_BITBAND(base, reg, mask) \
+	bitband<(base) + offsetof(UART_Block, reg), (mask)>()
 
 //
 // Global variables
 //
 
+//! Received characters, enough for several RPC requests sent at once (see rpc.cpp)
+constexpr u32 UART_RX_QUEUE_SIZE = 64;
+
+RTOS_MEMORY static RtosQueue<char, UART_RX_QUEUE_SIZE> rx_queue_memory;
 static QueueHandle_t rx_queue = nullptr;
 
+//! Mutual exclusion of tasks writing to the UART
+RTOS_MEMORY static RtosMutex tx_mutex_memory;
+static SemaphoreHandle_t tx_mutex = nullptr;
+
 static volatile const char* tx_string;
 static volatile const char* tx_string_end;
 static volatile TaskHandle_t tx_task;
@@ -121,8 +143,8 @@ void uart_init()
 	// Global data initialization
 	//
 
-	const auto rx_queue_size = 8;
-	CHECK(rx_queue = xQueueCreate(rx_queue_size, sizeof(char)));
+	CHECK(rx_queue = rx_queue_memory.create());
+	CHECK(tx_mutex = tx_mutex_memory.create());
 
 	tx_task = nullptr;
 	tx_string = nullptr;
@@ -151,7 +173,7 @@ void uart_init()
 	//
 
 	// Disable UART first
-	UART0->CTL &= ~UART_CTL_UARTEN;
+	UART_BITBAND(UART0_BASE, CTL, UART_CTL_UARTEN) = 0;
 
 	// Wait for end of transmission or reception of the current character
 	while(UART0->FR & UART_FR_BUSY);
@@ -199,6 +221,7 @@ u32 uart_read_until(char* string, u32 size, char delimiter)
 		// if one is not already available.
 		char c;
 		CHECK(xQueueReceive(rx_queue, &c, portMAX_DELAY));
+		latency_task_resumed(LATENCY_UART0_RX);
 		if(c == delimiter) {
 			// We have reached delimiter, we have to stop further reading
 			break;
@@ -212,13 +235,39 @@ u32 uart_read_until(char* string, u32 size, char delimiter)
 	return i;
 }
 
+//! Reads single character, waiting for it at most specified time
+// Returns whether any character has been received
+bool uart_read_char(char& c, TickType_t timeout)
+{
+	if(xQueueReceive(rx_queue, &c, timeout) != pdTRUE) {
+		return false;
+	}
+
+	latency_task_resumed(LATENCY_UART0_RX);
+	return true;
+}
+
+//! Gives the calling task exclusive access to UART writing
+// Should be held by whole sequence of writes, which must not be interleaved
+// with writes of other tasks
+void uart_lock()
+{
+	CHECK(xSemaphoreTake(tx_mutex, portMAX_DELAY));
+}
+
+//! Releases access taken by `uart_lock`
+void uart_unlock()
+{
+	CHECK(xSemaphoreGive(tx_mutex));
+}
+
 void uart_write(const char* string, u32 size)
 {
 	assert(string != nullptr);
 	assert(size > 0);
 
 	// Note there is no mutual exclusion at the driver level. If more than one
-	// task is using the serial port then mutual exclusion should be provided 
+	// task is using the serial port then `uart_lock` should be taken
 	// where this function is called. 
 
 	// Ensure notifications are not already waiting
@@ -257,6 +306,14 @@ void uart_write(char const (&data)[N])
 	uart_write(data, N);
 }
 
+//! Writes formatted text (see format.cpp), e.g. `uart_format(FORMAT("used: {}\n"), used)`
+// Text is sent in chunks of the small buffer on the stack, so it has no size limit
+template<typename Format, typename... Args>
+void uart_format(Format format, Args... args)
+{
+	format_write(uart_write, format, args...);
+}
+
 // The transmit interrupt changes state when one of the following events occurs:
 // - If the FIFOs are enabled and the transmit FIFO progresses through the programmed trigger
 // level, the TXRIS bit is set. The transmit interrupt is based on a transition through level, therefore
@@ -271,6 +328,8 @@ void uart_write(char const (&data)[N])
 
 void UART0_handler()
 {
+	latency_isr_entry(LATENCY_UART0_RX);
+
 	// We need to know, if some of the operations done here may 
 	// unblock task with higher priority.
 	auto highpriotask_woken = pdFALSE;
@@ -325,5 +384,6 @@ void UART0_handler()
 	that left the blocked state has a higher priority than the currently running
 	task (the task this interrupt interrupted).  See the comment above the calls
 	to xSemaphoreGiveFromISR() and xQueueSendFromISR() within this function. */
+	latency_isr_exit(LATENCY_UART0_RX, (masked_status & UART_MIS_RXMIS));
 	portYIELD_FROM_ISR(highpriotask_woken);
 }
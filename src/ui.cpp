@@ -148,10 +148,11 @@ static void ui_task([[maybe_unused]] void* params)
 // Public functions
 //
 
+RTOS_MEMORY static RtosTask<configMINIMAL_STACK_SIZE> ui_task_memory;
+
 void ui_init()
 {
-	const auto stacksize = configMINIMAL_STACK_SIZE;
 	const auto params = nullptr;
 	const auto priority = (tskIDLE_PRIORITY + 1);
-	CHECK(xTaskCreate(ui_task, "ui", stacksize, params, priority, nullptr));
+	CHECK(ui_task_memory.create(ui_task, "ui", params, priority));
 }
\ No newline at end of file
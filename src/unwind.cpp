@@ -0,0 +1,372 @@
+///////////////////////////////////////////////////////////////////////////////
+// Stack unwinder
+///////////////////////////////////////////////////////////////////////////////
+
+// Backtraces are built without frame pointers, using ARM exception handling
+// ABI (EHABI) unwind table. The compiler emits it (see -funwind-tables in
+// Makefile) as `.ARM.exidx` section, sorted by the linker, with one 8-byte
+// entry per function: address of the function and short bytecode, which
+// describes how to undo its prologue (e.g. "pop {r4-r7, lr}"). Longer
+// bytecodes are placed in `.ARM.extab`. Only compact personality routines
+// are supported, which is enough for C++ without exceptions.
+//
+// Unwinding repeatedly finds the entry of the function containing the PC,
+// executes its bytecode on the virtual register set and continues with
+// the return address. All stack reads are bounded to SRAM, so it is safe to
+// run it in fault handlers, even on corrupted stack.
+//
+// Addresses of the backtrace are symbolised on the host by tools/symbolize.py
+//
+// Host build (see host.cpp) has its own unwinder in the C library, only
+// `unwind_backtrace_here` is provided there.
+
+#ifndef TARGET_HOST
+
+//
+// Helper constants
+//
+
+//! Entry of the function, which cannot be unwound (e.g. naked functions)
+constexpr u32 UNWIND_EXIDX_CANTUNWIND = 0x1;
+
+//! First address of SRAM
+constexpr u32 UNWIND_SRAM_START = 0x20000000;
+
+//! Indexes of special registers
+constexpr u8 UNWIND_SP = 13;
+constexpr u8 UNWIND_LR = 14;
+constexpr u8 UNWIND_PC = 15;
+
+//
+// Public types
+//
+
+//! Virtual register set, updated by the unwinding
+struct UnwindState
+{
+	u32 r[16];
+};
+
+//
+// Global variables
+//
+
+//! Bounds of the unwind table, provided by linker script
+extern const u32 __exidx_start[];
+extern const u32 __exidx_end[];
+
+extern unsigned __stacktop;
+
+//
+// Private functions
+//
+
+//! Checks whether specified range of words is readable SRAM
+// Used also by crash.cpp for reading the stack in fault handlers
+bool unwind_readable(u32 address, u32 words)
+{
+	const auto sram_end = (u32)((uintptr_t)(&__stacktop));
+	return ((address & 0x3) == 0) && (address >= UNWIND_SRAM_START) && (address < sram_end) &&
+		(words <= ((sram_end - address) / sizeof(u32)));
+}
+
+//! Decodes 31-bit offset relative to its own address
+static const u32* unwind_prel31(const u32* word)
+{
+	const auto offset = ((i32)(*word << 1) >> 1);
+	return (const u32*)((uintptr_t)(word) + offset);
+}
+
+//! Returns address of the function described by entry of the unwind table
+static u32 unwind_function(const u32* entry)
+{
+	// Thumb bit is set in addresses of the functions
+	return ((u32)((uintptr_t)(unwind_prel31(entry))) & ~1u);
+}
+
+//! Finds entry of the unwind table of the function containing the address
+static const u32* unwind_find(u32 address)
+{
+	const u32* first = __exidx_start;
+	u32 count = ((__exidx_end - __exidx_start) / 2);
+	if(!count || (address < unwind_function(first))) {
+		return nullptr;
+	}
+
+	// Find the last entry starting at or before the address
+	while(count > 1) {
+		const auto half = (count / 2);
+		const auto middle = (first + half * 2);
+		if(unwind_function(middle) <= address) {
+			first = middle;
+			count -= half;
+		} else {
+			count = half;
+		}
+	}
+
+	return first;
+}
+
+//! Reads bytecode of the function into the buffer
+// Returns number of the bytes, zero if function cannot be unwound
+static u32 unwind_bytecode(const u32* entry, u8* bytes, u32 size)
+{
+	const auto data = entry[1];
+	if(data == UNWIND_EXIDX_CANTUNWIND) {
+		return 0;
+	}
+
+	// Data is either inline compact entry or offset into `.ARM.extab`
+	const auto table = (data & 0x80000000) ? &entry[1] : unwind_prel31(&entry[1]);
+	if(!(*table & 0x80000000)) {
+		// Generic personality routine, used only with exceptions
+		return 0;
+	}
+
+	// Personality 0 has 3 bytes in the first word, 1 and 2 have 2 bytes
+	// in the first word followed by specified number of words
+	const auto personality = ((*table >> 24) & 0xF);
+	u32 count = 0;
+	u32 words = 0;
+	u32 shift = 16;
+	if(personality == 0) {
+		shift = 16;
+	} else if(personality <= 2) {
+		words = ((*table >> 16) & 0xFF);
+		shift = 8;
+	} else {
+		return 0;
+	}
+
+	for(u32 word = 0; word <= words; ++word) {
+		const auto value = table[word];
+		for(i32 bit = shift; bit >= 0; bit -= 8) {
+			if(count < size) {
+				bytes[count++] = (value >> bit);
+			}
+		}
+		shift = 24;
+	}
+
+	return count;
+}
+
+//! Pops word from the virtual stack
+static bool unwind_pop(UnwindState& state, u32& value)
+{
+	if(!unwind_readable(state.r[UNWIND_SP], 1)) {
+		return false;
+	}
+
+	value = *(const u32*)((uintptr_t)(state.r[UNWIND_SP]));
+	state.r[UNWIND_SP] += sizeof(u32);
+	return true;
+}
+
+//! Pops registers selected by the mask (bit 0 is r0)
+static bool unwind_pop_mask(UnwindState& state, u16 mask)
+{
+	// SP popped from the stack is applied after all other registers
+	u32 sp = 0;
+	for(u8 reg = 0; reg < 16; ++reg) {
+		if(mask & (1 << reg)) {
+			if(!unwind_pop(state, (reg == UNWIND_SP) ? sp : state.r[reg])) {
+				return false;
+			}
+		}
+	}
+
+	if(mask & (1 << UNWIND_SP)) {
+		state.r[UNWIND_SP] = sp;
+	}
+
+	return true;
+}
+
+//! Executes bytecode of the function on virtual registers
+// Returns false, when bytecode is not supported or stack is invalid
+static bool unwind_execute(UnwindState& state, const u8* bytes, u32 count)
+{
+	bool pc_set = false;
+
+	for(u32 i = 0; i < count; ++i) {
+		const auto op = bytes[i];
+		const auto next = ((i + 1) < count) ? bytes[i + 1] : 0;
+
+		if((op & 0xC0) == 0x00) {
+			// vsp = vsp + (xxxxxx << 2) + 4
+			state.r[UNWIND_SP] += ((op & 0x3F) << 2) + 4;
+		} else if((op & 0xC0) == 0x40) {
+			// vsp = vsp - (xxxxxx << 2) - 4
+			state.r[UNWIND_SP] -= ((op & 0x3F) << 2) + 4;
+		} else if((op & 0xF0) == 0x80) {
+			// Pop r4-r15 under 12-bit mask
+			const u16 mask = ((((op & 0x0F) << 8) | next) << 4);
+			if(!mask) {
+				return false; // Refuse to unwind
+			}
+			if(!unwind_pop_mask(state, mask)) {
+				return false;
+			}
+			pc_set |= (mask & (1 << UNWIND_PC));
+			i++;
+		} else if((op & 0xF0) == 0x90) {
+			// vsp = r[nnnn]
+			const auto reg = (op & 0x0F);
+			if((reg == UNWIND_SP) || (reg == UNWIND_PC)) {
+				return false;
+			}
+			state.r[UNWIND_SP] = state.r[reg];
+		} else if((op & 0xF0) == 0xA0) {
+			// Pop r4-r[4+nnn], optionally r14
+			u16 mask = (((1 << ((op & 0x07) + 1)) - 1) << 4);
+			if(op & 0x08) {
+				mask |= (1 << UNWIND_LR);
+			}
+			if(!unwind_pop_mask(state, mask)) {
+				return false;
+			}
+		} else if(op == 0xB0) {
+			// Finish
+			break;
+		} else if(op == 0xB1) {
+			// Pop r0-r3 under mask
+			if(!next || (next & 0xF0) || !unwind_pop_mask(state, next)) {
+				return false;
+			}
+			i++;
+		} else if(op == 0xB2) {
+			// vsp = vsp + 0x204 + (uleb128 << 2)
+			u32 value = 0;
+			u32 shift = 0;
+			do {
+				if(++i >= count) {
+					return false;
+				}
+				value |= ((bytes[i] & 0x7F) << shift);
+				shift += 7;
+			} while(bytes[i] & 0x80);
+			state.r[UNWIND_SP] += 0x204 + (value << 2);
+		} else if(op == 0xB3) {
+			// Pop VFP registers saved by FSTMFDX
+			state.r[UNWIND_SP] += ((next & 0x0F) + 1) * 8 + 4;
+			i++;
+		} else if((op & 0xF8) == 0xB8) {
+			// Pop VFP d8-d[8+nnn] saved by FSTMFDX
+			state.r[UNWIND_SP] += ((op & 0x07) + 1) * 8 + 4;
+		} else if((op == 0xC8) || (op == 0xC9)) {
+			// Pop VFP registers saved by VPUSH
+			state.r[UNWIND_SP] += ((next & 0x0F) + 1) * 8;
+			i++;
+		} else if((op & 0xF8) == 0xD0) {
+			// Pop VFP d8-d[8+nnn] saved by VPUSH
+			state.r[UNWIND_SP] += ((op & 0x07) + 1) * 8;
+		} else {
+			// Spare or not available on Cortex-M4
+			return false;
+		}
+	}
+
+	if(!pc_set) {
+		state.r[UNWIND_PC] = state.r[UNWIND_LR];
+	}
+
+	return true;
+}
+
+//
+// Public functions
+//
+
+//! Builds backtrace starting from specified register set
+// Returns number of addresses stored, the first one is PC of the state
+u32 unwind_backtrace(UnwindState& state, u32* addresses, u32 count)
+{
+	u32 depth = 0;
+	while(depth < count) {
+		const auto pc = (state.r[UNWIND_PC] & ~1u);
+		addresses[depth++] = pc;
+
+		// Return addresses point after the call, which might be the last
+		// instruction of the function (e.g. call of [[noreturn]] function)
+		const auto entry = unwind_find((depth > 1) ? (pc - 2) : pc);
+		if(!entry) {
+			break;
+		}
+
+		u8 bytes[16];
+		const auto bytes_count = unwind_bytecode(entry, bytes, sizeof(bytes));
+		if(!bytes_count) {
+			break;
+		}
+
+		const auto sp = state.r[UNWIND_SP];
+		if(!unwind_execute(state, bytes, bytes_count)) {
+			break;
+		}
+
+		// Stop at the end of the stack (e.g. task function or exception return)
+		if(((state.r[UNWIND_PC] & ~1u) == pc) && (state.r[UNWIND_SP] == sp)) {
+			break;
+		}
+		if(!(state.r[UNWIND_PC] & 1) || (state.r[UNWIND_PC] >= 0xF0000000)) {
+			break;
+		}
+	}
+
+	return depth;
+}
+
+//! Stores registers of the caller, as they are right after the call
+// r4-r11 and SP are unchanged and the caller continues at LR
+extern "C" __attribute__((naked, noinline)) void unwind_capture([[maybe_unused]] UnwindState* state)
+{
+	__asm volatile
+	(
+		" add r0, r0, #16                                           \n"
+		" stmia r0!, {r4-r11}                                       \n"
+		" mov r1, sp                                                \n"
+		" str r1, [r0, #4]                                          \n"
+		" str lr, [r0, #8]                                          \n"
+		" str lr, [r0, #12]                                         \n"
+		" bx lr                                                     \n"
+	);
+}
+
+//! Builds backtrace of the calling function
+// Returns number of addresses stored, the first one is inside this function
+__attribute__((noinline)) u32 unwind_backtrace_here(u32* addresses, u32 count)
+{
+	UnwindState state = {};
+	unwind_capture(&state);
+	return unwind_backtrace(state, addresses, count);
+}
+
+//
+// Personality routines
+//
+
+// Every entry of the unwind table refers to its personality routine, which
+// would pull whole exception handling runtime from libgcc. Since there are
+// no exceptions, they are never called.
+extern "C" void __aeabi_unwind_cpp_pr0() { while(true); }
+extern "C" void __aeabi_unwind_cpp_pr1() { while(true); }
+extern "C" void __aeabi_unwind_cpp_pr2() { while(true); }
+
+#else
+
+//! Builds backtrace of the calling function
+// Executable is not position independent, so addresses fit into 32 bits
+__attribute__((noinline)) u32 unwind_backtrace_here(u32* addresses, u32 count)
+{
+	void* frames[16];
+	const auto depth = backtrace(frames, min<u32>(count, sizeof(frames) / sizeof(frames[0])));
+	for(i32 i = 0; i < depth; ++i) {
+		addresses[i] = (u32)((uintptr_t)(frames[i]));
+	}
+
+	return depth;
+}
+
+#endif
@@ -0,0 +1,329 @@
+///////////////////////////////////////////////////////////////////////////////
+// Firmware update with two slots
+///////////////////////////////////////////////////////////////////////////////
+
+// Flash is split into the bootloader (see boot.cpp) and two slots of the
+// application, linked for their own addresses (slot_a.ld, slot_b.ld):
+//   0x00000000  bootloader, 16K
+//   0x00004000  slot A: header block, image (vector table first)
+//   0x00021000  slot B: header block, image
+//   0x0003E000  configuration store, 8K (see config.cpp)
+// Image starts in the second block of the slot, so the header can be erased
+// and written on its own, and the vector table is aligned for VTOR.
+//
+// Running application receives the image of the other slot in chunks (e.g.
+// by tools/update.py over binary RPC, see rpc.cpp) and programs each one at
+// once. Blocks are erased as the chunks come to them. Commit checks CRC-32
+// of the whole image and its vector table, and only then writes the header,
+// with sequence number above the one of the running slot. Header is the last
+// thing written, so the switch is atomic: until it is complete, the header
+// checksum fails and the bootloader keeps starting the old slot.
+//
+// Bootloader starts the slot with valid header, image CRC and the highest
+// sequence number. Slot A without any header (e.g. written by lm4flash)
+// is started as well, when its vector table looks sane.
+
+//
+// Helper constants
+//
+
+//! Layout of the flash, must match the linker scripts of the images. Blocks
+//! after the slots are left to the configuration store
+constexpr u32 UPDATE_BOOT_SIZE = 0x4000;
+constexpr u32 UPDATE_SLOT_SIZE = 0x1D000;
+constexpr u32 UPDATE_SLOTS = 2;
+constexpr u32 UPDATE_SLOT_ADDRESS[UPDATE_SLOTS] = { UPDATE_BOOT_SIZE, UPDATE_BOOT_SIZE + UPDATE_SLOT_SIZE };
+constexpr u32 UPDATE_SLOTS_END = (UPDATE_SLOT_ADDRESS[UPDATE_SLOTS - 1] + UPDATE_SLOT_SIZE);
+static_assert(UPDATE_SLOTS_END <= FLASH_SIZE);
+
+//! Returned, when no slot fits
+constexpr u8 UPDATE_SLOT_NONE = 0xFF;
+
+//! Header has its own block, the rest of the slot is the image
+constexpr u32 UPDATE_HEADER_SIZE = FLASH_BLOCK_SIZE;
+constexpr u32 UPDATE_IMAGE_MAX = (UPDATE_SLOT_SIZE - UPDATE_HEADER_SIZE);
+
+//! Address of the image (and its vector table) in the slot
+constexpr u32 update_image_address(u8 slot)
+{
+	return (UPDATE_SLOT_ADDRESS[slot] + UPDATE_HEADER_SIZE);
+}
+
+//! Bootloader points VTOR to the image, which keeps only bits 31:10 of it
+static_assert(((update_image_address(0) % 1024) == 0) && ((update_image_address(1) % 1024) == 0),
+	"Vector table of the image is not aligned for VTOR");
+
+//! Longest chunk of the image, programmed by single write buffer command
+constexpr u32 UPDATE_CHUNK_SIZE = FLASH_WRITE_BUFFER_SIZE;
+
+//! Marks the header of the slot ("UPDT")
+constexpr u32 UPDATE_MAGIC = 0x54445055;
+
+//! Initial stack pointer of the image has to point into SRAM
+constexpr u32 UPDATE_SRAM_BEGIN = 0x20000000;
+constexpr u32 UPDATE_SRAM_END = (UPDATE_SRAM_BEGIN + 32 * 1024);
+
+//! Results of the update steps
+enum UpdateStatus : u8
+{
+	UPDATE_OK,
+	UPDATE_NOT_STARTED, // No update_begin before
+	UPDATE_TOO_BIG, // Image does not fit the slot
+	UPDATE_BAD_OFFSET, // Chunks have to come in order
+	UPDATE_BAD_CHUNK, // Empty, too long or not whole words (but the last one)
+	UPDATE_FLASH_FAILED,
+	UPDATE_INCOMPLETE, // Commit before the whole image was written
+	UPDATE_BAD_CRC,
+	UPDATE_BAD_IMAGE, // Vector table does not belong to the slot
+};
+
+//
+// Private types
+//
+
+//! Header in the first block of the slot
+struct UpdateHeader
+{
+	u32 magic;
+	u32 sequence; // The highest one is started
+	u32 size; // Size of the image
+	u32 crc; // CRC-32 of the image
+	u32 checksum; // CRC-32 of the fields above
+};
+
+//! Update in progress
+struct UpdateSession
+{
+	bool active;
+	u8 slot;
+	u32 size;
+	u32 crc;
+	u32 written; // Bytes of the image written so far
+	u32 erased; // Address of the first block not erased yet
+	u64 cycles; // Time spent erasing and programming
+};
+
+//
+// Global variables
+//
+
+static UpdateSession update_session;
+
+//
+// Private functions
+//
+
+static u32 update_header_checksum(const UpdateHeader& header)
+{
+	return crc32(&header, offsetof(UpdateHeader, checksum));
+}
+
+//! Returns header of the slot, or nullptr when it is not valid
+static const UpdateHeader* update_header(u8 slot)
+{
+	const auto header = (const UpdateHeader*)(flash_memory(UPDATE_SLOT_ADDRESS[slot]));
+	if((header->magic != UPDATE_MAGIC) || (header->checksum != update_header_checksum(*header)) ||
+		(header->size > UPDATE_IMAGE_MAX)) {
+		return nullptr;
+	}
+	return header;
+}
+
+//! Whether the image starts by vector table linked for the slot
+static bool update_vectors_valid(u8 slot, u32 size)
+{
+	const auto image = update_image_address(slot);
+	const auto vectors = (const u32*)(flash_memory(image));
+	const auto stack = vectors[0];
+	const auto reset = vectors[1];
+	return (stack > UPDATE_SRAM_BEGIN) && (stack <= UPDATE_SRAM_END) && !(stack & 3) &&
+		(reset & 1) && ((reset & ~1u) >= image) && ((reset & ~1u) < (image + size));
+}
+
+//! Whether the image matches the header
+static bool update_image_valid(u8 slot, const UpdateHeader& header)
+{
+	const auto image = update_image_address(slot);
+	return update_vectors_valid(slot, header.size) && (crc32(flash_memory(image), header.size) == header.crc);
+}
+
+//! Measures the flash operation
+template<typename Operation>
+static bool update_flash(Operation operation)
+{
+	const auto begin = dwt_cycles();
+	const bool done = operation();
+	update_session.cycles += (dwt_cycles() - begin);
+	return done;
+}
+
+//
+// Public functions
+//
+
+//! Returns name of the slot
+inline const char* update_slot_name(u8 slot)
+{
+	return slot ? "B" : "A";
+}
+
+//! Returns sequence number of the slot, zero when it has no valid header
+u32 update_sequence(u8 slot)
+{
+	const auto header = update_header(slot);
+	return header ? header->sequence : 0;
+}
+
+//! Returns size of the image in the slot, zero when it has no valid header
+u32 update_image_size(u8 slot)
+{
+	const auto header = update_header(slot);
+	return header ? header->size : 0;
+}
+
+//! Selects the slot to be started, checks whole image by its CRC
+u8 update_boot_slot()
+{
+	u8 best = UPDATE_SLOT_NONE;
+	u32 sequence = 0;
+	for(u8 slot = 0; slot < UPDATE_SLOTS; ++slot) {
+		const auto header = update_header(slot);
+		if(header && (header->sequence >= sequence) && update_image_valid(slot, *header)) {
+			best = slot;
+			sequence = header->sequence;
+		}
+	}
+
+	// Slot A written by the programmer, without any header
+	if((best == UPDATE_SLOT_NONE) && update_vectors_valid(0, UPDATE_IMAGE_MAX)) {
+		best = 0;
+	}
+	return best;
+}
+
+//! Returns slot of the running application, by its vector table
+u8 update_running_slot()
+{
+	for(u8 slot = 0; slot < UPDATE_SLOTS; ++slot) {
+		if(SCB->VTOR == update_image_address(slot)) {
+			return slot;
+		}
+	}
+	return UPDATE_SLOT_NONE;
+}
+
+//! Returns the slot, which receives the update
+u8 update_target_slot()
+{
+	return (update_running_slot() == 0) ? 1 : 0;
+}
+
+//! Starts update of the other slot, erases its header at once, so it is never
+//! started half written
+UpdateStatus update_begin(u32 size, u32 crc)
+{
+	update_session.active = false;
+	if(!size || (size > UPDATE_IMAGE_MAX)) {
+		return UPDATE_TOO_BIG;
+	}
+
+	const auto slot = update_target_slot();
+	update_session = { true, slot, size, crc, 0, update_image_address(slot), 0 };
+	if(!update_flash([slot] { return flash_erase(UPDATE_SLOT_ADDRESS[slot]); })) {
+		update_session.active = false;
+		return UPDATE_FLASH_FAILED;
+	}
+	return UPDATE_OK;
+}
+
+//! Programs the next chunk of the image
+UpdateStatus update_write(u32 offset, const u8* data, u32 size)
+{
+	auto& session = update_session;
+	if(!session.active) {
+		return UPDATE_NOT_STARTED;
+	}
+	if(offset != session.written) {
+		return UPDATE_BAD_OFFSET;
+	}
+
+	const auto end = (offset + size);
+	if(!size || (size > UPDATE_CHUNK_SIZE) || (end > session.size) || ((size & 3) && (end != session.size))) {
+		return UPDATE_BAD_CHUNK;
+	}
+
+	const auto address = (update_image_address(session.slot) + offset);
+	while(session.erased < (address + size)) {
+		if(!update_flash([&session] { return flash_erase(session.erased); })) {
+			return UPDATE_FLASH_FAILED;
+		}
+		session.erased += FLASH_BLOCK_SIZE;
+	}
+
+	if(!update_flash([=] { return flash_write(address, data, size); })) {
+		return UPDATE_FLASH_FAILED;
+	}
+
+	session.written = end;
+	return UPDATE_OK;
+}
+
+//! Verifies the whole image and writes the header, which switches the slot
+//! started by the bootloader
+UpdateStatus update_commit()
+{
+	auto& session = update_session;
+	if(!session.active) {
+		return UPDATE_NOT_STARTED;
+	}
+	if(session.written != session.size) {
+		return UPDATE_INCOMPLETE;
+	}
+
+	const auto slot = session.slot;
+	UpdateHeader header = { UPDATE_MAGIC, 0, session.size, session.crc, 0 };
+	if(crc32(flash_memory(update_image_address(slot)), session.size) != session.crc) {
+		return UPDATE_BAD_CRC;
+	}
+	if(!update_vectors_valid(slot, session.size)) {
+		return UPDATE_BAD_IMAGE;
+	}
+
+	header.sequence = (update_sequence(1 - slot) + 1);
+	header.checksum = update_header_checksum(header);
+	if(!update_flash([&] { return flash_write(UPDATE_SLOT_ADDRESS[slot], &header, sizeof(header)); })) {
+		return UPDATE_FLASH_FAILED;
+	}
+
+	session.active = false;
+	return UPDATE_OK;
+}
+
+//! Returns bytes of the image written so far
+u32 update_written()
+{
+	return update_session.written;
+}
+
+//! Returns cycles spent by erasing and programming in the last update
+u64 update_flash_cycles()
+{
+	return update_session.cycles;
+}
+
+//! Returns description of the status
+const char* update_status_name(UpdateStatus status)
+{
+	switch(status) {
+		case UPDATE_OK: return "ok";
+		case UPDATE_NOT_STARTED: return "no update started";
+		case UPDATE_TOO_BIG: return "image does not fit the slot";
+		case UPDATE_BAD_OFFSET: return "chunk out of order";
+		case UPDATE_BAD_CHUNK: return "bad size of the chunk";
+		case UPDATE_FLASH_FAILED: return "flash operation failed";
+		case UPDATE_INCOMPLETE: return "image not written whole";
+		case UPDATE_BAD_CRC: return "CRC of the image does not match";
+		case UPDATE_BAD_IMAGE: return "image is not linked for the slot";
+		default: return "unknown";
+	}
+}
@@ -2,6 +2,20 @@
 // Utilities
 ///////////////////////////////////////////////////////////////////////////////
 
+//! Logs the failure, defined in log.cpp
+void log_failure(const char* file, const char* function, int line, const char* expr);
+
+//! Stops the program after the failure
+[[noreturn]] inline void halt()
+{
+#ifndef TARGET_HOST
+	while(1);
+#else
+	// Nobody would notice hanging simulator (see host.cpp), so end the process
+	abort();
+#endif
+}
+
 // Generic hook to be called, when CHECK(...) macro detects failure
 [[noreturn]] void check_failed(const char* file, const char* function, int line, const char* expr)
 {
@@ -12,8 +26,11 @@
 	static_cast<void>(line);
 	static_cast<void>(expr);
 
+	// Report the failure over UART, if possible
+	log_failure(file, function, line, expr);
+
 	// Abort the program
-	while(1);
+	halt();
 }
 
 //! Helper macro, hangs if specified condition is failed (=false)
@@ -30,8 +47,11 @@
 	static_cast<void>(line);
 	static_cast<void>(expr);
 
+	// Report the failure over UART, if possible
+	log_failure(file, function, line, expr);
+
 	// Abort the program
-	while(1);
+	halt();
 }
 
 //! Simple assertion macro, available only when NDEBUG is not present
@@ -56,7 +76,7 @@ template<typename X, typename Y>
 	static_cast<void>(y);
 
 	// Abort the program
-	while(1);
+	halt();
 }
 
 //! Simple assertion macro for testing equality, available only when NDEBUG is not present
@@ -68,40 +88,16 @@ template<typename X, typename Y>
 #define assert_equal(x, y) if((x) != (y)) __builtin_unreachable();
 #endif
 
-//! Converts numerical value to string
-// Similar to stdlib's `itoa`, but does not add any '\0' char at the end
-// and writes data "from_back", instead of re-writing it at the begin of string
-char* to_digits_ascii(u32 value, char* buffer_end)
+//! Returns smaller of two values
+template<typename T>
+constexpr T min(T a, T b)
 {
-	// 1234567 / 10 = 123456
-	// 1234567 - 123456*10 = 7
-	// -------
-	// 123456 / 10 = 12345
-	// 123456 - 12345*10 = 6
-	// -------
-	// 12345 / 10 = 1234
-	// 12345 - 1234*10 = 5
-	// ...
-
-	// 7654321
-	//   ...
-	// 1234567
-
-	// 1000 / 10 = 100
-	// 1000 - 100*10 = 0
-	
-	auto buffer = buffer_end;
-
-	do {
-		// TODO: May be done more performant by lookup table!
-		const auto tmp = (value / 10);
-		const u8 digit = (value - tmp*10);
-		value = tmp;
-
-		assert(digit < 10);
-		*(--buffer) = digit + '0';
-	} 
-	while(value);
+	return (a < b) ? a : b;
+}
 
-	return buffer;
-}
\ No newline at end of file
+//! Returns bigger of two values
+template<typename T>
+constexpr T max(T a, T b)
+{
+	return (a > b) ? a : b;
+}
@@ -0,0 +1,152 @@
+#!/usr/bin/env python3
+###############################################################################
+# Benchmarks runner
+# Runs benchmarks of bench.cpp in QEMU, counts their instructions per
+# iteration and compares them against the baseline
+###############################################################################
+
+import argparse
+import json
+import os
+import re
+import subprocess
+import sys
+
+# Board emulated by QEMU, Cortex-M4 with FPU and memory map of TM4C123
+MACHINE = 'mps2-an386'
+
+# Output of the instruction counting plugin (contrib/plugins or tests/plugin
+# of QEMU), depending on its version
+INSTRUCTIONS = re.compile(r'^(?:total )?insns:\s*(\d+)\s*$', re.MULTILINE)
+
+# Result printed by bench.cpp right before it exits QEMU
+RESULT = re.compile(r'^\{"benchmark".*\}$', re.MULTILINE)
+
+
+def run(args, name=None, iterations=None):
+    """Runs the program with given semihosting command line, returns its
+    output and number of executed instructions"""
+    cmdline = 'arg=bench'
+    if name is not None:
+        cmdline += ',arg=%s,arg=%d' % (name, iterations)
+
+    command = [
+        args.qemu, '-M', MACHINE, '-nographic', '-serial', 'null', '-monitor', 'none',
+        '-kernel', args.elf,
+        '-semihosting-config', 'enable=on,target=native,' + cmdline,
+        '-icount', 'shift=0',
+        '-plugin', args.plugin, '-d', 'plugin',
+    ]
+    try:
+        process = subprocess.run(command, stdout=subprocess.PIPE, stderr=subprocess.STDOUT,
+                                 universal_newlines=True, timeout=args.timeout)
+    except subprocess.TimeoutExpired:
+        sys.exit('%s: timed out after %d seconds' % (name or 'list', args.timeout))
+
+    if process.returncode != 0:
+        sys.exit('%s: failed (exit code %d):\n%s' % (name or 'list', process.returncode, process.stdout))
+
+    match = INSTRUCTIONS.search(process.stdout)
+    if not match:
+        sys.exit('%s: no instruction count in the output, is %s the insn plugin?\n%s'
+                 % (name or 'list', args.plugin, process.stdout))
+    return process.stdout, int(match.group(1))
+
+
+def measure(args, name, iterations):
+    """Returns instructions per iteration, overhead of the setup is subtracted"""
+    output, total = run(args, name, iterations)
+    if not RESULT.search(output):
+        sys.exit('%s: no result in the output:\n%s' % (name, output))
+    _, setup = run(args, name, 0)
+    return (total - setup) / iterations
+
+
+def compare(results, baseline, threshold):
+    """Prints results next to the baseline, returns names of regressions"""
+    regressions = []
+    print('%-20s %12s %12s %8s' % ('benchmark', 'baseline', 'current', 'change'))
+    for name, current in results.items():
+        previous = baseline.get(name)
+        if previous is None:
+            print('%-20s %12s %12.1f %8s' % (name, '-', current, 'new'))
+            continue
+
+        change = (current - previous) * 100 / previous if previous else 0
+        status = ''
+        if change > threshold:
+            status = ' REGRESSION'
+            regressions.append(name)
+        print('%-20s %12.1f %12.1f %+7.1f%%%s' % (name, previous, current, change, status))
+
+    for name in baseline:
+        if name not in results:
+            print('%-20s %12.1f %12s %8s' % (name, baseline[name], '-', 'removed'))
+
+    return regressions
+
+
+def main():
+    parser = argparse.ArgumentParser(description='Runs benchmarks in QEMU and compares them against the baseline')
+    parser.add_argument('elf', help='ELF file built from bench.cpp')
+    parser.add_argument('--qemu', default='qemu-system-arm', help='QEMU executable (default: qemu-system-arm)')
+    parser.add_argument('--plugin', default=os.environ.get('QEMU_PLUGIN', ''),
+                        help='path to libinsn.so plugin of QEMU (default: $QEMU_PLUGIN)')
+    parser.add_argument('--baseline', required=True, help='JSON file with the baseline')
+    parser.add_argument('--output', help='JSON file to write the results into')
+    parser.add_argument('--threshold', type=float, default=2.0,
+                        help='allowed increase of instructions in percent (default: 2)')
+    parser.add_argument('--update', action='store_true', help='write the results as the new baseline')
+    parser.add_argument('--timeout', type=int, default=60, help='timeout of single run in seconds (default: 60)')
+    parser.add_argument('--only', nargs='+', metavar='NAME', help='run only given benchmarks')
+    args = parser.parse_args()
+
+    if not args.plugin:
+        sys.exit('path to the libinsn.so plugin of QEMU is needed, pass --plugin or set QEMU_PLUGIN')
+
+    # Without the benchmark name the program lists all of them
+    output, _ = run(args)
+    benchmarks = json.loads(output[output.index('{'):output.index('}') + 1])
+    if args.only:
+        unknown = set(args.only) - set(benchmarks)
+        if unknown:
+            sys.exit('unknown benchmarks: %s' % ', '.join(sorted(unknown)))
+        benchmarks = {name: benchmarks[name] for name in args.only}
+
+    results = {}
+    for name, iterations in benchmarks.items():
+        results[name] = round(measure(args, name, iterations), 1)
+
+    report = {
+        'machine': MACHINE,
+        'unit': 'instructions per iteration',
+        'benchmarks': results,
+    }
+    if args.output:
+        with open(args.output, 'w') as file:
+            json.dump(report, file, indent=4)
+            file.write('\n')
+
+    if args.update:
+        with open(args.baseline, 'w') as file:
+            json.dump(report, file, indent=4)
+            file.write('\n')
+        print('baseline written to %s' % args.baseline)
+        return
+
+    # Missing baseline fails, the comparison would not guard anything
+    if not os.path.exists(args.baseline):
+        print(json.dumps(report, indent=4))
+        sys.exit('no baseline in %s, record it with `make bench-baseline` and commit it' % args.baseline)
+
+    with open(args.baseline) as file:
+        baseline = json.load(file)['benchmarks']
+
+    regressions = compare(results, baseline, args.threshold)
+    if regressions:
+        sys.exit('%d benchmark(s) are more than %g%% slower: %s'
+                 % (len(regressions), args.threshold, ', '.join(regressions)))
+
+
+if __name__ == '__main__':
+    main()
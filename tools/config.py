@@ -0,0 +1,145 @@
+#!/usr/bin/env python3
+###############################################################################
+# Configuration store check
+# Writes the settings of the host build by binary RPC (see rpc.py), while its
+# simulated flash loses the power in the middle of random erase or programming
+# (see host.cpp), and checks the store after each restart (see config.cpp)
+###############################################################################
+
+import argparse
+import random
+import re
+import sys
+import tempfile
+import threading
+
+from rpc import Rpc, RpcError, Serial, run_host
+
+# Keys of the store, in the order of the `config` command
+KEYS = ['rtc_trim', 'contrast', 'long_press', 'double_click', 'repeat']
+
+# Lines of the `config` command
+VALUE = re.compile(r'^(\w+): (\d+|not set)$', re.M)
+STATS = re.compile(r'blocks: (\d+) used, (\d+) free, sequence (\d+)\nerases: (\d+), compactions: (\d+)')
+
+# Printed by the host build, when the power is lost
+POWER_LOST = 'host: power lost'
+
+# Writes of single power cycle, enough to fill the store and compact it
+# several times
+WRITES_MAX = 1200
+
+
+def settings(rpc):
+    """Returns value of each key, None when it is not set"""
+    output = rpc.call('config').decode()
+    return {key: (None if value == 'not set' else int(value)) for key, value in VALUE.findall(output)}
+
+
+def stats(rpc):
+    """Returns used and free blocks, sequence, erases and compactions"""
+    return tuple(int(value) for value in STATS.search(rpc.call('config').decode()).groups())
+
+
+def write(rpc, key, value):
+    """Sets value of the key, deletes it, when the value is None"""
+    if value is None:
+        output = rpc.call('config_delete', key).decode()
+    else:
+        output = rpc.call('config_set', key, value).decode()
+    if output.startswith('error:'):
+        raise RpcError('%s: %s' % (key, output.strip()))
+
+
+def check(elf, timeout, rounds, seed):
+    """Writes random settings until the power is lost, then checks that every
+    acknowledged value survived and the one in flight is either old or new"""
+    failures = []
+    generator = random.Random(seed)
+    values = {key: None for key in KEYS}
+    writes = 0
+    losses = 0
+
+    with tempfile.TemporaryDirectory() as directory:
+        process = None
+        output = []
+
+        def start(power_loss=0):
+            nonlocal process
+            env = {'HOST_FLASH_POWER_LOSS': str(power_loss)} if power_loss else {}
+            process, port = run_host(elf, directory, env)
+
+            # Messages of the host are kept, so its pipe never fills
+            del output[:]
+            threading.Thread(target=lambda: output.extend(process.stdout), daemon=True).start()
+            return Rpc(Serial(port, timeout), window=1)
+
+        def verify(rpc, pending):
+            actual = settings(rpc)
+            for key in KEYS:
+                allowed = [values[key]]
+                if pending and pending[0] == key:
+                    allowed.append(pending[1])
+                if actual.get(key, 'missing') not in allowed:
+                    failures.append('%s after %d writes: %r not in %r' % (key, writes, actual.get(key), allowed))
+                values[key] = actual.get(key)
+
+        try:
+            pending = None
+            for _ in range(rounds):
+                # Power is lost by a write, an erase of new block or the compaction
+                rpc = start(generator.randint(1, WRITES_MAX))
+                verify(rpc, pending)
+                pending = None
+                try:
+                    for _ in range(WRITES_MAX):
+                        key = generator.choice(KEYS)
+                        pending = (key, None if generator.random() < 0.1 else generator.randrange(1 << 16))
+                        write(rpc, *pending)
+                        values[key] = pending[1]
+                        pending = None
+                        writes += 1
+                    failures.append('power not lost within %d writes' % WRITES_MAX)
+                except RpcError as error:
+                    process.wait(timeout)
+                    if not any(POWER_LOST in line for line in output):
+                        raise RpcError('%s: %s' % (error, ''.join(output[-3:]).strip()))
+                    losses += 1
+
+            # Store is usable after all the losses
+            rpc = start()
+            verify(rpc, pending)
+            write(rpc, 'contrast', 0x50)
+            values['contrast'] = 0x50
+            verify(rpc, None)
+            used, free, sequence, _, _ = stats(rpc)
+            print('config: %d writes, %d power losses, %d blocks used, %d free, sequence %d' %
+                  (writes, losses, used, free, sequence))
+            rpc.close()
+        except RpcError as error:
+            failures.append('%s after %d writes: %s' % (error, writes, ''.join(output[-3:]).strip()))
+        finally:
+            if process and process.poll() is None:
+                process.terminate()
+                process.wait()
+
+    for failure in failures:
+        print('FAIL ' + failure)
+    print('%s' % ('FAILED' if failures else 'OK'))
+    return not failures
+
+
+def main():
+    parser = argparse.ArgumentParser(description='Checks the configuration store against power loss')
+    parser.add_argument('--run', metavar='ELF', required=True, help='host build to check')
+    parser.add_argument('--timeout', type=float, default=5, help='timeout of single response in seconds (default: 5)')
+    parser.add_argument('--rounds', type=int, default=10, help='power losses (default: 10)')
+    parser.add_argument('--seed', type=int, default=0, help='seed of the random writes and losses (default: 0)')
+    args = parser.parse_args()
+
+    if not check(args.run, args.timeout, args.rounds, args.seed):
+        sys.exit(1)
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,255 @@
+#!/usr/bin/env python3
+###############################################################################
+# Line editor check
+# Types keys into the CLI of the host build over its pseudo-terminal (see
+# line.cpp), follows the echo with minimal model of VT100 terminal and checks
+# both the line shown on it and the command submitted by the editor
+###############################################################################
+
+import argparse
+import re
+import select
+import sys
+
+from rpc import PROMPT, RpcError, Serial, run_host
+
+# Keys, as sent by VT100 terminal
+LEFT = b'\x1b[D'
+RIGHT = b'\x1b[C'
+UP = b'\x1b[A'
+DOWN = b'\x1b[B'
+DELETE = b'\x1b[3~'
+BACKSPACE = b'\x7f'
+CTRL_A = b'\x01'
+CTRL_C = b'\x03'
+CTRL_E = b'\x05'
+CTRL_K = b'\x0b'
+TAB = b'\t'
+ENTER = b'\r'
+
+# History arena of the editor, each line takes two bytes more
+HISTORY_SIZE = 256
+
+# Sequences written by the editor: cursor back and erase to the end
+SEQUENCE = re.compile(rb'\x1b\[(\d*)([DK])')
+
+
+class Terminal:
+    """Current line of the terminal, with the output of the editor applied"""
+
+    def __init__(self):
+        self.lines = []  # Lines above, finished by LF
+        self.line = bytearray(PROMPT)
+        self.column = len(PROMPT)
+        self.bells = 0
+
+    def feed(self, data):
+        position = 0
+        while position < len(data):
+            match = SEQUENCE.match(data, position)
+            if match:
+                if match.group(2) == b'D':
+                    self.column -= int(match.group(1) or 1)
+                else:
+                    del self.line[self.column:]
+                position = match.end()
+            else:
+                self.put(data[position])
+                position += 1
+
+            if not 0 <= self.column <= len(self.line):
+                raise RpcError('cursor out of the line after %r' % data)
+
+    def put(self, byte):
+        if byte == 0x07:
+            self.bells += 1
+        elif byte == 0x08:
+            self.column -= 1
+        elif byte == 0x0D:
+            self.column = 0
+        elif byte == 0x0A:
+            self.lines.append(bytes(self.line))
+            self.line = bytearray()
+        elif 0x20 <= byte < 0x7F:
+            self.line[self.column:self.column + 1] = bytes([byte])
+            self.column += 1
+        else:
+            raise RpcError('unexpected character 0x%02X' % byte)
+
+
+class Session:
+    """Keys typed into the editor, with the history it is expected to keep"""
+
+    def __init__(self, serial):
+        self.serial = serial
+        self.history = []
+        self.cancel()
+
+    def keys(self, data, quiet=0.3):
+        """Sends the keys, returns the output until the line is quiet"""
+        self.serial.write(data)
+        output = b''
+        while select.select([self.serial.fd], [], [], quiet)[0]:
+            output += self.serial.read()
+        self.terminal.feed(output)
+        return output
+
+    def shown(self):
+        """Returns the line after the prompt (erased tail is blank) and the
+        cursor in it"""
+        text = bytes(self.terminal.line[len(PROMPT):]).rstrip(b' ').decode()
+        return text, self.terminal.column - len(PROMPT)
+
+    def prompt(self):
+        output = b''
+        while not output.endswith(b'\n' + PROMPT):
+            output += self.serial.read()
+        self.terminal = Terminal()
+        return output
+
+    def enter(self, text):
+        """Submits the line, which has to be `text`, returns output of the command"""
+        self.serial.write(ENTER)
+        output = self.prompt()
+        if text and (not self.history or self.history[-1] != text):
+            self.history.append(text)
+        # CR LF of the editor comes first
+        return output[output.index(b'\r\n') + 2:-len(PROMPT)]
+
+    def call(self, text):
+        self.keys(text.encode())
+        return self.enter(text)
+
+    def cancel(self):
+        """Drops the line by Ctrl-C, it is not stored in the history"""
+        self.serial.write(CTRL_C)
+        self.prompt()
+        while select.select([self.serial.fd], [], [], 0.2)[0]:
+            self.serial.read()
+
+    def retained(self):
+        """Returns lines of the history from the newest one, which fit the arena"""
+        lines = []
+        used = 0
+        for text in reversed(self.history):
+            used += len(text) + 2
+            if used > HISTORY_SIZE:
+                break
+            lines.append(text)
+        return lines
+
+
+def check(serial):
+    """Edits lines by the keys and checks the terminal and the submitted commands"""
+    session = Session(serial)
+    failures = []
+
+    def expect(name, actual, expected):
+        if actual != expected:
+            failures.append('%s: %r != %r' % (name, actual, expected))
+
+    # Responses of lines typed without editing
+    help_time = session.call('help time')
+    help_config = session.call('help config')
+    invalid = session.call('xyz')
+    expect('invalid command', invalid, b'Invalid command\n')
+
+    # Characters at the end are only echoed, the ones in the middle rewrite
+    # the tail and move the cursor back
+    expect('echo', session.keys(b'hep'), b'hep')
+    expect('insert tail', session.keys(LEFT + b'l'), b'\blp\b')
+    expect('insert', session.shown(), ('help', 3))
+    session.keys(CTRL_E + b' tme' + LEFT + LEFT + b'i')
+    expect('insert word', session.shown(), ('help time', 7))
+    expect('insert submitted', session.enter('help time'), help_time)
+
+    # Backspace before the cursor, Delete under it
+    session.keys(b'xhelp  timez' + BACKSPACE)
+    expect('backspace', session.shown(), ('xhelp  time', 11))
+    session.keys(CTRL_A + DELETE + RIGHT * 5 + DELETE)
+    expect('delete', session.shown(), ('help time', 5))
+    expect('erase submitted', session.enter('help time'), help_time)
+
+    # Ctrl-K erases from the cursor to the end
+    session.keys(b'help time junk' + LEFT * 5 + CTRL_K)
+    expect('ctrl-k', session.shown(), ('help time', 9))
+    expect('ctrl-k submitted', session.enter('help time'), help_time)
+
+    # Tab completes single match with the space, more of them to their common
+    # prefix, and lists them, when there is nothing to complete
+    session.keys(b'hel' + TAB)
+    expect('complete', session.shown(), ('help', 5))
+    session.keys(b'config')
+    expect('complete submitted', session.enter('help config'), help_config)
+
+    session.keys(b'up' + TAB)
+    expect('complete prefix', session.shown(), ('update_', 7))
+    session.keys(TAB)
+    listed = session.terminal.lines[-1].split() if session.terminal.lines else []
+    expect('complete list', sorted(listed), [b'update_begin', b'update_commit', b'update_write'])
+    expect('complete list line', session.shown(), ('update_', 7))
+    session.cancel()
+
+    for name, keys, shown in [('no match', b'zz', ('zz', 2)), ('not the first word', b'help t', ('help t', 6))]:
+        bells = session.terminal.bells
+        session.keys(keys + TAB)
+        expect('complete %s' % name, (session.shown(), session.terminal.bells - bells), (shown, 1))
+        session.cancel()
+
+    # History wraps around the arena: the oldest lines are dropped, lines
+    # stored across the end of the arena are shown whole. Repeated line is
+    # stored once
+    for i in range(12):
+        text = 'x%02d' % i + '-' * 26
+        expect('history line %d' % i, session.call(text), invalid)
+    session.call(session.history[-1])
+
+    lines = session.retained()
+    for i, text in enumerate(lines):
+        session.keys(UP)
+        expect('history up %d' % i, session.shown(), (text, len(text)))
+    bells = session.terminal.bells
+    session.keys(UP)
+    expect('history oldest', (session.shown(), session.terminal.bells - bells), ((lines[-1], len(lines[-1])), 1))
+
+    for i, text in reversed(list(enumerate(lines[:-1]))):
+        session.keys(DOWN)
+        expect('history down %d' % i, session.shown(), (text, len(text)))
+    session.keys(DOWN)
+    expect('history newest', session.shown(), ('', 0))
+    bells = session.terminal.bells
+    session.keys(DOWN)
+    expect('history end', session.terminal.bells - bells, 1)
+
+    # Line from the history is edited and submitted like a typed one
+    session.keys(UP * len(lines) + CTRL_A + CTRL_K + b'help time')
+    expect('history edited', session.enter('help time'), help_time)
+    session.keys(UP)
+    expect('history edited newest', session.shown(), ('help time', 9))
+    session.cancel()
+
+    for failure in failures:
+        print('FAIL ' + failure)
+    print('%s' % ('FAILED' if failures else 'OK'))
+    return not failures
+
+
+def main():
+    parser = argparse.ArgumentParser(description='Checks the line editor of the CLI over the pseudo-terminal')
+    parser.add_argument('--run', metavar='ELF', required=True, help='host build to check')
+    parser.add_argument('--timeout', type=float, default=5, help='timeout of single response in seconds (default: 5)')
+    args = parser.parse_args()
+
+    process, port = run_host(args.run)
+    try:
+        if not check(Serial(port, args.timeout)):
+            sys.exit(1)
+    except RpcError as error:
+        sys.exit('line: %s' % error)
+    finally:
+        process.terminate()
+        process.wait()
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,198 @@
+#!/usr/bin/env python3
+###############################################################################
+# Deferred log decoder
+# Formats binary log records sent over UART (see log.cpp), using format
+# strings interned in the ELF file. Other text is passed through
+###############################################################################
+
+import argparse
+import re
+import struct
+import sys
+
+# Precedes every record in the stream
+LOG_FRAME_START = 0xFE
+
+# Marks committed header of the record
+LOG_COMMITTED = 0x4C
+
+# Words of the record before its arguments
+LOG_HEADER_WORDS = 3
+
+# Id of the record reporting number of dropped records
+LOG_DROPPED_ID = 0xFFFF
+
+# Section flags and types
+SHF_ALLOC = 0x2
+SHT_NOBITS = 8
+
+# printf conversion specification
+SPECIFIER = re.compile(r'%([-+ #0]*)(\d*)(?:\.(\d+))?(hh|h|ll|l|z|t|j)?([diouxXcsfFeEgGp%])')
+
+
+class Elf:
+    """Minimal reader of section headers of little-endian ELF file"""
+
+    def __init__(self, path):
+        self.path = path
+        with open(path, 'rb') as file:
+            self.data = file.read()
+
+        if self.data[:4] != b'\x7fELF':
+            sys.exit('%s is not ELF file' % path)
+
+        if self.data[4] == 1:
+            header, section = '<16xHHIIIIIHHHHHH', '<IIIIIIIIII'
+        else:
+            header, section = '<16xHHIQQQIHHHHHH', '<IIQQQQIIQQ'
+
+        fields = struct.unpack_from(header, self.data)
+        shoff, shentsize, shnum, shstrndx = fields[5], fields[10], fields[11], fields[12]
+
+        sections = []
+        for i in range(shnum):
+            name, kind, flags, addr, offset, size = struct.unpack_from(
+                section, self.data, shoff + i * shentsize)[:6]
+            sections.append((name, kind, flags, addr, offset, size))
+
+        names = sections[shstrndx][4]
+        self.sections = {}
+        for name, kind, flags, addr, offset, size in sections:
+            self.sections[self.string(names + name)] = (kind, flags, addr, offset, size)
+
+    def symbols(self):
+        """Yields name, value, size and info of every symbol"""
+        if '.symtab' not in self.sections:
+            sys.exit('ELF file has no symbol table')
+
+        _, _, _, symtab, symtab_size = self.sections['.symtab']
+        _, _, _, strtab, _ = self.sections['.strtab']
+
+        if self.data[4] == 1:
+            symbol, order = struct.Struct('<IIIBBH'), (0, 1, 2, 3)
+        else:
+            symbol, order = struct.Struct('<IBBHQQ'), (0, 4, 5, 1)
+
+        for offset in range(symtab, symtab + symtab_size, symbol.size):
+            fields = symbol.unpack_from(self.data, offset)
+            name, value, size, info = (fields[i] for i in order)
+            yield self.string(strtab + name), value, size, info
+
+    def string(self, offset):
+        end = self.data.index(b'\0', offset)
+        return self.data[offset:end].decode('ascii', 'replace')
+
+    def log_string(self, id):
+        if '.log_strings' not in self.sections:
+            sys.exit('ELF file has no .log_strings section')
+
+        kind, flags, addr, offset, size = self.sections['.log_strings']
+        if id >= size:
+            return None
+        return self.string(offset + id)
+
+    def memory_string(self, address):
+        """Reads string from the loaded sections, e.g. flash"""
+        for kind, flags, addr, offset, size in self.sections.values():
+            if (flags & SHF_ALLOC) and kind != SHT_NOBITS and addr <= address < addr + size:
+                return self.string(offset + address - addr)
+        return '<0x%08x>' % address
+
+
+def format_message(elf, format, words):
+    """Formats the message like printf, taking raw arguments from words"""
+
+    def replace(match):
+        flags, width, precision, length, conversion = match.groups()
+        if conversion == '%':
+            return '%'
+
+        spec = '%' + flags + width + ('.' + precision if precision is not None else '')
+        if length == 'll':
+            value = words.pop(0) | (words.pop(0) << 32) if len(words) >= 2 else 0
+            bits = 64
+        else:
+            value = words.pop(0) if words else 0
+            bits = 32
+
+        if conversion in 'di':
+            if value & (1 << (bits - 1)):
+                value -= (1 << bits)
+            return (spec + 'd') % value
+        elif conversion in 'ouxX':
+            return (spec + conversion) % value
+        elif conversion == 'c':
+            return (spec + 'c') % chr(value & 0xFF)
+        elif conversion == 's':
+            return (spec + 's') % elf.memory_string(value)
+        elif conversion == 'p':
+            return '0x%08x' % value
+        else:
+            number, = struct.unpack('<f', struct.pack('<I', value))
+            return (spec + conversion) % number
+
+    return SPECIFIER.sub(replace, format)
+
+
+def decode(elf, data, clock_hz, output):
+    offset = 0
+    while offset < len(data):
+        start = data.find(bytes([LOG_FRAME_START]), offset)
+        if start < 0:
+            start = len(data)
+
+        # Text written by the CLI (without string terminators)
+        output.write(data[offset:start].replace(b'\0', b'').decode('ascii', 'replace'))
+        if start + 5 > len(data):
+            break
+
+        header, = struct.unpack_from('<I', data, start + 1)
+        words = (header >> 8) & 0xFF
+        if (header & 0xFF) != LOG_COMMITTED or words < LOG_HEADER_WORDS:
+            # Not a record, just pass it through
+            output.write('\ufffd')
+            offset = start + 1
+            continue
+
+        end = start + 1 + words * 4
+        if end > len(data):
+            break
+
+        record = list(struct.unpack_from('<%dI' % words, data, start + 1))
+        id = record[0] >> 16
+        time = (record[1] | (record[2] << 32)) / clock_hz
+        arguments = record[LOG_HEADER_WORDS:]
+
+        if id == LOG_DROPPED_ID:
+            message = 'W dropped %d records' % arguments[0]
+        else:
+            format = elf.log_string(id)
+            if format is None:
+                message = 'E unknown log id %d (wrong ELF file?)' % id
+            else:
+                message = format_message(elf, format, arguments)
+
+        output.write('[%12.6f] %s\n' % (time, message))
+        offset = end
+
+
+def main():
+    parser = argparse.ArgumentParser(description='Formats binary log records using ELF file')
+    parser.add_argument('elf', help='ELF file of the running program')
+    parser.add_argument('input', nargs='?', help='stream captured from UART (default: stdin)')
+    parser.add_argument('--clock', type=int, default=16000000, help='CPU clock frequency in Hz')
+    args = parser.parse_args()
+
+    elf = Elf(args.elf)
+
+    if args.input:
+        with open(args.input, 'rb') as file:
+            data = file.read()
+    else:
+        data = sys.stdin.buffer.read()
+
+    decode(elf, data, args.clock, sys.stdout)
+
+
+if __name__ == '__main__':
+    main()
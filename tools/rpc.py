@@ -0,0 +1,343 @@
+#!/usr/bin/env python3
+###############################################################################
+# Binary RPC client
+# Calls commands of the CLI over the serial link in binary mode (see rpc.cpp),
+# checks it against the host build and compares it with the text mode
+###############################################################################
+
+import argparse
+import os
+import re
+import select
+import struct
+import subprocess
+import sys
+import termios
+import time
+import tty
+
+# Commands of rpc.cpp besides the ones of the CLI
+RPC_DESCRIBE = 0xFF
+RPC_EXIT = 0xFE
+
+# Statuses of the responses
+STATUS_OK = 0
+STATUS_MORE = 1
+STATUS_NAMES = ['ok', 'more', 'unknown command', 'bad arguments', 'interactive', 'bad frame']
+
+# Prompt of the line editor (see line.cpp)
+PROMPT = b'> '
+
+# Printed by the host build at start
+HOST_UART = re.compile(r'UART0 is (\S+)')
+
+
+def crc16(data):
+    """CRC-16/CCITT-FALSE"""
+    crc = 0xFFFF
+    for byte in data:
+        crc ^= byte << 8
+        for _ in range(8):
+            crc = ((crc << 1) ^ 0x1021 if crc & 0x8000 else crc << 1) & 0xFFFF
+    return crc
+
+
+def cobs_encode(data):
+    """Returns COBS frame of the data, ended by 0x00"""
+    frame = bytearray([0])
+    code_index = 0
+    for byte in data:
+        if byte:
+            frame.append(byte)
+        if not byte or len(frame) - code_index == 0xFF:
+            frame[code_index] = len(frame) - code_index
+            code_index = len(frame)
+            frame.append(0)
+    frame[code_index] = len(frame) - code_index
+    frame.append(0)
+    return bytes(frame)
+
+
+def cobs_decode(frame):
+    """Returns data of COBS frame (without 0x00), None when it is broken"""
+    data = bytearray()
+    i = 0
+    while i < len(frame):
+        code = frame[i]
+        if not code or i + code > len(frame):
+            return None
+        data += frame[i + 1:i + code]
+        i += code
+        if code < 0xFF and i < len(frame):
+            data.append(0)
+    return bytes(data)
+
+
+class RpcError(Exception):
+    pass
+
+
+class Serial:
+    """Raw serial port, the pseudo-terminal of the host build as well"""
+
+    def __init__(self, path, timeout):
+        self.fd = os.open(path, os.O_RDWR | os.O_NOCTTY)
+        self.timeout = timeout
+        tty.setraw(self.fd)
+        attributes = termios.tcgetattr(self.fd)
+        attributes[4] = attributes[5] = termios.B115200
+        termios.tcsetattr(self.fd, termios.TCSANOW, attributes)
+
+    def write(self, data):
+        os.write(self.fd, data)
+
+    def read(self):
+        """Returns available bytes, waits for them up to the timeout"""
+        if not select.select([self.fd], [], [], self.timeout)[0]:
+            raise RpcError('no response within %g seconds' % self.timeout)
+        # Pseudo-terminal of the host build is closed, when the program ends
+        try:
+            data = os.read(self.fd, 4096)
+        except OSError:
+            data = b''
+        if not data:
+            raise RpcError('port closed')
+        return data
+
+    def drain(self, quiet=0.2):
+        """Drops everything until the line is quiet"""
+        while select.select([self.fd], [], [], quiet)[0]:
+            self.read()
+
+
+class Text:
+    """Commands typed into the text CLI, the way operator does"""
+
+    def __init__(self, serial):
+        self.serial = serial
+        self.serial.write(b'\x03')
+        self.serial.drain()
+
+    def call(self, line):
+        """Returns output of the command, without echo and the prompt"""
+        self.serial.write(line.encode() + b'\r')
+        output = b''
+        while not output.endswith(b'\n' + PROMPT):
+            output += self.serial.read()
+        # Echo of the line is followed by CR LF of the editor
+        return output[output.index(b'\r\n') + 2:-len(PROMPT)]
+
+
+class Rpc:
+    """Client of the binary mode, several requests may be in flight"""
+
+    def __init__(self, serial, window=4):
+        self.serial = serial
+        self.window = window
+        self.received = b''
+        self.next_id = 0
+
+        # Editor drops the line typed so far, the empty frame ends any noise
+        self.serial.write(b'\x03rpc\r')
+        self.serial.drain()
+        self.serial.write(b'\x00')
+
+        self.commands = {}
+        self.schemas = {}
+        fields = self.request(RPC_DESCRIBE, b'').split(b'\0')
+        for index, (name, schema) in enumerate(zip(fields[0::2], fields[1::2])):
+            self.commands[name.decode()] = index
+            self.schemas[name.decode()] = schema.decode()
+
+    def close(self):
+        self.request(RPC_EXIT, b'')
+
+    def encode(self, name, args):
+        """Returns command index and arguments of the request"""
+        if name not in self.commands:
+            raise RpcError('unknown command %s' % name)
+
+        data = b''
+        for kind, arg in zip(self.schemas[name], args):
+            if kind in 'uU':
+                data += struct.pack('<I', int(arg))
+            else:
+                arg = arg.encode() if isinstance(arg, str) else arg
+                data += bytes([len(arg)]) + arg
+        if len(args) > len(self.schemas[name]):
+            raise RpcError('too many arguments for %s' % name)
+        return self.commands[name], data
+
+    def send(self, command, data):
+        request_id = self.next_id
+        self.next_id = (self.next_id + 1) & 0xFF
+        payload = bytes([request_id, command]) + data
+        self.serial.write(cobs_encode(payload + struct.pack('<H', crc16(payload))))
+        return request_id
+
+    def receive(self):
+        """Returns id, status and output of the next response packet"""
+        while b'\0' not in self.received:
+            self.received += self.serial.read()
+        frame, self.received = self.received.split(b'\0', 1)
+
+        packet = cobs_decode(frame)
+        if packet is None or len(packet) < 4:
+            raise RpcError('broken frame %r' % frame)
+        payload, (crc,) = packet[:-2], struct.unpack('<H', packet[-2:])
+        if crc != crc16(payload):
+            raise RpcError('bad CRC of the response %r' % packet)
+        return payload[0], payload[1], payload[2:]
+
+    def request(self, command, data):
+        return self.pipeline([(command, data)])[0]
+
+    def pipeline(self, requests):
+        """Sends the requests, up to `window` of them ahead of the responses,
+        returns their outputs in the same order"""
+        pending = {}
+        outputs = [b''] * len(requests)
+        sent = 0
+        done = 0
+        while done < len(requests):
+            while sent < len(requests) and len(pending) < self.window:
+                pending[self.send(*requests[sent])] = sent
+                sent += 1
+
+            request_id, status, output = self.receive()
+            if request_id not in pending:
+                raise RpcError('response to unknown request %d' % request_id)
+            index = pending[request_id]
+            outputs[index] += output
+            if status == STATUS_MORE:
+                continue
+
+            del pending[request_id]
+            done += 1
+            if status != STATUS_OK:
+                raise RpcError('request %d failed: %s' % (index, STATUS_NAMES[status]
+                                                          if status < len(STATUS_NAMES) else status))
+        return outputs
+
+    def call(self, name, *args):
+        return self.request(*self.encode(name, args))
+
+    def calls(self, calls):
+        return self.pipeline([self.encode(name, args) for name, *args in calls])
+
+
+def check(serial):
+    """Calls the commands in both modes and checks the errors of the binary one"""
+    text = Text(serial)
+    expected_help = text.call('help')
+    expected_usage = text.call('help top')
+    expected_pipeline = [text.call('help time'), text.call('power'), text.call('help power')]
+
+    rpc = Rpc(serial)
+    failures = []
+
+    def expect(name, actual, expected):
+        if actual != expected:
+            failures.append('%s: %r != %r' % (name, actual, expected))
+
+    expect('help', rpc.call('help'), expected_help)
+    expect('help top', rpc.call('help', 'top'), expected_usage)
+    expect('time', rpc.call('time').strip().isdigit(), True)
+    expect('pipeline', rpc.calls([('help', 'time'), ('power',), ('help', 'power')]), expected_pipeline)
+
+    # Errors are reported by status, the link stays in sync after them
+    for name, command, data, status in [
+        ('unknown command', 0xF0, b'', 2),
+        ('bad arguments', rpc.commands['help'], b'\x05ab', 3),
+        ('interactive', rpc.commands['top'], b'', 4),
+    ]:
+        request_id = rpc.send(command, data)
+        expect(name, rpc.receive(), (request_id, status, b''))
+
+    payload = bytes([0x42, rpc.commands['time']])
+    serial.write(cobs_encode(payload + b'\x00\x00'))
+    expect('bad frame', rpc.receive(), (0x42, 5, b''))
+
+    rpc.close()
+    expect('text after rpc', Text(serial).call('help time'), expected_pipeline[0])
+
+    for failure in failures:
+        print('FAIL ' + failure)
+    print('%s' % ('FAILED' if failures else 'OK'))
+    return not failures
+
+
+def bench(serial, count, window):
+    """Prints requests per second of the text and binary mode"""
+    text = Text(serial)
+    begin = time.monotonic()
+    for _ in range(count):
+        text.call('time')
+    text_rate = count / (time.monotonic() - begin)
+
+    rpc = Rpc(serial, window)
+    begin = time.monotonic()
+    for _ in range(count):
+        rpc.call('time')
+    rpc_rate = count / (time.monotonic() - begin)
+
+    begin = time.monotonic()
+    rpc.calls([('time',)] * count)
+    pipelined_rate = count / (time.monotonic() - begin)
+    rpc.close()
+
+    print('%-24s %10s' % ('mode', 'requests/s'))
+    print('%-24s %10.1f' % ('text', text_rate))
+    print('%-24s %10.1f' % ('rpc', rpc_rate))
+    print('%-24s %10.1f' % ('rpc, window %d' % window, pipelined_rate))
+
+
+def run_host(elf, cwd=None, env=None):
+    """Starts the host build with additional environment, returns the process
+    and its UART"""
+    process = subprocess.Popen([os.path.abspath(elf)], stdout=subprocess.PIPE, stderr=subprocess.STDOUT,
+                               universal_newlines=True, cwd=cwd, env=dict(os.environ, **(env or {})))
+    for line in process.stdout:
+        match = HOST_UART.search(line)
+        if match:
+            return process, match.group(1)
+    sys.exit('%s did not print its UART' % elf)
+
+
+def main():
+    parser = argparse.ArgumentParser(description='Calls commands of the CLI in binary RPC mode')
+    source = parser.add_mutually_exclusive_group(required=True)
+    source.add_argument('--port', help='serial port, e.g. /dev/ttyACM0 or pty of the host build')
+    source.add_argument('--run', metavar='ELF', help='start the host build and use its UART')
+    parser.add_argument('--timeout', type=float, default=5, help='timeout of single response in seconds (default: 5)')
+    parser.add_argument('--window', type=int, default=4, help='requests in flight (default: 4)')
+    parser.add_argument('--count', type=int, default=200, help='requests measured by bench (default: 200)')
+    parser.add_argument('command', nargs='+', help='`check`, `bench` or command of the CLI with its arguments')
+    args = parser.parse_args()
+
+    process = None
+    port = args.port
+    if args.run:
+        process, port = run_host(args.run)
+
+    try:
+        serial = Serial(port, args.timeout)
+        if args.command == ['check']:
+            if not check(serial):
+                sys.exit(1)
+        elif args.command == ['bench']:
+            bench(serial, args.count, args.window)
+        else:
+            rpc = Rpc(serial, args.window)
+            sys.stdout.write(rpc.call(*args.command).decode(errors='replace'))
+            rpc.close()
+    except RpcError as error:
+        sys.exit('rpc: %s' % error)
+    finally:
+        if process:
+            process.terminate()
+            process.wait()
+
+
+if __name__ == '__main__':
+    main()
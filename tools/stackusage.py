@@ -0,0 +1,330 @@
+#!/usr/bin/env python3
+###############################################################################
+# Stack usage analysis
+# Computes worst-case stack depth of every task and of the interrupts, using
+# frame sizes reported by -fstack-usage (.su files) and call graph built from
+# the disassembly of the ELF file (objdump -d)
+###############################################################################
+
+import argparse
+import glob
+import os
+import re
+import sys
+
+from logdecode import Elf
+from symbolize import Symbols
+
+# Pushed on the task stack, when it is preempted: exception frame with
+# floating point context (26 words + alignment) and context saved by PendSV
+# (r4-r11, r14 and s16-s31)
+TASK_SWITCH_OVERHEAD = (26 + 1) * 4 + (9 + 16) * 4
+
+# Exception frame pushed on the main stack by every nested interrupt
+INTERRUPT_FRAME = (26 + 1) * 4
+
+# Kernel tasks, which are not created by `create` of the wrappers (see rtos.cpp)
+KERNEL_TASKS = {
+    'idle': 'prvIdleTask',
+    'timer': 'prvTimerTask',
+}
+
+# Exception handlers of the kernel, other handlers are named `*_handler`
+KERNEL_HANDLERS = ('xPortPendSVHandler', 'xPortSysTickHandler', 'vPortSVCHandler')
+
+# Handlers running at priority higher than the peripherals (see nvic_init),
+# which can preempt them. Handlers of the same priority never nest
+FAULT_HANDLERS = ('NMI_handler', 'HARDFAULT_handler', 'MEMMANAGEFAULT_handler',
+                  'BUSFAULT_handler', 'USAGEFAULT_handler')
+
+# Handlers of the CLI commands (see cli.cpp), the interactive ones are not
+# called over RPC
+CLI_INTERACTIVE = ['cli_top', 'cli_trace', 'cli_rpc']
+CLI_COMMANDS = ['cli_time', 'cli_power', 'cli_heap', 'cli_bitband', 'cli_digits', 'cli_crc',
+                'cli_switch', 'cli_latency', 'cli_slots', 'cli_update_begin', 'cli_update_write',
+                'cli_update_commit', 'cli_config', 'cli_config_set', 'cli_config_delete', 'cli_reset',
+                'cli_help']
+
+# Targets of indirect calls, which cannot be seen in the disassembly
+# Must be kept in sync with the sources
+INDIRECT_CALLS = {
+    'log_flush': ['uart_write', 'log_write_polling'],
+    'trace_task': ['uart_write'],  # `trace_output`, given by the "trace" command
+    'gpio_dispatch': ['buttons_touched'],
+    'flush': ['uart_write', 'rpc_output_write'],  # FormatOutput::flush, used by `uart_format` and `cli_format`
+    'cli_write': ['uart_write', 'rpc_output_write'],  # `cli_output`
+    'cli_task': CLI_COMMANDS + CLI_INTERACTIVE,
+    'rpc_handle': CLI_COMMANDS,
+}
+
+# Function header and instruction of objdump output
+FUNCTION = re.compile(r'^([0-9a-f]+) <(.+)>:$')
+INSTRUCTION = re.compile(r'^\s+[0-9a-f]+:\s+(?:[0-9a-f]{2,8}(?: [0-9a-f]{2,8})*\s+)?(\S+)\s*(.*)$')
+
+# Branches, which may be calls (or tail calls) of other functions
+BRANCH = re.compile(r'^(bl|blx|b|cbn?z|b(eq|ne|cs|hs|cc|lo|mi|pl|vs|vc|hi|ls|ge|lt|gt|le))(\.[nw])?$|^(call|jmp)q?$')
+TARGET = re.compile(r'<([^+>]+)>$')
+REGISTER = re.compile(r'^(r\d+|ip|sl|fp|\*%\w+|\*)')
+
+# Line of .su file: location, function name, bytes and qualifier
+STACK_USAGE = re.compile(r'^(.*?):(\d+):(\d+):(.*)\t(\d+)\t(\S+)$')
+
+# Sources of other programs, which are not linked into the firmware
+# (bench.cpp is built instead of main.cpp by `make bench`)
+OTHER_PROGRAMS = ('bench.cpp',)
+
+# Task memory wrappers and their creation in the sources
+TASK_MEMORY = re.compile(r'Rtos(?:Static)?Task<(\w+)>\s+(\w+)_task_memory')
+TASK_CREATE = re.compile(r'(\w+)_task_memory\.create\((\w+)')
+DEFINE = re.compile(r'^#define\s+(\w+)\s+(.+?)\s*$', re.MULTILINE)
+CONSTANT = re.compile(r'^constexpr\s+\w+\s+(\w+)\s*=\s*(\w+);', re.MULTILINE)
+
+
+def function_key(name):
+    """Reduces function name to unqualified identifier, e.g.
+    "TaskHandle_t RtosStaticTask<StackDepth>::create(...) [with ...]" -> "create"
+    """
+    name = re.sub(r' \[with .*\]$', '', name)
+    while True:
+        stripped = re.sub(r'<[^<>]*>', '', name)
+        if stripped == name:
+            break
+        name = stripped
+
+    name = name.split('(')[0].split()[-1] if name.split('(')[0].split() else name
+    return name.lstrip('*&').split('::')[-1]
+
+
+def read_stack_usage(paths):
+    """Returns frame sizes by function key, the largest one for ambiguous keys"""
+    frames = {}
+    dynamic = set()
+    for path in paths:
+        with open(path) as file:
+            for line in file:
+                match = STACK_USAGE.match(line.rstrip('\n'))
+                if not match:
+                    continue
+                key = function_key(match.group(4))
+                frames[key] = max(frames.get(key, 0), int(match.group(5)))
+                if match.group(6).startswith('dynamic') and match.group(6) != 'dynamic,bounded':
+                    dynamic.add(key)
+    return frames, dynamic
+
+
+def read_call_graph(path):
+    """Returns callees and indirect calls of every symbol and function key of
+    the symbols, from objdump output. Functions sharing a key (overloads,
+    instances of templates and lambdas) stay separate nodes, so chains of them
+    are not mistaken for recursion
+    """
+    symbols = []
+    calls = []
+    with open(path) as file:
+        current = None
+        for line in file:
+            line = line.rstrip('\n')
+            match = FUNCTION.match(line)
+            if match:
+                current = len(symbols)
+                symbols.append(match.group(2))
+                calls.append(([], False))
+                continue
+
+            match = INSTRUCTION.match(line)
+            if current is None or not match or not BRANCH.match(match.group(1)):
+                continue
+
+            operands = match.group(2).split(';')[0].strip()
+            target = TARGET.search(operands)
+            if target:
+                if target.group(1) != symbols[current]:
+                    calls[current][0].append(target.group(1))
+            elif REGISTER.match(operands.split(',')[-1].strip()) and match.group(1) in ('blx', 'call'):
+                calls[current] = (calls[current][0], True)
+
+    graph = {}
+    indirect = set()
+    for symbol, (callees, has_indirect) in zip(symbols, calls):
+        graph.setdefault(symbol, set()).update(callees)
+        if has_indirect:
+            indirect.add(symbol)
+
+    names = sorted(set(graph) | set().union(*graph.values()))
+    keys = dict(zip(names, (function_key(name) for name in Symbols.demangle(names))))
+
+    for symbol in graph:
+        targets = INDIRECT_CALLS.get(keys[symbol])
+        if targets is not None:
+            graph[symbol].update(name for name in names if keys[name] in targets)
+            indirect.discard(symbol)
+
+    return graph, indirect, keys
+
+
+class Analysis:
+    """Worst-case stack depth of the functions"""
+
+    def __init__(self, frames, dynamic, graph, indirect, keys):
+        self.frames = frames
+        self.dynamic = dynamic
+        self.graph = graph
+        self.indirect = indirect
+        self.keys = keys
+        self.depths = {}
+        self.cycles = 0
+        self.warnings = set()
+
+    def depth(self, key):
+        """Returns worst-case depth of all functions of the key"""
+        symbols = [symbol for symbol in self.graph if self.keys[symbol] == key]
+        if not symbols:
+            return self.symbol_depth(key)
+        return max(self.symbol_depth(symbol) for symbol in symbols)
+
+    def symbol_depth(self, symbol, path=()):
+        """Returns worst-case depth and collects warnings found on the way"""
+        if symbol in self.depths:
+            return self.depths[symbol]
+
+        key = self.keys.get(symbol, symbol)
+        if symbol in path:
+            self.warn(key, 'recursion through %s is not bounded' % key)
+            self.cycles += 1
+            return 0
+
+        if key not in self.frames:
+            self.warn(key, 'no stack usage of %s (assumed 0)' % key)
+        if key in self.dynamic:
+            self.warn(key, 'dynamic stack in %s' % key)
+        if symbol in self.indirect:
+            self.warn(key, 'indirect calls in %s are not followed' % key)
+
+        # Depth cut by a cycle depends on the path, which reached it
+        cycles = self.cycles
+        callees = self.graph.get(symbol, ())
+        worst = max((self.symbol_depth(callee, path + (symbol,)) for callee in callees), default=0)
+        depth = self.frames.get(key, 0) + worst
+        if self.cycles == cycles:
+            self.depths[symbol] = depth
+        return depth
+
+    def warn(self, key, message):
+        self.warnings.add(message)
+
+
+def read_defines(path):
+    with open(path) as file:
+        return dict(DEFINE.findall(file.read()))
+
+
+def resolve(token, defines):
+    """Resolves stack depth, which might be a macro from FreeRTOSConfig.h or
+    a constant of the source"""
+    for _ in range(8):
+        token = token.strip().strip('()').strip()
+        if token.isdigit():
+            return int(token)
+        if token not in defines:
+            break
+        token = defines[token]
+    sys.exit('Cannot resolve stack depth %s' % token)
+
+
+def read_tasks(sources, defines):
+    """Returns stack size in bytes and entry function of every task"""
+    depths = {}
+    entries = dict(KERNEL_TASKS)
+    for path in sorted(glob.glob(os.path.join(sources, '*.cpp'))):
+        if os.path.basename(path) in OTHER_PROGRAMS:
+            continue
+        with open(path) as file:
+            text = file.read()
+        constants = dict(defines, **dict(CONSTANT.findall(text)))
+        for depth, name in TASK_MEMORY.findall(text):
+            depths[name] = resolve(depth, constants) * 4
+        for name, entry in TASK_CREATE.findall(text):
+            entries[name] = entry
+
+    return {name: (depths[name], entries[name]) for name in depths if name in entries}
+
+
+def main():
+    parser = argparse.ArgumentParser(description='Reports worst-case stack usage of tasks and interrupts')
+    parser.add_argument('elf', help='ELF file of the program')
+    parser.add_argument('disassembly', help='output of objdump -d of the ELF file')
+    parser.add_argument('su', nargs='+', help='.su files produced by -fstack-usage')
+    parser.add_argument('--sources', required=True, help='directory with sources creating the tasks')
+    parser.add_argument('--config', required=True, help='FreeRTOSConfig.h')
+    parser.add_argument('--margin', type=int, default=10, help='safety margin in percent (default: 10)')
+    parser.add_argument('--informational', action='store_true',
+                        help='only report the depths, without overhead of Cortex-M4 and checks of the stacks '
+                             '(host build, whose tasks and interrupts run on stacks of the threads)')
+    args = parser.parse_args()
+
+    frames, dynamic = read_stack_usage(args.su)
+    graph, indirect, keys = read_call_graph(args.disassembly)
+    analysis = Analysis(frames, dynamic, graph, indirect, keys)
+    tasks = read_tasks(args.sources, read_defines(args.config))
+
+    def needed(depth):
+        return (depth * (100 + args.margin) + 99) // 100
+
+    failed = False
+    reclaimable = 0
+
+    # Frames of the exceptions and the context switch exist only on Cortex-M4
+    task_overhead = 0 if args.informational else TASK_SWITCH_OVERHEAD
+    interrupt_frame = 0 if args.informational else INTERRUPT_FRAME
+
+    if args.informational:
+        print('Stacks are not checked, depths of the host build are informational\n')
+
+    print('%-12s %-24s %6s %6s %8s' % ('task', 'entry', 'stack', 'worst', 'reclaim'))
+    for name, (stack, entry) in sorted(tasks.items()):
+        worst = analysis.depth(function_key(entry)) + task_overhead
+        if args.informational:
+            print('%-12s %-24s %6s %6d %8s' % (name, entry, '-', worst, '-'))
+            continue
+        spare = stack - needed(worst)
+        status = ''
+        if worst > stack:
+            status = '  UNDER-PROVISIONED'
+            failed = True
+        reclaimable += max(spare, 0)
+        print('%-12s %-24s %6d %6d %8d%s' % (name, entry, stack, worst, max(spare, 0), status))
+
+    # Interrupts use main stack. The deepest handler of every priority level
+    # (kernel, peripherals and faults) can be nested in one another
+    symbols = {name: value for name, value, _, _ in Elf(args.elf).symbols()}
+    main_stack = symbols.get('__stacktop', 0) - symbols.get('__noinit_end', 0)
+    functions = set(keys[symbol] for symbol in graph)
+    handlers = [key for key in functions if key.endswith('_handler') and key != 'RESET_handler']
+    levels = (
+        [key for key in functions if key in KERNEL_HANDLERS],
+        [key for key in handlers if key not in FAULT_HANDLERS],
+        [key for key in handlers if key in FAULT_HANDLERS],
+    )
+    interrupts = sum(max((analysis.depth(key) for key in level), default=0) + interrupt_frame
+                     for level in levels)
+    if args.informational:
+        print('%-12s %-24s %6s %6d %8s' % ('interrupts', '(nested levels)', '-', interrupts, '-'))
+    else:
+        status = ''
+        if interrupts > main_stack:
+            status = '  UNDER-PROVISIONED'
+            failed = True
+        print('%-12s %-24s %6d %6d %8s%s' % ('interrupts', '(nested levels)', main_stack, interrupts, '-', status))
+        print('\nSRAM which could be reclaimed from tasks (with %d%% margin): %d bytes' % (args.margin, reclaimable))
+
+    if analysis.warnings:
+        print('\nWarnings:')
+        for message in sorted(analysis.warnings):
+            print('  ' + message)
+
+    if failed:
+        sys.exit('Stack of some tasks is under-provisioned')
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,153 @@
+#!/usr/bin/env python3
+###############################################################################
+# Backtrace symbolizer
+# Replaces addresses of backtraces (see unwind.cpp), printed as "at 0x...",
+# with names of the functions from the ELF file
+###############################################################################
+
+import argparse
+import os
+import re
+import shutil
+import subprocess
+import sys
+
+from logdecode import Elf
+
+# Symbol type of the functions
+STT_FUNC = 2
+
+# Address of the backtrace, as printed by the crash report and failure log
+BACKTRACE = re.compile(r'\bat (0x[0-9a-fA-F]{8})\b')
+
+# Host test (see test.cpp) printing backtrace of known calls,
+# and the functions expected in it, from the innermost one
+CHECK_TEST = 'unwind_backtrace'
+CHECK_FUNCTIONS = ['unwind_backtrace_here', 'test_backtrace_leaf', 'test_backtrace_middle',
+                   'test_backtrace_root', 'test_unwind_backtrace']
+
+
+class Symbols:
+    """Functions of the ELF file, sorted by address"""
+
+    def __init__(self, elf, addr2line):
+        functions = []
+        for name, value, size, info in elf.symbols():
+            if (info & 0xF) == STT_FUNC and size > 0:
+                functions.append((value & ~1, size, name))
+
+        self.functions = sorted(functions)
+        self.names = self.demangle([name for _, _, name in self.functions])
+        self.addr2line = addr2line
+        self.elf_path = elf.path
+
+    @staticmethod
+    def demangle(names):
+        tool = shutil.which('arm-none-eabi-c++filt') or shutil.which('c++filt')
+        if not tool or not names:
+            return names
+
+        result = subprocess.run([tool], input='\n'.join(names), capture_output=True, text=True)
+        demangled = result.stdout.splitlines()
+        return demangled if len(demangled) == len(names) else names
+
+    def lookup(self, address):
+        """Returns "function+offset" (and location, if available) of the address"""
+        address &= ~1
+        low, high = 0, len(self.functions)
+        while low < high:
+            middle = (low + high) // 2
+            if self.functions[middle][0] <= address:
+                low = middle + 1
+            else:
+                high = middle
+
+        if low == 0:
+            return None
+
+        start, size, _ = self.functions[low - 1]
+        if address >= start + size:
+            return None
+
+        description = '%s+0x%x' % (self.names[low - 1], address - start)
+
+        tool = shutil.which(self.addr2line) if self.addr2line else None
+        if tool:
+            result = subprocess.run([tool, '-e', self.elf_path, '0x%x' % address],
+                                    capture_output=True, text=True)
+            location = result.stdout.strip()
+            if location and not location.startswith('??'):
+                description += ' ' + location
+
+        return description
+
+
+def annotate(symbols, line):
+    def replace(match):
+        description = symbols.lookup(int(match.group(1), 16))
+        return match.group(0) + (' (%s)' % description if description else '')
+
+    return BACKTRACE.sub(replace, line)
+
+
+def check(elf, symbols):
+    """Symbolizes backtrace printed by the host tests, returns whether it has
+    the expected functions, with their source locations in debug builds"""
+    output = subprocess.run([os.path.abspath(symbols.elf_path), CHECK_TEST],
+                            capture_output=True, text=True).stdout
+    lines = [annotate(symbols, line) for line in output.splitlines() if BACKTRACE.search(line)]
+    for line in lines:
+        print(line)
+
+    passed = True
+
+    def expect(name, actual, expected):
+        nonlocal passed
+        if actual != expected:
+            print('%s: expected %r, got %r' % (name, expected, actual))
+            passed = False
+
+    expect('frames', len(lines) >= len(CHECK_FUNCTIONS), True)
+    for line, function in zip(lines, CHECK_FUNCTIONS):
+        name = re.search(r'\((\w+)[(+]', line)
+        expect('function', name and name.group(1), function)
+        if '.debug_line' in elf.sections:
+            location = re.search(r' (\S+):\d+(?: \(discriminator \d+\))?\)$', line)
+            expect('%s location' % function, location and os.path.basename(location.group(1)),
+                   'unwind.cpp' if function == 'unwind_backtrace_here' else 'test.cpp')
+
+    # Addresses outside of the functions are left as they are
+    expect('unknown address', annotate(symbols, 'at 0x00000010'), 'at 0x00000010')
+    expect('lookup', symbols.lookup(0x10), None)
+
+    print('OK' if passed else 'FAIL')
+    return passed
+
+
+def main():
+    parser = argparse.ArgumentParser(description='Symbolizes backtrace addresses using ELF file')
+    parser.add_argument('elf', help='ELF file of the running program')
+    parser.add_argument('addresses', nargs='*',
+                        help='addresses to be symbolized (default: annotate "at 0x..." in stdin)')
+    parser.add_argument('--addr2line', default='arm-none-eabi-addr2line',
+                        help='tool used for source locations, when available')
+    parser.add_argument('--check', action='store_true',
+                        help='run the host tests ELF and check its symbolized backtrace')
+    args = parser.parse_args()
+
+    elf = Elf(args.elf)
+    symbols = Symbols(elf, args.addr2line)
+
+    if args.check:
+        if not check(elf, symbols):
+            sys.exit(1)
+    elif args.addresses:
+        for address in args.addresses:
+            print('0x%08x %s' % (int(address, 16), symbols.lookup(int(address, 16)) or '??'))
+    else:
+        for line in sys.stdin:
+            sys.stdout.write(annotate(symbols, line))
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,127 @@
+#!/usr/bin/env python3
+###############################################################################
+# Kernel trace decoder
+# Converts binary trace captured from the "trace" CLI command (see trace.cpp)
+# into Chrome/Perfetto JSON timeline
+###############################################################################
+
+import argparse
+import json
+import struct
+import sys
+
+# Beginning of the stream (ASCII "TRC1")
+TRACE_MAGIC = 0x31435254
+
+# Record layout: time (delta), event, object, arg
+RECORD = struct.Struct('<IBBH')
+
+# Event ids, must be kept in sync with config/FreeRTOSTrace.h
+EVENTS = {
+    1: 'task switched in',
+    2: 'task create',
+    3: 'task delay',
+    4: 'queue create',
+    5: 'queue send',
+    6: 'queue send failed',
+    7: 'queue send from isr',
+    8: 'queue receive',
+    9: 'queue receive failed',
+    10: 'queue receive from isr',
+    11: 'queue block send',
+    12: 'queue block receive',
+    13: 'task notify',
+    14: 'task notify from isr',
+    15: 'task notify take',
+    16: 'task notify take block',
+    17: 'malloc',
+    18: 'free',
+}
+
+TRACE_TASK_SWITCHED_IN = 1
+TRACE_TASK_NAME = 0xF0
+TRACE_DROPPED = 0xF1
+
+QUEUE_EVENTS = range(4, 13)
+HEAP_EVENTS = (17, 18)
+
+# Process ids of timeline tracks
+PID_CPU = 1
+PID_TASKS = 2
+PID_QUEUES = 3
+
+
+def decode(data):
+    start = data.find(struct.pack('<I', TRACE_MAGIC))
+    if start < 0:
+        sys.exit('Trace header not found')
+
+    clock_hz, = struct.unpack_from('<I', data, start + 4)
+    offset = start + 8
+
+    names = {}
+    events = []
+    cycles = 0
+    running = None  # (task, start cycles)
+
+    def us(value):
+        return value * 1e6 / clock_hz
+
+    def task_name(task):
+        return names.get(task, 'task %d' % task)
+
+    while offset + RECORD.size <= len(data):
+        delta, event, obj, arg = RECORD.unpack_from(data, offset)
+        offset += RECORD.size
+        cycles += delta
+
+        if event == TRACE_TASK_NAME:
+            chars = bytes([arg & 0xFF, arg >> 8]).rstrip(b'\0')
+            names[obj] = names.get(obj, '') + chars.decode('ascii', 'replace')
+        elif event == TRACE_DROPPED:
+            events.append({'name': 'dropped %d records' % arg, 'ph': 'i', 's': 'g',
+                           'ts': us(cycles), 'pid': PID_CPU, 'tid': 0})
+        elif event == TRACE_TASK_SWITCHED_IN:
+            if running is not None:
+                task, begin = running
+                events.append({'name': task_name(task), 'ph': 'X', 'ts': us(begin),
+                               'dur': us(cycles - begin), 'pid': PID_CPU, 'tid': 0})
+            running = (obj, cycles)
+        elif event in EVENTS:
+            if event in QUEUE_EVENTS:
+                pid, tid = PID_QUEUES, obj
+            elif event in HEAP_EVENTS:
+                pid, tid = PID_CPU, 0
+            else:
+                pid, tid = PID_TASKS, obj
+            events.append({'name': EVENTS[event], 'ph': 'i', 's': 't', 'ts': us(cycles),
+                           'pid': pid, 'tid': tid, 'args': {'arg': arg}})
+        else:
+            print('Unknown event %d at offset %d' % (event, offset), file=sys.stderr)
+
+    # Names of the tracks
+    events.append({'name': 'process_name', 'ph': 'M', 'pid': PID_CPU, 'args': {'name': 'CPU'}})
+    events.append({'name': 'process_name', 'ph': 'M', 'pid': PID_TASKS, 'args': {'name': 'Tasks'}})
+    events.append({'name': 'process_name', 'ph': 'M', 'pid': PID_QUEUES, 'args': {'name': 'Queues'}})
+    for task, name in names.items():
+        events.append({'name': 'thread_name', 'ph': 'M', 'pid': PID_TASKS, 'tid': task,
+                       'args': {'name': name}})
+
+    return {'traceEvents': events, 'displayTimeUnit': 'ns'}
+
+
+def main():
+    parser = argparse.ArgumentParser(description='Converts binary kernel trace into JSON timeline')
+    parser.add_argument('input', help='binary trace captured from UART')
+    parser.add_argument('output', help='JSON file to be opened in chrome://tracing or Perfetto')
+    args = parser.parse_args()
+
+    with open(args.input, 'rb') as file:
+        timeline = decode(file.read())
+
+    with open(args.output, 'w') as file:
+        json.dump(timeline, file)
+
+
+if __name__ == '__main__':
+    main()
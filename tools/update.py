@@ -0,0 +1,233 @@
+#!/usr/bin/env python3
+###############################################################################
+# Firmware update over the serial link
+# Sends the image linked for the slot not running (see update.cpp) by binary
+# RPC (see rpc.py), reports the throughput and checks the protocol against
+# the host build
+###############################################################################
+
+import argparse
+import os
+import random
+import re
+import struct
+import sys
+import tempfile
+import time
+import zlib
+
+from rpc import Rpc, RpcError, Serial, run_host
+
+# Chunk of the image programmed at once by the write buffer of the flash
+CHUNK_SIZE = 128
+
+# Space of the image in the slot, after the header block
+IMAGE_MAX = 0x1D000 - 0x400
+
+# Lines of the `slots` command
+SLOT = re.compile(r'slot (\w) at 0x([0-9A-F]+): (\w+), sequence (\d+), (\d+) bytes')
+
+# Top of SRAM, initial stack pointer of the synthetic images
+STACK_TOP = 0x20008000
+
+# Flash of the host build, in its working directory (see host.cpp)
+HOST_FLASH_IMAGE = 'flash.bin'
+
+
+class UpdateError(Exception):
+    pass
+
+
+def slots(rpc):
+    """Returns name, image address, state, sequence and image size of each slot"""
+    return [(name, int(address, 16), state, int(sequence), int(size))
+            for name, address, state, sequence, size in SLOT.findall(rpc.call('slots').decode())]
+
+
+def target(rpc):
+    """Returns the slot receiving the update"""
+    return next(slot for slot in slots(rpc) if slot[2] == 'target')
+
+
+def linked_for(image, address):
+    """Whether reset vector of the image points into the slot"""
+    reset = struct.unpack_from('<I', image, 4)[0] & ~1
+    return address <= reset < address + IMAGE_MAX
+
+
+def call(rpc, name, *args):
+    """Calls the update command, its output is an error, unless it is expected"""
+    output = rpc.call(name, *args).decode()
+    if output.startswith('error:'):
+        raise UpdateError('%s: %s' % (name, output.strip()))
+    return output
+
+
+def update(rpc, image, crc=None):
+    """Writes the image into the target slot, returns the report of the device
+    and throughput of the whole update in KiB/s"""
+    begin = time.monotonic()
+    call(rpc, 'update_begin', len(image), zlib.crc32(image) if crc is None else crc)
+    for offset in range(0, len(image), CHUNK_SIZE):
+        call(rpc, 'update_write', offset, image[offset:offset + CHUNK_SIZE])
+    report = call(rpc, 'update_commit')
+    return report.strip(), len(image) / 1024 / (time.monotonic() - begin)
+
+
+def reset(rpc):
+    """Resets the device, there is no response"""
+    rpc.send(rpc.commands['reset'], b'')
+
+
+def synthetic_image(address, size, seed=0):
+    """Returns random image with vector table linked for the slot"""
+    data = bytearray(random.Random(seed).getrandbits(8) for _ in range(size))
+    struct.pack_into('<II', data, 0, STACK_TOP, (address + 0x100) | 1)
+    return bytes(data)
+
+
+def check(elf, timeout, size):
+    """Updates the host build with synthetic images, checks rejected updates
+    and that the slot is switched only by whole and valid image"""
+    failures = []
+
+    def expect(name, actual, expected):
+        if actual != expected:
+            failures.append('%s: %r != %r' % (name, actual, expected))
+
+    def expect_error(name, function, *args):
+        try:
+            function(*args)
+            failures.append('%s: no error' % name)
+        except UpdateError as error:
+            if name not in str(error):
+                failures.append('%s: %s' % (name, error))
+
+    with tempfile.TemporaryDirectory() as directory:
+        process = None
+
+        def start():
+            nonlocal process
+            process, port = run_host(elf, directory)
+            return Rpc(Serial(port, timeout), window=1)
+
+        def restart(rpc):
+            reset(rpc)
+            process.wait(timeout)
+            return start()
+
+        def running(rpc):
+            return next(slot[0] for slot in slots(rpc) if slot[2] == 'running')
+
+        try:
+            rpc = start()
+            expect('first slot', running(rpc), 'A')
+            name, address = target(rpc)[:2]
+            small = synthetic_image(address, 1000, 1)
+
+            # Rejected steps leave the link and the running slot untouched
+            expect_error('no update started', call, rpc, 'update_write', 0, small[:CHUNK_SIZE])
+            expect_error('image does not fit the slot', call, rpc, 'update_begin', IMAGE_MAX + 1, 0)
+            call(rpc, 'update_begin', len(small), zlib.crc32(small))
+            expect_error('chunk out of order', call, rpc, 'update_write', CHUNK_SIZE, small[:CHUNK_SIZE])
+            expect_error('bad size of the chunk', call, rpc, 'update_write', 0, small[:CHUNK_SIZE - 1])
+            expect_error('image not written whole', call, rpc, 'update_commit')
+            expect_error('CRC of the image does not match', update, rpc, small, zlib.crc32(small) ^ 1)
+            expect_error('image is not linked for the slot', update, rpc, synthetic_image(0x4400, 1000))
+
+            # Whole update, with incomplete last word
+            image = synthetic_image(address, size - 1)
+            report, throughput = update(rpc, image)
+            expect('target', target(rpc)[2:], ('target', 1, len(image)))
+            print('update: %d bytes to slot %s, %.1f KiB/s, %s' % (len(image), name, throughput, report))
+
+            rpc = restart(rpc)
+            expect('updated slot', running(rpc), name)
+
+            # Slot is not switched by interrupted update
+            other, other_address = target(rpc)[:2]
+            image = synthetic_image(other_address, size, 2)
+            call(rpc, 'update_begin', len(image), zlib.crc32(image))
+            call(rpc, 'update_write', 0, image[:CHUNK_SIZE])
+            rpc = restart(rpc)
+            expect('interrupted update', running(rpc), name)
+            expect('erased header', target(rpc)[2:], ('target', 0, 0))
+
+            update(rpc, image)
+            rpc = restart(rpc)
+            expect('second update', running(rpc), other)
+            expect('sequence', [slot[3] for slot in slots(rpc)], [2, 1] if other == 'A' else [1, 2])
+
+            # Newer image broken after its commit is not started, the boot
+            # rolls back to the previous one
+            reset(rpc)
+            process.wait(timeout)
+            with open(os.path.join(directory, HOST_FLASH_IMAGE), 'r+b') as flash:
+                flash.seek(other_address + len(image) // 2)
+                byte = flash.read(1)[0]
+                flash.seek(-1, os.SEEK_CUR)
+                flash.write(bytes([byte ^ 0xFF]))
+            rpc = start()
+            expect('rollback', running(rpc), name)
+            rpc.close()
+        except (RpcError, UpdateError) as error:
+            failures.append(str(error))
+        finally:
+            if process and process.poll() is None:
+                process.terminate()
+                process.wait()
+
+    for failure in failures:
+        print('FAIL ' + failure)
+    print('%s' % ('FAILED' if failures else 'OK'))
+    return not failures
+
+
+def main():
+    parser = argparse.ArgumentParser(description='Updates the firmware over the serial link')
+    source = parser.add_mutually_exclusive_group(required=True)
+    source.add_argument('--port', help='serial port, e.g. /dev/ttyACM0 or pty of the host build')
+    source.add_argument('--run', metavar='ELF', help='start the host build and use its UART')
+    parser.add_argument('--timeout', type=float, default=5, help='timeout of single response in seconds (default: 5)')
+    parser.add_argument('--size', type=int, default=64 * 1024, help='size of the synthetic image of check (default: 65536)')
+    parser.add_argument('--no-reset', action='store_true', help='do not reset the device after the update')
+    parser.add_argument('images', nargs='+', metavar='image',
+                        help='`check` or binary images linked for the slots, the one for the target slot is sent')
+    args = parser.parse_args()
+
+    if args.images == ['check']:
+        if not args.run:
+            sys.exit('check needs the host build (--run)')
+        if not check(args.run, args.timeout, args.size):
+            sys.exit(1)
+        return
+
+    process = None
+    port = args.port
+    if args.run:
+        process, port = run_host(args.run)
+
+    try:
+        rpc = Rpc(Serial(port, args.timeout), window=1)
+        name, address = target(rpc)[:2]
+        images = [open(path, 'rb').read() for path in args.images]
+        image = next((image for image in images if linked_for(image, address)), None)
+        if image is None:
+            sys.exit('none of the images is linked for slot %s at 0x%08X' % (name, address))
+
+        report, throughput = update(rpc, image)
+        print('update: %d bytes to slot %s, %.1f KiB/s, %s' % (len(image), name, throughput, report))
+        if args.no_reset:
+            rpc.close()
+        else:
+            reset(rpc)
+    except (RpcError, UpdateError) as error:
+        sys.exit('update: %s' % error)
+    finally:
+        if process:
+            process.terminate()
+            process.wait()
+
+
+if __name__ == '__main__':
+    main()